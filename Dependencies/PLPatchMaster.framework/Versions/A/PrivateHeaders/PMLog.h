@@ -45,4 +45,4 @@
 #define PMFatal(fmt, ...) do { \
     PMDoLog("[PLPatchMaster] FATAL ERROR: ", fmt, ## __VA_ARGS__); \
     abort(); \
-} while(0)
\ No newline at end of file
+} while(0)
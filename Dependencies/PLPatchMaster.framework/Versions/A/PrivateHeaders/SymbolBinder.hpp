@@ -35,10 +35,15 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <dlfcn.h>
 
+#include <functional>
+#include <memory>
+#include <type_traits>
 #include <vector>
 #include <map>
 #include <string>
@@ -66,6 +71,73 @@ static constexpr uint32_t PL_LC_SEGMENT = LC_SEGMENT;
 uint64_t read_uleb128 (const void *location, std::size_t *size);
 int64_t read_sleb128 (const void *location, std::size_t *size);
 
+/**
+ * Decode a LEB128 value from @a location, reading no further than @a limit.
+ *
+ * When at least 8 bytes are readable, the terminating byte is located with a single 64-bit
+ * mask of the continuation bits, and the 7-bit groups are packed in parallel (SWAR); this avoids
+ * any per-byte branching for values of up to 8 encoded bytes. Longer values, or values near
+ * @a limit, are decoded bytewise.
+ *
+ * @param location The LEB128 value to decode.
+ * @param limit The end of the readable buffer.
+ * @param size On return, the number of bytes consumed.
+ * @param is_signed If true, the result will be sign-extended from the encoded width.
+ */
+static inline uint64_t read_leb128_bounded (const uint8_t *location, const uint8_t *limit, std::size_t *size, bool is_signed) {
+    uint64_t result = 0;
+    unsigned int bits = 0;
+    const uint8_t *p = location;
+    
+#if defined(__LITTLE_ENDIAN__) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    if (limit - location >= 8) {
+        uint64_t word;
+        memcpy(&word, location, sizeof(word));
+        
+        /* Find the first byte with a clear continuation bit */
+        uint64_t stop = ~word & 0x8080808080808080ULL;
+        if (stop != 0) {
+            unsigned int len = (__builtin_ctzll(stop) >> 3) + 1;
+            
+            /* Discard bytes following the terminator, and all continuation bits */
+            if (len < 8)
+                word &= (1ULL << (len * 8)) - 1;
+            word &= 0x7f7f7f7f7f7f7f7fULL;
+            
+            /* Pack 7-bit groups: 8x7 -> 4x14 -> 2x28 -> 1x56 */
+            word = ((word & 0x7f007f007f007f00ULL) >> 1) | (word & 0x007f007f007f007fULL);
+            word = ((word & 0x3fff00003fff0000ULL) >> 2) | (word & 0x00003fff00003fffULL);
+            word = ((word & 0x0fffffff00000000ULL) >> 4) | (word & 0x000000000fffffffULL);
+            
+            bits = len * 7;
+            if (is_signed && (location[len - 1] & 0x40))
+                word |= ~0ULL << bits;
+
+            *size = len;
+            return word;
+        }
+    }
+#endif
+    
+    /* Scalar decode */
+    uint8_t byte;
+    do {
+        if (p >= limit)
+            PMFatal("LEB128 value at %p extends past the end of its buffer", location);
+        
+        byte = *p++;
+        if (bits < 64)
+            result |= ((uint64_t) (byte & 0x7f)) << bits;
+        bits += 7;
+    } while (byte & 0x80);
+    
+    if (is_signed && bits < 64 && (byte & 0x40))
+        result |= ~0ULL << bits;
+    
+    *size = p - location;
+    return result;
+}
+
 /* Forward declaration */
 class LocalImage;
 
@@ -123,8 +195,8 @@ private:
         /**
          * Return symbol_proc representation of the current evaluation state.
          */
-        symbol_proc symbol_proc () {
-            return symbol_proc::symbol_proc(
+        bind_opstream::symbol_proc symbol_proc () {
+            return bind_opstream::symbol_proc(
                     SymbolName(sym_image, sym_name),
                     bind_type,
                     sym_flags,
@@ -197,10 +269,13 @@ public:
     void evaluate (const LocalImage &image, const std::function<void(const symbol_proc &)> &bind);
     uint8_t step (const LocalImage &image, const std::function<void(const symbol_proc &)> &bind);
     
+    template <typename Visitor> void evaluate (const LocalImage &image, Visitor &&visitor);
+    template <typename Visitor> uint8_t step (const LocalImage &image, Visitor &&visitor);
+    
     /** Read a ULEB128 value and advance the stream */
     inline uint64_t uleb128 () {
         size_t len;
-        uint64_t result = read_uleb128(_p, &len);
+        uint64_t result = read_leb128_bounded(_p, _instr_max, &len, false);
         
         _p += len;
         assert(_p <= _instr_max);
@@ -210,7 +285,7 @@ public:
     /** Read a SLEB128 value and advance the stream */
     inline int64_t sleb128 () {
         size_t len;
-        int64_t result = read_sleb128(_p, &len);
+        int64_t result = (int64_t) read_leb128_bounded(_p, _instr_max, &len, true);
         
         _p += len;
         assert(_p <= _instr_max);
@@ -268,6 +343,18 @@ public:
 
 };
 
+/**
+ * The element container used for LocalImage's shared library, segment, and opcode tables.
+ *
+ * libc++ accepts std::vector<const T>, and the framework is built against that type. Other standard libraries reject
+ * const-qualified elements; as the element layout is identical, the qualifier is dropped there.
+ */
+#ifdef _LIBCPP_VERSION
+template <typename T> using pl_image_vector = std::vector<T>;
+#else
+template <typename T> using pl_image_vector = std::vector<typename std::remove_const<T>::type>;
+#endif
+
 /**
  * An in-memory Mach-O image.
  */
@@ -282,15 +369,16 @@ private:
         const std::string &path,
         const pl_mach_header_t *header,
         const intptr_t vmaddr_slide,
-        std::shared_ptr<std::vector<const std::string>> &libraries,
-        std::shared_ptr<std::vector<const pl_segment_command_t *>> &segments,
-        std::shared_ptr<std::vector<const bind_opstream>> &bindings
+        std::shared_ptr<pl_image_vector<const std::string>> &libraries,
+        std::shared_ptr<pl_image_vector<const pl_segment_command_t *>> &segments,
+        std::shared_ptr<pl_image_vector<const bind_opstream>> &bindings
     ) : _header(header), _vmaddr_slide(vmaddr_slide), _libraries(libraries), _segments(segments), _bindOpcodes(bindings), _path(path) {}
 
 public:
     static const std::string &MainExecutablePath ();
     static LocalImage Analyze (const std::string &path, const pl_mach_header_t *header);
     void rebind_symbols (const std::function<void(const bind_opstream::symbol_proc &)> &bind);
+    template <typename Visitor> void rebind_symbols (Visitor &&visitor);
     
     /**
      * Return a borrowed reference to the image's path.
@@ -305,12 +393,12 @@ public:
     /**
      * Return the image's symbol binding opcode streams.
      */
-    std::shared_ptr<std::vector<const bind_opstream>> bindOpcodes () const { return _bindOpcodes; }
+    std::shared_ptr<pl_image_vector<const bind_opstream>> bindOpcodes () const { return _bindOpcodes; }
     
     /**
      * Return the image's defined segments.
      */
-    std::shared_ptr<std::vector<const pl_segment_command_t *>> segments () const { return _segments; }
+    std::shared_ptr<pl_image_vector<const pl_segment_command_t *>> segments () const { return _segments; }
     
 private:
     /** Mach-O image header */
@@ -320,16 +408,146 @@ private:
     const intptr_t _vmaddr_slide;
     
     /** Linked libraries, indexed by reference order. */
-    std::shared_ptr<std::vector<const std::string>> _libraries;
+    std::shared_ptr<pl_image_vector<const std::string>> _libraries;
     
     /** Segment commands, indexed by declaration order. */
-    std::shared_ptr<std::vector<const pl_segment_command_t *>> _segments;
+    std::shared_ptr<pl_image_vector<const pl_segment_command_t *>> _segments;
     
     /** All symbol binding opcodes. */
-    std::shared_ptr<std::vector<const bind_opstream>> _bindOpcodes;
+    std::shared_ptr<pl_image_vector<const bind_opstream>> _bindOpcodes;
 
     /** Image path */
     const std::string _path;
 };
 
+/**
+ * Evaluate all opcodes in the stream, calling @a visitor for every bound symbol.
+ *
+ * Unlike the std::function-based evaluate(), the visitor call is statically dispatched and may
+ * be inlined; no per-opcode or per-symbol allocations are performed.
+ *
+ * @param image The image to which this opcode stream belongs.
+ * @param visitor A function object accepting a `const bind_opstream::symbol_proc &`.
+ */
+template <typename Visitor> inline void bind_opstream::evaluate (const LocalImage &image, Visitor &&visitor) {
+    while (!isEmpty() && step(image, visitor) != BIND_OPCODE_DONE);
+}
+
+/**
+ * Evaluate a single opcode, calling @a visitor if the opcode binds one or more symbols.
+ *
+ * @param image The image to which this opcode stream belongs.
+ * @param visitor A function object accepting a `const bind_opstream::symbol_proc &`.
+ *
+ * @return Returns the evaluated opcode.
+ */
+template <typename Visitor> inline uint8_t bind_opstream::step (const LocalImage &image, Visitor &&visitor) {
+    uint8_t op = opcode();
+    
+    switch (op) {
+        case BIND_OPCODE_DONE:
+            /* Reset evaluation state */
+            _eval_state = evaluation_state();
+            break;
+            
+        case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:
+        case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB: {
+            uint64_t ordinal = (op == BIND_OPCODE_SET_DYLIB_ORDINAL_IMM) ? immd() : uleb128();
+            if (ordinal == 0 || ordinal > image._libraries->size())
+                PMFatal("Invalid dylib ordinal %" PRIu64 " in %s", ordinal, image.path().c_str());
+            
+            _eval_state.sym_image = (*image._libraries)[ordinal - 1].c_str();
+            break;
+        }
+            
+        case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM:
+            switch (signed_immd()) {
+                case BIND_SPECIAL_DYLIB_SELF:
+                    _eval_state.sym_image = image.path().c_str();
+                    break;
+                    
+                case BIND_SPECIAL_DYLIB_MAIN_EXECUTABLE:
+                    _eval_state.sym_image = LocalImage::MainExecutablePath().c_str();
+                    break;
+                    
+                case BIND_SPECIAL_DYLIB_FLAT_LOOKUP:
+                    _eval_state.sym_image = "";
+                    break;
+                    
+                default:
+                    PMFatal("Unknown special dylib ordinal %" PRId8 " in %s", signed_immd(), image.path().c_str());
+            }
+            break;
+            
+        case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM:
+            _eval_state.sym_name = cstring();
+            _eval_state.sym_flags = immd();
+            break;
+            
+        case BIND_OPCODE_SET_TYPE_IMM:
+            _eval_state.bind_type = immd();
+            break;
+            
+        case BIND_OPCODE_SET_ADDEND_SLEB:
+            _eval_state.addend = sleb128();
+            break;
+            
+        case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB: {
+            uint8_t segment = immd();
+            if (segment >= image._segments->size())
+                PMFatal("Invalid segment index %" PRIu8 " in %s", segment, image.path().c_str());
+
+            _eval_state.bind_address = (*image._segments)[segment]->vmaddr + uleb128() + image.vmaddr_slide();
+            break;
+        }
+            
+        case BIND_OPCODE_ADD_ADDR_ULEB:
+            _eval_state.bind_address += uleb128();
+            break;
+            
+        case BIND_OPCODE_DO_BIND:
+            visitor(_eval_state.symbol_proc());
+            _eval_state.bind_address += sizeof(uintptr_t);
+            break;
+            
+        case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB:
+            visitor(_eval_state.symbol_proc());
+            _eval_state.bind_address += sizeof(uintptr_t) + uleb128();
+            break;
+            
+        case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:
+            visitor(_eval_state.symbol_proc());
+            _eval_state.bind_address += sizeof(uintptr_t) + (immd() * sizeof(uintptr_t));
+            break;
+            
+        case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB: {
+            uint64_t count = uleb128();
+            uint64_t skip = uleb128();
+            
+            for (uint64_t i = 0; i < count; i++) {
+                visitor(_eval_state.symbol_proc());
+                _eval_state.bind_address += sizeof(uintptr_t) + skip;
+            }
+            break;
+        }
+            
+        default:
+            PMFatal("Unhandled bind opcode 0x%" PRIx8 " in %s", op, image.path().c_str());
+    }
+    
+    return op;
+}
+
+/**
+ * Evaluate all of the image's bind opcode streams, calling @a visitor for every bound symbol.
+ *
+ * @param visitor A function object accepting a `const bind_opstream::symbol_proc &`.
+ */
+template <typename Visitor> inline void LocalImage::rebind_symbols (Visitor &&visitor) {
+    for (auto &&opcodes : *_bindOpcodes) {
+        bind_opstream ops = opcodes;
+        ops.evaluate(*this, visitor);
+    }
+}
+
 } /* namespace patchmaster */
\ No newline at end of file
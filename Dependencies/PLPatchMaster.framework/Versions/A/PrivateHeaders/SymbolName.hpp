@@ -35,6 +35,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <dlfcn.h>
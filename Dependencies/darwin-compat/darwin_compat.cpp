@@ -0,0 +1,218 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Non-Darwin implementations of the Darwin APIs declared by the compatibility headers.
+ */
+
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach-o/dyld.h>
+#include <malloc/malloc.h>
+#include <sys/sysctl.h>
+
+#include <darwin_compat.h>
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Mach semaphores are allocated from a table of POSIX semaphores; a semaphore_t is its table index + 1.
+ *
+ * As with Mach semaphores, the table is never destroyed; detached threads (such as the async_log flusher) may still
+ * be blocked on a semaphore while exit() runs static destructors.
+ */
+struct semaphore_table {
+    std::mutex lock;
+    std::vector<sem_t *> entries;
+};
+
+static semaphore_table &semaphore_table_get () {
+    static semaphore_table *table = new semaphore_table();
+    return *table;
+}
+
+static sem_t *semaphore_lookup (semaphore_t semaphore) {
+    semaphore_table &table = semaphore_table_get();
+    std::lock_guard<std::mutex> guard(table.lock);
+    if (semaphore == 0 || semaphore > table.entries.size())
+        return nullptr;
+    return table.entries[semaphore - 1];
+}
+
+mach_port_t mach_task_self (void) {
+    return (mach_port_t) getpid();
+}
+
+kern_return_t semaphore_create (task_t task, semaphore_t *semaphore, int policy, int value) {
+    sem_t *sem = new sem_t;
+    if (value < 0 || sem_init(sem, 0, (unsigned int) value) != 0) {
+        delete sem;
+        return KERN_INVALID_ARGUMENT;
+    }
+    
+    semaphore_table &table = semaphore_table_get();
+    std::lock_guard<std::mutex> guard(table.lock);
+    table.entries.push_back(sem);
+    *semaphore = (semaphore_t) table.entries.size();
+    return KERN_SUCCESS;
+}
+
+kern_return_t semaphore_destroy (task_t task, semaphore_t semaphore) {
+    semaphore_table &table = semaphore_table_get();
+    std::lock_guard<std::mutex> guard(table.lock);
+    if (semaphore == 0 || semaphore > table.entries.size() || table.entries[semaphore - 1] == nullptr)
+        return KERN_INVALID_ARGUMENT;
+    
+    sem_destroy(table.entries[semaphore - 1]);
+    delete table.entries[semaphore - 1];
+    table.entries[semaphore - 1] = nullptr;
+    return KERN_SUCCESS;
+}
+
+kern_return_t semaphore_signal (semaphore_t semaphore) {
+    sem_t *sem = semaphore_lookup(semaphore);
+    if (sem == nullptr)
+        return KERN_INVALID_ARGUMENT;
+    return sem_post(sem) == 0 ? KERN_SUCCESS : KERN_FAILURE;
+}
+
+kern_return_t semaphore_wait (semaphore_t semaphore) {
+    sem_t *sem = semaphore_lookup(semaphore);
+    if (sem == nullptr)
+        return KERN_INVALID_ARGUMENT;
+    
+    while (sem_wait(sem) != 0) {
+        if (errno != EINTR)
+            return KERN_FAILURE;
+    }
+    return KERN_SUCCESS;
+}
+
+kern_return_t mach_timebase_info (mach_timebase_info_t info) {
+    info->numer = 1;
+    info->denom = 1;
+    return KERN_SUCCESS;
+}
+
+uint64_t mach_absolute_time (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+int pthread_threadid_np (pthread_t thread, uint64_t *thread_id) {
+    if (!pthread_equal(thread, pthread_self()))
+        return ESRCH;
+    
+    *thread_id = (uint64_t) syscall(SYS_gettid);
+    return 0;
+}
+
+void malloc_zone_statistics (malloc_zone_t *zone, malloc_statistics_t *stats) {
+    struct mallinfo2 info = mallinfo2();
+    
+    stats->blocks_in_use = (unsigned) info.ordblks;
+    stats->size_in_use = info.uordblks + info.hblkhd;
+    stats->max_size_in_use = info.usmblks;
+    stats->size_allocated = info.arena + info.hblkhd;
+}
+
+int sysctlbyname (const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+    if (strcmp(name, "hw.ncpu") != 0 && strcmp(name, "hw.activecpu") != 0 && strcmp(name, "hw.logicalcpu") != 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    
+    if (newp != nullptr || oldlenp == nullptr || *oldlenp < sizeof(int)) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    *(int *) oldp = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    *oldlenp = sizeof(int);
+    return 0;
+}
+
+/** A registered image */
+struct compat_image {
+    const struct mach_header *header;
+    std::string name;
+    intptr_t vmaddr_slide;
+};
+
+/* Registered images; as with dyld, image indices are not stable across image addition or removal, but an image's
+ * name remains valid until the image is removed. */
+static std::mutex image_lock;
+static std::vector<std::unique_ptr<compat_image>> images;
+
+void darwin_compat_add_image (const struct mach_header *header, const char *name, intptr_t vmaddr_slide) {
+    std::lock_guard<std::mutex> guard(image_lock);
+    images.emplace_back(new compat_image { header, name, vmaddr_slide });
+}
+
+void darwin_compat_remove_image (const struct mach_header *header) {
+    std::lock_guard<std::mutex> guard(image_lock);
+    for (auto it = images.begin(); it != images.end(); ++it) {
+        if ((*it)->header == header) {
+            images.erase(it);
+            return;
+        }
+    }
+}
+
+uint32_t _dyld_image_count (void) {
+    std::lock_guard<std::mutex> guard(image_lock);
+    return (uint32_t) images.size();
+}
+
+const struct mach_header *_dyld_get_image_header (uint32_t image_index) {
+    std::lock_guard<std::mutex> guard(image_lock);
+    return image_index < images.size() ? images[image_index]->header : nullptr;
+}
+
+intptr_t _dyld_get_image_vmaddr_slide (uint32_t image_index) {
+    std::lock_guard<std::mutex> guard(image_lock);
+    return image_index < images.size() ? images[image_index]->vmaddr_slide : 0;
+}
+
+const char *_dyld_get_image_name (uint32_t image_index) {
+    std::lock_guard<std::mutex> guard(image_lock);
+    return image_index < images.size() ? images[image_index]->name.c_str() : nullptr;
+}
@@ -0,0 +1,53 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Dynamic linker image list declarations, as defined by <mach-o/dyld.h> in the macOS SDK.
+ *
+ * Part of the Darwin compatibility headers. On non-Darwin hosts there is no dyld image list; images are instead
+ * registered explicitly via darwin_compat_add_image() (see <darwin_compat.h>).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <mach-o/loader.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t _dyld_image_count (void);
+const struct mach_header *_dyld_get_image_header (uint32_t image_index);
+intptr_t _dyld_get_image_vmaddr_slide (uint32_t image_index);
+const char *_dyld_get_image_name (uint32_t image_index);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,375 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Mach-O file format declarations, as defined by <mach-o/loader.h> in the macOS SDK.
+ *
+ * Part of the Darwin compatibility headers used to build xpf-analyze, xpf-prepatch, and the xpf-bootstrap tests on
+ * non-Darwin hosts. Only the subset of the format used by this project is declared; all structure layouts and
+ * constant values match the Darwin ABI.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <mach/machine.h>
+#include <mach/vm_prot.h>
+
+/* 32-bit Mach-O header */
+struct mach_header {
+    uint32_t        magic;
+    cpu_type_t      cputype;
+    cpu_subtype_t   cpusubtype;
+    uint32_t        filetype;
+    uint32_t        ncmds;
+    uint32_t        sizeofcmds;
+    uint32_t        flags;
+};
+
+#define MH_MAGIC        0xfeedface
+#define MH_CIGAM        0xcefaedfe
+
+/* 64-bit Mach-O header */
+struct mach_header_64 {
+    uint32_t        magic;
+    cpu_type_t      cputype;
+    cpu_subtype_t   cpusubtype;
+    uint32_t        filetype;
+    uint32_t        ncmds;
+    uint32_t        sizeofcmds;
+    uint32_t        flags;
+    uint32_t        reserved;
+};
+
+#define MH_MAGIC_64     0xfeedfacf
+#define MH_CIGAM_64     0xcffaedfe
+
+/* File types */
+#define MH_OBJECT       0x1
+#define MH_EXECUTE      0x2
+#define MH_FVMLIB       0x3
+#define MH_CORE         0x4
+#define MH_PRELOAD      0x5
+#define MH_DYLIB        0x6
+#define MH_DYLINKER     0x7
+#define MH_BUNDLE       0x8
+#define MH_DYLIB_STUB   0x9
+#define MH_DSYM         0xa
+#define MH_KEXT_BUNDLE  0xb
+
+/* Header flags */
+#define MH_NOUNDEFS             0x00000001
+#define MH_DYLDLINK             0x00000004
+#define MH_TWOLEVEL             0x00000080
+#define MH_WEAK_DEFINES         0x00008000
+#define MH_BINDS_TO_WEAK        0x00010000
+#define MH_PIE                  0x00200000
+
+/* Load commands */
+struct load_command {
+    uint32_t cmd;
+    uint32_t cmdsize;
+};
+
+#define LC_REQ_DYLD             0x80000000
+
+#define LC_SEGMENT              0x1
+#define LC_SYMTAB               0x2
+#define LC_THREAD               0x4
+#define LC_UNIXTHREAD           0x5
+#define LC_DYSYMTAB             0xb
+#define LC_LOAD_DYLIB           0xc
+#define LC_ID_DYLIB             0xd
+#define LC_LOAD_DYLINKER        0xe
+#define LC_ID_DYLINKER          0xf
+#define LC_SUB_FRAMEWORK        0x12
+#define LC_SUB_UMBRELLA         0x13
+#define LC_SUB_CLIENT           0x14
+#define LC_SUB_LIBRARY          0x15
+#define LC_LOAD_WEAK_DYLIB      (0x18 | LC_REQ_DYLD)
+#define LC_SEGMENT_64           0x19
+#define LC_UUID                 0x1b
+#define LC_RPATH                (0x1c | LC_REQ_DYLD)
+#define LC_CODE_SIGNATURE       0x1d
+#define LC_SEGMENT_SPLIT_INFO   0x1e
+#define LC_REEXPORT_DYLIB       (0x1f | LC_REQ_DYLD)
+#define LC_LAZY_LOAD_DYLIB      0x20
+#define LC_ENCRYPTION_INFO      0x21
+#define LC_DYLD_INFO            0x22
+#define LC_DYLD_INFO_ONLY       (0x22 | LC_REQ_DYLD)
+#define LC_LOAD_UPWARD_DYLIB    (0x23 | LC_REQ_DYLD)
+#define LC_VERSION_MIN_MACOSX   0x24
+#define LC_FUNCTION_STARTS      0x26
+#define LC_MAIN                 (0x28 | LC_REQ_DYLD)
+#define LC_DATA_IN_CODE         0x29
+#define LC_SOURCE_VERSION       0x2a
+#define LC_DYLIB_CODE_SIGN_DRS  0x2b
+#define LC_BUILD_VERSION        0x32
+#define LC_DYLD_EXPORTS_TRIE    (0x33 | LC_REQ_DYLD)
+#define LC_DYLD_CHAINED_FIXUPS  (0x34 | LC_REQ_DYLD)
+
+/* Variable-length strings within a load command */
+union lc_str {
+    uint32_t offset;
+};
+
+/* Segments */
+struct segment_command {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    char            segname[16];
+    uint32_t        vmaddr;
+    uint32_t        vmsize;
+    uint32_t        fileoff;
+    uint32_t        filesize;
+    vm_prot_t       maxprot;
+    vm_prot_t       initprot;
+    uint32_t        nsects;
+    uint32_t        flags;
+};
+
+struct segment_command_64 {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    char            segname[16];
+    uint64_t        vmaddr;
+    uint64_t        vmsize;
+    uint64_t        fileoff;
+    uint64_t        filesize;
+    vm_prot_t       maxprot;
+    vm_prot_t       initprot;
+    uint32_t        nsects;
+    uint32_t        flags;
+};
+
+#define SG_HIGHVM               0x1
+#define SG_NORELOC              0x4
+#define SG_PROTECTED_VERSION_1  0x8
+#define SG_READ_ONLY            0x10
+
+struct section {
+    char            sectname[16];
+    char            segname[16];
+    uint32_t        addr;
+    uint32_t        size;
+    uint32_t        offset;
+    uint32_t        align;
+    uint32_t        reloff;
+    uint32_t        nreloc;
+    uint32_t        flags;
+    uint32_t        reserved1;
+    uint32_t        reserved2;
+};
+
+struct section_64 {
+    char            sectname[16];
+    char            segname[16];
+    uint64_t        addr;
+    uint64_t        size;
+    uint32_t        offset;
+    uint32_t        align;
+    uint32_t        reloff;
+    uint32_t        nreloc;
+    uint32_t        flags;
+    uint32_t        reserved1;
+    uint32_t        reserved2;
+    uint32_t        reserved3;
+};
+
+#define SECTION_TYPE            0x000000ff
+#define SECTION_ATTRIBUTES      0xffffff00
+
+#define S_REGULAR                       0x0
+#define S_ZEROFILL                      0x1
+#define S_CSTRING_LITERALS              0x2
+#define S_NON_LAZY_SYMBOL_POINTERS      0x6
+#define S_LAZY_SYMBOL_POINTERS          0x7
+#define S_SYMBOL_STUBS                  0x8
+#define S_MOD_INIT_FUNC_POINTERS        0x9
+
+#define S_ATTR_PURE_INSTRUCTIONS        0x80000000
+#define S_ATTR_SOME_INSTRUCTIONS        0x00000400
+
+#define SEG_PAGEZERO    "__PAGEZERO"
+#define SEG_TEXT        "__TEXT"
+#define SECT_TEXT       "__text"
+#define SEG_DATA        "__DATA"
+#define SECT_DATA       "__data"
+#define SECT_BSS        "__bss"
+#define SEG_OBJC        "__OBJC"
+#define SEG_LINKEDIT    "__LINKEDIT"
+
+/* Dynamic libraries */
+struct dylib {
+    union lc_str    name;
+    uint32_t        timestamp;
+    uint32_t        current_version;
+    uint32_t        compatibility_version;
+};
+
+struct dylib_command {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    struct dylib    dylib;
+};
+
+struct rpath_command {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    union lc_str    path;
+};
+
+/* Symbol tables */
+struct symtab_command {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    uint32_t        symoff;
+    uint32_t        nsyms;
+    uint32_t        stroff;
+    uint32_t        strsize;
+};
+
+struct dysymtab_command {
+    uint32_t cmd;
+    uint32_t cmdsize;
+    uint32_t ilocalsym;
+    uint32_t nlocalsym;
+    uint32_t iextdefsym;
+    uint32_t nextdefsym;
+    uint32_t iundefsym;
+    uint32_t nundefsym;
+    uint32_t tocoff;
+    uint32_t ntoc;
+    uint32_t modtaboff;
+    uint32_t nmodtab;
+    uint32_t extrefsymoff;
+    uint32_t nextrefsyms;
+    uint32_t indirectsymoff;
+    uint32_t nindirectsyms;
+    uint32_t extreloff;
+    uint32_t nextrel;
+    uint32_t locreloff;
+    uint32_t nlocrel;
+};
+
+#define INDIRECT_SYMBOL_LOCAL   0x80000000
+#define INDIRECT_SYMBOL_ABS     0x40000000
+
+/* Image UUID */
+struct uuid_command {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    uint8_t         uuid[16];
+};
+
+/* __LINKEDIT data (LC_CODE_SIGNATURE, LC_FUNCTION_STARTS, LC_DYLD_EXPORTS_TRIE, LC_DYLD_CHAINED_FIXUPS, ...) */
+struct linkedit_data_command {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    uint32_t        dataoff;
+    uint32_t        datasize;
+};
+
+struct entry_point_command {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    uint64_t        entryoff;
+    uint64_t        stacksize;
+};
+
+/* Compressed dyld information */
+struct dyld_info_command {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    uint32_t        rebase_off;
+    uint32_t        rebase_size;
+    uint32_t        bind_off;
+    uint32_t        bind_size;
+    uint32_t        weak_bind_off;
+    uint32_t        weak_bind_size;
+    uint32_t        lazy_bind_off;
+    uint32_t        lazy_bind_size;
+    uint32_t        export_off;
+    uint32_t        export_size;
+};
+
+#define REBASE_TYPE_POINTER                                     1
+#define REBASE_TYPE_TEXT_ABSOLUTE32                             2
+#define REBASE_TYPE_TEXT_PCREL32                                3
+
+#define REBASE_OPCODE_MASK                                      0xF0
+#define REBASE_IMMEDIATE_MASK                                   0x0F
+#define REBASE_OPCODE_DONE                                      0x00
+#define REBASE_OPCODE_SET_TYPE_IMM                              0x10
+#define REBASE_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB               0x20
+#define REBASE_OPCODE_ADD_ADDR_ULEB                             0x30
+#define REBASE_OPCODE_ADD_ADDR_IMM_SCALED                       0x40
+#define REBASE_OPCODE_DO_REBASE_IMM_TIMES                       0x50
+#define REBASE_OPCODE_DO_REBASE_ULEB_TIMES                      0x60
+#define REBASE_OPCODE_DO_REBASE_ADD_ADDR_ULEB                   0x70
+#define REBASE_OPCODE_DO_REBASE_ULEB_TIMES_SKIPPING_ULEB        0x80
+
+#define BIND_TYPE_POINTER                                       1
+#define BIND_TYPE_TEXT_ABSOLUTE32                               2
+#define BIND_TYPE_TEXT_PCREL32                                  3
+
+#define BIND_SPECIAL_DYLIB_SELF                                 0
+#define BIND_SPECIAL_DYLIB_MAIN_EXECUTABLE                      -1
+#define BIND_SPECIAL_DYLIB_FLAT_LOOKUP                          -2
+#define BIND_SPECIAL_DYLIB_WEAK_LOOKUP                          -3
+
+#define BIND_SYMBOL_FLAGS_WEAK_IMPORT                           0x1
+#define BIND_SYMBOL_FLAGS_NON_WEAK_DEFINITION                   0x8
+
+#define BIND_OPCODE_MASK                                        0xF0
+#define BIND_IMMEDIATE_MASK                                     0x0F
+#define BIND_OPCODE_DONE                                        0x00
+#define BIND_OPCODE_SET_DYLIB_ORDINAL_IMM                       0x10
+#define BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB                      0x20
+#define BIND_OPCODE_SET_DYLIB_SPECIAL_IMM                       0x30
+#define BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM               0x40
+#define BIND_OPCODE_SET_TYPE_IMM                                0x50
+#define BIND_OPCODE_SET_ADDEND_SLEB                             0x60
+#define BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB                 0x70
+#define BIND_OPCODE_ADD_ADDR_ULEB                               0x80
+#define BIND_OPCODE_DO_BIND                                     0x90
+#define BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB                       0xA0
+#define BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED                 0xB0
+#define BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB            0xC0
+#define BIND_OPCODE_THREADED                                    0xD0
+#define BIND_SUBOPCODE_THREADED_SET_BIND_ORDINAL_TABLE_SIZE_ULEB 0x00
+#define BIND_SUBOPCODE_THREADED_APPLY                           0x01
+
+#define EXPORT_SYMBOL_FLAGS_KIND_MASK                           0x03
+#define EXPORT_SYMBOL_FLAGS_KIND_REGULAR                        0x00
+#define EXPORT_SYMBOL_FLAGS_KIND_THREAD_LOCAL                   0x01
+#define EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE                       0x02
+#define EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION                     0x04
+#define EXPORT_SYMBOL_FLAGS_REEXPORT                            0x08
+#define EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER                   0x10
@@ -0,0 +1,85 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Symbol table entry declarations, as defined by <mach-o/nlist.h> in the macOS SDK.
+ *
+ * Part of the Darwin compatibility headers; see <mach-o/loader.h>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+struct nlist {
+    union {
+        uint32_t n_strx;
+    } n_un;
+    uint8_t n_type;
+    uint8_t n_sect;
+    int16_t n_desc;
+    uint32_t n_value;
+};
+
+struct nlist_64 {
+    union {
+        uint32_t n_strx;
+    } n_un;
+    uint8_t n_type;
+    uint8_t n_sect;
+    uint16_t n_desc;
+    uint64_t n_value;
+};
+
+/* n_type masks */
+#define N_STAB  0xe0
+#define N_PEXT  0x10
+#define N_TYPE  0x0e
+#define N_EXT   0x01
+
+/* N_TYPE values */
+#define N_UNDF  0x0
+#define N_ABS   0x2
+#define N_SECT  0xe
+#define N_PBUD  0xc
+#define N_INDR  0xa
+
+#define NO_SECT         0
+#define MAX_SECT        255
+
+/* n_desc reference flags */
+#define REFERENCE_TYPE                          0x7
+#define REFERENCE_FLAG_UNDEFINED_NON_LAZY       0
+#define REFERENCE_FLAG_UNDEFINED_LAZY           1
+#define N_WEAK_REF      0x0040
+#define N_WEAK_DEF      0x0080
+
+#define GET_LIBRARY_ORDINAL(n_desc)             (((n_desc) >> 8) & 0xff)
+#define SELF_LIBRARY_ORDINAL                    0x0
+#define DYNAMIC_LOOKUP_ORDINAL                  0xfe
+#define EXECUTABLE_ORDINAL                      0xff
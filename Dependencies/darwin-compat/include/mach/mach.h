@@ -0,0 +1,78 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Mach task and semaphore declarations, as defined by <mach/mach.h> in the macOS SDK.
+ *
+ * Part of the Darwin compatibility headers; on non-Darwin hosts, Mach semaphores are backed by POSIX semaphores.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <mach/machine.h>
+#include <mach/vm_prot.h>
+
+typedef int kern_return_t;
+typedef unsigned int mach_port_t;
+typedef mach_port_t task_t;
+typedef mach_port_t semaphore_t;
+
+#define KERN_SUCCESS            0
+#define KERN_INVALID_ARGUMENT   4
+#define KERN_FAILURE            5
+#define KERN_RESOURCE_SHORTAGE  6
+#define KERN_ABORTED            14
+
+#define MACH_PORT_NULL          ((mach_port_t) 0)
+
+/* Semaphore policies */
+#define SYNC_POLICY_FIFO        0x0
+#define SYNC_POLICY_LIFO        0x2
+
+/* Time unit conversions, as defined by <mach/clock_types.h> */
+#define NSEC_PER_USEC   1000ull
+#define USEC_PER_SEC    1000000ull
+#define NSEC_PER_SEC    1000000000ull
+#define NSEC_PER_MSEC   1000000ull
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+mach_port_t mach_task_self (void);
+
+kern_return_t semaphore_create (task_t task, semaphore_t *semaphore, int policy, int value);
+kern_return_t semaphore_destroy (task_t task, semaphore_t semaphore);
+kern_return_t semaphore_signal (semaphore_t semaphore);
+kern_return_t semaphore_wait (semaphore_t semaphore);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Mach virtual memory protection values, as defined by <mach/vm_prot.h> in the macOS SDK.
+ *
+ * Part of the Darwin compatibility headers; see <mach/machine.h>.
+ */
+
+#pragma once
+
+typedef int vm_prot_t;
+
+#define VM_PROT_NONE            ((vm_prot_t) 0x00)
+#define VM_PROT_READ            ((vm_prot_t) 0x01)
+#define VM_PROT_WRITE           ((vm_prot_t) 0x02)
+#define VM_PROT_EXECUTE         ((vm_prot_t) 0x04)
+
+#define VM_PROT_DEFAULT         (VM_PROT_READ | VM_PROT_WRITE)
+#define VM_PROT_ALL             (VM_PROT_READ | VM_PROT_WRITE | VM_PROT_EXECUTE)
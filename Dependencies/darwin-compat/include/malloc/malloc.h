@@ -0,0 +1,57 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Malloc zone declarations, as defined by <malloc/malloc.h> in the macOS SDK.
+ *
+ * Part of the Darwin compatibility headers; on non-Darwin hosts, malloc_zone_statistics() reports the process-wide
+ * statistics of the system allocator for every zone.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+typedef struct _malloc_zone_t malloc_zone_t;
+
+typedef struct malloc_statistics_t {
+    unsigned    blocks_in_use;
+    size_t      size_in_use;
+    size_t      max_size_in_use;
+    size_t      size_allocated;
+} malloc_statistics_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void malloc_zone_statistics (malloc_zone_t *zone, malloc_statistics_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
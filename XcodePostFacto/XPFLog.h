@@ -26,13 +26,15 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#pragma once
+
 #ifdef __OBJC__
 
 #import <Foundation/Foundation.h>
 #define XPFLog(fmt, ...) NSLog(@"[XcodePostFacto] %@", [NSString stringWithFormat: fmt, ##__VA_ARGS__])
 #else
 
-#import <stdio.h>
+#include <stdio.h>
 #define XPFLog(fmt, ...) fprintf(stderr, "[XcodePostFacto] " fmt "\n", ##__VA_ARGS__)
 
 #endif
\ No newline at end of file
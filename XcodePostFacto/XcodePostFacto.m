@@ -34,7 +34,8 @@
 #import "XPFLog.h"
 #import <dlfcn.h>
 
-/* Replacement frameworks bundled with Xcode that are required for Mavericks */
+/* Replacement frameworks bundled with Xcode that are required for Mavericks; overridden by any framework rules in
+ * xpf-bootstrap's rule manifest. */
 static NSString *sharedFrameworks[] = {
     @"SceneKit.framework",
     @"PhysicsKit.framework",
@@ -66,17 +67,42 @@ static CFURLRef xpf_LSCopyDefaultApplicationURLForURL (CFURLRef inURL, LSRolesMa
     return appURL;
 }
 
+/* xpf-bootstrap's startup trace hooks; resolved at runtime, as the plugin does not link against the bootstrap framework. */
+static uint64_t (*xpf_trace_now_fn) (void);
+static void (*xpf_trace_record_fn) (const char *name, const char *detail, uint64_t start, uint64_t end);
+
+/**
+ * Return the shared frameworks to be loaded: those declared by xpf-bootstrap's rule manifest, if any, or our
+ * compiled sharedFrameworks list.
+ */
+static NSArray *xpf_shared_frameworks (void) {
+    const char *(*manifest_framework)(size_t) = (const char *(*)(size_t)) dlsym(RTLD_DEFAULT, "xpf_rule_manifest_framework");
+    NSMutableArray *frameworks = [NSMutableArray array];
+    
+    for (size_t i = 0; manifest_framework != NULL && manifest_framework(i) != NULL; i++)
+        [frameworks addObject: [NSString stringWithUTF8String: manifest_framework(i)]];
+    
+    if ([frameworks count] == 0)
+        [frameworks addObjectsFromArray: [NSArray arrayWithObjects: sharedFrameworks count: sizeof(sharedFrameworks) / sizeof(sharedFrameworks[0])]];
+    
+    return frameworks;
+}
+
 @implementation XcodePostFacto
 
 // from IDEInitialization protocol
 + (BOOL) ide_initializeWithOptions: (int) flags error: (NSError **) arg2 {
     NSError *error;
+    
+    /* Record our initialization in the bootstrap's startup trace, if enabled */
+    xpf_trace_now_fn = (uint64_t (*)(void)) dlsym(RTLD_DEFAULT, "xpf_trace_now");
+    xpf_trace_record_fn = (void (*)(const char *, const char *, uint64_t, uint64_t)) dlsym(RTLD_DEFAULT, "xpf_trace_record");
+    uint64_t trace_start = (xpf_trace_now_fn != NULL) ? xpf_trace_now_fn() : 0;
 
     /* Since we pretend to be 10.10, we have to implement shared framework loading ourselves.
      * This is normally done in IDEFoundation:__IDEInitializeLoadSharedFrameworksFor10_9 */
     XPFLog(@"Initializing Mavericks shared frameworks");
-    for (size_t i = 0; i < sizeof(sharedFrameworks) / sizeof(sharedFrameworks[0]); i++) {
-        NSString *framework = sharedFrameworks[i];
+    for (NSString *framework in xpf_shared_frameworks()) {
         NSString *path = [[[NSBundle bundleWithIdentifier: @"com.apple.dt.Xcode"] sharedFrameworksPath] stringByAppendingPathComponent: framework];
         NSBundle *bundle = [NSBundle bundleWithPath: path];
         
@@ -114,6 +140,9 @@ static CFURLRef xpf_LSCopyDefaultApplicationURLForURL (CFURLRef inURL, LSRolesMa
     /* Swap in our compatibility shims */
     [[PLPatchMaster master] rebindSymbol: @"_LSCopyDefaultApplicationURLForURL" fromImage: @"CoreServices" replacementAddress: (uintptr_t) &xpf_LSCopyDefaultApplicationURLForURL];
     
+    if (xpf_trace_now_fn != NULL && xpf_trace_record_fn != NULL)
+        xpf_trace_record_fn("plugin-initialize", NULL, trace_start, xpf_trace_now_fn());
+    
     return YES;
 }
 
@@ -0,0 +1,131 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "analyze_rules.h"
+
+#include <string.h>
+
+#include "rebind_table.h"
+
+namespace xpf {
+
+/**
+ * Read a pointer-sized value from @a p.
+ */
+static uint64_t read_pointer (const uint8_t *p, bool is64) {
+    if (is64) {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    } else {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+}
+
+/**
+ * Read the rebind rules defined in the XPF_REBIND_SECTION of @a image.
+ *
+ * The section is read using the xpf_rebind_entry layout of the image's architecture; string pointers are
+ * resolved against the image's unslid VM addresses.
+ *
+ * @param image The xpf-bootstrap image.
+ * @param rules On success, the rules will be appended to this vector.
+ * @param error On failure, a description of the error.
+ */
+bool analyze_read_rebind_rules (const macho_file_image &image, std::vector<analyze_rebind_rule> &rules, std::string &error) {
+    const macho_file_section *sect = image.find_section(SEG_DATA, XPF_REBIND_SECTION);
+    if (sect == nullptr) {
+        error = "no " SEG_DATA "," XPF_REBIND_SECTION " section";
+        return false;
+    }
+    
+    /* struct xpf_rebind_entry: symbol, symbol_hash (padded to pointer alignment), image, original, replacement */
+    size_t ptr_size = image.is64() ? 8 : 4;
+    size_t entry_size = ptr_size * 5;
+    
+    if (sect->size % entry_size != 0) {
+        error = "rebind section size is not a multiple of the entry size";
+        return false;
+    }
+    
+    macho_file_range data = image.file_range(sect->offset, sect->size);
+    if (data.data == nullptr) {
+        error = "rebind section extends past the end of the image";
+        return false;
+    }
+    
+    for (size_t offset = 0; offset < data.size; offset += entry_size) {
+        const uint8_t *entry = data.data + offset;
+        const char *symbol = image.vm_cstring(read_pointer(entry, image.is64()));
+        const char *library = image.vm_cstring(read_pointer(entry + (ptr_size * 2), image.is64()));
+        bool has_original = read_pointer(entry + (ptr_size * 3), image.is64()) != 0;
+        
+        if (symbol == nullptr || library == nullptr) {
+            error = "rebind entry references an invalid string";
+            return false;
+        }
+        
+        rules.push_back({ symbol, library, has_original });
+    }
+    
+    return true;
+}
+
+/**
+ * Load the rebind rules from the xpf-bootstrap binary at @a path.
+ *
+ * The rule table is identical across architectures; if the binary is universal, the first slice is used.
+ *
+ * @param path The path to the xpf-bootstrap binary.
+ * @param rules On success, the rules will be appended to this vector.
+ * @param error On failure, a description of the error.
+ */
+bool analyze_load_rebind_rules (const std::string &path, std::vector<analyze_rebind_rule> &rules, std::string &error) {
+    mapped_file file;
+    if (!file.map(path, error))
+        return false;
+    
+    std::vector<macho_slice> slices;
+    if (!macho_slices(file.data(), file.size(), slices, error))
+        return false;
+    
+    if (slices.empty()) {
+        error = "no Mach-O slices";
+        return false;
+    }
+    
+    macho_file_image image;
+    if (!image.parse(file.data() + slices[0].offset, slices[0].size, error))
+        return false;
+    
+    return analyze_read_rebind_rules(image, rules, error);
+}
+
+} /* namespace xpf */
@@ -0,0 +1,55 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "macho_file.h"
+
+namespace xpf {
+
+/**
+ * A rebind rule, as defined by an XPF_REBIND_ENTRY() in the xpf-bootstrap binary.
+ */
+struct analyze_rebind_rule {
+    /** Name of the symbol to rebind. */
+    std::string symbol;
+    
+    /** Image exporting the symbol, or an empty string if the rule matches the symbol in any image. */
+    std::string image;
+    
+    /** If true, the rule's implementation stores the symbol's original address in an original slot. */
+    bool has_original;
+};
+
+bool analyze_load_rebind_rules (const std::string &path, std::vector<analyze_rebind_rule> &rules, std::string &error);
+bool analyze_read_rebind_rules (const macho_file_image &image, std::vector<analyze_rebind_rule> &rules, std::string &error);
+
+} /* namespace xpf */
@@ -0,0 +1,375 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "macho_binds.h"
+
+#include <string.h>
+
+#include "macho_chained.h"
+
+namespace xpf {
+
+/**
+ * A bounds-checked reader over a single bind opcode stream.
+ */
+class bind_reader {
+public:
+    bind_reader (const uint8_t *start, const uint8_t *end) : _p(start), _end(end) {}
+    
+    /** Return true if there are no additional bytes to be read. */
+    bool empty () const { return _p >= _end; }
+    
+    /** Return the current position. */
+    const uint8_t *position () const { return _p; }
+    
+    /** Read a single byte. The stream must not be empty. */
+    uint8_t byte () { return *_p++; }
+    
+    /**
+     * Read a ULEB128 value, returning false if the value is truncated or overflows 64 bits.
+     */
+    bool uleb128 (uint64_t *result) {
+        uint64_t value = 0;
+        unsigned int shift = 0;
+        
+        while (_p < _end) {
+            uint8_t b = *_p++;
+            if (shift >= 64 || (shift == 63 && (b & 0x7e) != 0))
+                return false;
+            
+            value |= (uint64_t) (b & 0x7f) << shift;
+            shift += 7;
+            
+            if ((b & 0x80) == 0) {
+                *result = value;
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    /**
+     * Read a SLEB128 value, returning false if the value is truncated or overflows 64 bits.
+     */
+    bool sleb128 (int64_t *result) {
+        uint64_t value = 0;
+        unsigned int shift = 0;
+        uint8_t b;
+        
+        do {
+            if (_p >= _end || shift >= 64)
+                return false;
+            
+            b = *_p++;
+            value |= (uint64_t) (b & 0x7f) << shift;
+            shift += 7;
+        } while (b & 0x80);
+        
+        /* Sign extend */
+        if (shift < 64 && (b & 0x40))
+            value |= ~(uint64_t) 0 << shift;
+        
+        *result = (int64_t) value;
+        return true;
+    }
+    
+    /**
+     * Read a NUL-terminated string, returning nullptr if the string is unterminated.
+     */
+    const char *cstring () {
+        const uint8_t *nul = (const uint8_t *) memchr(_p, '\0', _end - _p);
+        if (nul == nullptr)
+            return nullptr;
+        
+        const char *result = (const char *) _p;
+        _p = nul + 1;
+        return result;
+    }
+
+private:
+    /** Current position */
+    const uint8_t *_p;
+    
+    /** End of the stream */
+    const uint8_t *_end;
+};
+
+/**
+ * Evaluate a single bind opcode stream.
+ */
+static bool evaluate_stream (const macho_file_image &image, macho_bind_stream stream, macho_file_range range, const std::function<void(const macho_bind &)> &fn, std::string &error) {
+    static const char *stream_names[] = { "bind", "weak bind", "lazy bind", "chained fixup" };
+    
+    const uint64_t ptr_size = image.is64() ? 8 : 4;
+    bind_reader reader(range.data, range.data + range.size);
+    
+    macho_bind bind;
+    bind.stream = stream;
+    bind.ordinal = 0;
+    bind.library = "";
+    bind.symbol = nullptr;
+    bind.flags = 0;
+    bind.type = BIND_TYPE_POINTER;
+    bind.addend = 0;
+    bind.address = 0;
+    bind.segment = 0;
+    bind.symbol_opcode_offset = 0;
+    bind.ordinal_opcode_offset = 0;
+    bind.ordinal_opcode_size = 0;
+    
+    auto fail = [&](const char *reason) {
+        error = std::string(stream_names[stream]) + " opcodes: " + reason;
+        return false;
+    };
+    
+    const uint8_t *opcode_pc = nullptr;
+    auto set_ordinal = [&](int64_t ordinal) {
+        bind.ordinal = ordinal;
+        bind.ordinal_opcode_offset = opcode_pc - (const uint8_t *) image.header();
+        bind.ordinal_opcode_size = (uint32_t) (reader.position() - opcode_pc);
+        if (ordinal <= 0) {
+            bind.library = "";
+            return true;
+        }
+        
+        if ((uint64_t) ordinal > image.libraries().size())
+            return false;
+        
+        bind.library = image.libraries()[ordinal - 1].c_str();
+        return true;
+    };
+    
+    auto do_bind = [&]() {
+        if (bind.symbol == nullptr)
+            return false;
+        
+        fn(bind);
+        return true;
+    };
+    
+    while (!reader.empty()) {
+        opcode_pc = reader.position();
+        uint8_t b = reader.byte();
+        uint8_t opcode = b & BIND_OPCODE_MASK;
+        uint8_t immd = b & BIND_IMMEDIATE_MASK;
+        
+        switch (opcode) {
+            case BIND_OPCODE_DONE:
+                /* The lazy stream terminates each entry with BIND_OPCODE_DONE */
+                if (stream != MACHO_BIND_STREAM_LAZY)
+                    return true;
+                break;
+                
+            case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:
+                if (!set_ordinal(immd))
+                    return fail("invalid library ordinal");
+                break;
+                
+            case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB: {
+                uint64_t ordinal;
+                if (!reader.uleb128(&ordinal) || ordinal > INT64_MAX || !set_ordinal((int64_t) ordinal))
+                    return fail("invalid library ordinal");
+                break;
+            }
+                
+            case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM:
+                /* Sign-extend the immediate value */
+                set_ordinal(immd == 0 ? 0 : (int8_t) (BIND_OPCODE_MASK | immd));
+                break;
+                
+            case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM:
+                bind.symbol_opcode_offset = opcode_pc - (const uint8_t *) image.header();
+                bind.flags = immd;
+                if ((bind.symbol = reader.cstring()) == nullptr)
+                    return fail("unterminated symbol name");
+                break;
+                
+            case BIND_OPCODE_SET_TYPE_IMM:
+                bind.type = immd;
+                break;
+                
+            case BIND_OPCODE_SET_ADDEND_SLEB:
+                if (!reader.sleb128(&bind.addend))
+                    return fail("invalid addend");
+                break;
+                
+            case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB: {
+                uint64_t offset;
+                if (immd >= image.segments().size())
+                    return fail("invalid segment index");
+                
+                if (!reader.uleb128(&offset))
+                    return fail("invalid segment offset");
+                
+                bind.segment = immd;
+                bind.address = image.segments()[immd].vmaddr + offset;
+                break;
+            }
+                
+            case BIND_OPCODE_ADD_ADDR_ULEB: {
+                uint64_t delta;
+                if (!reader.uleb128(&delta))
+                    return fail("invalid address delta");
+                
+                bind.address += delta;
+                break;
+            }
+                
+            case BIND_OPCODE_DO_BIND:
+                if (!do_bind())
+                    return fail("bind without symbol");
+                
+                bind.address += ptr_size;
+                break;
+                
+            case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB: {
+                uint64_t delta;
+                if (!do_bind())
+                    return fail("bind without symbol");
+                
+                if (!reader.uleb128(&delta))
+                    return fail("invalid address delta");
+                
+                bind.address += ptr_size + delta;
+                break;
+            }
+                
+            case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:
+                if (!do_bind())
+                    return fail("bind without symbol");
+                
+                bind.address += ptr_size + (immd * ptr_size);
+                break;
+                
+            case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB: {
+                uint64_t count, skip;
+                if (!reader.uleb128(&count) || !reader.uleb128(&skip))
+                    return fail("invalid bind count or skip");
+                
+                for (uint64_t i = 0; i < count; i++) {
+                    if (!do_bind())
+                        return fail("bind without symbol");
+                    
+                    bind.address += ptr_size + skip;
+                }
+                break;
+            }
+                
+            default:
+                return fail("unsupported opcode");
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Evaluate all binds declared by the LC_DYLD_CHAINED_FIXUPS fixup chains of @a image.
+ */
+static bool evaluate_chained (const macho_file_image &image, const std::function<void(const macho_bind &)> &fn, std::string &error) {
+    macho_chained_imports imports;
+    if (!macho_chained_read_imports(image, imports, error))
+        return false;
+    
+    return macho_chained_walk_binds(image, [&](uint32_t import_index, int64_t addend, uint64_t address) {
+        const macho_chained_import &import = imports.imports[import_index];
+        
+        macho_bind bind;
+        bind.stream = MACHO_BIND_STREAM_CHAINED;
+        bind.ordinal = import.ordinal;
+        bind.library = import.library;
+        bind.symbol = import.symbol;
+        bind.flags = import.weak ? BIND_SYMBOL_FLAGS_WEAK_IMPORT : 0;
+        bind.type = BIND_TYPE_POINTER;
+        bind.addend = import.addend + addend;
+        bind.address = address;
+        bind.segment = 0;
+        bind.ordinal_opcode_offset = import.entry_offset;
+        bind.ordinal_opcode_size = 0;
+        bind.symbol_opcode_offset = import.entry_offset;
+        
+        const auto &segments = image.segments();
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (address >= segments[i].vmaddr && address - segments[i].vmaddr < segments[i].vmsize) {
+                bind.segment = i;
+                break;
+            }
+        }
+        
+        fn(bind);
+    }, error);
+}
+
+/**
+ * Evaluate all bind opcodes and chained fixup binds of a file-backed image, calling @a fn for every bound symbol.
+ * This mirrors the evaluation performed by patchmaster::bind_opstream for images loaded by dyld.
+ *
+ * @param image The image to evaluate.
+ * @param fn The function to call for each bind.
+ * @param error On failure, a description of the error.
+ *
+ * @return Returns true on success, or false if the image's bind opcodes are malformed. Binds evaluated prior
+ * to the failure will have been reported to @a fn.
+ */
+bool macho_evaluate_binds (const macho_file_image &image, const std::function<void(const macho_bind &)> &fn, std::string &error) {
+    if (image.chained_fixups() != nullptr && !evaluate_chained(image, fn, error))
+        return false;
+    
+    const struct dyld_info_command *info = image.dyld_info();
+    if (info == nullptr)
+        return true;
+    
+    const struct {
+        macho_bind_stream stream;
+        uint32_t offset;
+        uint32_t size;
+    } streams[] = {
+        { MACHO_BIND_STREAM_REGULAR, info->bind_off, info->bind_size },
+        { MACHO_BIND_STREAM_WEAK, info->weak_bind_off, info->weak_bind_size },
+        { MACHO_BIND_STREAM_LAZY, info->lazy_bind_off, info->lazy_bind_size },
+    };
+    
+    for (auto &&s : streams) {
+        if (s.size == 0)
+            continue;
+        
+        macho_file_range range = image.file_range(s.offset, s.size);
+        if (range.data == nullptr) {
+            error = "bind opcodes extend past the end of the image";
+            return false;
+        }
+        
+        if (!evaluate_stream(image, s.stream, range, fn, error))
+            return false;
+    }
+    
+    return true;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,105 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+
+#include "macho_file.h"
+
+namespace xpf {
+
+/**
+ * Bind opcode stream kinds.
+ */
+enum macho_bind_stream {
+    /** Non-lazy binds; resolved at load time. */
+    MACHO_BIND_STREAM_REGULAR = 0,
+    
+    /** Weak definition binds; coalesced across all loaded images. */
+    MACHO_BIND_STREAM_WEAK,
+    
+    /** Lazy binds; resolved on first call. */
+    MACHO_BIND_STREAM_LAZY,
+    
+    /** LC_DYLD_CHAINED_FIXUPS binds; resolved at load time. */
+    MACHO_BIND_STREAM_CHAINED
+};
+
+/**
+ * A single bind performed by a file-backed image's bind opcodes or chained fixups.
+ *
+ * For chained fixup binds, the opcode offsets refer to the bind's LC_DYLD_CHAINED_FIXUPS imports table entry.
+ */
+struct macho_bind {
+    /** The stream containing the bind. */
+    macho_bind_stream stream;
+    
+    /** The library ordinal, or one of the BIND_SPECIAL_DYLIB_* constants. Always 0 for weak definition binds. */
+    int64_t ordinal;
+    
+    /** The install name of the library from which the symbol is imported, or an empty string for special ordinals. */
+    const char *library;
+    
+    /** The symbol name. */
+    const char *symbol;
+    
+    /** The symbol flags (eg, BIND_SYMBOL_FLAGS_WEAK_IMPORT). */
+    uint8_t flags;
+    
+    /** The bind type (eg, BIND_TYPE_POINTER). */
+    uint8_t type;
+    
+    /** The addend. */
+    int64_t addend;
+    
+    /** The VM address of the bound location. */
+    uint64_t address;
+    
+    /** Index of the segment most recently set by BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB, or the segment
+     * containing a chained fixup. */
+    uint8_t segment;
+    
+    /** Offset of the BIND_OPCODE_SET_DYLIB_* opcode that declared the library ordinal, relative to the start of
+     * the image, or 0 if no ordinal was declared. */
+    uint64_t ordinal_opcode_offset;
+    
+    /** Size of the BIND_OPCODE_SET_DYLIB_* opcode, including any ULEB128 operand. */
+    uint32_t ordinal_opcode_size;
+    
+    /** Offset of the BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM opcode that declared the symbol, relative to the
+     * start of the image. */
+    uint64_t symbol_opcode_offset;
+};
+
+bool macho_evaluate_binds (const macho_file_image &image, const std::function<void(const macho_bind &)> &fn, std::string &error);
+
+} /* namespace xpf */
@@ -0,0 +1,426 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "macho_chained.h"
+
+#include <string.h>
+
+namespace xpf {
+
+/* LC_DYLD_CHAINED_FIXUPS structure sizes and constants; these mirror <mach-o/fixup-chains.h>, which is not
+ * available in older SDKs. */
+
+/** Size of struct dyld_chained_fixups_header */
+static constexpr size_t CHAINED_FIXUPS_HEADER_SIZE = 28;
+
+/** Size of struct dyld_chained_starts_in_segment, excluding the page_start array */
+static constexpr size_t CHAINED_STARTS_IN_SEGMENT_SIZE = 22;
+
+/** page_start value for pages with no fixups */
+static constexpr uint16_t CHAINED_PTR_START_NONE = 0xFFFF;
+
+/** page_start flag for pages with multiple chain starts (32-bit formats only) */
+static constexpr uint16_t CHAINED_PTR_START_MULTI = 0x8000;
+
+/** page_start flag marking the final chain start of a multi-start page */
+static constexpr uint16_t CHAINED_PTR_START_LAST = 0x8000;
+
+/** Supported pointer formats */
+enum {
+    CHAINED_PTR_ARM64E = 1,
+    CHAINED_PTR_64 = 2,
+    CHAINED_PTR_32 = 3,
+    CHAINED_PTR_64_OFFSET = 6,
+    CHAINED_PTR_ARM64E_USERLAND = 9,
+    CHAINED_PTR_ARM64E_USERLAND24 = 12
+};
+
+template <typename T> static T read_le (const uint8_t *p) {
+    T value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/**
+ * The parsed dyld_chained_fixups_header.
+ */
+struct chained_header {
+    macho_file_range data;
+    uint32_t starts_offset;
+    uint32_t imports_offset;
+    uint32_t symbols_offset;
+    uint32_t imports_count;
+    uint32_t imports_format;
+};
+
+/**
+ * Read and validate the chained fixups header of @a image.
+ */
+static bool read_header (const macho_file_image &image, chained_header &header, std::string &error) {
+    const struct linkedit_data_command *cmd = image.chained_fixups();
+    if (cmd == nullptr) {
+        error = "no LC_DYLD_CHAINED_FIXUPS command";
+        return false;
+    }
+    
+    header.data = image.file_range(cmd->dataoff, cmd->datasize);
+    if (header.data.data == nullptr || header.data.size < CHAINED_FIXUPS_HEADER_SIZE) {
+        error = "chained fixups extend past the end of the image";
+        return false;
+    }
+    
+    const uint8_t *p = header.data.data;
+    if (read_le<uint32_t>(p) != 0) {
+        error = "unsupported chained fixups version";
+        return false;
+    }
+    
+    header.starts_offset = read_le<uint32_t>(p + 4);
+    header.imports_offset = read_le<uint32_t>(p + 8);
+    header.symbols_offset = read_le<uint32_t>(p + 12);
+    header.imports_count = read_le<uint32_t>(p + 16);
+    header.imports_format = read_le<uint32_t>(p + 20);
+    
+    if (read_le<uint32_t>(p + 24) != 0) {
+        error = "compressed chained fixup symbols are not supported";
+        return false;
+    }
+    
+    if (header.starts_offset > header.data.size || header.imports_offset > header.data.size || header.symbols_offset > header.data.size) {
+        error = "invalid chained fixups header";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Return the size of a single imports table entry of @a format, or 0 if the format is unsupported.
+ */
+static size_t import_entry_size (uint32_t format) {
+    switch (format) {
+        case MACHO_CHAINED_IMPORT:
+            return 4;
+        case MACHO_CHAINED_IMPORT_ADDEND:
+            return 8;
+        case MACHO_CHAINED_IMPORT_ADDEND64:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Read the LC_DYLD_CHAINED_FIXUPS imports table of @a image.
+ *
+ * @param image The image to read.
+ * @param imports On success, the parsed imports table.
+ * @param error On failure, a description of the error.
+ */
+bool macho_chained_read_imports (const macho_file_image &image, macho_chained_imports &imports, std::string &error) {
+    chained_header header;
+    if (!read_header(image, header, error))
+        return false;
+    
+    size_t entry_size = import_entry_size(header.imports_format);
+    if (entry_size == 0) {
+        error = "unsupported chained fixups imports format";
+        return false;
+    }
+    
+    if (header.imports_count > (header.data.size - header.imports_offset) / entry_size) {
+        error = "chained fixups imports table extends past the end of the fixups data";
+        return false;
+    }
+    
+    const uint8_t *symbols = header.data.data + header.symbols_offset;
+    size_t symbols_size = header.data.size - header.symbols_offset;
+    uint64_t table_offset = (header.data.data - (const uint8_t *) image.header()) + header.imports_offset;
+    
+    imports.format = header.imports_format;
+    imports.imports.clear();
+    imports.imports.reserve(header.imports_count);
+    
+    for (uint32_t i = 0; i < header.imports_count; i++) {
+        const uint8_t *entry = header.data.data + header.imports_offset + (i * entry_size);
+        macho_chained_import import;
+        uint64_t name_offset;
+        
+        if (header.imports_format == MACHO_CHAINED_IMPORT_ADDEND64) {
+            uint64_t value = read_le<uint64_t>(entry);
+            uint16_t ordinal = value & 0xFFFF;
+            
+            import.ordinal = (ordinal > 0xFFF0) ? (int16_t) ordinal : ordinal;
+            import.weak = (value >> 16) & 1;
+            name_offset = value >> 32;
+            import.addend = read_le<int64_t>(entry + 8);
+        } else {
+            uint32_t value = read_le<uint32_t>(entry);
+            uint8_t ordinal = value & 0xFF;
+            
+            import.ordinal = (ordinal > 0xF0) ? (int8_t) ordinal : ordinal;
+            import.weak = (value >> 8) & 1;
+            name_offset = value >> 9;
+            import.addend = (header.imports_format == MACHO_CHAINED_IMPORT_ADDEND) ? read_le<int32_t>(entry + 4) : 0;
+        }
+        
+        if (name_offset >= symbols_size || memchr(symbols + name_offset, '\0', symbols_size - name_offset) == nullptr) {
+            error = "invalid chained fixups import name";
+            return false;
+        }
+        import.symbol = (const char *) symbols + name_offset;
+        
+        if (import.ordinal > 0) {
+            if ((uint64_t) import.ordinal > image.libraries().size()) {
+                error = "invalid chained fixups import library ordinal";
+                return false;
+            }
+            import.library = image.libraries()[import.ordinal - 1].c_str();
+        } else {
+            import.library = "";
+        }
+        
+        import.entry_offset = table_offset + (i * entry_size);
+        imports.imports.push_back(import);
+    }
+    
+    return true;
+}
+
+/**
+ * Walk all fixup chains of @a image, calling @a fn with the import index, the fixup's inline addend, and the VM address
+ * of every bind fixup.
+ *
+ * @param image The image to walk.
+ * @param fn The function to call for each bind.
+ * @param error On failure, a description of the error.
+ */
+bool macho_chained_walk_binds (const macho_file_image &image, const std::function<void(uint32_t, int64_t, uint64_t)> &fn, std::string &error) {
+    chained_header header;
+    if (!read_header(image, header, error))
+        return false;
+    
+    const uint8_t *data = header.data.data;
+    size_t size = header.data.size;
+    
+    if (size - header.starts_offset < 4) {
+        error = "truncated chained starts";
+        return false;
+    }
+    
+    uint32_t seg_count = read_le<uint32_t>(data + header.starts_offset);
+    if (seg_count > image.segments().size() || seg_count > (size - header.starts_offset - 4) / 4) {
+        error = "invalid chained starts segment count";
+        return false;
+    }
+    
+    for (uint32_t seg = 0; seg < seg_count; seg++) {
+        uint32_t seg_info_offset = read_le<uint32_t>(data + header.starts_offset + 4 + (seg * 4));
+        if (seg_info_offset == 0)
+            continue;
+        
+        /* Read the segment's dyld_chained_starts_in_segment */
+        uint64_t starts = (uint64_t) header.starts_offset + seg_info_offset;
+        if (starts > size || size - starts < CHAINED_STARTS_IN_SEGMENT_SIZE) {
+            error = "truncated chained starts";
+            return false;
+        }
+        
+        uint32_t starts_size = read_le<uint32_t>(data + starts);
+        uint16_t page_size = read_le<uint16_t>(data + starts + 4);
+        uint16_t pointer_format = read_le<uint16_t>(data + starts + 6);
+        uint16_t page_count = read_le<uint16_t>(data + starts + 20);
+        
+        if (starts_size > size - starts || starts_size < CHAINED_STARTS_IN_SEGMENT_SIZE + (page_count * 2) || page_size == 0) {
+            error = "invalid chained starts";
+            return false;
+        }
+        
+        const uint8_t *page_starts = data + starts + CHAINED_STARTS_IN_SEGMENT_SIZE;
+        size_t page_starts_count = (starts_size - CHAINED_STARTS_IN_SEGMENT_SIZE) / 2;
+        
+        /* Determine the pointer layout */
+        size_t ptr_size, stride;
+        switch (pointer_format) {
+            case CHAINED_PTR_ARM64E:
+            case CHAINED_PTR_ARM64E_USERLAND:
+            case CHAINED_PTR_ARM64E_USERLAND24:
+                ptr_size = 8;
+                stride = 8;
+                break;
+            case CHAINED_PTR_64:
+            case CHAINED_PTR_64_OFFSET:
+                ptr_size = 8;
+                stride = 4;
+                break;
+            case CHAINED_PTR_32:
+                ptr_size = 4;
+                stride = 4;
+                break;
+            default:
+                error = "unsupported chained pointer format";
+                return false;
+        }
+        
+        const macho_file_segment &segment = image.segments()[seg];
+        
+        /* Walk a single chain starting at @a offset within @a page */
+        auto walk_chain = [&](uint32_t page, uint32_t offset) {
+            while (true) {
+                if (offset + ptr_size > page_size) {
+                    error = "chained fixup extends past the end of its page";
+                    return false;
+                }
+                
+                uint64_t seg_offset = ((uint64_t) page * page_size) + offset;
+                macho_file_range loc = image.file_range(segment.fileoff + seg_offset, ptr_size);
+                if (seg_offset + ptr_size > segment.filesize || loc.data == nullptr) {
+                    error = "chained fixup extends past the end of its segment";
+                    return false;
+                }
+                
+                bool bind;
+                uint32_t next;
+                uint32_t ordinal = 0;
+                int64_t addend = 0;
+                
+                if (ptr_size == 8) {
+                    uint64_t value = read_le<uint64_t>(loc.data);
+                    if (pointer_format == CHAINED_PTR_64 || pointer_format == CHAINED_PTR_64_OFFSET) {
+                        bind = (value >> 63) & 1;
+                        next = (value >> 51) & 0xFFF;
+                        if (bind) {
+                            ordinal = value & 0xFFFFFF;
+                            addend = (value >> 24) & 0xFF;
+                        }
+                    } else {
+                        bool auth = (value >> 63) & 1;
+                        bind = (value >> 62) & 1;
+                        next = (value >> 51) & 0x7FF;
+                        if (bind) {
+                            ordinal = (pointer_format == CHAINED_PTR_ARM64E_USERLAND24) ? (value & 0xFFFFFF) : (value & 0xFFFF);
+                            
+                            /* Sign-extend the 19-bit addend; authenticated binds have none */
+                            if (!auth)
+                                addend = ((int64_t) (((value >> 32) & 0x7FFFF) << 45)) >> 45;
+                        }
+                    }
+                } else {
+                    uint32_t value = read_le<uint32_t>(loc.data);
+                    bind = (value >> 31) & 1;
+                    next = (value >> 26) & 0x1F;
+                    if (bind) {
+                        ordinal = value & 0xFFFFF;
+                        addend = (value >> 20) & 0x3F;
+                    }
+                }
+                
+                if (bind) {
+                    if (ordinal >= header.imports_count) {
+                        error = "chained bind references an invalid import";
+                        return false;
+                    }
+                    
+                    fn(ordinal, addend, segment.vmaddr + seg_offset);
+                }
+                
+                if (next == 0)
+                    return true;
+                
+                offset += next * stride;
+            }
+        };
+        
+        for (uint32_t page = 0; page < page_count; page++) {
+            uint16_t start = read_le<uint16_t>(page_starts + (page * 2));
+            if (start == CHAINED_PTR_START_NONE)
+                continue;
+            
+            /* 32-bit formats may declare multiple chain starts within a single page */
+            if (ptr_size == 4 && (start & CHAINED_PTR_START_MULTI)) {
+                for (size_t idx = start & ~CHAINED_PTR_START_MULTI; ; idx++) {
+                    if (idx >= page_starts_count) {
+                        error = "invalid chained starts overflow index";
+                        return false;
+                    }
+                    
+                    uint16_t multi_start = read_le<uint16_t>(page_starts + (idx * 2));
+                    if (!walk_chain(page, multi_start & ~CHAINED_PTR_START_LAST))
+                        return false;
+                    
+                    if (multi_start & CHAINED_PTR_START_LAST)
+                        break;
+                }
+            } else if (!walk_chain(page, start)) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Update the library ordinal and weak import flag of a single imports table entry, in place.
+ *
+ * @param image The image data.
+ * @param format The imports table format.
+ * @param entry_offset The offset of the entry, relative to @a image.
+ * @param ordinal The new library ordinal, or one of the BIND_SPECIAL_DYLIB_* constants.
+ * @param weak The new weak import flag.
+ * @param error On failure, a description of the error.
+ *
+ * @return Returns false if @a ordinal can not be represented in the entry's format.
+ */
+bool macho_chained_set_import (uint8_t *image, uint32_t format, uint64_t entry_offset, int64_t ordinal, bool weak, std::string &error) {
+    uint8_t *entry = image + entry_offset;
+    
+    if (format == MACHO_CHAINED_IMPORT_ADDEND64) {
+        if (ordinal > 0xFFF0 || ordinal < -15) {
+            error = "library ordinal can not be represented in the chained fixups imports table";
+            return false;
+        }
+        
+        uint64_t value = read_le<uint64_t>(entry);
+        value = (value & ~(uint64_t) 0x1FFFF) | ((uint16_t) ordinal) | ((uint64_t) weak << 16);
+        memcpy(entry, &value, sizeof(value));
+    } else {
+        if (ordinal > 0xF0 || ordinal < -15) {
+            error = "library ordinal can not be represented in the chained fixups imports table";
+            return false;
+        }
+        
+        uint32_t value = read_le<uint32_t>(entry);
+        value = (value & ~(uint32_t) 0x1FF) | ((uint8_t) ordinal) | ((uint32_t) weak << 8);
+        memcpy(entry, &value, sizeof(value));
+    }
+    
+    return true;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,86 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "macho_file.h"
+
+namespace xpf {
+
+/**
+ * A single entry in an LC_DYLD_CHAINED_FIXUPS imports table.
+ */
+struct macho_chained_import {
+    /** The library ordinal, or one of the BIND_SPECIAL_DYLIB_* constants. */
+    int64_t ordinal;
+    
+    /** The install name of the library from which the symbol is imported, or an empty string for special ordinals. */
+    const char *library;
+    
+    /** The symbol name. */
+    const char *symbol;
+    
+    /** True if this is a weak import. */
+    bool weak;
+    
+    /** The import's addend. */
+    int64_t addend;
+    
+    /** Offset of the import's table entry, relative to the start of the image. */
+    uint64_t entry_offset;
+};
+
+/**
+ * Parsed LC_DYLD_CHAINED_FIXUPS imports table.
+ */
+struct macho_chained_imports {
+    /** The imports table format (DYLD_CHAINED_IMPORT, DYLD_CHAINED_IMPORT_ADDEND, or DYLD_CHAINED_IMPORT_ADDEND64). */
+    uint32_t format;
+    
+    /** All imports, in table order; bind fixups reference imports by their index in this table. */
+    std::vector<macho_chained_import> imports;
+};
+
+/** Imports table entry formats */
+enum {
+    MACHO_CHAINED_IMPORT = 1,
+    MACHO_CHAINED_IMPORT_ADDEND = 2,
+    MACHO_CHAINED_IMPORT_ADDEND64 = 3
+};
+
+bool macho_chained_read_imports (const macho_file_image &image, macho_chained_imports &imports, std::string &error);
+bool macho_chained_walk_binds (const macho_file_image &image, const std::function<void(uint32_t, int64_t, uint64_t)> &fn, std::string &error);
+bool macho_chained_set_import (uint8_t *image, uint32_t format, uint64_t entry_offset, int64_t ordinal, bool weak, std::string &error);
+
+} /* namespace xpf */
@@ -0,0 +1,453 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "macho_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace xpf {
+
+/** Upper bound on the number of architectures in a fat file; used to distinguish fat files from Java class files,
+ * which share the same magic. */
+static constexpr uint32_t XPF_FAT_MAX_ARCHS = 32;
+
+/** Read a big-endian 32-bit value. */
+static inline uint32_t read_be32 (const uint8_t *p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+/** Read a big-endian 64-bit value. */
+static inline uint64_t read_be64 (const uint8_t *p) {
+    return ((uint64_t) read_be32(p) << 32) | read_be32(p + 4);
+}
+
+mapped_file::~mapped_file () {
+    if (_data != nullptr)
+        munmap((void *) _data, _size);
+}
+
+/**
+ * Map the file at @a path, replacing any existing mapping.
+ *
+ * @param path The file to map.
+ * @param error On failure, a description of the error.
+ *
+ * @return Returns true on success, or false on failure.
+ */
+bool mapped_file::map (const std::string &path, std::string &error) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = std::string("open() failed: ") + strerror(errno);
+        return false;
+    }
+    
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        error = std::string("fstat() failed: ") + strerror(errno);
+        close(fd);
+        return false;
+    }
+    
+    if (sb.st_size == 0) {
+        error = "empty file";
+        close(fd);
+        return false;
+    }
+    
+    void *mapping = mmap(nullptr, (size_t) sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = std::string("mmap() failed: ") + strerror(errno);
+        return false;
+    }
+    
+    if (_data != nullptr)
+        munmap((void *) _data, _size);
+    
+    _data = (const uint8_t *) mapping;
+    _size = (size_t) sb.st_size;
+    return true;
+}
+
+/**
+ * Return true if @a data appears to be a thin or fat Mach-O file.
+ */
+bool macho_is_candidate (const uint8_t *data, size_t size) {
+    if (size < sizeof(uint32_t))
+        return false;
+    
+    uint32_t magic;
+    memcpy(&magic, data, sizeof(magic));
+    if (magic == MH_MAGIC || magic == MH_MAGIC_64 || magic == MH_CIGAM || magic == MH_CIGAM_64)
+        return true;
+    
+    uint32_t fat_magic = read_be32(data);
+    if (fat_magic == FAT_MAGIC || fat_magic == FAT_MAGIC_64)
+        return size >= 8 && read_be32(data + 4) <= XPF_FAT_MAX_ARCHS;
+    
+    return false;
+}
+
+/**
+ * Enumerate the architecture slices of a thin or fat Mach-O file.
+ *
+ * @param data The file data.
+ * @param size The file size.
+ * @param slices On success, all slices will be appended to this vector. A thin file has a single slice.
+ * @param error On failure, a description of the error.
+ *
+ * @return Returns true on success, or false if the file is not a valid Mach-O file.
+ */
+bool macho_slices (const uint8_t *data, size_t size, std::vector<macho_slice> &slices, std::string &error) {
+    if (!macho_is_candidate(data, size)) {
+        error = "not a Mach-O file";
+        return false;
+    }
+    
+    uint32_t fat_magic = read_be32(data);
+    if (fat_magic != FAT_MAGIC && fat_magic != FAT_MAGIC_64) {
+        /* Thin file */
+        if (size < sizeof(struct mach_header)) {
+            error = "truncated mach header";
+            return false;
+        }
+        
+        const struct mach_header *header = (const struct mach_header *) data;
+        slices.push_back(macho_slice { header->cputype, header->cpusubtype, 0, size, 0 });
+        return true;
+    }
+    
+    /* Fat file; all fields are big-endian */
+    uint32_t nfat_arch = read_be32(data + 4);
+    size_t arch_size = (fat_magic == FAT_MAGIC_64) ? 32 : 20;
+    if (nfat_arch > (size - 8) / arch_size) {
+        error = "truncated fat header";
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < nfat_arch; i++) {
+        const uint8_t *arch = data + 8 + (i * arch_size);
+        macho_slice slice;
+        
+        slice.cputype = (cpu_type_t) read_be32(arch);
+        slice.cpusubtype = (cpu_subtype_t) read_be32(arch + 4);
+        if (fat_magic == FAT_MAGIC_64) {
+            slice.offset = read_be64(arch + 8);
+            slice.size = read_be64(arch + 16);
+            slice.align = read_be32(arch + 24);
+        } else {
+            slice.offset = read_be32(arch + 8);
+            slice.size = read_be32(arch + 12);
+            slice.align = read_be32(arch + 16);
+        }
+        
+        if (slice.offset > size || slice.size > size - slice.offset) {
+            error = std::string("fat slice for ") + macho_arch_name(slice.cputype) + " extends past the end of the file";
+            return false;
+        }
+        
+        slices.push_back(slice);
+    }
+    
+    return true;
+}
+
+/**
+ * Return a human-readable name for @a cputype.
+ */
+const char *macho_arch_name (cpu_type_t cputype) {
+    switch (cputype) {
+        case CPU_TYPE_X86:
+            return "i386";
+        case CPU_TYPE_X86_64:
+            return "x86_64";
+        case CPU_TYPE_ARM:
+            return "arm";
+        case CPU_TYPE_ARM64:
+            return "arm64";
+        case CPU_TYPE_POWERPC:
+            return "ppc";
+        case CPU_TYPE_POWERPC64:
+            return "ppc64";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * Return the NUL-terminated string at @a offset within a load command, or nullptr if the string is not
+ * terminated within the command.
+ */
+static const char *load_command_string (const struct load_command *cmd, uint32_t offset) {
+    if (offset < sizeof(struct load_command) || offset >= cmd->cmdsize)
+        return nullptr;
+    
+    const char *str = (const char *) cmd + offset;
+    if (memchr(str, '\0', cmd->cmdsize - offset) == nullptr)
+        return nullptr;
+    
+    return str;
+}
+
+/**
+ * Parse a single-architecture Mach-O image.
+ *
+ * @param data The image data; this must remain valid for the lifetime of the image.
+ * @param size The size of the image data.
+ * @param error On failure, a description of the error.
+ *
+ * @return Returns true on success, or false if the image is malformed or unsupported.
+ */
+bool macho_file_image::parse (const uint8_t *data, size_t size, std::string &error) {
+    if (size < sizeof(struct mach_header)) {
+        error = "truncated mach header";
+        return false;
+    }
+    
+    _data = data;
+    _size = size;
+    _header = (const struct mach_header *) data;
+    
+    size_t header_size;
+    if (_header->magic == MH_MAGIC) {
+        _is64 = false;
+        header_size = sizeof(struct mach_header);
+    } else if (_header->magic == MH_MAGIC_64) {
+        _is64 = true;
+        header_size = sizeof(struct mach_header_64);
+    } else if (_header->magic == MH_CIGAM || _header->magic == MH_CIGAM_64) {
+        error = "non-native byte order is not supported";
+        return false;
+    } else {
+        error = "invalid mach header magic";
+        return false;
+    }
+    
+    if (header_size > size || _header->sizeofcmds > size - header_size) {
+        error = "truncated load commands";
+        return false;
+    }
+    
+    const uint8_t *cmd_ptr = data + header_size;
+    const uint8_t *cmd_end = cmd_ptr + _header->sizeofcmds;
+    for (uint32_t i = 0; i < _header->ncmds; i++) {
+        if ((size_t) (cmd_end - cmd_ptr) < sizeof(struct load_command)) {
+            error = "truncated load command";
+            return false;
+        }
+        
+        const struct load_command *cmd = (const struct load_command *) cmd_ptr;
+        if (cmd->cmdsize < sizeof(struct load_command) || cmd->cmdsize > (size_t) (cmd_end - cmd_ptr) || (cmd->cmdsize % 4) != 0) {
+            error = "invalid load command size";
+            return false;
+        }
+        
+        switch (cmd->cmd) {
+            case LC_SEGMENT:
+            case LC_SEGMENT_64: {
+                bool seg64 = (cmd->cmd == LC_SEGMENT_64);
+                size_t seg_size = seg64 ? sizeof(struct segment_command_64) : sizeof(struct segment_command);
+                size_t sect_size = seg64 ? sizeof(struct section_64) : sizeof(struct section);
+                if (cmd->cmdsize < seg_size) {
+                    error = "truncated segment command";
+                    return false;
+                }
+                
+                macho_file_segment segment;
+                uint32_t nsects;
+                if (seg64) {
+                    auto seg = (const struct segment_command_64 *) cmd;
+                    segment = macho_file_segment { std::string(seg->segname, strnlen(seg->segname, sizeof(seg->segname))), seg->vmaddr, seg->vmsize, seg->fileoff, seg->filesize };
+                    nsects = seg->nsects;
+                } else {
+                    auto seg = (const struct segment_command *) cmd;
+                    segment = macho_file_segment { std::string(seg->segname, strnlen(seg->segname, sizeof(seg->segname))), seg->vmaddr, seg->vmsize, seg->fileoff, seg->filesize };
+                    nsects = seg->nsects;
+                }
+                
+                if (nsects > (cmd->cmdsize - seg_size) / sect_size) {
+                    error = "truncated section list";
+                    return false;
+                }
+                
+                for (uint32_t n = 0; n < nsects; n++) {
+                    const uint8_t *sect_ptr = cmd_ptr + seg_size + (n * sect_size);
+                    macho_file_section section;
+                    if (seg64) {
+                        auto sect = (const struct section_64 *) sect_ptr;
+                        section = macho_file_section { std::string(sect->segname, strnlen(sect->segname, sizeof(sect->segname))), std::string(sect->sectname, strnlen(sect->sectname, sizeof(sect->sectname))), sect->addr, sect->size, sect->offset };
+                    } else {
+                        auto sect = (const struct section *) sect_ptr;
+                        section = macho_file_section { std::string(sect->segname, strnlen(sect->segname, sizeof(sect->segname))), std::string(sect->sectname, strnlen(sect->sectname, sizeof(sect->sectname))), sect->addr, sect->size, sect->offset };
+                    }
+                    
+                    _sections.push_back(section);
+                }
+                
+                _segments.push_back(segment);
+                break;
+            }
+                
+            case LC_ID_DYLIB:
+            case LC_LOAD_DYLIB:
+            case LC_LOAD_WEAK_DYLIB:
+            case LC_REEXPORT_DYLIB:
+            case LC_LAZY_LOAD_DYLIB:
+            case LC_LOAD_UPWARD_DYLIB: {
+                if (cmd->cmdsize < sizeof(struct dylib_command)) {
+                    error = "truncated dylib command";
+                    return false;
+                }
+                
+                const char *name = load_command_string(cmd, ((const struct dylib_command *) cmd)->dylib.name.offset);
+                if (name == nullptr) {
+                    error = "invalid dylib name";
+                    return false;
+                }
+                
+                if (cmd->cmd == LC_ID_DYLIB) {
+                    _install_name = name;
+                    break;
+                }
+                
+                _libraries.push_back(name);
+                if (cmd->cmd == LC_REEXPORT_DYLIB)
+                    _reexports.push_back(name);
+                break;
+            }
+                
+            case LC_SYMTAB:
+                if (cmd->cmdsize < sizeof(struct symtab_command)) {
+                    error = "truncated symtab command";
+                    return false;
+                }
+                
+                _symtab = (const struct symtab_command *) cmd;
+                break;
+                
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY:
+                if (cmd->cmdsize < sizeof(struct dyld_info_command)) {
+                    error = "truncated dyld info command";
+                    return false;
+                }
+                
+                _dyld_info = (const struct dyld_info_command *) cmd;
+                break;
+                
+            case LC_DYLD_EXPORTS_TRIE:
+            case LC_DYLD_CHAINED_FIXUPS:
+                if (cmd->cmdsize < sizeof(struct linkedit_data_command)) {
+                    error = "truncated linkedit data command";
+                    return false;
+                }
+                
+                if (cmd->cmd == LC_DYLD_EXPORTS_TRIE)
+                    _exports_trie = (const struct linkedit_data_command *) cmd;
+                else
+                    _chained_fixups = (const struct linkedit_data_command *) cmd;
+                break;
+                
+            default:
+                break;
+        }
+        
+        cmd_ptr += cmd->cmdsize;
+    }
+    
+    return true;
+}
+
+/**
+ * Return the range [@a offset, @a offset + @a size) of the image's file data, or an empty range (with a nullptr
+ * data pointer) if the range is out of bounds.
+ */
+macho_file_range macho_file_image::file_range (uint64_t offset, uint64_t size) const {
+    if (offset > _size || size > _size - offset)
+        return macho_file_range { nullptr, 0 };
+    
+    return macho_file_range { _data + offset, (size_t) size };
+}
+
+/**
+ * Return the file-backed data at VM address @a vmaddr, or an empty range if the address range is not entirely
+ * backed by a single segment's file data.
+ */
+macho_file_range macho_file_image::vm_range (uint64_t vmaddr, uint64_t size) const {
+    for (auto &&segment : _segments) {
+        if (vmaddr < segment.vmaddr || vmaddr - segment.vmaddr >= segment.filesize)
+            continue;
+        
+        uint64_t offset = vmaddr - segment.vmaddr;
+        if (size > segment.filesize - offset)
+            return macho_file_range { nullptr, 0 };
+        
+        return file_range(segment.fileoff + offset, size);
+    }
+    
+    return macho_file_range { nullptr, 0 };
+}
+
+/**
+ * Return the NUL-terminated string at VM address @a vmaddr, or nullptr if the address is not file-backed or the
+ * string is unterminated.
+ */
+const char *macho_file_image::vm_cstring (uint64_t vmaddr) const {
+    for (auto &&segment : _segments) {
+        if (vmaddr < segment.vmaddr || vmaddr - segment.vmaddr >= segment.filesize)
+            continue;
+        
+        uint64_t offset = vmaddr - segment.vmaddr;
+        macho_file_range range = file_range(segment.fileoff + offset, segment.filesize - offset);
+        if (range.data == nullptr || memchr(range.data, '\0', range.size) == nullptr)
+            return nullptr;
+        
+        return (const char *) range.data;
+    }
+    
+    return nullptr;
+}
+
+/**
+ * Return the section named @a segname, @a sectname, or nullptr if not found.
+ */
+const macho_file_section *macho_file_image::find_section (const char *segname, const char *sectname) const {
+    for (auto &&section : _sections) {
+        if (section.segname == segname && section.sectname == sectname)
+            return &section;
+    }
+    
+    return nullptr;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,217 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <mach-o/loader.h>
+#include <mach-o/fat.h>
+
+#include <string>
+#include <vector>
+
+/* Not defined by older SDKs */
+#ifndef FAT_MAGIC_64
+#define FAT_MAGIC_64 0xcafebabf
+#endif
+
+#ifndef LC_DYLD_EXPORTS_TRIE
+#define LC_DYLD_EXPORTS_TRIE (0x33 | LC_REQ_DYLD)
+#endif
+
+#ifndef LC_DYLD_CHAINED_FIXUPS
+#define LC_DYLD_CHAINED_FIXUPS (0x34 | LC_REQ_DYLD)
+#endif
+
+namespace xpf {
+
+/**
+ * A read-only memory mapping of a file.
+ */
+class mapped_file {
+public:
+    mapped_file () : _data(nullptr), _size(0) {}
+    ~mapped_file ();
+    
+    mapped_file (const mapped_file &) = delete;
+    mapped_file &operator= (const mapped_file &) = delete;
+    
+    bool map (const std::string &path, std::string &error);
+    
+    /** Return the mapped file data. */
+    const uint8_t *data () const { return _data; }
+    
+    /** Return the size of the mapped file data. */
+    size_t size () const { return _size; }
+
+private:
+    /** The mapped file data, or nullptr if unmapped. */
+    const uint8_t *_data;
+    
+    /** The size of the mapping. */
+    size_t _size;
+};
+
+/**
+ * A single architecture slice within a (possibly fat) Mach-O file.
+ */
+struct macho_slice {
+    /** The slice's CPU type. */
+    cpu_type_t cputype;
+    
+    /** The slice's CPU subtype. */
+    cpu_subtype_t cpusubtype;
+    
+    /** Offset of the slice within the file. */
+    uint64_t offset;
+    
+    /** Size of the slice. */
+    uint64_t size;
+    
+    /** The slice's required alignment within a fat file, as a power of 2, or 0 for thin files. */
+    uint32_t align;
+};
+
+bool macho_is_candidate (const uint8_t *data, size_t size);
+bool macho_slices (const uint8_t *data, size_t size, std::vector<macho_slice> &slices, std::string &error);
+const char *macho_arch_name (cpu_type_t cputype);
+
+/**
+ * A segment of a file-backed Mach-O image.
+ */
+struct macho_file_segment {
+    /** Segment name. */
+    std::string name;
+    
+    /** Segment VM address and size. */
+    uint64_t vmaddr;
+    uint64_t vmsize;
+    
+    /** Segment file offset and size, relative to the start of the image. */
+    uint64_t fileoff;
+    uint64_t filesize;
+};
+
+/**
+ * A section of a file-backed Mach-O image.
+ */
+struct macho_file_section {
+    /** Segment and section names. */
+    std::string segname;
+    std::string sectname;
+    
+    /** Section VM address and size. */
+    uint64_t addr;
+    uint64_t size;
+    
+    /** Section file offset, relative to the start of the image. */
+    uint32_t offset;
+};
+
+/**
+ * A byte range within a file-backed Mach-O image.
+ */
+struct macho_file_range {
+    const uint8_t *data;
+    size_t size;
+};
+
+/**
+ * A single-architecture Mach-O image parsed from a file mapping, rather than from an image loaded by dyld.
+ *
+ * All ranges returned by the image are bounds-checked against the slice; the image borrows its data from the
+ * backing mapped_file, which must outlive it.
+ */
+class macho_file_image {
+public:
+    macho_file_image () : _data(nullptr), _size(0), _header(nullptr), _is64(false), _symtab(nullptr), _dyld_info(nullptr), _exports_trie(nullptr), _chained_fixups(nullptr) {}
+    
+    bool parse (const uint8_t *data, size_t size, std::string &error);
+    
+    macho_file_range file_range (uint64_t offset, uint64_t size) const;
+    macho_file_range vm_range (uint64_t vmaddr, uint64_t size) const;
+    const char *vm_cstring (uint64_t vmaddr) const;
+    const macho_file_section *find_section (const char *segname, const char *sectname) const;
+    
+    /** Return the image's mach header. */
+    const struct mach_header *header () const { return _header; }
+    
+    /** Return true if this is a 64-bit image. */
+    bool is64 () const { return _is64; }
+    
+    /** Return the image's install name, or an empty string if the image is not a dylib. */
+    const std::string &install_name () const { return _install_name; }
+    
+    /** Return the image's linked libraries, indexed by (ordinal - 1). */
+    const std::vector<std::string> &libraries () const { return _libraries; }
+    
+    /** Return the install names of all re-exported libraries. */
+    const std::vector<std::string> &reexports () const { return _reexports; }
+    
+    /** Return the image's segments, in declaration order. */
+    const std::vector<macho_file_segment> &segments () const { return _segments; }
+    
+    /** Return the image's sections, in declaration order. */
+    const std::vector<macho_file_section> &sections () const { return _sections; }
+    
+    /** Return the image's LC_SYMTAB command, or nullptr if none. */
+    const struct symtab_command *symtab () const { return _symtab; }
+    
+    /** Return the image's LC_DYLD_INFO(_ONLY) command, or nullptr if none. */
+    const struct dyld_info_command *dyld_info () const { return _dyld_info; }
+    
+    /** Return the image's LC_DYLD_EXPORTS_TRIE command, or nullptr if none. */
+    const struct linkedit_data_command *exports_trie () const { return _exports_trie; }
+    
+    /** Return the image's LC_DYLD_CHAINED_FIXUPS command, or nullptr if none. */
+    const struct linkedit_data_command *chained_fixups () const { return _chained_fixups; }
+
+private:
+    /** Slice data */
+    const uint8_t *_data;
+    size_t _size;
+    
+    /** Mach header */
+    const struct mach_header *_header;
+    bool _is64;
+    
+    std::string _install_name;
+    std::vector<std::string> _libraries;
+    std::vector<std::string> _reexports;
+    std::vector<macho_file_segment> _segments;
+    std::vector<macho_file_section> _sections;
+    
+    const struct symtab_command *_symtab;
+    const struct dyld_info_command *_dyld_info;
+    const struct linkedit_data_command *_exports_trie;
+    const struct linkedit_data_command *_chained_fixups;
+};
+
+} /* namespace xpf */
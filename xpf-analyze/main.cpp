@@ -0,0 +1,461 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * xpf-analyze
+ *
+ * Performs offline analysis of Mach-O binaries (eg, an entire Xcode.app tree), reporting every import that
+ * would be rebound or weakened by xpf-bootstrap, and every import that is missing from a given SDK.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ftw.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <PLPatchMaster/SymbolName.hpp>
+
+#include "macho_file.h"
+#include "macho_binds.h"
+#include "macho_chained.h"
+#include "analyze_rules.h"
+#include "sdk_index.h"
+#include "weak_table.h"
+
+using namespace xpf;
+using patchmaster::SymbolName;
+
+/** Maximum number of file descriptors used by nftw(). */
+static constexpr int XPF_ANALYZE_NFTW_FDS = 32;
+
+/**
+ * Analysis configuration, shared (read-only) by all workers.
+ */
+struct analyze_config {
+    /** Rebind rules loaded from xpf-bootstrap. */
+    std::vector<analyze_rebind_rule> rules;
+    
+    /** The SDK index, or nullptr if no SDK was specified. */
+    std::unique_ptr<sdk_index> sdk;
+    
+    /** If true, per-phase timings are recorded. */
+    bool timing;
+};
+
+/**
+ * Per-phase analysis timings, in nanoseconds; recorded only if analyze_config::timing is set.
+ */
+struct analyze_timing {
+    /** Number of architecture slices analyzed. */
+    uint64_t slices;
+    
+    /** Number of binds (or chained fixup imports) classified. */
+    uint64_t binds;
+    
+    /** Time spent parsing Mach-O headers and load commands. */
+    uint64_t parse_ns;
+    
+    /** Time spent evaluating bind opcodes, excluding classification. */
+    uint64_t evaluate_ns;
+    
+    /** Time spent matching binds against the rebind and weak symbol tables. */
+    uint64_t match_ns;
+    
+    /** Time spent resolving binds against the SDK. */
+    uint64_t sdk_ns;
+    
+    analyze_timing &operator+= (const analyze_timing &other) {
+        slices += other.slices;
+        binds += other.binds;
+        parse_ns += other.parse_ns;
+        evaluate_ns += other.evaluate_ns;
+        match_ns += other.match_ns;
+        sdk_ns += other.sdk_ns;
+        return *this;
+    }
+};
+
+/**
+ * Return the current monotonic time, in nanoseconds.
+ */
+static uint64_t analyze_now () {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Per-file analysis result.
+ */
+struct analyze_result {
+    /** The report lines. */
+    std::string output;
+    
+    /** The number of strong imports missing from the SDK that are not handled by a rebind or weak rule. */
+    size_t unhandled;
+    
+    /** Per-phase timings. */
+    analyze_timing timing;
+};
+
+/* Regular files found by nftw() */
+static std::vector<std::string> analyze_paths;
+
+static int analyze_nftw_callback (const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    if (typeflag == FTW_F && S_ISREG(sb->st_mode))
+        analyze_paths.push_back(path);
+    
+    return 0;
+}
+
+/**
+ * Return true if @a bind matches any of the xpf-bootstrap rebind rules.
+ */
+static bool analyze_match_rebind (const analyze_config &config, const macho_bind &bind) {
+    SymbolName name(bind.library, bind.symbol);
+    for (auto &&rule : config.rules) {
+        if (SymbolName(rule.image.c_str(), rule.symbol.c_str()).match(name))
+            return true;
+    }
+    
+    return false;
+}
+
+/**
+ * Return true if @a bind matches an entry in the xpf-bootstrap weak symbol table.
+ */
+static bool analyze_match_weak (const macho_bind &bind) {
+    for (size_t i = 0; i < sizeof(xpf_weak_symbols) / sizeof(xpf_weak_symbols[0]); i++) {
+        if (strcmp(xpf_weak_symbols[i].symbol, bind.symbol) == 0 && strcmp(xpf_weak_symbols[i].library, bind.library) == 0)
+            return true;
+    }
+    
+    return false;
+}
+
+/**
+ * Analyze a single architecture slice, appending the report to @a result.
+ */
+static void analyze_slice (const analyze_config &config, const std::string &path, const uint8_t *data, const macho_slice &slice, analyze_result &result) {
+    std::string error;
+    std::string prefix = path + " (" + macho_arch_name(slice.cputype) + "): ";
+    analyze_timing &timing = result.timing;
+    uint64_t start = config.timing ? analyze_now() : 0;
+    
+    macho_file_image image;
+    bool parsed = image.parse(data + slice.offset, slice.size, error);
+    
+    if (config.timing) {
+        timing.slices++;
+        timing.parse_ns += analyze_now() - start;
+    }
+    
+    if (!parsed) {
+        fprintf(stderr, "xpf-analyze: %s%s\n", prefix.c_str(), error.c_str());
+        return;
+    }
+    
+    /* Report each (kind, library, symbol) once per slice */
+    std::set<std::tuple<std::string, std::string, std::string>> reported;
+    auto report = [&](const char *kind, const char *library, const char *symbol) {
+        if (!reported.insert(std::make_tuple(kind, library, symbol)).second)
+            return;
+        
+        result.output += prefix + kind + " " + symbol + " (" + library + ")\n";
+    };
+    
+    /* Time spent classifying binds; subtracted from the total evaluation time */
+    uint64_t classify_ns = 0;
+    
+    auto classify = [&](const macho_bind &bind) {
+        /* Weak definition binds are coalesced at runtime, and never refer to a specific library */
+        if (bind.stream == MACHO_BIND_STREAM_WEAK)
+            return;
+        
+        uint64_t match_start = config.timing ? analyze_now() : 0;
+        bool rebind = analyze_match_rebind(config, bind);
+        bool weak = !rebind && analyze_match_weak(bind);
+        
+        if (config.timing) {
+            uint64_t elapsed = analyze_now() - match_start;
+            timing.binds++;
+            timing.match_ns += elapsed;
+            classify_ns += elapsed;
+        }
+        
+        if (rebind) {
+            report("rebind", bind.library, bind.symbol);
+            return;
+        }
+        
+        if (weak) {
+            report("weak", bind.library, bind.symbol);
+            return;
+        }
+        
+        if (config.sdk == nullptr || bind.ordinal <= 0 || image.install_name() == bind.library)
+            return;
+        
+        uint64_t sdk_start = config.timing ? analyze_now() : 0;
+        sdk_lookup_result found = config.sdk->lookup(bind.library, bind.symbol, slice.cputype);
+        
+        if (config.timing) {
+            uint64_t elapsed = analyze_now() - sdk_start;
+            timing.sdk_ns += elapsed;
+            classify_ns += elapsed;
+        }
+        
+        switch (found) {
+            case SDK_SYMBOL_FOUND:
+            case SDK_LIBRARY_UNRESOLVED:
+                break;
+                
+            case SDK_LIBRARY_MISSING:
+                report("missing-library", bind.library, "-");
+                break;
+                
+            case SDK_SYMBOL_MISSING:
+                if (bind.flags & BIND_SYMBOL_FLAGS_WEAK_IMPORT) {
+                    report("missing-weak", bind.library, bind.symbol);
+                } else {
+                    size_t count = reported.size();
+                    report("missing", bind.library, bind.symbol);
+                    if (reported.size() != count)
+                        result.unhandled++;
+                }
+                break;
+        }
+    };
+    
+    uint64_t evaluate_start = config.timing ? analyze_now() : 0;
+    
+    bool ok;
+    if (image.chained_fixups() != nullptr) {
+        /* Chained fixup images declare each import exactly once; classify the imports table directly rather than
+         * walking every fixup chain. */
+        macho_chained_imports imports;
+        ok = macho_chained_read_imports(image, imports, error);
+        
+        for (size_t i = 0; ok && i < imports.imports.size(); i++) {
+            const macho_chained_import &import = imports.imports[i];
+            macho_bind bind = {};
+            
+            bind.stream = MACHO_BIND_STREAM_CHAINED;
+            bind.ordinal = import.ordinal;
+            bind.library = import.library;
+            bind.symbol = import.symbol;
+            bind.flags = import.weak ? BIND_SYMBOL_FLAGS_WEAK_IMPORT : 0;
+            classify(bind);
+        }
+    } else {
+        ok = macho_evaluate_binds(image, classify, error);
+    }
+    
+    if (config.timing)
+        timing.evaluate_ns += (analyze_now() - evaluate_start) - classify_ns;
+    
+    if (!ok)
+        fprintf(stderr, "xpf-analyze: %s%s\n", prefix.c_str(), error.c_str());
+}
+
+/**
+ * Analyze all slices of the file at @a path; files that are not Mach-O binaries are ignored.
+ */
+static void analyze_file (const analyze_config &config, const std::string &path, analyze_result &result) {
+    std::string error;
+    mapped_file file;
+    
+    if (!file.map(path, error)) {
+        if (error != "empty file")
+            fprintf(stderr, "xpf-analyze: %s: %s\n", path.c_str(), error.c_str());
+        return;
+    }
+    
+    if (!macho_is_candidate(file.data(), file.size()))
+        return;
+    
+    std::vector<macho_slice> slices;
+    if (!macho_slices(file.data(), file.size(), slices, error)) {
+        fprintf(stderr, "xpf-analyze: %s: %s\n", path.c_str(), error.c_str());
+        return;
+    }
+    
+    for (auto &&slice : slices)
+        analyze_slice(config, path, file.data(), slice, result);
+}
+
+/**
+ * Write a JSON report of the aggregate per-phase @a timing to @a path.
+ *
+ * Phase times are summed across all workers; wall_ms is the elapsed time of the entire analysis.
+ */
+static bool write_timing_report (const char *path, const analyze_timing &timing, size_t files, unsigned int jobs, uint64_t wall_ns) {
+    FILE *output = fopen(path, "w");
+    if (output == nullptr) {
+        fprintf(stderr, "xpf-analyze: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    
+    auto ms = [](uint64_t ns) { return ns / 1000000.0; };
+    fprintf(output, "{\n");
+    fprintf(output, "  \"files\": %zu,\n", files);
+    fprintf(output, "  \"slices\": %llu,\n", (unsigned long long) timing.slices);
+    fprintf(output, "  \"binds\": %llu,\n", (unsigned long long) timing.binds);
+    fprintf(output, "  \"jobs\": %u,\n", jobs);
+    fprintf(output, "  \"wall_ms\": %.3f,\n", ms(wall_ns));
+    fprintf(output, "  \"parse_ms\": %.3f,\n", ms(timing.parse_ns));
+    fprintf(output, "  \"evaluate_ms\": %.3f,\n", ms(timing.evaluate_ns));
+    fprintf(output, "  \"match_ms\": %.3f,\n", ms(timing.match_ns));
+    fprintf(output, "  \"sdk_ms\": %.3f,\n", ms(timing.sdk_ns));
+    fprintf(output, "  \"match_ns_per_bind\": %.1f\n", timing.binds > 0 ? (double) timing.match_ns / timing.binds : 0.0);
+    fprintf(output, "}\n");
+    
+    if (fclose(output) != 0) {
+        fprintf(stderr, "xpf-analyze: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    
+    return true;
+}
+
+static void print_usage (const char *progname) {
+    fprintf(stderr, "Usage: %s -b <xpf-bootstrap binary> [-s <sdk root>] [-j <jobs>] <path> ...\n", progname);
+    fprintf(stderr, "  -b <path>   xpf-bootstrap binary from which rebind rules will be read\n");
+    fprintf(stderr, "  -s <path>   SDK root against which imports will be resolved\n");
+    fprintf(stderr, "  -j <jobs>   Number of parallel workers (default: number of CPUs)\n");
+    fprintf(stderr, "  -t <path>   Write a JSON report of per-phase timings to <path>\n");
+}
+
+int main (int argc, char * const argv[]) {
+    analyze_config config = analyze_config();
+    const char *progname = argv[0];
+    const char *bootstrap = nullptr;
+    const char *timing_path = nullptr;
+    unsigned int jobs = std::thread::hardware_concurrency();
+    int ch;
+    
+    while ((ch = getopt(argc, argv, "b:s:j:t:h")) != -1) {
+        switch (ch) {
+            case 'b':
+                bootstrap = optarg;
+                break;
+                
+            case 's':
+                config.sdk.reset(new sdk_index(optarg));
+                break;
+                
+            case 'j':
+                jobs = (unsigned int) strtoul(optarg, nullptr, 10);
+                break;
+                
+            case 't':
+                timing_path = optarg;
+                config.timing = true;
+                break;
+                
+            case 'h':
+            default:
+                print_usage(progname);
+                return 2;
+        }
+    }
+    
+    argc -= optind;
+    argv += optind;
+    
+    if (bootstrap == nullptr || argc == 0) {
+        print_usage(progname);
+        return 2;
+    }
+    
+    if (jobs == 0)
+        jobs = 1;
+    
+    /* Load the rebind rules */
+    std::string error;
+    if (!analyze_load_rebind_rules(bootstrap, config.rules, error)) {
+        fprintf(stderr, "xpf-analyze: %s: %s\n", bootstrap, error.c_str());
+        return 1;
+    }
+    
+    /* Gather all regular files */
+    for (int i = 0; i < argc; i++) {
+        if (nftw(argv[i], analyze_nftw_callback, XPF_ANALYZE_NFTW_FDS, FTW_PHYS) != 0) {
+            fprintf(stderr, "xpf-analyze: %s: %s\n", argv[i], strerror(errno));
+            return 1;
+        }
+    }
+    
+    /* Analyze in parallel; results are reported in path order once all workers have finished */
+    uint64_t wall_start = analyze_now();
+    std::vector<analyze_result> results(analyze_paths.size(), analyze_result { std::string(), 0, analyze_timing() });
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    
+    for (unsigned int i = 0; i < jobs; i++) {
+        workers.emplace_back([&]() {
+            size_t idx;
+            while ((idx = next.fetch_add(1)) < analyze_paths.size())
+                analyze_file(config, analyze_paths[idx], results[idx]);
+        });
+    }
+    
+    for (auto &&worker : workers)
+        worker.join();
+    
+    uint64_t wall_ns = analyze_now() - wall_start;
+    
+    size_t unhandled = 0;
+    analyze_timing timing = analyze_timing();
+    for (auto &&result : results) {
+        fputs(result.output.c_str(), stdout);
+        unhandled += result.unhandled;
+        timing += result.timing;
+    }
+    
+    fflush(stdout);
+    
+    if (timing_path != nullptr && !write_timing_report(timing_path, timing, analyze_paths.size(), jobs, wall_ns))
+        return 1;
+    
+    if (unhandled > 0) {
+        fprintf(stderr, "xpf-analyze: %zu unhandled missing import(s)\n", unhandled);
+        return 1;
+    }
+    
+    return 0;
+}
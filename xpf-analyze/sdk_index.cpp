@@ -0,0 +1,392 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sdk_index.h"
+#include "macho_file.h"
+#include "export_trie.h"
+
+#include <mach-o/nlist.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace xpf {
+
+/** Maximum depth of re-exported library chains; guards against re-export cycles. */
+static constexpr size_t XPF_SDK_MAX_REEXPORT_DEPTH = 16;
+
+/**
+ * Load the exports of a Mach-O library.
+ *
+ * @param path The library path.
+ * @param cputype The architecture to load; if the library is thin, its only slice is used regardless of architecture.
+ * @param exports On success, populated with the library's exports.
+ * @param error On failure, a description of the error.
+ */
+bool library_exports_load_macho (const std::string &path, cpu_type_t cputype, library_exports &exports, std::string &error) {
+    mapped_file file;
+    if (!file.map(path, error))
+        return false;
+    
+    std::vector<macho_slice> slices;
+    if (!macho_slices(file.data(), file.size(), slices, error))
+        return false;
+    
+    const macho_slice *slice = nullptr;
+    for (auto &&s : slices) {
+        if (s.cputype == cputype || slices.size() == 1)
+            slice = &s;
+    }
+    
+    if (slice == nullptr) {
+        error = std::string("no ") + macho_arch_name(cputype) + " slice";
+        return false;
+    }
+    
+    macho_file_image image;
+    if (!image.parse(file.data() + slice->offset, slice->size, error))
+        return false;
+    
+    exports.reexports = image.reexports();
+    
+    /* Prefer the export trie, which may be declared by either LC_DYLD_INFO or LC_DYLD_EXPORTS_TRIE */
+    uint32_t trie_off = 0, trie_size = 0;
+    if (image.dyld_info() != nullptr) {
+        trie_off = image.dyld_info()->export_off;
+        trie_size = image.dyld_info()->export_size;
+    } else if (image.exports_trie() != nullptr) {
+        trie_off = image.exports_trie()->dataoff;
+        trie_size = image.exports_trie()->datasize;
+    }
+    
+    if (trie_size > 0) {
+        macho_file_range trie = image.file_range(trie_off, trie_size);
+        if (trie.data == nullptr) {
+            error = "export trie extends past the end of the image";
+            return false;
+        }
+        
+        bool ok = export_trie_walk(trie.data, trie.size, [&](const std::string &name, uint64_t flags) {
+            exports.symbols.insert(name);
+        });
+        
+        if (!ok) {
+            error = "malformed export trie";
+            return false;
+        }
+        
+        return true;
+    }
+    
+    /* Otherwise, fall back on the symbol table */
+    const struct symtab_command *symtab = image.symtab();
+    if (symtab == nullptr)
+        return true;
+    
+    size_t nlist_size = image.is64() ? sizeof(struct nlist_64) : sizeof(struct nlist);
+    macho_file_range symbols = image.file_range(symtab->symoff, (uint64_t) symtab->nsyms * nlist_size);
+    macho_file_range strings = image.file_range(symtab->stroff, symtab->strsize);
+    if (symbols.data == nullptr || strings.data == nullptr) {
+        error = "symbol table extends past the end of the image";
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < symtab->nsyms; i++) {
+        const uint8_t *entry = symbols.data + (i * nlist_size);
+        uint32_t strx;
+        uint8_t type;
+        
+        if (image.is64()) {
+            strx = ((const struct nlist_64 *) entry)->n_un.n_strx;
+            type = ((const struct nlist_64 *) entry)->n_type;
+        } else {
+            strx = ((const struct nlist *) entry)->n_un.n_strx;
+            type = ((const struct nlist *) entry)->n_type;
+        }
+        
+        /* Only external, defined, non-debugging symbols are exported */
+        if ((type & N_STAB) || !(type & N_EXT) || (type & N_TYPE) == N_UNDF)
+            continue;
+        
+        if (strx >= strings.size)
+            continue;
+        
+        const char *name = (const char *) strings.data + strx;
+        exports.symbols.insert(std::string(name, strnlen(name, strings.size - strx)));
+    }
+    
+    return true;
+}
+
+/**
+ * Parse the elements of a YAML flow sequence (eg, `[ a, 'b', "c" ]`), appending them to @a elements.
+ */
+static void tbd_parse_flow_sequence (const std::string &text, std::vector<std::string> &elements) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t next = text.find(',', pos);
+        if (next == std::string::npos)
+            next = text.size();
+        
+        std::string element = text.substr(pos, next - pos);
+        size_t start = element.find_first_not_of(" \t\r\n'\"");
+        size_t end = element.find_last_not_of(" \t\r\n'\"");
+        if (start != std::string::npos)
+            elements.push_back(element.substr(start, end - start + 1));
+        
+        pos = next + 1;
+    }
+}
+
+/**
+ * Load the exports of a text-based (.tbd) library stub.
+ *
+ * This is not a general YAML parser; it supports the flow-sequence symbol lists emitted for all TBD versions,
+ * and merges all documents (eg, inlined umbrella sub-libraries) into a single export set.
+ *
+ * @param path The stub path.
+ * @param exports On success, populated with the library's exports.
+ * @param error On failure, a description of the error.
+ */
+bool library_exports_load_tbd (const std::string &path, library_exports &exports, std::string &error) {
+    mapped_file file;
+    if (!file.map(path, error))
+        return false;
+    
+    std::string text((const char *) file.data(), file.size());
+    
+    /* The current top-level key, and whether Objective-C names in the current document carry a leading underscore
+     * (as in TBD v1 and v2) */
+    std::string section;
+    bool objc_underscore = true;
+    
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = text.size();
+        
+        std::string line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+        
+        /* Document start; determine the TBD version from the tag */
+        if (line.compare(0, 3, "---") == 0) {
+            objc_underscore = (line.find("!tapi-tbd") == std::string::npos || line.find("!tapi-tbd-v2") != std::string::npos);
+            section.clear();
+            continue;
+        }
+        
+        /* Track the current top-level key */
+        size_t colon = line.find(':');
+        if (!line.empty() && line[0] != ' ' && line[0] != '-' && colon != std::string::npos)
+            section = line.substr(0, colon);
+        
+        if (section == "undefineds" || colon == std::string::npos)
+            continue;
+        
+        /* Determine the key, and skip any that do not contain exported names */
+        size_t key_start = line.find_first_not_of(" -");
+        if (key_start == std::string::npos || key_start > colon)
+            continue;
+        
+        std::string key = line.substr(key_start, colon - key_start);
+        if (key == "tbd-version" && line.find('4', colon) != std::string::npos)
+            objc_underscore = false;
+        
+        bool is_reexport = (key == "re-exports" || (key == "libraries" && section == "reexported-libraries"));
+        bool is_symbol = (key == "symbols" || key == "weak-def-symbols" || key == "weak-symbols" || key == "thread-local-symbols");
+        bool is_objc = (key == "objc-classes" || key == "objc-eh-types" || key == "objc-ivars");
+        if (!is_reexport && !is_symbol && !is_objc)
+            continue;
+        
+        /* Collect the (possibly multi-line) flow sequence */
+        size_t open = line.find('[', colon);
+        if (open == std::string::npos)
+            continue;
+        
+        std::string sequence = line.substr(open + 1);
+        while (sequence.find(']') == std::string::npos && pos < text.size()) {
+            eol = text.find('\n', pos);
+            if (eol == std::string::npos)
+                eol = text.size();
+            
+            sequence += text.substr(pos, eol - pos);
+            pos = eol + 1;
+        }
+        
+        size_t close = sequence.find(']');
+        if (close == std::string::npos) {
+            error = "unterminated sequence for '" + key + "'";
+            return false;
+        }
+        sequence.resize(close);
+        
+        std::vector<std::string> elements;
+        tbd_parse_flow_sequence(sequence, elements);
+        
+        for (auto &&element : elements) {
+            if (is_reexport) {
+                exports.reexports.push_back(element);
+            } else if (is_symbol) {
+                exports.symbols.insert(element);
+            } else {
+                std::string name = (objc_underscore && !element.empty() && element[0] == '_') ? element.substr(1) : element;
+                if (key == "objc-classes") {
+                    exports.symbols.insert("_OBJC_CLASS_$_" + name);
+                    exports.symbols.insert("_OBJC_METACLASS_$_" + name);
+                } else if (key == "objc-eh-types") {
+                    exports.symbols.insert("_OBJC_EHTYPE_$_" + name);
+                } else {
+                    exports.symbols.insert("_OBJC_IVAR_$_" + name);
+                }
+            }
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Construct a new index over the SDK at @a root.
+ */
+sdk_index::sdk_index (const std::string &root) : _root(root) {
+    pthread_mutex_init(&_lock, nullptr);
+}
+
+sdk_index::~sdk_index () {
+    pthread_mutex_destroy(&_lock);
+}
+
+/**
+ * Return true if @a path exists and is a regular file.
+ */
+static bool is_file (const std::string &path) {
+    struct stat sb;
+    return stat(path.c_str(), &sb) == 0 && S_ISREG(sb.st_mode);
+}
+
+/**
+ * Return the exports of the library with @a install_name, loading it if necessary, or nullptr if the library
+ * can not be found.
+ */
+std::shared_ptr<const library_exports> sdk_index::library (const std::string &install_name, cpu_type_t cputype) {
+    auto key = std::make_pair(cputype, install_name);
+    
+    pthread_mutex_lock(&_lock);
+    auto cached = _libraries.find(key);
+    if (cached != _libraries.end()) {
+        auto result = cached->second;
+        pthread_mutex_unlock(&_lock);
+        return result;
+    }
+    pthread_mutex_unlock(&_lock);
+    
+    /* Load the library without holding our lock; concurrent loads of the same library are harmless. */
+    std::shared_ptr<library_exports> exports;
+    std::string path = _root + install_name;
+    std::string error;
+    
+    if (is_file(path)) {
+        exports = std::make_shared<library_exports>();
+        if (!library_exports_load_macho(path, cputype, *exports, error)) {
+            fprintf(stderr, "xpf-analyze: %s: %s\n", path.c_str(), error.c_str());
+            exports.reset();
+        }
+    } else {
+        /* Try the text-based stub; libFoo.dylib is stubbed as libFoo.tbd, Foo.framework/Foo as Foo.framework/Foo.tbd */
+        std::string tbd = path;
+        if (tbd.size() > 6 && tbd.compare(tbd.size() - 6, 6, ".dylib") == 0)
+            tbd.resize(tbd.size() - 6);
+        tbd += ".tbd";
+        
+        if (is_file(tbd)) {
+            exports = std::make_shared<library_exports>();
+            if (!library_exports_load_tbd(tbd, *exports, error)) {
+                fprintf(stderr, "xpf-analyze: %s: %s\n", tbd.c_str(), error.c_str());
+                exports.reset();
+            }
+        }
+    }
+    
+    pthread_mutex_lock(&_lock);
+    auto result = _libraries.insert(std::make_pair(key, std::shared_ptr<const library_exports>(exports))).first->second;
+    pthread_mutex_unlock(&_lock);
+    
+    return result;
+}
+
+/**
+ * Search the re-exports of @a exports (recursively) for @a symbol.
+ */
+bool sdk_index::lookup_reexports (const library_exports &exports, const char *symbol, cpu_type_t cputype, std::set<std::string> &visited) {
+    if (visited.size() > XPF_SDK_MAX_REEXPORT_DEPTH)
+        return false;
+    
+    for (auto &&install_name : exports.reexports) {
+        if (!visited.insert(install_name).second)
+            continue;
+        
+        auto reexport = library(install_name, cputype);
+        if (reexport == nullptr)
+            continue;
+        
+        if (reexport->symbols.count(symbol) != 0 || lookup_reexports(*reexport, symbol, cputype, visited))
+            return true;
+    }
+    
+    return false;
+}
+
+/**
+ * Determine whether @a symbol is exported by the SDK library with @a install_name, or any library it re-exports.
+ *
+ * @param install_name The library's install name.
+ * @param symbol The symbol to look up.
+ * @param cputype The architecture of the importing image.
+ */
+sdk_lookup_result sdk_index::lookup (const std::string &install_name, const char *symbol, cpu_type_t cputype) {
+    if (install_name.empty() || install_name[0] != '/')
+        return SDK_LIBRARY_UNRESOLVED;
+    
+    auto exports = library(install_name, cputype);
+    if (exports == nullptr)
+        return SDK_LIBRARY_MISSING;
+    
+    if (exports->symbols.count(symbol) != 0)
+        return SDK_SYMBOL_FOUND;
+    
+    std::set<std::string> visited;
+    visited.insert(install_name);
+    if (lookup_reexports(*exports, symbol, cputype, visited))
+        return SDK_SYMBOL_FOUND;
+    
+    return SDK_SYMBOL_MISSING;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,106 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <mach-o/loader.h>
+
+#include <pthread.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace xpf {
+
+/**
+ * The set of symbols exported by a single library.
+ */
+struct library_exports {
+    /** All exported symbol names. */
+    std::unordered_set<std::string> symbols;
+    
+    /** Install names of all re-exported libraries. */
+    std::vector<std::string> reexports;
+};
+
+bool library_exports_load_macho (const std::string &path, cpu_type_t cputype, library_exports &exports, std::string &error);
+bool library_exports_load_tbd (const std::string &path, library_exports &exports, std::string &error);
+
+/**
+ * Result of an sdk_index lookup.
+ */
+enum sdk_lookup_result {
+    /** The symbol is exported by the library, or one of its re-exports. */
+    SDK_SYMBOL_FOUND = 0,
+    
+    /** The library was found, but does not export the symbol. */
+    SDK_SYMBOL_MISSING,
+    
+    /** The library was not found within the SDK. */
+    SDK_LIBRARY_MISSING,
+    
+    /** The install name can not be resolved against an SDK (eg, an @rpath-relative name). */
+    SDK_LIBRARY_UNRESOLVED
+};
+
+/**
+ * A lazily populated, thread-safe index of the symbols exported by libraries within an SDK (or any other root
+ * file system).
+ *
+ * Libraries are resolved by install name, preferring Mach-O images, and falling back on text-based (.tbd) stubs.
+ * Each library is loaded at most once per architecture.
+ */
+class sdk_index {
+public:
+    sdk_index (const std::string &root);
+    ~sdk_index ();
+    
+    sdk_index (const sdk_index &) = delete;
+    sdk_index &operator= (const sdk_index &) = delete;
+    
+    sdk_lookup_result lookup (const std::string &install_name, const char *symbol, cpu_type_t cputype);
+
+private:
+    std::shared_ptr<const library_exports> library (const std::string &install_name, cpu_type_t cputype);
+    bool lookup_reexports (const library_exports &exports, const char *symbol, cpu_type_t cputype, std::set<std::string> &visited);
+    
+    /** The SDK root path. */
+    std::string _root;
+    
+    /** Lock guarding _libraries. */
+    pthread_mutex_t _lock;
+    
+    /** Loaded libraries, keyed by architecture and install name; nullptr if the library was not found. */
+    std::map<std::pair<cpu_type_t, std::string>, std::shared_ptr<const library_exports>> _libraries;
+};
+
+} /* namespace xpf */
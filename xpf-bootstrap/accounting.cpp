@@ -0,0 +1,230 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "accounting.h"
+#include "page_snapshot.h"
+
+#include <malloc/malloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace xpf {
+
+/** Maximum number of images listed in the per-image section of the accounting report. */
+static constexpr size_t XPF_ACCOUNTING_MAX_IMAGES = 10;
+
+/** Per-phase totals */
+struct phase_totals {
+    /** Number of accounted scopes. */
+    std::atomic<uint64_t> scopes;
+    
+    /** Net heap growth across all scopes; may be negative. */
+    std::atomic<int64_t> net_bytes;
+    
+    /** Total growth of the heap high-water mark across all scopes. */
+    std::atomic<uint64_t> peak_bytes;
+    
+    /** Total pages faulted in. */
+    std::atomic<uint64_t> faulted;
+    
+    /** Total pages dirtied. */
+    std::atomic<uint64_t> dirtied;
+};
+
+/** Per-image page record */
+struct image_pages {
+    /** The image path. */
+    std::string path;
+    
+    /** Pages dirtied (or, if modification state is unavailable, faulted) per phase. */
+    uint64_t pages[ACCOUNTING_PHASE_COUNT];
+    
+    /** Total across all phases. */
+    uint64_t total;
+};
+
+/** Human-readable phase names, indexed by accounting_phase. */
+static const char *phase_names[ACCOUNTING_PHASE_COUNT] = {
+    "analyze",
+    "rewrite",
+    "rebind",
+    "info-dictionary"
+};
+
+static phase_totals totals[ACCOUNTING_PHASE_COUNT];
+
+/** Lock guarding image_records. */
+static pthread_mutex_t image_records_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<image_pages> *image_records = nullptr;
+
+/**
+ * Sample the process-wide heap usage.
+ */
+static void heap_usage (uint64_t *in_use, uint64_t *max_in_use) {
+    malloc_statistics_t stats;
+    malloc_zone_statistics(nullptr, &stats);
+    
+    *in_use = stats.size_in_use;
+    *max_in_use = stats.max_size_in_use;
+}
+
+/**
+ * Write the accounting report to stderr; registered with atexit().
+ */
+static void accounting_report_at_exit () {
+    accounting_report(stderr);
+}
+
+/**
+ * Return true if accounting is enabled (via XPF_ACCOUNTING). If enabled, the accounting report will be written
+ * to stderr at exit.
+ */
+bool accounting_enabled () {
+    static bool enabled = []() {
+        if (getenv("XPF_ACCOUNTING") == nullptr)
+            return false;
+        
+        atexit(accounting_report_at_exit);
+        return true;
+    }();
+    
+    return enabled;
+}
+
+/**
+ * Record the pages faulted in and dirtied by a single patch step.
+ *
+ * @param phase The phase in which the pages were touched.
+ * @param path The path of the affected image.
+ * @param faulted The number of pages newly made resident.
+ * @param dirtied The number of pages newly dirtied.
+ */
+void accounting_record_pages (accounting_phase phase, const char *path, uint64_t faulted, uint64_t dirtied) {
+    if (!accounting_enabled())
+        return;
+    
+    totals[phase].faulted += faulted;
+    totals[phase].dirtied += dirtied;
+    
+    /* Where modification state is unavailable, newly faulted pages are the best available approximation */
+    uint64_t pages = page_snapshot::dirty_state_supported() ? dirtied : faulted;
+    if (pages == 0)
+        return;
+    
+    pthread_mutex_lock(&image_records_lock);
+    
+    if (image_records == nullptr)
+        image_records = new std::vector<image_pages>();
+    
+    auto record = std::find_if(image_records->begin(), image_records->end(), [&](const image_pages &r) {
+        return r.path == path;
+    });
+    
+    if (record == image_records->end()) {
+        image_records->push_back(image_pages { path, {}, 0 });
+        record = image_records->end() - 1;
+    }
+    
+    record->pages[phase] += pages;
+    record->total += pages;
+    
+    pthread_mutex_unlock(&image_records_lock);
+}
+
+/**
+ * Write a compact accounting report to @a output. This may be called at any time (eg, from a debugger,
+ * via xpf_accounting_report()).
+ */
+void accounting_report (FILE *output) {
+    const char *unit = page_snapshot::dirty_state_supported() ? "dirtied" : "faulted";
+    
+    fprintf(output, "[xpf-bootstrap] accounting: %-16s %8s %12s %12s %10s %10s\n", "phase", "scopes", "net-bytes", "peak-bytes", "faulted", "dirtied");
+    for (size_t i = 0; i < ACCOUNTING_PHASE_COUNT; i++) {
+        const phase_totals &t = totals[i];
+        fprintf(output, "[xpf-bootstrap] accounting: %-16s %8llu %12lld %12llu %10llu %10llu\n", phase_names[i],
+            (unsigned long long) t.scopes, (long long) t.net_bytes, (unsigned long long) t.peak_bytes,
+            (unsigned long long) t.faulted, (unsigned long long) t.dirtied);
+    }
+    
+    /* Copy the image records; we must not hold the lock while writing to output */
+    std::vector<image_pages> sorted;
+    pthread_mutex_lock(&image_records_lock);
+    if (image_records != nullptr)
+        sorted = *image_records;
+    pthread_mutex_unlock(&image_records_lock);
+    
+    if (sorted.empty())
+        return;
+    
+    std::sort(sorted.begin(), sorted.end(), [](const image_pages &a, const image_pages &b) {
+        return a.total > b.total;
+    });
+    
+    fprintf(output, "[xpf-bootstrap] accounting: pages %s by image (top %zu of %zu):\n", unit, std::min(sorted.size(), XPF_ACCOUNTING_MAX_IMAGES), sorted.size());
+    for (size_t i = 0; i < sorted.size() && i < XPF_ACCOUNTING_MAX_IMAGES; i++) {
+        const image_pages &r = sorted[i];
+        fprintf(output, "[xpf-bootstrap] accounting: %6llu (rewrite %llu, rebind %llu) %s\n", (unsigned long long) r.total,
+            (unsigned long long) r.pages[ACCOUNTING_PHASE_REWRITE], (unsigned long long) r.pages[ACCOUNTING_PHASE_REBIND], r.path.c_str());
+    }
+}
+
+/**
+ * Begin accounting heap growth to @a phase.
+ */
+accounting_scope::accounting_scope (accounting_phase phase) : _phase(phase), _enabled(accounting_enabled()), _in_use(0), _max_in_use(0) {
+    if (_enabled)
+        heap_usage(&_in_use, &_max_in_use);
+}
+
+accounting_scope::~accounting_scope () {
+    if (!_enabled)
+        return;
+    
+    uint64_t in_use, max_in_use;
+    heap_usage(&in_use, &max_in_use);
+    
+    phase_totals &t = totals[_phase];
+    t.scopes++;
+    t.net_bytes += (int64_t) (in_use - _in_use);
+    t.peak_bytes += max_in_use - _max_in_use;
+}
+
+} /* namespace xpf */
+
+/**
+ * Write the accounting report to stderr; intended to be called on demand from a debugger.
+ */
+extern "C" void xpf_accounting_report (void) {
+    xpf::accounting_report(stderr);
+}
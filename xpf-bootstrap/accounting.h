@@ -0,0 +1,88 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace xpf {
+
+/**
+ * Accounted bootstrap phases.
+ */
+enum accounting_phase {
+    /** Bind opcode evaluation of newly loaded images. */
+    ACCOUNTING_PHASE_ANALYZE = 0,
+    
+    /** Bind opcode rewriting within __LINKEDIT. */
+    ACCOUNTING_PHASE_REWRITE,
+    
+    /** Rebind table evaluation and application within __DATA. */
+    ACCOUNTING_PHASE_REBIND,
+    
+    /** CFBundle info dictionary patching. */
+    ACCOUNTING_PHASE_INFO_DICTIONARY,
+    
+    /** Number of defined phases. */
+    ACCOUNTING_PHASE_COUNT
+};
+
+bool accounting_enabled ();
+void accounting_record_pages (accounting_phase phase, const char *path, uint64_t faulted, uint64_t dirtied);
+void accounting_report (FILE *output);
+
+/**
+ * Accounts all heap growth between construction and destruction to a phase. If accounting is disabled, no
+ * work is performed.
+ *
+ * Heap usage is sampled process-wide, and allocations made by other threads during the scope are included.
+ */
+class accounting_scope {
+public:
+    accounting_scope (accounting_phase phase);
+    ~accounting_scope ();
+    
+    accounting_scope (const accounting_scope &) = delete;
+    accounting_scope &operator= (const accounting_scope &) = delete;
+
+private:
+    /** The accounted phase */
+    accounting_phase _phase;
+    
+    /** If false, accounting is disabled. */
+    bool _enabled;
+    
+    /** Heap bytes in use at construction. */
+    uint64_t _in_use;
+    
+    /** Heap high-water mark at construction. */
+    uint64_t _max_in_use;
+};
+
+} /* namespace xpf */
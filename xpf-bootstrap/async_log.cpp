@@ -0,0 +1,407 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "async_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+
+namespace xpf {
+
+/** Number of ring buffer slots; must be a power of two. */
+static constexpr size_t XPF_LOG_SLOT_COUNT = 1024;
+
+/** Maximum length of a single formatted message, including its trailing newline; longer messages are truncated. */
+static constexpr size_t XPF_LOG_SLOT_SIZE = 512;
+
+/** Default maximum log file size before rotation, if XPF_LOG_FILE_SIZE is not set. */
+static constexpr size_t XPF_LOG_DEFAULT_FILE_SIZE = 4 * 1024 * 1024;
+
+/** Maximum time spent flushing pending messages on abort(), in nanoseconds. */
+static constexpr uint64_t XPF_LOG_ABORT_FLUSH_NS = 100 * NSEC_PER_MSEC;
+
+/** Maximum time spent flushing pending messages at exit, in nanoseconds. */
+static constexpr uint64_t XPF_LOG_EXIT_FLUSH_NS = 1 * NSEC_PER_SEC;
+
+/**
+ * A single ring buffer slot.
+ */
+struct async_log_slot {
+    /**
+     * The slot's sequence number. A slot is free for the producer claiming position `pos` when equal to `pos`,
+     * and contains a complete message for the consumer at position `pos` when equal to `pos + 1`.
+     */
+    std::atomic<size_t> seq;
+    
+    /** The message length. */
+    size_t length;
+    
+    /** The formatted message. */
+    char text[XPF_LOG_SLOT_SIZE];
+};
+
+/** The ring buffer. */
+static async_log_slot log_slots[XPF_LOG_SLOT_COUNT];
+
+/** The next position to be claimed by a producer. */
+static std::atomic<size_t> log_tail(0);
+
+/** The next position to be consumed; only accessed while holding log_consumer. */
+static size_t log_head = 0;
+
+/** Held by the single active consumer. */
+static std::atomic_flag log_consumer = ATOMIC_FLAG_INIT;
+
+/** Number of messages dropped because the ring buffer was full. */
+static std::atomic<uint64_t> log_dropped(0);
+
+/** If true, messages are enqueued for the flusher thread; otherwise, they are written synchronously. */
+static std::atomic<bool> log_async(false);
+
+/** Signaled by producers to wake the flusher thread. */
+static semaphore_t log_semaphore;
+
+/** The output file descriptor. */
+static int log_fd = STDERR_FILENO;
+
+/** The output path, if writing to a rotating log file, or nullptr if writing to stderr. */
+static const char *log_path = nullptr;
+
+/** Maximum log file size before rotation. */
+static size_t log_file_limit = XPF_LOG_DEFAULT_FILE_SIZE;
+
+/** Consumer output batch; messages are coalesced here to amortize write(2) calls. */
+static char log_batch[16 * 1024];
+
+/** Number of bytes pending in log_batch. */
+static size_t log_batch_used = 0;
+
+/**
+ * Write @a len bytes to @a fd, retrying on partial writes.
+ */
+static void log_write_fd (int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, p, len);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return;
+        
+        p += written;
+        len -= written;
+    }
+}
+
+/**
+ * Rotate the log file if writing @a pending additional bytes would exceed log_file_limit. Must only be called by
+ * the consumer.
+ *
+ * Any number of processes may share a single log file. The file's current size is used, rather than the number of
+ * bytes written by this process, and rotation is serialized via an flock(2) of the current file; a process that
+ * finds the file has already been rotated by another process reopens the new file, rather than rotating it again.
+ */
+static void log_rotate (size_t pending) {
+    struct stat current;
+    if (fstat(log_fd, &current) != 0 || current.st_size == 0 || (size_t) current.st_size + pending <= log_file_limit)
+        return;
+    
+    char rotated[PATH_MAX];
+    if (snprintf(rotated, sizeof(rotated), "%s.1", log_path) >= (int) sizeof(rotated))
+        return;
+    
+    flock(log_fd, LOCK_EX);
+    
+    struct stat named;
+    if (stat(log_path, &named) == 0 && named.st_dev == current.st_dev && named.st_ino == current.st_ino)
+        rename(log_path, rotated);
+    
+    /* The new file may already have been created (and written to) by another process */
+    int fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    flock(log_fd, LOCK_UN);
+    
+    if (fd >= 0) {
+        close(log_fd);
+        log_fd = fd;
+    }
+}
+
+/**
+ * Write all batched output, rotating the log file if required. Must only be called by the consumer.
+ */
+static void log_output_flush () {
+    if (log_batch_used == 0)
+        return;
+    
+    if (log_path != nullptr)
+        log_rotate(log_batch_used);
+    
+    log_write_fd(log_fd, log_batch, log_batch_used);
+    log_batch_used = 0;
+}
+
+/**
+ * Append a message to the output batch. Must only be called by the consumer.
+ */
+static void log_output (const char *text, size_t len) {
+    if (len > sizeof(log_batch) - log_batch_used)
+        log_output_flush();
+    
+    memcpy(log_batch + log_batch_used, text, len);
+    log_batch_used += len;
+}
+
+/**
+ * Format a message into @a buffer, ensuring that the (possibly truncated) result is newline-terminated.
+ *
+ * @return Returns the formatted length.
+ */
+static size_t log_format (char *buffer, size_t size, const char *fmt, va_list ap) {
+    int len = vsnprintf(buffer, size, fmt, ap);
+    if (len < 0)
+        return 0;
+    
+    if ((size_t) len >= size) {
+        len = (int) size - 1;
+        buffer[len - 1] = '\n';
+    }
+    
+    return (size_t) len;
+}
+
+/**
+ * Consume and write all complete messages, giving up after @a deadline (in mach_absolute_time() units) if another
+ * consumer holds the ring buffer.
+ *
+ * @return Returns true if the ring buffer was drained, or false if the deadline passed first.
+ */
+static bool log_drain (uint64_t deadline) {
+    while (log_consumer.test_and_set(std::memory_order_acquire)) {
+        if (mach_absolute_time() >= deadline)
+            return false;
+        sched_yield();
+    }
+    
+    uint64_t dropped = log_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        char notice[128];
+        int len = snprintf(notice, sizeof(notice), "[XcodePostFacto] %llu log messages dropped\n", (unsigned long long) dropped);
+        log_output(notice, (size_t) len);
+    }
+    
+    bool drained = true;
+    while (true) {
+        async_log_slot &slot = log_slots[log_head & (XPF_LOG_SLOT_COUNT - 1)];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != log_head + 1) {
+            /* Either empty, or a producer is still formatting into the slot. */
+            drained = (log_tail.load(std::memory_order_relaxed) == log_head);
+            if (drained || mach_absolute_time() >= deadline)
+                break;
+            
+            sched_yield();
+            continue;
+        }
+        
+        log_output(slot.text, slot.length);
+        slot.seq.store(log_head + XPF_LOG_SLOT_COUNT, std::memory_order_release);
+        log_head++;
+    }
+    
+    log_output_flush();
+    log_consumer.clear(std::memory_order_release);
+    return drained;
+}
+
+/**
+ * Return the mach_absolute_time() deadline @a timeout_ns nanoseconds from now.
+ */
+static uint64_t log_deadline (uint64_t timeout_ns) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return mach_absolute_time() + timeout_ns * timebase.denom / timebase.numer;
+}
+
+/**
+ * Background flusher thread.
+ */
+static void *log_flusher (void *) {
+    while (true) {
+        semaphore_wait(log_semaphore);
+        log_drain(UINT64_MAX);
+    }
+    
+    return nullptr;
+}
+
+/**
+ * Exit handler; flushes all pending messages.
+ */
+static void log_exit_flush () {
+    async_log_flush(XPF_LOG_EXIT_FLUSH_NS);
+}
+
+/**
+ * SIGABRT handler; performs a bounded flush of all pending messages (eg, those logged by PMFatal()), and then
+ * re-raises the signal with its default disposition.
+ */
+static void log_abort_handler (int sig) {
+    async_log_flush(XPF_LOG_ABORT_FLUSH_NS);
+    
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/**
+ * Enable asynchronous logging, unless XPF_LOG_SYNC is set. Messages are written to stderr, or to the rotating
+ * log file named by XPF_LOG_FILE (limited to XPF_LOG_FILE_SIZE bytes, with a single `.1` backup); the log file
+ * may be shared by concurrent processes.
+ *
+ * This must be called once, prior to main(); messages logged before initialization are written synchronously.
+ */
+void async_log_init () {
+    if (getenv("XPF_LOG_SYNC") != nullptr)
+        return;
+    
+    const char *path = getenv("XPF_LOG_FILE");
+    if (path != nullptr && *path != '\0') {
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            PMLog("Failed to open log file %s: %s", path, strerror(errno));
+        } else {
+            log_fd = fd;
+            log_path = path;
+            
+            const char *limit = getenv("XPF_LOG_FILE_SIZE");
+            if (limit != nullptr && strtoull(limit, nullptr, 10) > 0)
+                log_file_limit = (size_t) strtoull(limit, nullptr, 10);
+        }
+    }
+    
+    for (size_t i = 0; i < XPF_LOG_SLOT_COUNT; i++)
+        log_slots[i].seq.store(i, std::memory_order_relaxed);
+    
+    if (semaphore_create(mach_task_self(), &log_semaphore, SYNC_POLICY_FIFO, 0) != KERN_SUCCESS) {
+        PMLog("Failed to create log semaphore; logging synchronously");
+        return;
+    }
+    
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, log_flusher, nullptr) != 0) {
+        PMLog("Failed to start log flusher; logging synchronously");
+        return;
+    }
+    pthread_detach(thread);
+    
+    atexit(log_exit_flush);
+    
+    struct sigaction previous;
+    if (sigaction(SIGABRT, nullptr, &previous) == 0 && previous.sa_handler == SIG_DFL) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = log_abort_handler;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGABRT, &action, nullptr);
+    }
+    
+    log_async.store(true, std::memory_order_release);
+}
+
+/**
+ * Log a message. Once asynchronous logging is enabled, the message is formatted into the ring buffer and written
+ * by the flusher thread; if the ring buffer is full, the message is dropped and counted. The caller never blocks
+ * on I/O.
+ *
+ * @param fmt A printf-style format string; the caller is responsible for supplying any trailing newline.
+ */
+void async_log_write (const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    
+    if (!log_async.load(std::memory_order_acquire)) {
+        char buffer[XPF_LOG_SLOT_SIZE];
+        size_t len = log_format(buffer, sizeof(buffer), fmt, ap);
+        va_end(ap);
+        
+        log_write_fd(STDERR_FILENO, buffer, len);
+        return;
+    }
+    
+    /* Claim a slot */
+    size_t pos = log_tail.load(std::memory_order_relaxed);
+    async_log_slot *slot;
+    while (true) {
+        slot = &log_slots[pos & (XPF_LOG_SLOT_COUNT - 1)];
+        intptr_t diff = (intptr_t) slot->seq.load(std::memory_order_acquire) - (intptr_t) pos;
+        if (diff == 0) {
+            if (log_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            /* Full */
+            va_end(ap);
+            log_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = log_tail.load(std::memory_order_relaxed);
+        }
+    }
+    
+    /* Format the message in place, and publish it */
+    slot->length = log_format(slot->text, sizeof(slot->text), fmt, ap);
+    va_end(ap);
+    
+    slot->seq.store(pos + 1, std::memory_order_release);
+    semaphore_signal(log_semaphore);
+}
+
+/**
+ * Write all pending messages, waiting at most @a timeout_ns nanoseconds.
+ *
+ * @return Returns true if all pending messages were written.
+ */
+bool async_log_flush (uint64_t timeout_ns) {
+    if (!log_async.load(std::memory_order_acquire))
+        return true;
+    
+    return log_drain(log_deadline(timeout_ns));
+}
+
+} /* namespace xpf */
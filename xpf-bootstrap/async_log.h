@@ -0,0 +1,107 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <PLPatchMaster/PMLog.h>
+#include "XPFLog.h"
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace xpf {
+
+void async_log_init ();
+void async_log_write (const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+bool async_log_flush (uint64_t timeout_ns);
+
+/** Result of a rate-limited log call site check; see async_log_admit() */
+enum async_log_admission {
+    /** The message should be logged */
+    ASYNC_LOG_ADMIT,
+    
+    /** The message should be logged, and all further occurrences will be suppressed */
+    ASYNC_LOG_ADMIT_LAST,
+    
+    /** The message should be suppressed */
+    ASYNC_LOG_SUPPRESS
+};
+
+/**
+ * Determine whether a rate-limited call site may log another message.
+ *
+ * @param count The call site's occurrence count.
+ * @param limit The maximum number of messages to be logged by the call site.
+ */
+static inline async_log_admission async_log_admit (std::atomic<uint32_t> &count, uint32_t limit) {
+    if (count.load(std::memory_order_relaxed) >= limit)
+        return ASYNC_LOG_SUPPRESS;
+    
+    uint32_t n = count.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (n < limit)
+        return ASYNC_LOG_ADMIT;
+    else if (n == limit)
+        return ASYNC_LOG_ADMIT_LAST;
+    else
+        return ASYNC_LOG_SUPPRESS;
+}
+
+} /* namespace xpf */
+
+/*
+ * Route PMLog(), PMDebug(), PMFatal() and XPFLog() through the asynchronous backend; prior to async_log_init(),
+ * messages are written synchronously.
+ */
+#undef PMDoLog
+#define PMDoLog(_prefix, fmt, ...) do { \
+    ::xpf::async_log_write(_prefix fmt "\n", ## __VA_ARGS__); \
+} while(0)
+
+#undef XPFLog
+#ifdef __OBJC__
+#define XPFLog(fmt, ...) ::xpf::async_log_write("[XcodePostFacto] %s\n", [[NSString stringWithFormat: fmt, ##__VA_ARGS__] UTF8String])
+#else
+#define XPFLog(fmt, ...) ::xpf::async_log_write("[XcodePostFacto] " fmt "\n", ##__VA_ARGS__)
+#endif
+
+/**
+ * Log a message via XPFLog() at most @a _limit times from this call site; the final message is followed by a
+ * notice that further occurrences will be suppressed.
+ */
+#define XPFLogLimit(_limit, fmt, ...) do { \
+    static std::atomic<uint32_t> _xpf_log_count(0); \
+    ::xpf::async_log_admission _xpf_admit = ::xpf::async_log_admit(_xpf_log_count, _limit); \
+    if (_xpf_admit != ::xpf::ASYNC_LOG_SUPPRESS) \
+        XPFLog(fmt, ##__VA_ARGS__); \
+    if (_xpf_admit == ::xpf::ASYNC_LOG_ADMIT_LAST && (_limit) > 1) \
+        XPFLog("Further occurrences of the above message will be suppressed."); \
+} while(0)
+
+/** Log a message via XPFLog() only once from this call site. */
+#define XPFLogOnce(fmt, ...) XPFLogLimit(1, fmt, ##__VA_ARGS__)
@@ -0,0 +1,309 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bind_plan_cache.h"
+
+#include "async_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace xpf {
+
+/** Plan file magic ('XPFP') */
+static constexpr uint32_t XPF_BIND_PLAN_MAGIC = 0x58504650;
+
+/** Plan file format version; this must be incremented if the file format or the plan semantics change. */
+static constexpr uint32_t XPF_BIND_PLAN_VERSION = 4;
+
+/**
+ * On-disk plan file header. The header is immediately followed by the weak rewrite
+ * records, followed by the rebind site records.
+ */
+struct bind_plan_file_header {
+    /** XPF_BIND_PLAN_MAGIC */
+    uint32_t magic;
+    
+    /** XPF_BIND_PLAN_VERSION */
+    uint32_t version;
+    
+    /** The image's LC_UUID */
+    uint8_t uuid[16];
+    
+    /** The image's segment layout fingerprint. */
+    uint32_t layout_hash;
+    
+    /** The rule table hash. */
+    uint32_t rules_hash;
+    
+    /** The FNV-1a checksum of all record data following the header. */
+    uint32_t checksum;
+    
+    uint32_t reserved;
+    
+    /** Number of bind_plan_weak_rewrite records. */
+    uint64_t weak_rewrite_count;
+    
+    /** Number of bind_plan_rebind_site records. */
+    uint64_t rebind_site_count;
+};
+
+/**
+ * Compute the 32-bit FNV-1a checksum of @a len bytes at @a data.
+ */
+static uint32_t plan_checksum (const void *data, size_t len, uint32_t h = 2166136261U) {
+    auto p = (const uint8_t *) data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+mapped_bind_plan::~mapped_bind_plan () {
+    if (_mapping != nullptr)
+        munmap(_mapping, _mapping_size);
+}
+
+/**
+ * Replace this plan's contents with @a plan, releasing any existing file mapping.
+ */
+void mapped_bind_plan::adopt (bind_plan &&plan) {
+    if (_mapping != nullptr)
+        munmap(_mapping, _mapping_size);
+    
+    _mapping = nullptr;
+    _mapping_size = 0;
+    _adopted = std::move(plan);
+    
+    _weak_rewrites = _adopted.weak_rewrites.data();
+    _weak_rewrite_count = _adopted.weak_rewrites.size();
+    _rebind_sites = _adopted.rebind_sites.data();
+    _rebind_site_count = _adopted.rebind_sites.size();
+}
+
+/**
+ * Construct a new cache instance.
+ *
+ * @param directory The directory in which plan files will be stored. The directory will be created on demand.
+ * @param rules_hash The hash of the rule tables used to compute plans; plans computed for any other rule tables
+ * will be ignored.
+ */
+bind_plan_cache::bind_plan_cache (const std::string &directory, uint32_t rules_hash) : _directory(directory), _rules_hash(rules_hash) {}
+
+/**
+ * Return a new cache instance using the per-user Darwin cache directory, or nullptr if caching is disabled
+ * (via the XPF_DISABLE_BIND_CACHE environment variable) or the cache directory is unavailable.
+ *
+ * @param rules_hash The hash of the rule tables used to compute plans.
+ */
+bind_plan_cache *bind_plan_cache::CreateDefault (uint32_t rules_hash) {
+    if (getenv("XPF_DISABLE_BIND_CACHE") != nullptr)
+        return nullptr;
+    
+    char path[PATH_MAX];
+    size_t len = confstr(_CS_DARWIN_USER_CACHE_DIR, path, sizeof(path));
+    if (len == 0 || len > sizeof(path))
+        return nullptr;
+
+    return new bind_plan_cache(std::string(path) + "org.landonf.xpf-bootstrap", rules_hash);
+}
+
+/**
+ * Return the plan file path for @a key.
+ */
+std::string bind_plan_cache::plan_path (const bind_plan_key &key) const {
+    const uint8_t *uuid = key.uuid;
+    char name[80];
+    snprintf(name, sizeof(name), "/%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X-%08X-%08X.plan",
+             uuid[0], uuid[1], uuid[2], uuid[3], uuid[4], uuid[5], uuid[6], uuid[7],
+             uuid[8], uuid[9], uuid[10], uuid[11], uuid[12], uuid[13], uuid[14], uuid[15], key.layout_hash, _rules_hash);
+    return _directory + name;
+}
+
+/**
+ * Map and validate the cached plan for @a key.
+ *
+ * @param key The image's LC_UUID and segment layout fingerprint.
+ * @param plan On success, will be initialized with the mapped plan.
+ *
+ * @return Returns true on success, or false if no valid plan is available for the image's layout.
+ */
+bool bind_plan_cache::load (const bind_plan_key &key, mapped_bind_plan &plan) const {
+    std::string path = plan_path(key);
+    
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t) sb.st_size < sizeof(bind_plan_file_header)) {
+        close(fd);
+        return false;
+    }
+    
+    size_t size = (size_t) sb.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    
+    /* Validate the header */
+    auto hdr = (const bind_plan_file_header *) mapping;
+    auto invalid = [&](const char *reason) {
+        PMLog("Ignoring invalid bind plan %s: %s", path.c_str(), reason);
+        munmap(mapping, size);
+        return false;
+    };
+    
+    if (hdr->magic != XPF_BIND_PLAN_MAGIC || hdr->version != XPF_BIND_PLAN_VERSION) {
+        /* Stale format; not an error */
+        munmap(mapping, size);
+        return false;
+    }
+    
+    if (memcmp(hdr->uuid, key.uuid, sizeof(hdr->uuid)) != 0 || hdr->layout_hash != key.layout_hash || hdr->rules_hash != _rules_hash)
+        return invalid("UUID, layout, or rules hash mismatch");
+    
+    size_t payload_size = size - sizeof(*hdr);
+    if (hdr->weak_rewrite_count > payload_size / sizeof(bind_plan_weak_rewrite))
+        return invalid("truncated weak rewrite records");
+    
+    size_t weak_size = hdr->weak_rewrite_count * sizeof(bind_plan_weak_rewrite);
+    if (hdr->rebind_site_count != (payload_size - weak_size) / sizeof(bind_plan_rebind_site) ||
+        (payload_size - weak_size) % sizeof(bind_plan_rebind_site) != 0)
+    {
+        return invalid("incorrect rebind site record count");
+    }
+    
+    const uint8_t *payload = (const uint8_t *) (hdr + 1);
+    if (plan_checksum(payload, payload_size) != hdr->checksum)
+        return invalid("checksum mismatch");
+    
+    /* Hand the mapping off to the caller */
+    if (plan._mapping != nullptr)
+        munmap(plan._mapping, plan._mapping_size);
+    
+    plan._adopted = bind_plan();
+    plan._mapping = mapping;
+    plan._mapping_size = size;
+    plan._weak_rewrites = (const bind_plan_weak_rewrite *) payload;
+    plan._weak_rewrite_count = (size_t) hdr->weak_rewrite_count;
+    plan._rebind_sites = (const bind_plan_rebind_site *) (payload + weak_size);
+    plan._rebind_site_count = (size_t) hdr->rebind_site_count;
+    
+    return true;
+}
+
+/**
+ * Atomically write @a plan to the cache.
+ *
+ * @param key The LC_UUID and segment layout fingerprint of the image against which @a plan was computed.
+ * @param plan The plan to be written.
+ *
+ * @return Returns true on success, or false if the plan could not be written.
+ */
+bool bind_plan_cache::store (const bind_plan_key &key, const bind_plan &plan) const {
+    /* Create the cache directory, if necessary */
+    if (mkdir(_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        PMLog("Could not create bind plan cache directory %s: %s", _directory.c_str(), strerror(errno));
+        return false;
+    }
+    
+    /* Populate the header */
+    size_t weak_size = plan.weak_rewrites.size() * sizeof(bind_plan_weak_rewrite);
+    size_t rebind_size = plan.rebind_sites.size() * sizeof(bind_plan_rebind_site);
+
+    bind_plan_file_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = XPF_BIND_PLAN_MAGIC;
+    hdr.version = XPF_BIND_PLAN_VERSION;
+    memcpy(hdr.uuid, key.uuid, sizeof(hdr.uuid));
+    hdr.layout_hash = key.layout_hash;
+    hdr.rules_hash = _rules_hash;
+    hdr.weak_rewrite_count = plan.weak_rewrites.size();
+    hdr.rebind_site_count = plan.rebind_sites.size();
+    hdr.checksum = plan_checksum(plan.weak_rewrites.data(), weak_size);
+    hdr.checksum = plan_checksum(plan.rebind_sites.data(), rebind_size, hdr.checksum);
+    
+    /* Write to a temporary file, and then move the completed file into place */
+    std::string path = plan_path(key);
+    std::string tmp_path = path + ".XXXXXX";
+    
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd < 0) {
+        PMLog("Could not create bind plan %s: %s", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    
+    struct {
+        const void *base;
+        size_t len;
+    } segments[] = {
+        { &hdr, sizeof(hdr) },
+        { plan.weak_rewrites.data(), weak_size },
+        { plan.rebind_sites.data(), rebind_size }
+    };
+    
+    for (auto &&v : segments) {
+        const uint8_t *p = (const uint8_t *) v.base;
+        size_t remaining = v.len;
+        while (remaining > 0) {
+            ssize_t written = write(fd, p, remaining);
+            if (written < 0 && errno == EINTR)
+                continue;
+            
+            if (written <= 0) {
+                PMLog("Could not write bind plan %s: %s", tmp_path.c_str(), strerror(errno));
+                close(fd);
+                unlink(tmp_path.c_str());
+                return false;
+            }
+            
+            p += written;
+            remaining -= written;
+        }
+    }
+    
+    if (close(fd) != 0 || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        PMLog("Could not finalize bind plan %s: %s", path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,160 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+namespace xpf {
+
+/**
+ * A single recorded LINKEDIT rewrite of a BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM opcode.
+ */
+struct bind_plan_weak_rewrite {
+    /** Offset of the opcode byte, relative to the image's mach header. */
+    uint64_t offset;
+    
+    /** The replacement opcode byte. */
+    uint8_t opcode;
+    
+    uint8_t reserved[7];
+};
+
+/**
+ * A single recorded rebind site.
+ */
+struct bind_plan_rebind_site {
+    /** Offset of the bound pointer, relative to the image's mach header. */
+    uint64_t offset;
+    
+    /** Index of the matching entry within the XPF rebind table. */
+    uint32_t rule;
+    
+    uint32_t reserved;
+};
+
+/**
+ * The pre-computed results of evaluating an image's bind opcodes against the bootstrap's weak
+ * symbol and rebind tables.
+ */
+struct bind_plan {
+    /** LINKEDIT opcode rewrites, in evaluation order. */
+    std::vector<bind_plan_weak_rewrite> weak_rewrites;
+    
+    /** Rebind sites, in evaluation order. */
+    std::vector<bind_plan_rebind_site> rebind_sites;
+};
+
+/**
+ * A read-only bind plan, either memory-mapped from a bind_plan_cache, or adopted from a newly computed bind_plan.
+ */
+class mapped_bind_plan {
+public:
+    mapped_bind_plan () : _mapping(nullptr), _mapping_size(0), _weak_rewrites(nullptr), _weak_rewrite_count(0), _rebind_sites(nullptr), _rebind_site_count(0) {}
+    ~mapped_bind_plan ();
+    
+    mapped_bind_plan (const mapped_bind_plan &) = delete;
+    mapped_bind_plan &operator= (const mapped_bind_plan &) = delete;
+    
+    void adopt (bind_plan &&plan);
+    
+    /** Return the plan's weak rewrites. */
+    const bind_plan_weak_rewrite *weak_rewrites () const { return _weak_rewrites; }
+    
+    /** Return the number of weak rewrites. */
+    size_t weak_rewrite_count () const { return _weak_rewrite_count; }
+    
+    /** Return the plan's rebind sites. */
+    const bind_plan_rebind_site *rebind_sites () const { return _rebind_sites; }
+    
+    /** Return the number of rebind sites. */
+    size_t rebind_site_count () const { return _rebind_site_count; }
+
+private:
+    friend class bind_plan_cache;
+    
+    /** The backing file mapping, or nullptr if unmapped. */
+    void *_mapping;
+    
+    /** The size of the backing file mapping. */
+    size_t _mapping_size;
+    
+    /** The adopted plan, if not backed by a file mapping. */
+    bind_plan _adopted;
+    
+    /** Weak rewrites, borrowed from the backing mapping. */
+    const bind_plan_weak_rewrite *_weak_rewrites;
+    size_t _weak_rewrite_count;
+    
+    /** Rebind sites, borrowed from the backing mapping. */
+    const bind_plan_rebind_site *_rebind_sites;
+    size_t _rebind_site_count;
+};
+
+/**
+ * Identifies the image layout against which a bind plan was computed.
+ */
+struct bind_plan_key {
+    /** The image's LC_UUID. */
+    uint8_t uuid[16];
+    
+    /** The image's segment layout fingerprint; see macho_layout_hash(). */
+    uint32_t layout_hash;
+};
+
+/**
+ * A persistent on-disk cache of bind plans, keyed by image LC_UUID and segment layout, and the hash of the
+ * bootstrap's rule tables.
+ *
+ * Each plan is stored in its own versioned, checksummed file; any plan that fails validation
+ * is ignored, and the caller is expected to fall back to full bind opcode evaluation.
+ */
+class bind_plan_cache {
+public:
+    bind_plan_cache (const std::string &directory, uint32_t rules_hash);
+    
+    static bind_plan_cache *CreateDefault (uint32_t rules_hash);
+    
+    bool load (const bind_plan_key &key, mapped_bind_plan &plan) const;
+    bool store (const bind_plan_key &key, const bind_plan &plan) const;
+    
+private:
+    std::string plan_path (const bind_plan_key &key) const;
+    
+    /** The cache directory. */
+    const std::string _directory;
+    
+    /** The hash of the rule tables used to compute all cached plans. */
+    const uint32_t _rules_hash;
+};
+
+} /* namespace xpf */
@@ -0,0 +1,307 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bind_rewrite.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <mach/mach_time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "accounting.h"
+#include "macho_util.h"
+#include "page_snapshot.h"
+#include "weak_table.h"
+
+using namespace patchmaster;
+
+namespace xpf {
+
+/**
+ * Evaluate the bind instructions of a newly loaded image, detecting any symbols that must be marked as weak, and
+ * recording the required opcode rewrites -- along with all rebind table matches -- in @a plan.
+ *
+ * By default, every strong import is marked as weak. If bind_plan_rules::auto_weak_resolver is set, only imports
+ * listed in the weak rules, imports matching the rebind table, and imports not exported by their target library
+ * are marked as weak.
+ *
+ * If bind_plan_rules::rebind_prefilter is set, the image's bind opcode streams are first scanned for rebind table
+ * symbol names; the binds of images that can't reference a rebind table symbol are still evaluated for weakening, but
+ * are not looked up in the rebind table.
+ *
+ * This function performs no writes to the image, and may be called concurrently for distinct images.
+ *
+ * @param image The image to evaluate.
+ * @param rules The rule tables against which the image is evaluated.
+ * @param plan The plan to which all opcode rewrites and all rebind table matches will be appended.
+ */
+void bind_plan_image (const LocalImage &image, const bind_plan_rules &rules, bind_plan &plan) {
+    /* The image's in-memory base address; used to compute plan offsets */
+    const pl_segment_command_t *text = nullptr;
+    for (auto &&segment : *image.segments()) {
+        if (strcmp(segment->segname, SEG_TEXT) == 0)
+            text = segment;
+    }
+
+    if (text == nullptr) {
+        PMLog("Could not find the __TEXT segment; cannot rebind opcodes for %s", image.path().c_str());
+        return;
+    }
+    uintptr_t image_header = text->vmaddr + image.vmaddr_slide();
+    
+    /* Skip rebind table lookups entirely if the image can't reference a rebind table symbol */
+    const rebind_index *rebinds = rules.rebinds;
+    bind_prefilter_stats *stats = rules.prefilter_stats;
+    if (rebinds != nullptr && rules.rebind_prefilter != nullptr) {
+        uint64_t scan_start = mach_absolute_time();
+        if (!rules.rebind_prefilter->image_matches((const pl_mach_header_t *) image_header))
+            rebinds = nullptr;
+        
+        if (stats != nullptr) {
+            stats->scanned++;
+            stats->scan_time += mach_absolute_time() - scan_start;
+            if (rebinds == nullptr)
+                stats->skipped++;
+        }
+    }
+    
+    /* Rebind table lookups skipped via the prefilter; accumulated locally, as images are planned concurrently */
+    uint64_t lookups_skipped = 0;
+    
+    /* Iterate over all opcode streams in the image, looking for non-weak references to undefined symbols. */
+    for (auto &&opcodes : *image.bindOpcodes()) {
+        bind_opstream ops = opcodes;
+        
+        /* Points to the last instance of BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM (if any). */
+        const uint8_t *symbol_decl_pc = nullptr;
+        
+        /* Lazy binds need not be rewritten if we're preserving __LINKEDIT; see bind_plan_rules::preserve_linkedit. */
+        bool weaken = !(rules.preserve_linkedit && ops.isLazy());
+        
+        /* The symbol declaration most recently checked against its target library's exports, and the result; a
+         * single declaration may apply to any number of binds. */
+        const uint8_t *checked_decl_pc = nullptr;
+        bool checked_missing = false;
+        
+        /* Check for an undefined symbol */
+        auto check_def = [&](const bind_opstream::symbol_proc &sp) {
+            /* Record any rebind table matches */
+            bool rebound = false;
+            if (rebinds != nullptr) {
+                rebinds->lookup(sp.name(), [&](const struct xpf_rebind_entry &entry) {
+                    uint64_t offset = sp.bind_address() - image_header;
+                    plan.rebind_sites.push_back(bind_plan_rebind_site { offset, (uint32_t) rebinds->index_of(entry), 0 });
+                    rebound = true;
+                });
+            } else if (rules.rebinds != nullptr) {
+                lookups_skipped++;
+            }
+            
+            if (!weaken || (sp.flags() & BIND_SYMBOL_FLAGS_WEAK_IMPORT))
+                return;
+            
+            /* Unless missing imports are detected automatically, all strong imports are marked as weak */
+            bool found = (rules.auto_weak_resolver == nullptr) || rebound;
+            for (size_t i = 0; !found && i < rules.weak_rule_count; i++) {
+                if (strcmp(rules.weak_rules[i].symbol, sp.name().symbol()) != 0)
+                    continue;
+                
+                if (strcmp(rules.weak_rules[i].library, sp.name().image()) != 0)
+                    continue;
+                
+                found = true;
+            }
+
+            /* Otherwise, check whether the target library actually exports the symbol */
+            bool missing = false;
+            if (!found && *sp.name().image() != '\0') {
+                if (checked_decl_pc != symbol_decl_pc) {
+                    checked_decl_pc = symbol_decl_pc;
+                    checked_missing = (rules.auto_weak_resolver->lookup(sp.name().image(), sp.name().symbol()) == EXPORT_MISSING);
+                }
+                missing = checked_missing;
+            }
+            
+            /* Mark the symbol as weak */
+            if (found || missing) {
+                /* Record the symbol flag rewrite; a single SET_SYMBOL opcode may apply to any number of binds */
+                uint8_t opcode = BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM | sp.flags() | BIND_SYMBOL_FLAGS_WEAK_IMPORT;
+                uint64_t offset = (uintptr_t) symbol_decl_pc - image_header;
+                if (plan.weak_rewrites.empty() || plan.weak_rewrites.back().offset != offset) {
+                    plan.weak_rewrites.push_back(bind_plan_weak_rewrite { offset, opcode, {} });
+                    
+                    if (missing && rules.auto_weak_report != nullptr)
+                        rules.auto_weak_report(image.path() + ": " + sp.name().symbol() + " (" + sp.name().image() + ")");
+                }
+            }
+        };
+    
+        /* Step the VM, keeping track of symbol definition state so that we can rewrite
+         * any SET_SYMBOL opcodes that reference unknown symbols. */
+        const uint8_t *last_pc = ops.position();
+        uint8_t opcode = BIND_OPCODE_DONE;
+        while (!ops.isEmpty() && (opcode = ops.step(image, check_def)) != BIND_OPCODE_DONE) {
+            /* Save the opcode address */
+            if (opcode == BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM) {
+                symbol_decl_pc = last_pc;
+            }
+            
+            /* Update our PC state */
+            last_pc = ops.position();
+        }
+    }
+    
+    if (stats != nullptr && lookups_skipped > 0)
+        stats->lookups_skipped += lookups_skipped;
+}
+
+/**
+ * Apply a set of bind opcode rewrites to a loaded image's __LINKEDIT segment.
+ *
+ * @param path The image's path.
+ * @param header The image's mach header.
+ * @param rewrites The rewrites to be applied, as produced by bind_plan_image().
+ * @param count The number of rewrites.
+ * @param stats Statistics to be updated with the applied rewrites.
+ *
+ * @return Returns true on success, or false if the rewrites are not applicable to the image.
+ */
+bool bind_rewrite_apply (const char *path, const pl_mach_header_t *header, const bind_plan_weak_rewrite *rewrites, size_t count, bind_rewrite_stats &stats) {
+    /* Nothing to do? We can skip touching LINKEDIT entirely. */
+    if (count == 0)
+        return true;
+    
+    /* Find the LINKEDIT segment; we need this to be able to reset memory protections
+     * back to their original values. */
+    const pl_segment_command_t *linkedit = macho_find_segment(header, SEG_LINKEDIT);
+    if (linkedit == nullptr) {
+        PMLog("Could not find the __LINKEDIT segment; cannot rebind opcodes for %s", path);
+        return false;
+    }
+    
+    /* Validate all rewrites before performing any writes; every rewrite must target an existing
+     * SET_SYMBOL_TRAILING_FLAGS_IMM opcode within __LINKEDIT. */
+    intptr_t slide = macho_vmaddr_slide(header);
+    uintptr_t linkedit_start = linkedit->vmaddr + slide;
+    for (size_t i = 0; i < count; i++) {
+        uintptr_t address = (uintptr_t) header + rewrites[i].offset;
+        
+        if (address < linkedit_start || address - linkedit_start >= linkedit->vmsize)
+            return false;
+        
+        if ((*(const uint8_t *) address & BIND_OPCODE_MASK) != BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM)
+            return false;
+        
+        if ((rewrites[i].opcode & BIND_OPCODE_MASK) != BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM)
+            return false;
+    }
+    
+    /* Determine the pages that actually require modification, skipping any rewrites that are already in place. */
+    uintptr_t page_size = getpagesize();
+    std::vector<uintptr_t> pages;
+    for (size_t i = 0; i < count; i++) {
+        uintptr_t address = (uintptr_t) header + rewrites[i].offset;
+        if (*(const uint8_t *) address == rewrites[i].opcode) {
+            stats.unchanged++;
+            continue;
+        }
+        
+        pages.push_back(address & ~(page_size - 1));
+    }
+    
+    /* If nothing needs to be written, we can leave __LINKEDIT untouched */
+    if (pages.empty())
+        return true;
+    
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    
+    /* Coalesce adjacent pages into contiguous ranges. */
+    struct page_range {
+        uintptr_t start;
+        size_t length;
+    };
+    std::vector<page_range> ranges;
+    for (uintptr_t page : pages) {
+        if (!ranges.empty() && ranges.back().start + ranges.back().length == page)
+            ranges.back().length += page_size;
+        else
+            ranges.push_back(page_range { page, page_size });
+    }
+    
+    /* Capture the initial page state of the affected range, if accounting is enabled */
+    page_snapshot before;
+    bool accounting = accounting_enabled() && before.capture((const void *) pages.front(), pages.back() + page_size - pages.front());
+    
+    /* Mark only the affected LINKEDIT pages as writable */
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (mprotect((void *) ranges[i].start, ranges[i].length, linkedit->initprot|PROT_WRITE) == 0)
+            continue;
+        
+        PMLog("mprotect(__LINKEDIT, PROT_WRITE) failed; cannot rebind opcodes for %s: %s", path, strerror(errno));
+        
+        /* Restore any pages we've already modified */
+        for (size_t j = 0; j < i; j++)
+            mprotect((void *) ranges[j].start, ranges[j].length, linkedit->initprot);
+        
+        return false;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *opcode = (uint8_t *) header + rewrites[i].offset;
+        if (*opcode == rewrites[i].opcode)
+            continue;
+        
+        *opcode = rewrites[i].opcode;
+        stats.written++;
+    }
+    
+    /* Restore the LINKEDIT segment's initial protections. */
+    for (auto &&range : ranges) {
+        if (mprotect((void *) range.start, range.length, linkedit->initprot) != 0)
+            PMLog("mprotect(__LINKEDIT, initprot) failed; could not restore expected protections for %s: %s", path, strerror(errno));
+    }
+    
+    stats.images++;
+    stats.pages += pages.size();
+    
+    if (accounting) {
+        page_snapshot after;
+        if (after.capture((const void *) pages.front(), pages.back() + page_size - pages.front()))
+            accounting_record_pages(ACCOUNTING_PHASE_REWRITE, path, before.newly_resident(after), before.newly_dirtied(after));
+    }
+    
+    return true;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,120 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <string>
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+#include "bind_plan_cache.h"
+#include "export_index.h"
+#include "rebind_index.h"
+#include "symbol_prefilter.h"
+
+struct xpf_weak_entry;
+
+namespace xpf {
+
+/**
+ * Rebind prefilter statistics; see bind_plan_rules::rebind_prefilter.
+ */
+struct bind_prefilter_stats {
+    /** Number of images scanned by the prefilter. */
+    std::atomic<uint64_t> scanned;
+    
+    /** Number of images rejected by the prefilter. */
+    std::atomic<uint64_t> skipped;
+    
+    /** Number of rebind table lookups skipped within rejected images. */
+    std::atomic<uint64_t> lookups_skipped;
+    
+    /** Total time spent in the prefilter, in mach_absolute_time() units. */
+    std::atomic<uint64_t> scan_time;
+};
+
+/**
+ * The rule tables and configuration against which bind_plan_image() evaluates an image.
+ */
+struct bind_plan_rules {
+    /** Rebind table index, or nullptr if no rebind table is available. */
+    const rebind_index *rebinds;
+    
+    /** Imports to be marked as weak in XPF_AUTO_WEAK mode; all strong imports are otherwise weakened. */
+    const struct xpf_weak_entry *weak_rules;
+    
+    /** Number of entries in weak_rules. */
+    size_t weak_rule_count;
+    
+    /** If true, lazy bind opcodes are never rewritten; see XPF_PRESERVE_LINKEDIT. */
+    bool preserve_linkedit;
+    
+    /**
+     * If non-nullptr, only strong imports that are listed in weak_rules, match the rebind table, or are not exported by
+     * their target library are marked as weak; see XPF_AUTO_WEAK. Otherwise, all strong imports are marked as weak.
+     */
+    export_resolver *auto_weak_resolver;
+    
+    /** If non-nullptr, called with a description of each import weakened via auto_weak_resolver. */
+    void (*auto_weak_report)(const std::string &import);
+    
+    /**
+     * If non-nullptr, a prefilter over all rebind table symbol names. Images it rejects can't reference a rebind table
+     * symbol, and their binds are not looked up in the rebind table.
+     */
+    const symbol_prefilter *rebind_prefilter;
+    
+    /** If non-nullptr, updated with rebind_prefilter statistics. */
+    bind_prefilter_stats *prefilter_stats;
+};
+
+/**
+ * __LINKEDIT rewrite statistics.
+ */
+struct bind_rewrite_stats {
+    /** Number of images for which at least one rewrite was written. */
+    std::atomic<uint64_t> images;
+    
+    /** Number of opcode bytes written. */
+    std::atomic<uint64_t> written;
+    
+    /** Number of rewrites skipped, as the opcode already had the required value. */
+    std::atomic<uint64_t> unchanged;
+    
+    /** Number of pages made writable (and thus potentially dirtied). */
+    std::atomic<uint64_t> pages;
+};
+
+void bind_plan_image (const patchmaster::LocalImage &image, const bind_plan_rules &rules, bind_plan &plan);
+bool bind_rewrite_apply (const char *path, const patchmaster::pl_mach_header_t *header, const bind_plan_weak_rewrite *rewrites, size_t count, bind_rewrite_stats &stats);
+
+} /* namespace xpf */
@@ -0,0 +1,194 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <sched.h>
+
+#include <atomic>
+
+namespace xpf {
+
+/** Result of block_completion::wait() */
+enum block_completion_wait_result {
+    /** The block completed */
+    BLOCK_COMPLETION_COMPLETED,
+    
+    /** The timeout expired before the block completed */
+    BLOCK_COMPLETION_TIMED_OUT,
+    
+    /** Another thread is already waiting on the block */
+    BLOCK_COMPLETION_BUSY
+};
+
+/**
+ * The completion state of a dispatch_block_create() block: a lock-free stack of pending notifications, and the
+ * semaphore of a single blocked waiter.
+ *
+ * Completion atomically marks the block complete, wakes the waiter, and hands all pending notifications to the caller
+ * in registration order; notifications registered after completion are refused, and must be submitted immediately by
+ * the caller.
+ *
+ * The semaphore operations are supplied by @a Semaphore, allowing the completion protocol to be used with both
+ * dispatch semaphores and (for benchmarking on non-Darwin hosts) POSIX primitives. @a Semaphore must provide:
+ *
+ * - `type` and `timeout` typedefs
+ * - `static type create ()` and `static void release (type)`
+ * - `static void signal (type)`
+ * - `static bool wait (type, timeout)`, returning true if signaled before the timeout expires
+ * - `static void wait_forever (type)`
+ * - `static bool is_now (timeout)`, returning true if the timeout expires immediately
+ *
+ * @a Node must provide a `Node *next` member.
+ *
+ * Zero-initialization produces an incomplete block with no pending notifications.
+ */
+template <typename Node, typename Semaphore> class block_completion {
+public:
+    typedef typename Semaphore::type semaphore_type;
+    typedef typename Semaphore::timeout timeout_type;
+    
+    /** Return true if the block has completed. */
+    bool completed () const {
+        return _notifications.load(std::memory_order_seq_cst) == completed_marker();
+    }
+    
+    /**
+     * Register a pending notification.
+     *
+     * @return Returns false if the block has already completed; @a n was not registered, and the caller is
+     * responsible for its submission.
+     */
+    bool notify (Node *n) {
+        n->next = _notifications.load(std::memory_order_acquire);
+        while (n->next != completed_marker()) {
+            if (_notifications.compare_exchange_weak(n->next, n, std::memory_order_acq_rel, std::memory_order_acquire))
+                return true;
+        }
+        
+        return false;
+    }
+    
+    /**
+     * Mark the block as complete, waking any waiter, and pass each pending notification to @a submit in the order
+     * they were registered. Subsequent completions only wake the waiter.
+     */
+    template <typename Fn> void complete (Fn submit) {
+        Node *n = _notifications.exchange(completed_marker(), std::memory_order_seq_cst);
+        
+        semaphore_type waiter = _waiter.exchange(semaphore_type(), std::memory_order_seq_cst);
+        if (waiter != semaphore_type())
+            Semaphore::signal(waiter);
+        
+        /* Already completed by a previous execution */
+        if (n == completed_marker())
+            return;
+        
+        /* Reverse the stack */
+        Node *ordered = nullptr;
+        while (n != nullptr) {
+            Node *next = n->next;
+            n->next = ordered;
+            ordered = n;
+            n = next;
+        }
+        
+        while (ordered != nullptr) {
+            Node *next = ordered->next;
+            submit(ordered);
+            ordered = next;
+        }
+    }
+    
+    /**
+     * Pass each pending notification to @a release without submitting them; used when a block is deallocated without
+     * having been executed. The caller must ensure that no other thread is accessing the completion state.
+     */
+    template <typename Fn> void discard (Fn release) {
+        Node *n = _notifications.exchange(nullptr, std::memory_order_acquire);
+        while (n != nullptr && n != completed_marker()) {
+            Node *next = n->next;
+            release(n);
+            n = next;
+        }
+    }
+    
+    /**
+     * Wait for the block to complete.
+     *
+     * Most waits are issued shortly before (or after) completion; completion is polled up to @a spin times before
+     * blocking on a semaphore. As with libdispatch, only a single concurrent waiter is supported.
+     */
+    block_completion_wait_result wait (timeout_type timeout, unsigned int spin) {
+        if (Semaphore::is_now(timeout))
+            spin = 1;
+        
+        for (unsigned int i = 0; i < spin; i++) {
+            if (completed())
+                return BLOCK_COMPLETION_COMPLETED;
+            
+            if (i % 64 == 63)
+                sched_yield();
+        }
+        
+        if (Semaphore::is_now(timeout))
+            return BLOCK_COMPLETION_TIMED_OUT;
+        
+        /* Register as the waiter */
+        semaphore_type sema = Semaphore::create();
+        semaphore_type expected = semaphore_type();
+        if (!_waiter.compare_exchange_strong(expected, sema, std::memory_order_seq_cst)) {
+            Semaphore::release(sema);
+            return BLOCK_COMPLETION_BUSY;
+        }
+        
+        bool signaled = false;
+        if (!completed())
+            signaled = Semaphore::wait(sema, timeout);
+        
+        /* If we can't withdraw our semaphore, the completing thread has claimed it, and an (imminent) signal is
+         * guaranteed; consume it before releasing the semaphore. */
+        expected = sema;
+        if (!_waiter.compare_exchange_strong(expected, semaphore_type(), std::memory_order_seq_cst) && !signaled)
+            Semaphore::wait_forever(sema);
+        
+        Semaphore::release(sema);
+        return completed() ? BLOCK_COMPLETION_COMPLETED : BLOCK_COMPLETION_TIMED_OUT;
+    }
+
+private:
+    /** Sentinel value of _notifications once the block has completed. */
+    static Node *completed_marker () { return (Node *) 1; }
+    
+    /** Pending notifications, as a LIFO stack, or completed_marker() once the block has completed. */
+    std::atomic<Node *> _notifications;
+    
+    /** Semaphore of the blocked waiter, if any. */
+    std::atomic<semaphore_type> _waiter;
+};
+
+} /* namespace xpf */
@@ -28,6 +28,10 @@
 
 #include "cfbundle_rebind.h"
 #import "rebind_table.h"
+#import "accounting.h"
+
+#include <objc/runtime.h>
+#include <pthread.h>
 
 namespace xpf {
 
@@ -38,31 +42,135 @@ namespace xpf {
  * We patch out the relevant CFBundle* APIs here, rewriting the LSMinimumSystemVersion
  * to 10.9.
  */
-static CFStringRef kLSMinimumSystemVersionKey = CFSTR("LSMinimumSystemVersion");
-static CFStringRef kSupportedSystemVersion = CFSTR("10.9");
 
 /**
- * Return a representation of @a infoDictionary where kLSMinimumSystemVersionKey, if set, has
- * been patched to be equal to 10.9.
+ * An Info.plist key override.
  */
-static CFDictionaryRef xpf_patch_info_dictionary (CFDictionaryRef info) {
-    if (!CFDictionaryContainsKey(info, kLSMinimumSystemVersionKey))
+struct cfbundle_key_override {
+    /** The overridden key */
+    CFStringRef key;
+    
+    /** The replacement value */
+    CFTypeRef value;
+    
+    /** The key's length; used to reject most non-matching keys without a full comparison. */
+    CFIndex key_length;
+};
+
+/* Define a string-valued key override */
+#define XPF_CFBUNDLE_OVERRIDE(_key, _value) { CFSTR(_key), CFSTR(_value), sizeof(_key) - 1 }
+
+/** All Info.plist key overrides */
+static const cfbundle_key_override cfbundle_overrides[] = {
+    XPF_CFBUNDLE_OVERRIDE("LSMinimumSystemVersion", "10.9")
+};
+
+/** Associated object key of a source dictionary's patched dictionary. */
+static char cfbundle_patched_key;
+
+/** Lock serializing the creation of patched dictionaries */
+static pthread_mutex_t cfbundle_patch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Return the override value for @a key, or NULL if @a key is not overridden.
+ */
+static CFTypeRef cfbundle_override_value (CFStringRef key) {
+    if (key == NULL)
+        return NULL;
+    
+    /* Most callers pass the same constant string instances; check for pointer identity first */
+    for (auto &&o : cfbundle_overrides) {
+        if (key == o.key)
+            return o.value;
+    }
+    
+    if (CFGetTypeID(key) != CFStringGetTypeID())
+        return NULL;
+    
+    CFIndex length = CFStringGetLength(key);
+    for (auto &&o : cfbundle_overrides) {
+        if (length == o.key_length && CFEqual(key, o.key))
+            return o.value;
+    }
+    
+    return NULL;
+}
+
+/**
+ * Return the patched dictionary previously associated with @a info, or NULL if none.
+ */
+static CFDictionaryRef cfbundle_patched_lookup (CFDictionaryRef info) {
+    CFTypeRef patched = (CFTypeRef) objc_getAssociatedObject((id) info, &cfbundle_patched_key);
+    
+    /* kCFNull marks dictionaries that require no changes */
+    if (patched == kCFNull)
         return info;
     
-    CFMutableDictionaryRef patched = CFDictionaryCreateMutableCopy(nullptr, 0, info);
-    CFDictionarySetValue(patched, kLSMinimumSystemVersionKey, kSupportedSystemVersion);
-    CFAutorelease(patched);
+    return (CFDictionaryRef) patched;
+}
+
+/**
+ * Return a representation of @a info in which all overridden keys have been replaced.
+ *
+ * Patched dictionaries are created once per source dictionary, and are attached to the source dictionary as an
+ * associated object; they remain valid for the lifetime of the source dictionary, and are released along with it.
+ * Dictionaries that require no changes are returned as-is.
+ */
+static CFDictionaryRef xpf_patch_info_dictionary (CFDictionaryRef info) {
+    if (info == NULL)
+        return NULL;
+    
+    /* Associations are never replaced once set, and may be read without locking */
+    CFDictionaryRef patched = cfbundle_patched_lookup(info);
+    if (patched != NULL)
+        return patched;
     
+    pthread_mutex_lock(&cfbundle_patch_lock);
+    
+    /* Another thread may have patched the dictionary while we waited */
+    patched = cfbundle_patched_lookup(info);
+    if (patched != NULL) {
+        pthread_mutex_unlock(&cfbundle_patch_lock);
+        return patched;
+    }
+    
+    /* Determine whether any keys must be overridden */
+    CFMutableDictionaryRef copy = NULL;
+    {
+        accounting_scope scope(ACCOUNTING_PHASE_INFO_DICTIONARY);
+        for (auto &&o : cfbundle_overrides) {
+            if (!CFDictionaryContainsKey(info, o.key))
+                continue;
+            
+            if (copy == NULL)
+                copy = CFDictionaryCreateMutableCopy(NULL, 0, info);
+            CFDictionarySetValue(copy, o.key, o.value);
+        }
+    }
+    
+    /* Dictionaries that require no changes are marked too, avoiding repeated key checks; the association owns
+     * the copy. */
+    if (copy != NULL) {
+        objc_setAssociatedObject((id) info, &cfbundle_patched_key, (id) copy, OBJC_ASSOCIATION_RETAIN);
+        CFRelease(copy);
+        patched = copy;
+    } else {
+        objc_setAssociatedObject((id) info, &cfbundle_patched_key, (id) kCFNull, OBJC_ASSOCIATION_ASSIGN);
+        patched = info;
+    }
+    
+    pthread_mutex_unlock(&cfbundle_patch_lock);
     return patched;
 }
 
 /* Patch CFBundleGetValueForInfoDictionaryKey() */
 static CFTypeRef (*orig_CFBundleGetValueForInfoDictionaryKey) (CFBundleRef bundle, CFStringRef key);
 static CFTypeRef xpf_CFBundleGetValueForInfoDictionaryKey (CFBundleRef bundle, CFStringRef key) {
-    if (!CFEqual(key, kLSMinimumSystemVersionKey))
+    CFTypeRef value = cfbundle_override_value(key);
+    if (value == NULL)
         return orig_CFBundleGetValueForInfoDictionaryKey(bundle, key);
-
-    return kSupportedSystemVersion;
+    
+    return value;
 }
 XPF_REBIND_ENTRY("_CFBundleGetValueForInfoDictionaryKey", "CoreFoundation", (void **) &orig_CFBundleGetValueForInfoDictionaryKey, (uintptr_t) &xpf_CFBundleGetValueForInfoDictionaryKey);
 
@@ -76,8 +184,8 @@ XPF_REBIND_ENTRY("_CFBundleGetInfoDictionary", "CoreFoundation", (void **) &orig
 /* Patch CFBundleGetLocalInfoDictionary() */
 static CFDictionaryRef (*orig_CFBundleGetLocalInfoDictionary)(CFBundleRef bundle);
 static CFDictionaryRef xpf_CFBundleGetLocalInfoDictionary (CFBundleRef bundle) {
-    return xpf_patch_info_dictionary(orig_CFBundleGetInfoDictionary(bundle));
+    return xpf_patch_info_dictionary(orig_CFBundleGetLocalInfoDictionary(bundle));
 }
 XPF_REBIND_ENTRY("_CFBundleGetLocalInfoDictionary", "CoreFoundation", (void **) &orig_CFBundleGetLocalInfoDictionary, (uintptr_t) &xpf_CFBundleGetLocalInfoDictionary);
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,185 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "dispatch_block_rebind.h"
+#include "rebind_table.h"
+#include "dispatch_block_runtime.h"
+#include "qos_policy.h"
+#include "XPFLog.h"
+#include "async_log.h"
+
+#include <Block.h>
+
+namespace xpf {
+
+/*
+ * Yosemite's libdispatch provides a set of block utility functions that support creating a custom block type that allows
+ * the assignation of operations over GCD-specific block attributes.
+ *
+ * We emulate these via dispatch_block_runtime, which wraps the user's block and registers the wrapper's attributes;
+ * our dispatch_async() and dispatch_sync() hooks route DISPATCH_BLOCK_BARRIER blocks to the corresponding barrier API.
+ *
+ * A block's QoS class is applied to the executing thread via the qos_policy table. The remaining flags (such as
+ * DISPATCH_BLOCK_DETACHED) have no Mavericks equivalent, and are ignored.
+ *
+ * Alternatively, we could actually provide a backported copy of 10.10's libdispatch :-)
+ */
+
+/** Maximum number of live dispatch_block_create() blocks; additional blocks do not support cancellation or barriers. */
+static constexpr size_t XPF_DISPATCH_BLOCK_TABLE_SIZE = 16384;
+
+/** Number of completion checks performed by dispatch_block_wait() before blocking. */
+static constexpr unsigned int XPF_DISPATCH_BLOCK_WAIT_SPIN = 1000;
+
+/**
+ * block_completion semaphore operations backed by dispatch semaphores.
+ */
+struct dispatch_block_semaphore {
+    typedef dispatch_semaphore_t type;
+    typedef dispatch_time_t timeout;
+    
+    static type create () { return dispatch_semaphore_create(0); }
+    static void release (type sema) { dispatch_release(sema); }
+    static void signal (type sema) { dispatch_semaphore_signal(sema); }
+    static bool wait (type sema, timeout t) { return dispatch_semaphore_wait(sema, t) == 0; }
+    static void wait_forever (type sema) { dispatch_semaphore_wait(sema, DISPATCH_TIME_FOREVER); }
+    static bool is_now (timeout t) { return t == DISPATCH_TIME_NOW; }
+};
+
+static void (*orig_dispatch_async) (dispatch_queue_t queue, dispatch_block_t block);
+static void (*orig_dispatch_sync) (dispatch_queue_t queue, dispatch_block_t block);
+
+/**
+ * dispatch_block_runtime executor backed by libdispatch and the blocks runtime. Non-barrier submissions are passed
+ * to the original dispatch_async() and dispatch_sync() implementations, bypassing our own hooks.
+ */
+struct dispatch_block_executor {
+    typedef dispatch_block_t block;
+    typedef dispatch_queue_t queue;
+    typedef dispatch_block_flags_t flags;
+    typedef dispatch_block_semaphore semaphore;
+    
+    static constexpr flags BARRIER = DISPATCH_BLOCK_BARRIER;
+    
+    /* The block captures (and Block_copy() copies) `f` by value; a captured reference would dangle on return. */
+    template <typename Fn> static block wrap (const Fn &fn) {
+        Fn f = fn;
+        return Block_copy(^{ f(); });
+    }
+    
+    static block copy_block (block b) { return Block_copy(b); }
+    static void release_block (block b) { Block_release(b); }
+    static void invoke (block b) { b(); }
+    
+    static void retain_queue (queue q) { dispatch_retain(q); }
+    static void release_queue (queue q) { dispatch_release(q); }
+    
+    static void async (queue q, block b) { orig_dispatch_async(q, b); }
+    static void barrier_async (queue q, block b) { dispatch_barrier_async(q, b); }
+    static void sync (queue q, block b) { orig_dispatch_sync(q, b); }
+    static void barrier_sync (queue q, block b) { dispatch_barrier_sync(q, b); }
+};
+
+constexpr dispatch_block_executor::flags dispatch_block_executor::BARRIER;
+
+/** All live dispatch_block_create() blocks */
+static dispatch_block_runtime<dispatch_block_executor, XPF_DISPATCH_BLOCK_TABLE_SIZE> dispatch_blocks;
+
+static dispatch_block_t xpf_dispatch_block_create_with_qos_class (dispatch_block_flags_t flags, dispatch_qos_class_t qos_class, int relative_priority, dispatch_block_t block) {
+    /* Resolve the block's scheduling policy; blocks without a QoS class run with the executing thread's policy. */
+    const qos_policy *policy = qos_class_valid(qos_class) ? &qos_policy_lookup(qos_class) : nullptr;
+    
+    bool registered;
+    dispatch_block_t wrapper = dispatch_blocks.create(flags, policy, relative_priority, block, registered);
+    if (!registered)
+        XPFLogOnce("Warning! Too many live dispatch_block_create() blocks; cancellation and DISPATCH_BLOCK_BARRIER will be ignored for new blocks. This message will be logged only once.");
+    
+    return wrapper;
+}
+XPF_REBIND_ENTRY("_dispatch_block_create_with_qos_class", "libSystem.B.dylib", NULL, (uintptr_t) &xpf_dispatch_block_create_with_qos_class);
+
+static dispatch_block_t xpf_dispatch_block_create (dispatch_block_flags_t flags, dispatch_block_t block) {
+    return xpf_dispatch_block_create_with_qos_class(flags, QOS_CLASS_UNSPECIFIED, 0, block);
+}
+XPF_REBIND_ENTRY("_dispatch_block_create", "libSystem.B.dylib", NULL, (uintptr_t) &xpf_dispatch_block_create);
+
+static void xpf_dispatch_block_cancel (dispatch_block_t block) {
+    if (!dispatch_blocks.cancel(block))
+        XPFLogOnce("Warning! Ignoring dispatch_block_cancel() of a block not created by dispatch_block_create(); this may result in unexpected behavior. This message will be logged only once.");
+}
+XPF_REBIND_ENTRY("_dispatch_block_cancel", "libSystem.B.dylib", NULL, (uintptr_t) &xpf_dispatch_block_cancel);
+
+static long xpf_dispatch_block_testcancel (dispatch_block_t block) {
+    return dispatch_blocks.testcancel(block);
+}
+XPF_REBIND_ENTRY("_dispatch_block_testcancel", "libSystem.B.dylib", NULL, (uintptr_t) &xpf_dispatch_block_testcancel);
+
+static long xpf_dispatch_block_wait (dispatch_block_t block, dispatch_time_t timeout) {
+    block_completion_wait_result result;
+    if (!dispatch_blocks.wait(block, timeout, XPF_DISPATCH_BLOCK_WAIT_SPIN, result)) {
+        XPFLogOnce("Warning! Ignoring dispatch_block_wait() on a block not created by dispatch_block_create(); this may result in unexpected behavior. This message will be logged only once.");
+        return 0;
+    }
+    
+    switch (result) {
+        case BLOCK_COMPLETION_COMPLETED:
+            return 0;
+            
+        case BLOCK_COMPLETION_TIMED_OUT:
+            return 1;
+            
+        case BLOCK_COMPLETION_BUSY:
+            XPFLogOnce("Warning! dispatch_block_wait() may not be called concurrently on the same block; returning as if timed out. This message will be logged only once.");
+            return 1;
+    }
+    
+    return 1;
+}
+XPF_REBIND_ENTRY("_dispatch_block_wait", "libSystem.B.dylib", NULL, (uintptr_t) &xpf_dispatch_block_wait);
+
+static void xpf_dispatch_block_notify (dispatch_block_t block, dispatch_queue_t queue, dispatch_block_t notification_block) {
+    if (!dispatch_blocks.notify(block, queue, notification_block))
+        XPFLogOnce("Warning! Ignoring dispatch_block_notify() on a block not created by dispatch_block_create(); this may result in unexpected behavior. This message will be logged only once.");
+}
+XPF_REBIND_ENTRY("_dispatch_block_notify", "libSystem.B.dylib", NULL, (uintptr_t) &xpf_dispatch_block_notify);
+
+/*
+ * DISPATCH_BLOCK_BARRIER blocks submitted via dispatch_async() or dispatch_sync() are redirected to the corresponding
+ * barrier API.
+ */
+static void xpf_dispatch_async (dispatch_queue_t queue, dispatch_block_t block) {
+    dispatch_blocks.async(queue, block);
+}
+XPF_REBIND_ENTRY("_dispatch_async", "libSystem.B.dylib", (void **) &orig_dispatch_async, (uintptr_t) &xpf_dispatch_async);
+
+static void xpf_dispatch_sync (dispatch_queue_t queue, dispatch_block_t block) {
+    dispatch_blocks.sync(queue, block);
+}
+XPF_REBIND_ENTRY("_dispatch_sync", "libSystem.B.dylib", (void **) &orig_dispatch_sync, (uintptr_t) &xpf_dispatch_sync);
+
+} /* namespace xpf */
@@ -0,0 +1,372 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "block_completion.h"
+#include "ptr_table.h"
+#include "qos_policy.h"
+
+namespace xpf {
+
+/**
+ * An emulation of Yosemite's dispatch_block_create() family over a pluggable block and queue executor.
+ *
+ * Each created block is a wrapper around the user's block; the wrapper's attributes are registered in a table keyed by
+ * the wrapper (with lock-free lookup), allowing cancel(), wait(), and notify() to find them, and allowing async() and
+ * sync() to route barrier-flagged blocks to the executor's barrier variants. The wrapper skips the user's block once
+ * cancelled, and marks the block complete after each execution (including cancelled executions), waking any waiter
+ * and submitting any pending notifications. The attributes are unregistered and freed along with the last copy of the
+ * wrapper.
+ *
+ * The block, queue, and semaphore operations are supplied by @a Executor, allowing the emulation to be used with both
+ * libdispatch and (for testing on non-Darwin hosts) pthreads. @a Executor must provide:
+ *
+ * - `block`, `queue`, and `flags` typedefs, and a `static constexpr flags BARRIER` flag value
+ * - a `semaphore` typedef, providing the block_completion semaphore operations
+ * - `template <typename Fn> static block wrap (const Fn &fn)`, returning a new heap block that invokes (a copy of)
+ *   @a fn; the copy is destroyed along with the last copy of the block
+ * - `static block copy_block (block)` and `static void release_block (block)`
+ * - `static void invoke (block)`
+ * - `static void retain_queue (queue)` and `static void release_queue (queue)`
+ * - `static void async (queue, block)` and `static void barrier_async (queue, block)`
+ * - `static void sync (queue, block)` and `static void barrier_sync (queue, block)`
+ *
+ * @a Capacity is the maximum number of live blocks; additional blocks do not support cancellation, waiting,
+ * notification, or barriers.
+ *
+ * Zero-initialization produces an empty runtime, and no static constructor is required.
+ */
+template <typename Executor, size_t Capacity> class dispatch_block_runtime {
+public:
+    typedef typename Executor::block block_type;
+    typedef typename Executor::queue queue_type;
+    typedef typename Executor::flags flags_type;
+    typedef typename Executor::semaphore::timeout timeout_type;
+    
+    /**
+     * Create a new block wrapping @a block.
+     *
+     * @param flags The block's flags; only Executor::BARRIER is honored.
+     * @param policy The scheduling policy to be applied while executing @a block, or nullptr to run with the executing
+     * thread's policy.
+     * @param relative_priority The priority of @a block relative to @a policy.
+     * @param block The user's block; it is copied, and released along with the last copy of the returned block.
+     * @param registered On return, false if the table was full, in which case the returned block does not support
+     * cancellation, waiting, notification, or barriers.
+     *
+     * @return Returns the new block, which must be released via Executor::release_block().
+     */
+    block_type create (flags_type flags, const qos_policy *policy, int relative_priority, block_type block, bool &registered) {
+        block_attrs *attrs = new block_attrs();
+        attrs->refs.store(1, std::memory_order_relaxed);
+        attrs->runtime = this;
+        attrs->flags = flags;
+        attrs->policy = policy;
+        attrs->relative_priority = relative_priority;
+        attrs->block = Executor::copy_block(block);
+        attrs->cancelled.store(false, std::memory_order_relaxed);
+        attrs->inline_notification_used.store(false, std::memory_order_relaxed);
+        attrs->wrapper = block_type();
+        
+        /* The executor copies `ref` into the heap wrapper; our own copy is released on return. */
+        block_ref ref(attrs);
+        block_type wrapper = Executor::wrap([ref]() {
+            if (!ref->cancelled.load(std::memory_order_acquire)) {
+                qos_thread_scope scope(ref->policy, ref->relative_priority);
+                Executor::invoke(ref->block);
+            }
+            
+            ref->runtime->complete(ref.get());
+        });
+        
+        /* The wrapper holds a reference, and will not unregister itself before we return. */
+        registered = _table.insert((const void *) wrapper, attrs);
+        if (registered)
+            attrs->wrapper = wrapper;
+        
+        return wrapper;
+    }
+    
+    /**
+     * Cancel @a block; any subsequent executions will skip the user's block.
+     *
+     * @return Returns false if @a block was not created by create().
+     */
+    bool cancel (block_type block) {
+        block_attrs *attrs = lookup(block);
+        if (attrs == nullptr)
+            return false;
+        
+        attrs->cancelled.store(true, std::memory_order_release);
+        return true;
+    }
+    
+    /**
+     * Return non-zero if @a block has been cancelled; blocks not created by create() are never cancelled.
+     */
+    long testcancel (block_type block) const {
+        block_attrs *attrs = lookup(block);
+        if (attrs == nullptr)
+            return 0;
+        
+        return attrs->cancelled.load(std::memory_order_acquire) ? 1 : 0;
+    }
+    
+    /**
+     * Wait for @a block to complete, polling up to @a spin times before blocking.
+     *
+     * @param block The block to wait on.
+     * @param timeout The executor's semaphore timeout.
+     * @param spin The number of completion checks to perform before blocking.
+     * @param result On success, the result of the wait.
+     *
+     * @return Returns false if @a block was not created by create().
+     */
+    bool wait (block_type block, timeout_type timeout, unsigned int spin, block_completion_wait_result &result) {
+        block_attrs *attrs = lookup(block);
+        if (attrs == nullptr)
+            return false;
+        
+        result = attrs->completion.wait(timeout, spin);
+        return true;
+    }
+    
+    /**
+     * Submit @a notification_block to @a queue once @a block completes, or immediately if it already has.
+     *
+     * @return Returns false if @a block was not created by create(); @a notification_block is not submitted.
+     */
+    bool notify (block_type block, queue_type queue, block_type notification_block) {
+        block_attrs *attrs = lookup(block);
+        if (attrs == nullptr)
+            return false;
+        
+        /* Fast path; the block has already completed */
+        if (attrs->completion.completed()) {
+            async(queue, notification_block);
+            return true;
+        }
+        
+        /* Claim the inline notification, if available */
+        notification *n;
+        bool expected = false;
+        if (attrs->inline_notification_used.compare_exchange_strong(expected, true, std::memory_order_relaxed)) {
+            n = &attrs->inline_notification;
+            n->allocated = false;
+        } else {
+            n = new notification();
+            n->allocated = true;
+        }
+        
+        Executor::retain_queue(queue);
+        n->queue = queue;
+        n->block = Executor::copy_block(notification_block);
+        
+        /* Register the notification, unless the block completes first */
+        if (!attrs->completion.notify(n)) {
+            async(queue, notification_block);
+            notification_free(n);
+        }
+        
+        return true;
+    }
+    
+    /**
+     * Submit @a block to @a queue, via the executor's barrier variant if @a block was created with Executor::BARRIER.
+     */
+    void async (queue_type queue, block_type block) const {
+        if (is_barrier(block))
+            Executor::barrier_async(queue, block);
+        else
+            Executor::async(queue, block);
+    }
+    
+    /**
+     * Execute @a block on @a queue, via the executor's barrier variant if @a block was created with Executor::BARRIER.
+     */
+    void sync (queue_type queue, block_type block) const {
+        if (is_barrier(block))
+            Executor::barrier_sync(queue, block);
+        else
+            Executor::sync(queue, block);
+    }
+    
+    /** Return true if @a block was created by create(), and is still live. */
+    bool registered (block_type block) const {
+        return lookup(block) != nullptr;
+    }
+    
+    /** Return true if no created blocks are registered. */
+    bool empty () const {
+        return _table.empty();
+    }
+
+private:
+    /**
+     * A pending notify() submission.
+     */
+    struct notification {
+        /** The target queue (retained) */
+        queue_type queue;
+        
+        /** The notification block (copied) */
+        block_type block;
+        
+        /** The next pending notification, or NULL */
+        notification *next;
+        
+        /** If true, this notification is heap allocated; otherwise, it is the owning block's inline notification. */
+        bool allocated;
+    };
+    
+    /**
+     * Attributes of a create() block.
+     */
+    struct block_attrs {
+        /** Reference count; one reference is held by each copy of the wrapper block's captured block_ref. */
+        std::atomic<uint32_t> refs;
+        
+        /** The owning runtime */
+        dispatch_block_runtime *runtime;
+        
+        /** The flags supplied to create() */
+        flags_type flags;
+        
+        /** The scheduling policy applied while executing the user's block, or nullptr. */
+        const qos_policy *policy;
+        
+        /** The user's block's priority, relative to policy. */
+        int relative_priority;
+        
+        /** The user's block (copied) */
+        block_type block;
+        
+        /** Set by cancel() */
+        std::atomic<bool> cancelled;
+        
+        /** Pending notifications and the blocked wait() caller, if any. */
+        block_completion<notification, typename Executor::semaphore> completion;
+        
+        /** Storage for the first notification, avoiding an allocation for the common single-notification case. */
+        notification inline_notification;
+        
+        /** Set once inline_notification has been claimed. */
+        std::atomic<bool> inline_notification_used;
+        
+        /** The wrapper block, if registered in _table; otherwise NULL. */
+        block_type wrapper;
+    };
+    
+    /**
+     * A reference to a block's attributes, captured by value by its wrapper block; the executor copies and destroys
+     * the reference along with the wrapper block. The attributes are unregistered and freed along with the last
+     * reference.
+     */
+    class block_ref {
+    public:
+        /** Adopt the caller's reference to @a attrs */
+        explicit block_ref (block_attrs *attrs) : _attrs(attrs) {}
+        
+        block_ref (const block_ref &other) : _attrs(other._attrs) {
+            _attrs->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        ~block_ref () {
+            if (_attrs->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            
+            if (_attrs->wrapper != block_type())
+                _attrs->runtime->_table.remove((const void *) _attrs->wrapper);
+            
+            /* If the block was never executed, its notifications will never be submitted */
+            _attrs->completion.discard(notification_free);
+            
+            Executor::release_block(_attrs->block);
+            delete _attrs;
+        }
+        
+        block_ref &operator= (const block_ref &) = delete;
+        
+        block_attrs *operator-> () const { return _attrs; }
+        block_attrs *get () const { return _attrs; }
+        
+    private:
+        /** The referenced attributes */
+        block_attrs *_attrs;
+    };
+    
+    /**
+     * Release the queue and block of @a n, freeing @a n if heap allocated.
+     */
+    static void notification_free (notification *n) {
+        Executor::release_queue(n->queue);
+        Executor::release_block(n->block);
+        if (n->allocated)
+            delete n;
+    }
+    
+    /**
+     * Return the attributes of @a block, or nullptr if @a block was not created by create().
+     */
+    block_attrs *lookup (block_type block) const {
+        /* Avoid any probing on the async() fast path */
+        if (_table.empty())
+            return nullptr;
+        
+        return _table.find((const void *) block);
+    }
+    
+    /**
+     * Return true if @a block was created with Executor::BARRIER.
+     */
+    bool is_barrier (block_type block) const {
+        block_attrs *attrs = lookup(block);
+        return attrs != nullptr && (attrs->flags & Executor::BARRIER) == Executor::BARRIER;
+    }
+    
+    /**
+     * Mark the block described by @a attrs as complete, waking any waiter and submitting all pending notifications.
+     */
+    void complete (block_attrs *attrs) {
+        attrs->completion.complete([this](notification *n) {
+            async(n->queue, n->block);
+            notification_free(n);
+        });
+    }
+    
+    /** All live create() blocks, keyed by wrapper block */
+    ptr_table<block_attrs, Capacity> _table;
+};
+
+} /* namespace xpf */
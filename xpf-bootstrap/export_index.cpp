@@ -0,0 +1,307 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "export_index.h"
+#include "export_trie.h"
+#include "macho_util.h"
+#include "async_log.h"
+
+#ifndef LC_DYLD_EXPORTS_TRIE
+#define LC_DYLD_EXPORTS_TRIE (0x33 | LC_REQ_DYLD)
+#endif
+
+#ifndef EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE
+#define EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE 0x02
+#endif
+
+namespace xpf {
+
+using namespace patchmaster;
+
+/** Maximum re-export depth; guards against re-export cycles. */
+static constexpr unsigned int XPF_EXPORT_MAX_DEPTH = 16;
+
+/**
+ * Construct a new index over the exports of the loaded library @a header.
+ *
+ * @param header The library's mach header.
+ * @param generation The library's image_registry generation.
+ */
+export_index::export_index (const pl_mach_header_t *header, uint64_t generation) : _header(header), _generation(generation), _trie(nullptr), _trie_size(0) {
+    uint32_t export_off = 0;
+    uint32_t export_size = 0;
+    
+    macho_for_each_command(header, [&](const struct load_command *cmd) {
+        switch (cmd->cmd) {
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY:
+                export_off = ((const struct dyld_info_command *) cmd)->export_off;
+                export_size = ((const struct dyld_info_command *) cmd)->export_size;
+                break;
+                
+            case LC_DYLD_EXPORTS_TRIE:
+                export_off = ((const struct linkedit_data_command *) cmd)->dataoff;
+                export_size = ((const struct linkedit_data_command *) cmd)->datasize;
+                break;
+                
+            case LC_REEXPORT_DYLIB:
+                _reexports.push_back((uint32_t) _dependencies.size() + 1);
+                /* fallthrough */
+            case LC_LOAD_DYLIB:
+            case LC_LOAD_WEAK_DYLIB:
+            case LC_LOAD_UPWARD_DYLIB:
+            case LC_LAZY_LOAD_DYLIB: {
+                auto dylib = (const struct dylib_command *) cmd;
+                _dependencies.push_back((const char *) cmd + dylib->dylib.name.offset);
+                break;
+            }
+        }
+        
+        return true;
+    });
+    
+    /* The export trie must lie entirely within __LINKEDIT */
+    auto linkedit = macho_find_segment(header, SEG_LINKEDIT);
+    if (linkedit == nullptr || export_size == 0)
+        return;
+    
+    if (export_off < linkedit->fileoff || export_size > linkedit->filesize || export_off - linkedit->fileoff > linkedit->filesize - export_size) {
+        PMLog("Export trie lies outside of " SEG_LINKEDIT);
+        return;
+    }
+    
+    _trie = (const uint8_t *) (linkedit->vmaddr + macho_vmaddr_slide(header) + (export_off - linkedit->fileoff));
+    _trie_size = export_size;
+}
+
+/**
+ * Look up @a symbol in this library's exports.
+ *
+ * @param symbol The symbol to look up.
+ * @param result On success, the symbol's export information.
+ *
+ * @return Returns true if the symbol is exported by this library, or false if not found.
+ */
+bool export_index::find (const char *symbol, export_symbol &result) const {
+    if (_trie == nullptr)
+        return false;
+    
+    const uint8_t *end;
+    const uint8_t *p = export_trie_find(_trie, _trie_size, symbol, &end);
+    if (p == nullptr)
+        return false;
+    
+    if (!export_trie_uleb128(p, end, &result.flags))
+        return false;
+    
+    if (result.flags & EXPORT_SYMBOL_FLAGS_REEXPORT) {
+        if (!export_trie_uleb128(p, end, &result.reexport_ordinal))
+            return false;
+        
+        /* An empty name denotes a re-export under the same name */
+        const uint8_t *nul = (const uint8_t *) memchr(p, '\0', end - p);
+        if (nul == nullptr)
+            return false;
+        
+        result.reexport_name = (nul == p) ? symbol : (const char *) p;
+        result.address = 0;
+        return true;
+    }
+    
+    /* For stub-and-resolver symbols, this is the stub's offset; the stub invokes the resolver on first call */
+    uint64_t offset;
+    if (!export_trie_uleb128(p, end, &offset))
+        return false;
+    
+    if ((result.flags & EXPORT_SYMBOL_FLAGS_KIND_MASK) == EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE)
+        result.address = (uintptr_t) offset;
+    else
+        result.address = (uintptr_t) _header + (uintptr_t) offset;
+    
+    result.reexport_ordinal = 0;
+    result.reexport_name = nullptr;
+    return true;
+}
+
+/**
+ * Construct a new resolver.
+ *
+ * @param registry The registry of loaded images.
+ */
+export_resolver::export_resolver (const image_registry *registry) : _registry(registry) {
+    pthread_mutex_init(&_lock, NULL);
+}
+
+/**
+ * Return the index for the loaded @a library, building it if necessary, or nullptr if the library is not loaded.
+ * The caller must hold _lock.
+ *
+ * @param library The library's install name or path; relative names are matched by suffix, as per
+ * patchmaster::SymbolName.
+ */
+const export_index *export_resolver::index (const char *library) {
+    if (*library == '\0')
+        return nullptr;
+    
+    /* Use the cached index, if the same registration of its library is still loaded; a different library may
+     * since have been loaded at the same address. */
+    auto cached = _names.find(library);
+    if (cached != _names.end()) {
+        const export_index *index = cached->second;
+        if (_registry->generation((const struct mach_header *) index->header()) == index->generation())
+            return index;
+        
+        purge(index->header());
+    }
+    
+    /* Find the library */
+    uint64_t generation;
+    auto header = (const pl_mach_header_t *) _registry->find_library(library, &generation);
+    if (header == nullptr)
+        return nullptr;
+    
+    /* Share a single index across all names for the library, discarding any stale index at the same address */
+    auto existing = _indices.find(header);
+    if (existing != _indices.end() && existing->second->generation() != generation)
+        purge(header);
+    
+    auto &entry = _indices[header];
+    if (!entry)
+        entry.reset(new export_index(header, generation));
+    
+    _names[library] = entry.get();
+    return entry.get();
+}
+
+/**
+ * Discard the index of @a header, and all names referencing it. The caller must hold _lock.
+ */
+void export_resolver::purge (const pl_mach_header_t *header) {
+    for (auto it = _names.begin(); it != _names.end();) {
+        if (it->second->header() == header)
+            it = _names.erase(it);
+        else
+            ++it;
+    }
+    
+    _indices.erase(header);
+}
+
+/**
+ * Resolve @a symbol within @a index, following re-exports to at most XPF_EXPORT_MAX_DEPTH. The caller must
+ * hold _lock.
+ */
+export_status export_resolver::resolve (const export_index *index, const char *symbol, unsigned int depth, uintptr_t *address) {
+    if (index == nullptr || index->empty() || depth > XPF_EXPORT_MAX_DEPTH)
+        return EXPORT_UNKNOWN;
+    
+    export_symbol result;
+    if (index->find(symbol, result)) {
+        if (!(result.flags & EXPORT_SYMBOL_FLAGS_REEXPORT)) {
+            *address = result.address;
+            return EXPORT_FOUND;
+        }
+        
+        const char *dependency = index->dependency(result.reexport_ordinal);
+        if (dependency == nullptr)
+            return EXPORT_UNKNOWN;
+        
+        /* The target name may be owned by the trie of an index we discard; copy it */
+        std::string target = result.reexport_name;
+        return resolve(this->index(dependency), target.c_str(), depth + 1, address);
+    }
+    
+    /* Search all re-exported libraries (eg, libSystem's sub-libraries); the symbol is only known to be missing
+     * if every re-exported library could be searched. */
+    export_status status = EXPORT_MISSING;
+    for (auto &&ordinal : index->reexports()) {
+        switch (resolve(this->index(index->dependency(ordinal)), symbol, depth + 1, address)) {
+            case EXPORT_FOUND:
+                return EXPORT_FOUND;
+            case EXPORT_UNKNOWN:
+                status = EXPORT_UNKNOWN;
+                break;
+            case EXPORT_MISSING:
+                break;
+        }
+    }
+    
+    return status;
+}
+
+/**
+ * Resolve the address of @a symbol, as exported by the loaded @a library.
+ *
+ * @param library The exporting library's install name or path; relative names are matched by suffix.
+ * @param symbol The symbol to resolve.
+ * @param address On success, the symbol's address.
+ *
+ * @return Returns true on success, or false if the library is not loaded, or does not export @a symbol.
+ */
+bool export_resolver::resolve (const char *library, const char *symbol, uintptr_t *address) {
+    pthread_mutex_lock(&_lock);
+    export_status status = resolve(index(library), symbol, 0, address);
+    pthread_mutex_unlock(&_lock);
+    
+    return status == EXPORT_FOUND;
+}
+
+/**
+ * Determine whether @a symbol is exported by the loaded @a library.
+ *
+ * @param library The library's install name or path; relative names are matched by suffix.
+ * @param symbol The symbol to look up.
+ *
+ * @return Returns EXPORT_UNKNOWN if the library is not loaded, or if any library it re-exports is not loaded;
+ * the symbol's presence can not be determined.
+ */
+export_status export_resolver::lookup (const char *library, const char *symbol) {
+    uintptr_t address;
+    
+    pthread_mutex_lock(&_lock);
+    export_status status = resolve(index(library), symbol, 0, &address);
+    pthread_mutex_unlock(&_lock);
+    
+    return status;
+}
+
+/**
+ * Return the approximate heap size of all indices, in bytes.
+ */
+size_t export_resolver::heap_size () const {
+    size_t size = 0;
+    for (auto &&entry : _indices)
+        size += entry.second->heap_size();
+    
+    for (auto &&entry : _names)
+        size += sizeof(entry) + entry.first.capacity();
+    
+    return size;
+}
+
+} /* namespace xpf */
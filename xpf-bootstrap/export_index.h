@@ -0,0 +1,174 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+#include "image_registry.h"
+
+namespace xpf {
+
+/**
+ * Export lookup results.
+ */
+enum export_status {
+    /** The symbol is exported by the library, or by one of its re-exported libraries. */
+    EXPORT_FOUND,
+    
+    /** The symbol is not exported by the library, or by any of its re-exported libraries. */
+    EXPORT_MISSING,
+    
+    /** The library (or one of its re-exported libraries) is not loaded, or has no export trie. */
+    EXPORT_UNKNOWN
+};
+
+/**
+ * A single symbol found in an export_index.
+ */
+struct export_symbol {
+    /** The symbol's EXPORT_SYMBOL_FLAGS_* value. */
+    uint64_t flags;
+    
+    /** The symbol's address; undefined for re-exported symbols. */
+    uintptr_t address;
+    
+    /** If EXPORT_SYMBOL_FLAGS_REEXPORT is set, the ordinal of the library from which the symbol is re-exported. */
+    uint64_t reexport_ordinal;
+    
+    /** If EXPORT_SYMBOL_FLAGS_REEXPORT is set, the symbol's name within the re-exporting library. */
+    const char *reexport_name;
+};
+
+/**
+ * An immutable index over the exports of a single loaded library.
+ *
+ * The index references the library's in-memory export trie and load commands directly; lookups descend the trie
+ * in O(symbol length), and construction requires only a single pass over the library's load commands.
+ */
+class export_index {
+public:
+    export_index (const patchmaster::pl_mach_header_t *header, uint64_t generation);
+    
+    export_index (const export_index &) = delete;
+    export_index &operator= (const export_index &) = delete;
+    
+    bool find (const char *symbol, export_symbol &result) const;
+    
+    /** Return true if the library has no export trie; lookups will always fail. */
+    bool empty () const { return _trie == nullptr; }
+    
+    /** Return the library's mach header. */
+    const patchmaster::pl_mach_header_t *header () const { return _header; }
+    
+    /** Return the image_registry generation of the indexed library. */
+    uint64_t generation () const { return _generation; }
+    
+    /** Return the install name of the library's dependency with the given 1-based @a ordinal, or nullptr. */
+    const char *dependency (uint64_t ordinal) const {
+        return (ordinal > 0 && ordinal <= _dependencies.size()) ? _dependencies[ordinal - 1] : nullptr;
+    }
+    
+    /** Return the ordinals of all libraries re-exported by this library. */
+    const std::vector<uint32_t> &reexports () const { return _reexports; }
+    
+    /** Return the approximate heap size of this index, in bytes. */
+    size_t heap_size () const { return sizeof(*this) + _dependencies.capacity() * sizeof(const char *) + _reexports.capacity() * sizeof(uint32_t); }
+
+private:
+    /** The library's mach header. */
+    const patchmaster::pl_mach_header_t *_header;
+    
+    /** The image_registry generation of the library. */
+    uint64_t _generation;
+    
+    /** The in-memory export trie, or nullptr if the library exports no symbols. */
+    const uint8_t *_trie;
+    
+    /** The export trie's size. */
+    size_t _trie_size;
+    
+    /** Install names of all dependent libraries, in library ordinal order. */
+    std::vector<const char *> _dependencies;
+    
+    /** Ordinals of all LC_REEXPORT_DYLIB dependencies. */
+    std::vector<uint32_t> _reexports;
+};
+
+/**
+ * Resolves symbol addresses directly from the export tries of loaded libraries, following re-exports.
+ *
+ * Libraries are located via the image_registry, and an export_index is built once per library, on first use, and
+ * shared by all subsequent lookups. Indices of libraries that have since been unloaded (or replaced by another
+ * library at the same address) are detected by their registry generation, and are discarded and rebuilt as
+ * required. The resolver never calls back into dyld, and may be used from parallel_for() workers.
+ */
+class export_resolver {
+public:
+    export_resolver (const image_registry *registry);
+    
+    export_resolver (const export_resolver &) = delete;
+    export_resolver &operator= (const export_resolver &) = delete;
+    
+    bool resolve (const char *library, const char *symbol, uintptr_t *address);
+    export_status lookup (const char *library, const char *symbol);
+    
+    /** Return the number of libraries currently indexed. */
+    size_t index_count () const { return _indices.size(); }
+    
+    size_t heap_size () const;
+
+private:
+    const export_index *index (const char *library);
+    void purge (const patchmaster::pl_mach_header_t *header);
+    export_status resolve (const export_index *index, const char *symbol, unsigned int depth, uintptr_t *address);
+    
+    /** The registry of loaded images, used to locate libraries and detect unloaded libraries. */
+    const image_registry *_registry;
+    
+    /** All indices, by library mach header. */
+    std::map<const patchmaster::pl_mach_header_t *, std::unique_ptr<export_index>> _indices;
+    
+    /** Index lookup cache, by requested library name. */
+    std::map<std::string, const export_index *> _names;
+    
+    /** Lookup lock */
+    pthread_mutex_t _lock;
+};
+
+} /* namespace xpf */
@@ -0,0 +1,207 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace xpf {
+
+/**
+ * Read a ULEB128 value from [@a p, @a end), advancing @a p. Returns false if the value is truncated or
+ * overflows 64 bits.
+ */
+static inline bool export_trie_uleb128 (const uint8_t *&p, const uint8_t *end, uint64_t *result) {
+    uint64_t value = 0;
+    unsigned int shift = 0;
+    
+    while (p < end) {
+        uint8_t b = *p++;
+        if (shift >= 64 || (shift == 63 && (b & 0x7e) != 0))
+            return false;
+        
+        value |= (uint64_t) (b & 0x7f) << shift;
+        shift += 7;
+        
+        if ((b & 0x80) == 0) {
+            *result = value;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+/**
+ * Call @a fn with the name and flags of every symbol exported by a dyld export trie.
+ *
+ * The trie is treated as untrusted; malformed tries (including tries containing cycles) are rejected, and
+ * symbols visited prior to the failure will already have been reported.
+ *
+ * @param trie The export trie data.
+ * @param size The size of the export trie data.
+ * @param fn A function or function object accepting a `const std::string &` name and `uint64_t` EXPORT_SYMBOL_FLAGS_* value.
+ *
+ * @return Returns true on success, or false if the trie is malformed.
+ */
+template <typename Fn> static inline bool export_trie_walk (const uint8_t *trie, size_t size, Fn &&fn) {
+    if (size == 0)
+        return true;
+    
+    const uint8_t *end = trie + size;
+    
+    /* Pending nodes, and the symbol name prefix at each node */
+    struct pending {
+        uint64_t offset;
+        std::string prefix;
+    };
+    std::vector<pending> stack(1, pending { 0, std::string() });
+    std::vector<bool> visited(size, false);
+    
+    while (!stack.empty()) {
+        pending node = std::move(stack.back());
+        stack.pop_back();
+        
+        if (node.offset >= size || visited[node.offset])
+            return false;
+        visited[node.offset] = true;
+        
+        /* Terminal information */
+        const uint8_t *p = trie + node.offset;
+        uint64_t terminal_size;
+        if (!export_trie_uleb128(p, end, &terminal_size) || terminal_size > (uint64_t) (end - p))
+            return false;
+        
+        if (terminal_size > 0) {
+            const uint8_t *terminal = p;
+            uint64_t flags;
+            if (!export_trie_uleb128(terminal, p + terminal_size, &flags))
+                return false;
+            
+            fn((const std::string &) node.prefix, flags);
+        }
+        
+        /* Child edges; children are visited in reverse order, which is not significant. */
+        p += terminal_size;
+        if (p >= end)
+            return false;
+        
+        uint8_t child_count = *p++;
+        for (uint8_t i = 0; i < child_count; i++) {
+            const uint8_t *nul = (const uint8_t *) memchr(p, '\0', end - p);
+            if (nul == nullptr)
+                return false;
+            
+            std::string prefix = node.prefix;
+            prefix.append((const char *) p, nul - p);
+            
+            p = nul + 1;
+            uint64_t child_offset;
+            if (!export_trie_uleb128(p, end, &child_offset))
+                return false;
+            
+            stack.push_back(pending { child_offset, std::move(prefix) });
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Look up @a symbol in a dyld export trie.
+ *
+ * The trie is treated as untrusted; the walk is bounded by the length of @a symbol, and all reads are bounds checked.
+ *
+ * @param trie The export trie data.
+ * @param size The size of the export trie data.
+ * @param symbol The symbol to look up.
+ * @param terminal_end On success, set to the end of the symbol's terminal information.
+ *
+ * @return Returns a pointer to the symbol's terminal information, beginning with its EXPORT_SYMBOL_FLAGS_* ULEB128
+ * value, or nullptr if the symbol is not exported or the trie is malformed.
+ */
+static inline const uint8_t *export_trie_find (const uint8_t *trie, size_t size, const char *symbol, const uint8_t **terminal_end) {
+    const uint8_t *end = trie + size;
+    const uint8_t *p = trie;
+    const char *s = symbol;
+    
+    /* Every well-formed edge consumes at least one character of the symbol name */
+    for (size_t steps = strlen(symbol) + 1; steps > 0 && size > 0; steps--) {
+        uint64_t terminal_size;
+        if (!export_trie_uleb128(p, end, &terminal_size) || terminal_size > (uint64_t) (end - p))
+            return nullptr;
+        
+        if (*s == '\0') {
+            if (terminal_size == 0)
+                return nullptr;
+            
+            *terminal_end = p + terminal_size;
+            return p;
+        }
+        
+        /* Find the child edge matching the remainder of the symbol name */
+        const uint8_t *children = p + terminal_size;
+        if (children >= end)
+            return nullptr;
+        
+        uint8_t child_count = *children++;
+        bool found = false;
+        uint64_t child_offset = 0;
+        
+        for (uint8_t i = 0; i < child_count && !found; i++) {
+            const uint8_t *nul = (const uint8_t *) memchr(children, '\0', end - children);
+            if (nul == nullptr)
+                return nullptr;
+            
+            size_t edge_len = nul - children;
+            found = (strncmp((const char *) children, s, edge_len) == 0);
+            
+            children = nul + 1;
+            if (!export_trie_uleb128(children, end, &child_offset))
+                return nullptr;
+            
+            if (found)
+                s += edge_len;
+        }
+        
+        if (!found || child_offset >= size)
+            return nullptr;
+        
+        p = trie + child_offset;
+    }
+    
+    return nullptr;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,334 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "image_registry.h"
+#include "macho_util.h"
+
+#include <PLPatchMaster/SymbolName.hpp>
+
+namespace xpf {
+
+/** Initial table size; sufficient for a typical Xcode launch without resizing. */
+static constexpr size_t XPF_IMAGE_REGISTRY_INITIAL_SIZE = 1024;
+
+/**
+ * Construct a new, empty registry.
+ */
+image_registry::image_registry () : _table(new_table(XPF_IMAGE_REGISTRY_INITIAL_SIZE)), _generation(0) {
+    pthread_mutex_init(&_lock, NULL);
+}
+
+/**
+ * Allocate a new, empty table with @a size slots. @a size must be a power of two.
+ */
+image_registry::table *image_registry::new_table (size_t size) {
+    table *t = new table;
+    t->mask = size - 1;
+    t->used = 0;
+    t->slots = new slot[size];
+    
+    for (size_t i = 0; i < size; i++) {
+        t->slots[i].header.store(nullptr, std::memory_order_relaxed);
+        t->slots[i].path.store(nullptr, std::memory_order_relaxed);
+        t->slots[i].install_name = nullptr;
+        t->slots[i].generation.store(0, std::memory_order_relaxed);
+        t->slots[i].state.store(0, std::memory_order_relaxed);
+        t->slots[i].plan = nullptr;
+    }
+    
+    return t;
+}
+
+/**
+ * Look up the live slot for @a header, or nullptr if not found.
+ */
+const image_registry::slot *image_registry::find (const struct mach_header *header) const {
+    const table *t = _table.load(std::memory_order_acquire);
+    
+    for (size_t i = probe_start(t, header); ; i = (i + 1) & t->mask) {
+        const struct mach_header *h = t->slots[i].header.load(std::memory_order_acquire);
+        if (h == header)
+            return &t->slots[i];
+        
+        if (h == nullptr)
+            return nullptr;
+    }
+}
+
+/**
+ * Register a newly loaded image. If @a header is already registered, its path will be updated.
+ *
+ * @param header The image's mach header.
+ * @param path The image's path. This string is borrowed, and must remain valid until the image is removed.
+ */
+void image_registry::insert (const struct mach_header *header, const char *path) {
+    const char *install_name = macho_install_name((const patchmaster::pl_mach_header_t *) header);
+    
+    pthread_mutex_lock(&_lock);
+    
+    table *t = _table.load(std::memory_order_relaxed);
+    
+    /* Update in place if already registered */
+    slot *existing = (slot *) find(header);
+    if (existing != nullptr) {
+        remove_name(existing->path.load(std::memory_order_relaxed), header);
+        existing->path.store(path, std::memory_order_release);
+        add_name(path, header);
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+    
+    /* Resize (discarding tombstones) if the table would exceed a load factor of 0.5 */
+    if ((t->used + 1) * 2 > t->mask + 1) {
+        size_t live = 0;
+        for (size_t i = 0; i <= t->mask; i++) {
+            const struct mach_header *h = t->slots[i].header.load(std::memory_order_relaxed);
+            if (h != nullptr && h != removed_header())
+                live++;
+        }
+        
+        size_t size = XPF_IMAGE_REGISTRY_INITIAL_SIZE;
+        while (size < (live + 1) * 4)
+            size <<= 1;
+        
+        table *resized = new_table(size);
+        for (size_t i = 0; i <= t->mask; i++) {
+            const slot &s = t->slots[i];
+            const struct mach_header *h = s.header.load(std::memory_order_relaxed);
+            if (h == nullptr || h == removed_header())
+                continue;
+            
+            size_t n = probe_start(resized, h);
+            while (resized->slots[n].header.load(std::memory_order_relaxed) != nullptr)
+                n = (n + 1) & resized->mask;
+            
+            resized->slots[n].path.store(s.path.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            resized->slots[n].install_name = s.install_name;
+            resized->slots[n].generation.store(s.generation.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            resized->slots[n].state.store(s.state.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            resized->slots[n].plan = s.plan;
+            resized->slots[n].header.store(h, std::memory_order_relaxed);
+            resized->used++;
+        }
+        
+        /* Publish the new table. The previous table is intentionally leaked; concurrent readers may still
+         * be probing it. */
+        _table.store(resized, std::memory_order_release);
+        t = resized;
+    }
+    
+    /* Populate the slot before publishing the header */
+    size_t n = probe_start(t, header);
+    while (t->slots[n].header.load(std::memory_order_relaxed) != nullptr)
+        n = (n + 1) & t->mask;
+    
+    t->slots[n].path.store(path, std::memory_order_relaxed);
+    t->slots[n].install_name = install_name;
+    t->slots[n].generation.store(++_generation, std::memory_order_relaxed);
+    t->slots[n].state.store(0, std::memory_order_relaxed);
+    t->slots[n].plan = nullptr;
+    t->slots[n].header.store(header, std::memory_order_release);
+    t->used++;
+    
+    add_name(install_name, header);
+    add_name(path, header);
+    
+    pthread_mutex_unlock(&_lock);
+}
+
+/**
+ * Remove an unloaded image from the registry.
+ *
+ * @param header The image's mach header.
+ */
+void image_registry::remove (const struct mach_header *header) {
+    pthread_mutex_lock(&_lock);
+    
+    slot *existing = (slot *) find(header);
+    if (existing != nullptr) {
+        existing->header.store(removed_header(), std::memory_order_release);
+        remove_name(existing->install_name, header);
+        remove_name(existing->path.load(std::memory_order_relaxed), header);
+        delete existing->plan;
+        existing->plan = nullptr;
+    }
+    
+    pthread_mutex_unlock(&_lock);
+}
+
+/**
+ * Return the path of the image loaded at @a header, or nullptr if the image is not registered.
+ */
+const char *image_registry::path (const struct mach_header *header) const {
+    const slot *s = find(header);
+    if (s == nullptr)
+        return nullptr;
+    
+    return s->path.load(std::memory_order_acquire);
+}
+
+/**
+ * Return the registration generation of the image loaded at @a header, or 0 if the image is not registered.
+ */
+uint64_t image_registry::generation (const struct mach_header *header) const {
+    const slot *s = find(header);
+    if (s == nullptr)
+        return 0;
+    
+    return s->generation.load(std::memory_order_acquire);
+}
+
+/**
+ * Index @a header under @a name. The caller must hold _lock.
+ */
+void image_registry::add_name (const char *name, const struct mach_header *header) {
+    if (name == nullptr || *name == '\0')
+        return;
+    
+    if (*name == '/')
+        _absolute_names[name] = header;
+    else
+        _relative_names[name] = header;
+}
+
+/**
+ * Remove the index entry for @a name, if it refers to @a header. The caller must hold _lock.
+ */
+void image_registry::remove_name (const char *name, const struct mach_header *header) {
+    if (name == nullptr || *name == '\0')
+        return;
+    
+    auto &names = (*name == '/') ? _absolute_names : _relative_names;
+    auto entry = names.find(name);
+    if (entry != names.end() && entry->second == header)
+        names.erase(entry);
+}
+
+/**
+ * Find a registered library by install name or path.
+ *
+ * @param name The library's install name or path; relative names are matched by suffix, as per
+ * patchmaster::SymbolName.
+ * @param generation If non-nullptr, set to the library's registration generation on success.
+ *
+ * @return Returns the library's mach header, or nullptr if no matching library is registered.
+ */
+const struct mach_header *image_registry::find_library (const char *name, uint64_t *generation) const {
+    const struct mach_header *header = nullptr;
+    
+    pthread_mutex_lock(&_lock);
+    
+    /* Absolute names are matched exactly; only relative names, on either side, require a suffix match */
+    auto &names = (*name == '/') ? _absolute_names : _relative_names;
+    auto exact = names.find(name);
+    if (exact != names.end()) {
+        header = exact->second;
+    } else {
+        patchmaster::SymbolName target(name, "");
+        auto search = [&](const std::unordered_map<std::string, const struct mach_header *> &candidates) {
+            for (auto &&candidate : candidates) {
+                if (target.match(patchmaster::SymbolName(candidate.first.c_str(), ""))) {
+                    header = candidate.second;
+                    return;
+                }
+            }
+        };
+        
+        search(_relative_names);
+        if (header == nullptr && *name != '/')
+            search(_absolute_names);
+    }
+    
+    if (header != nullptr && generation != nullptr)
+        *generation = find(header)->generation.load(std::memory_order_relaxed);
+    
+    pthread_mutex_unlock(&_lock);
+    return header;
+}
+
+/**
+ * Return the state_flags of the image loaded at @a header, or 0 if the image is not registered.
+ */
+uint32_t image_registry::state (const struct mach_header *header) const {
+    const slot *s = find(header);
+    if (s == nullptr)
+        return 0;
+    
+    return s->state.load(std::memory_order_acquire);
+}
+
+/**
+ * Set the given state_flags on the image loaded at @a header. Has no effect if the image is not registered.
+ *
+ * The update is serialized with insert(); a concurrent resize would otherwise copy the slot's previous state
+ * into the new table, losing the update.
+ */
+void image_registry::set_state (const struct mach_header *header, uint32_t flags) {
+    pthread_mutex_lock(&_lock);
+    
+    slot *s = (slot *) find(header);
+    if (s != nullptr)
+        s->state.fetch_or(flags, std::memory_order_acq_rel);
+    
+    pthread_mutex_unlock(&_lock);
+}
+
+/**
+ * Attach @a plan to the image loaded at @a header, replacing any previously attached plan. Has no effect if the
+ * image is not registered.
+ */
+void image_registry::attach_plan (const struct mach_header *header, std::unique_ptr<mapped_bind_plan> plan) {
+    pthread_mutex_lock(&_lock);
+    
+    slot *s = (slot *) find(header);
+    if (s != nullptr) {
+        delete s->plan;
+        s->plan = plan.release();
+    }
+    
+    pthread_mutex_unlock(&_lock);
+}
+
+/**
+ * Detach and return the plan attached to the image loaded at @a header, or nullptr if none.
+ */
+std::unique_ptr<mapped_bind_plan> image_registry::take_plan (const struct mach_header *header) {
+    pthread_mutex_lock(&_lock);
+    
+    mapped_bind_plan *plan = nullptr;
+    slot *s = (slot *) find(header);
+    if (s != nullptr) {
+        plan = s->plan;
+        s->plan = nullptr;
+    }
+    
+    pthread_mutex_unlock(&_lock);
+    return std::unique_ptr<mapped_bind_plan>(plan);
+}
+
+} /* namespace xpf */
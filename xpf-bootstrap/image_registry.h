@@ -0,0 +1,161 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <mach-o/loader.h>
+
+#include "bind_plan_cache.h"
+
+namespace xpf {
+
+/**
+ * A registry of loaded images, mapping mach header addresses to their path and analysis state.
+ *
+ * The registry is maintained from dyld's image callbacks. Mutation is serialized by an internal lock;
+ * lookups are lock-free, and may be performed concurrently with mutation.
+ *
+ * Image paths are borrowed from dyld, and remain valid only while the image remains loaded.
+ *
+ * Each registration is assigned a unique, non-zero generation; a library unloaded and replaced by another at the
+ * same address will have a new generation. Libraries may also be looked up by install name or path, without
+ * calling back into dyld.
+ *
+ * The registry may also carry an image's bind plan from the pre-bind state change handler through to the image
+ * add callback, avoiding a second bind plan cache lookup.
+ */
+class image_registry {
+public:
+    /**
+     * Image analysis state flags. dyld delivers already-loaded images to newly registered callbacks, and may
+     * deliver an image to the state change handler more than once; these flags ensure that each image is
+     * rewritten and rebound at most once.
+     */
+    enum state_flags : uint32_t {
+        /** The image's bind opcodes have been evaluated, and any required weak rewrites applied. */
+        STATE_BIND_OPCODES_REWRITTEN = 1 << 0,
+        
+        /** The image's rebind table matches have been applied. */
+        STATE_SYMBOLS_REBOUND = 1 << 1,
+    };
+    
+    image_registry ();
+    
+    image_registry (const image_registry &) = delete;
+    image_registry &operator= (const image_registry &) = delete;
+    
+    void insert (const struct mach_header *header, const char *path);
+    void remove (const struct mach_header *header);
+    
+    const char *path (const struct mach_header *header) const;
+    uint64_t generation (const struct mach_header *header) const;
+    const struct mach_header *find_library (const char *name, uint64_t *generation) const;
+    uint32_t state (const struct mach_header *header) const;
+    void set_state (const struct mach_header *header, uint32_t flags);
+    
+    void attach_plan (const struct mach_header *header, std::unique_ptr<mapped_bind_plan> plan);
+    std::unique_ptr<mapped_bind_plan> take_plan (const struct mach_header *header);
+
+private:
+    /** A single registry slot. */
+    struct slot {
+        /** The image header, nullptr if the slot has never been used, or removed_header if the image has been removed. */
+        std::atomic<const struct mach_header *> header;
+        
+        /** The image path */
+        std::atomic<const char *> path;
+        
+        /** The image's LC_ID_DYLIB install name, or nullptr; borrowed from the image's load commands. */
+        const char *install_name;
+        
+        /** The registration generation */
+        std::atomic<uint64_t> generation;
+        
+        /** The image's state_flags */
+        std::atomic<uint32_t> state;
+        
+        /** The image's attached bind plan, if any; owned by the slot. */
+        mapped_bind_plan *plan;
+    };
+    
+    /**
+     * An open-addressed (linear probing) hash table of slots. Removed slots are never reused; tombstones are
+     * discarded when the table is next resized.
+     */
+    struct table {
+        /** Table size mask; the table size is always a power of two. */
+        size_t mask;
+        
+        /** Number of non-empty slots, including tombstones. */
+        size_t used;
+        
+        /** Table slots */
+        slot *slots;
+    };
+    
+    /** Tombstone marker for removed slots */
+    static const struct mach_header *removed_header () { return (const struct mach_header *) (uintptr_t) 1; }
+    
+    /** Return the initial probe index for @a header. */
+    static size_t probe_start (const table *t, const struct mach_header *header) {
+        /* Headers are always page-aligned; discard the low bits */
+        return (size_t) ((((uintptr_t) header) >> 12) * 0x9E3779B97F4A7C15ULL) & t->mask;
+    }
+    
+    static table *new_table (size_t size);
+    const slot *find (const struct mach_header *header) const;
+    
+    void add_name (const char *name, const struct mach_header *header);
+    void remove_name (const char *name, const struct mach_header *header);
+    
+    /** The current table; replaced tables are never deallocated, as they may be in use by concurrent readers. */
+    std::atomic<table *> _table;
+    
+    /** The most recently assigned generation. */
+    uint64_t _generation;
+    
+    /** Registered images by absolute install name and path; guarded by _lock. */
+    std::unordered_map<std::string, const struct mach_header *> _absolute_names;
+    
+    /** Registered images by relative (eg, @rpath) install name; guarded by _lock. */
+    std::unordered_map<std::string, const struct mach_header *> _relative_names;
+    
+    /** Mutation lock; also guards name lookups. */
+    mutable pthread_mutex_t _lock;
+};
+
+} /* namespace xpf */
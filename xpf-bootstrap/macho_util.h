@@ -0,0 +1,181 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+namespace xpf {
+
+/**
+ * Call @a fn with each load command in @a header, stopping early if @a fn returns false.
+ */
+template <typename Fn> static inline void macho_for_each_command (const patchmaster::pl_mach_header_t *header, Fn &&fn) {
+    auto cmd = (const struct load_command *) (header + 1);
+    for (uint32_t i = 0; i < header->ncmds; i++) {
+        if (!fn(cmd))
+            return;
+        
+        cmd = (const struct load_command *) ((const uint8_t *) cmd + cmd->cmdsize);
+    }
+}
+
+/**
+ * Return the segment named @a segname in @a header, or nullptr if not found.
+ */
+static inline const patchmaster::pl_segment_command_t *macho_find_segment (const patchmaster::pl_mach_header_t *header, const char *segname) {
+    const patchmaster::pl_segment_command_t *result = nullptr;
+    macho_for_each_command(header, [&](const struct load_command *cmd) {
+        if (cmd->cmd != patchmaster::PL_LC_SEGMENT)
+            return true;
+        
+        auto segment = (const patchmaster::pl_segment_command_t *) cmd;
+        if (strncmp(segment->segname, segname, sizeof(segment->segname)) != 0)
+            return true;
+        
+        result = segment;
+        return false;
+    });
+    
+    return result;
+}
+
+/**
+ * Return the vmaddr slide of a loaded image, computed from its __TEXT segment.
+ */
+static inline intptr_t macho_vmaddr_slide (const patchmaster::pl_mach_header_t *header) {
+    auto text = macho_find_segment(header, SEG_TEXT);
+    if (text == nullptr)
+        return 0;
+    
+    return (intptr_t) header - (intptr_t) text->vmaddr;
+}
+
+/**
+ * Return true if [@a address, @a address + @a size) lies entirely within a single segment of a loaded image.
+ *
+ * @param header The image's mach header.
+ * @param slide The image's vmaddr slide.
+ * @param address The in-memory address to check.
+ * @param size The size of the range to check.
+ */
+static inline bool macho_contains_range (const patchmaster::pl_mach_header_t *header, intptr_t slide, uintptr_t address, size_t size) {
+    bool found = false;
+    macho_for_each_command(header, [&](const struct load_command *cmd) {
+        if (cmd->cmd != patchmaster::PL_LC_SEGMENT)
+            return true;
+        
+        auto segment = (const patchmaster::pl_segment_command_t *) cmd;
+        uintptr_t start = segment->vmaddr + slide;
+        if (address >= start && size <= segment->vmsize && address - start <= segment->vmsize - size) {
+            found = true;
+            return false;
+        }
+        
+        return true;
+    });
+    
+    return found;
+}
+
+/**
+ * Return the LC_ID_DYLIB install name of @a header, or nullptr if none.
+ */
+static inline const char *macho_install_name (const patchmaster::pl_mach_header_t *header) {
+    const char *name = nullptr;
+    macho_for_each_command(header, [&](const struct load_command *cmd) {
+        if (cmd->cmd != LC_ID_DYLIB)
+            return true;
+        
+        name = (const char *) cmd + ((const struct dylib_command *) cmd)->dylib.name.offset;
+        return false;
+    });
+    
+    return name;
+}
+
+/**
+ * Fetch the LC_UUID of @a header.
+ *
+ * @param header The image's mach header.
+ * @param uuid On success, the image's UUID.
+ *
+ * @return Returns true on success, or false if the image has no LC_UUID.
+ */
+static inline bool macho_get_uuid (const patchmaster::pl_mach_header_t *header, uint8_t uuid[16]) {
+    bool found = false;
+    macho_for_each_command(header, [&](const struct load_command *cmd) {
+        if (cmd->cmd != LC_UUID)
+            return true;
+        
+        memcpy(uuid, ((const struct uuid_command *) cmd)->uuid, 16);
+        found = true;
+        return false;
+    });
+    
+    return found;
+}
+
+/**
+ * Return a fingerprint of the segment layout of @a header: the FNV-1a hash of the header's flags, and of each
+ * segment's vmaddr (relative to the __TEXT segment) and vmsize.
+ *
+ * Copies of a single image (as identified by LC_UUID) may differ in layout; eg, the dyld shared cache's copy of a
+ * library places its segments at different relative addresses than the on-disk copy. Offsets recorded against one
+ * layout are only valid for images with a matching fingerprint.
+ */
+static inline uint32_t macho_layout_hash (const patchmaster::pl_mach_header_t *header) {
+    uint32_t h = 2166136261U;
+    auto mix = [&](uint64_t value) {
+        for (size_t i = 0; i < sizeof(value); i++) {
+            h ^= (uint8_t) (value >> (i * 8));
+            h *= 16777619U;
+        }
+    };
+    
+    auto text = macho_find_segment(header, SEG_TEXT);
+    uint64_t base = (text != nullptr) ? text->vmaddr : 0;
+    
+    mix(header->flags);
+    macho_for_each_command(header, [&](const struct load_command *cmd) {
+        if (cmd->cmd != patchmaster::PL_LC_SEGMENT)
+            return true;
+        
+        auto segment = (const patchmaster::pl_segment_command_t *) cmd;
+        mix(segment->vmaddr - base);
+        mix(segment->vmsize);
+        return true;
+    });
+    
+    return h;
+}
+
+} /* namespace xpf */
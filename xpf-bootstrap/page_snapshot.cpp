@@ -0,0 +1,144 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "page_snapshot.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace xpf {
+
+#ifdef __APPLE__
+/** mincore() result vector element type */
+typedef char mincore_vec_t;
+#else
+typedef unsigned char mincore_vec_t;
+#endif
+
+#ifndef MINCORE_INCORE
+/* Residency is reported in the low bit on all platforms, but not all name it */
+#define MINCORE_INCORE 0x1
+#endif
+
+/**
+ * Capture the state of all pages overlapping [@a address, @a address + @a length), replacing any previously captured
+ * state.
+ *
+ * @return Returns true on success, or false if the range is not (entirely) mapped.
+ */
+bool page_snapshot::capture (const void *address, size_t length) {
+    uintptr_t page_size = getpagesize();
+    uintptr_t start = (uintptr_t) address & ~(page_size - 1);
+    uintptr_t end = ((uintptr_t) address + length + page_size - 1) & ~(page_size - 1);
+    
+    std::vector<mincore_vec_t> vec((end - start) / page_size);
+    if (!vec.empty() && mincore((void *) start, end - start, vec.data()) != 0)
+        return false;
+    
+    _start = start;
+    _pages.resize(vec.size());
+    for (size_t i = 0; i < vec.size(); i++) {
+        uint8_t state = 0;
+        
+        if (vec[i] & MINCORE_INCORE)
+            state |= PAGE_RESIDENT;
+        
+#ifdef MINCORE_MODIFIED
+        if (vec[i] & MINCORE_MODIFIED)
+            state |= PAGE_DIRTY;
+#endif
+        
+        _pages[i] = state;
+    }
+    
+    return true;
+}
+
+/**
+ * Return true if mincore() reports page modification state on this platform.
+ */
+bool page_snapshot::dirty_state_supported () {
+#ifdef MINCORE_MODIFIED
+    return true;
+#else
+    return false;
+#endif
+}
+
+/** Return the number of resident pages. */
+size_t page_snapshot::resident_count () const {
+    size_t count = 0;
+    for (uint8_t state : _pages)
+        count += (state & PAGE_RESIDENT) ? 1 : 0;
+    
+    return count;
+}
+
+/** Return the number of modified pages. */
+size_t page_snapshot::dirty_count () const {
+    size_t count = 0;
+    for (uint8_t state : _pages)
+        count += (state & PAGE_DIRTY) ? 1 : 0;
+    
+    return count;
+}
+
+/**
+ * Return the number of pages that are resident in @a later, but were not resident in this snapshot. Both snapshots
+ * must cover the same range.
+ */
+size_t page_snapshot::newly_resident (const page_snapshot &later) const {
+    return count_transitions(later, PAGE_RESIDENT);
+}
+
+/**
+ * Return the number of pages that are modified in @a later, but were not modified in this snapshot. Both snapshots
+ * must cover the same range.
+ */
+size_t page_snapshot::newly_dirtied (const page_snapshot &later) const {
+    return count_transitions(later, PAGE_DIRTY);
+}
+
+/**
+ * Return the number of pages for which @a flag is unset in this snapshot, and set in @a later.
+ */
+size_t page_snapshot::count_transitions (const page_snapshot &later, uint8_t flag) const {
+    /* Snapshots of differing ranges can not be compared */
+    if (later._start != _start || later._pages.size() != _pages.size())
+        return 0;
+    
+    size_t count = 0;
+    for (size_t i = 0; i < _pages.size(); i++) {
+        if (!(_pages[i] & flag) && (later._pages[i] & flag))
+            count++;
+    }
+    
+    return count;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,82 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+namespace xpf {
+
+/**
+ * A point-in-time snapshot of the residency and modification state of a range of pages, as reported by mincore().
+ *
+ * Snapshots taken before and after a patch step may be diffed to determine the number of pages the step faulted
+ * in or dirtied. Modification state is only available where mincore() reports it (eg, MINCORE_MODIFIED on
+ * Darwin); elsewhere, only residency is tracked, and no pages will be reported as dirty.
+ */
+class page_snapshot {
+public:
+    page_snapshot () : _start(0) {}
+    
+    bool capture (const void *address, size_t length);
+    
+    size_t resident_count () const;
+    size_t dirty_count () const;
+    
+    size_t newly_resident (const page_snapshot &later) const;
+    size_t newly_dirtied (const page_snapshot &later) const;
+    
+    /** Return the number of pages covered by this snapshot. */
+    size_t page_count () const { return _pages.size(); }
+    
+    /** Return true if mincore() reports page modification state on this platform. */
+    static bool dirty_state_supported ();
+
+private:
+    /** Per-page state flags */
+    enum {
+        /** The page is resident. */
+        PAGE_RESIDENT = 1 << 0,
+        
+        /** The page has been modified. */
+        PAGE_DIRTY = 1 << 1
+    };
+    
+    size_t count_transitions (const page_snapshot &later, uint8_t flag) const;
+    
+    /** Page-aligned start address of the snapshot */
+    uintptr_t _start;
+    
+    /** Per-page state flags, one entry per page */
+    std::vector<uint8_t> _pages;
+};
+
+} /* namespace xpf */
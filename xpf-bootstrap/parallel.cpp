@@ -0,0 +1,128 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "parallel.h"
+
+#include "async_log.h"
+
+#include <atomic>
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/sysctl.h>
+
+namespace xpf {
+
+/** Upper bound on the number of threads used by parallel_for() */
+static constexpr size_t XPF_PARALLEL_MAX_WORKERS = 8;
+
+/** True on any thread currently executing parallel_for() work, including the calling thread. */
+static __thread bool parallel_worker_active = false;
+
+/** Shared parallel_for() state */
+struct parallel_context {
+    /** The per-index function and its context */
+    void (*fn)(void *ctx, size_t i);
+    void *ctx;
+    
+    /** The next unclaimed index */
+    std::atomic<size_t> next;
+    
+    /** Total number of indices */
+    size_t count;
+};
+
+/**
+ * Worker entry point; claims and processes indices until none remain.
+ */
+static void *parallel_worker (void *arg) {
+    auto context = (parallel_context *) arg;
+    
+    parallel_worker_active = true;
+    
+    size_t i;
+    while ((i = context->next.fetch_add(1, std::memory_order_relaxed)) < context->count)
+        context->fn(context->ctx, i);
+    
+    parallel_worker_active = false;
+    return nullptr;
+}
+
+/**
+ * Return true if the current thread is executing parallel_for() work.
+ */
+bool parallel_in_worker () {
+    return parallel_worker_active;
+}
+
+/**
+ * Return the default number of parallel_for() workers for this host.
+ */
+size_t parallel_worker_count () {
+    int ncpu;
+    size_t len = sizeof(ncpu);
+    if (sysctlbyname("hw.activecpu", &ncpu, &len, NULL, 0) != 0 || ncpu < 1)
+        return 1;
+    
+    return ((size_t) ncpu < XPF_PARALLEL_MAX_WORKERS) ? (size_t) ncpu : XPF_PARALLEL_MAX_WORKERS;
+}
+
+/**
+ * Type-erased implementation of parallel_for().
+ */
+void parallel_for_impl (size_t count, size_t workers, void (*fn)(void *ctx, size_t i), void *ctx) {
+    parallel_context context;
+    context.fn = fn;
+    context.ctx = ctx;
+    context.next = 0;
+    context.count = count;
+    
+    if (workers > count)
+        workers = count;
+    
+    /* Spawn our additional workers; on failure, we simply proceed with fewer threads */
+    pthread_t threads[XPF_PARALLEL_MAX_WORKERS];
+    size_t spawned = 0;
+    for (size_t i = 1; i < workers && spawned < XPF_PARALLEL_MAX_WORKERS; i++) {
+        int err = pthread_create(&threads[spawned], NULL, parallel_worker, &context);
+        if (err != 0) {
+            PMLog("pthread_create() failed: %s", strerror(err));
+            break;
+        }
+        
+        spawned++;
+    }
+    
+    /* Participate, and then wait for all workers to finish */
+    parallel_worker(&context);
+    
+    for (size_t i = 0; i < spawned; i++)
+        pthread_join(threads[i], NULL);
+}
+
+} /* namespace xpf */
@@ -0,0 +1,63 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <type_traits>
+
+namespace xpf {
+
+size_t parallel_worker_count ();
+bool parallel_in_worker ();
+void parallel_for_impl (size_t count, size_t workers, void (*fn)(void *ctx, size_t i), void *ctx);
+
+/**
+ * Call @a fn with every index in [0, @a count), distributing the work across up to @a workers threads.
+ *
+ * The calling thread participates in the work, and all worker threads are joined before returning. Workers
+ * are plain pthreads, and no libdispatch or Objective-C runtime state is required; this is safe to use
+ * prior to main(), including from within dyld image callbacks, provided that @a fn does not itself call
+ * back into dyld.
+ *
+ * dyld holds its global lock for the duration of an image callback. A worker that calls back into dyld (or
+ * into anything that may take the dyld lock, such as dlopen(), dladdr(), or the Objective-C runtime) will
+ * deadlock against the waiting caller; code reachable from @a fn may use parallel_in_worker() to detect
+ * and reject such calls.
+ *
+ * @param count The number of indices to process.
+ * @param workers The maximum number of threads to use, including the calling thread.
+ * @param fn A function or function object accepting a `size_t` index.
+ */
+template <typename Fn> void parallel_for (size_t count, size_t workers, Fn &&fn) {
+    typedef typename std::remove_reference<Fn>::type fn_type;
+    parallel_for_impl(count, workers, [](void *ctx, size_t i) { (*(fn_type *) ctx)(i); }, (void *) &fn);
+}
+
+} /* namespace xpf */
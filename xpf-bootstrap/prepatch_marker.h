@@ -0,0 +1,71 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Load command marking an image that has been prepatched on disk by xpf-prepatch.
+ *
+ * LC_REQ_DYLD is not set, and dyld will ignore the command.
+ */
+#define XPF_LC_PREPATCHED 0x00585046 /* 'XPF' */
+
+/** Current version of the xpf_prepatch_command structure; also incremented if the prepatched changes differ */
+#define XPF_PREPATCH_VERSION 3
+
+/**
+ * Set if every import matching the rebind table was redirected to a shim library on disk. Otherwise, the image's
+ * rebind table imports were left untouched, and must still be rebound at runtime.
+ */
+#define XPF_PREPATCH_FLAG_REBOUND (1 << 0)
+
+/**
+ * XPF_LC_PREPATCHED load command.
+ */
+struct xpf_prepatch_command {
+    /** XPF_LC_PREPATCHED */
+    uint32_t cmd;
+    
+    /** sizeof(struct xpf_prepatch_command) */
+    uint32_t cmdsize;
+    
+    /** XPF_PREPATCH_VERSION */
+    uint32_t version;
+    
+    /** The xpf_rules_hash() of the rule tables applied to the image. If this does not match the rule tables of
+     * the running xpf-bootstrap, the image must be patched at runtime. */
+    uint32_t rules_hash;
+    
+    /** XPF_PREPATCH_FLAG_* */
+    uint32_t flags;
+    
+    /** Reserved; pads the command to a multiple of 8 bytes. */
+    uint32_t reserved;
+};
@@ -0,0 +1,265 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+namespace xpf {
+
+/**
+ * A fixed-capacity map from (non-NULL, at least 2-byte aligned) pointers to values, with lock-free lookup.
+ *
+ * Lookups never block, and may be performed concurrently with insertion and removal from any thread. Insertions and
+ * removals are serialized by a spin lock; they're expected to be far less frequent than lookups. Removed slots are
+ * reused by later insertions; insertion fails only when @a Capacity live entries are present.
+ *
+ * Removal leaves a TOMBSTONE in the removed slot, so that lookups of keys further along the same probe sequence
+ * continue past it. Any run of tombstones that ends at an EMPTY slot (or that spans the entire table) can't lie on
+ * the probe sequence of a live key, and is returned to EMPTY; this keeps lookup misses short after arbitrary
+ * insert/remove churn.
+ *
+ * Lookups are safe against concurrent removal of *other* keys, but callers must ensure that a key's value is not
+ * deallocated while it may still be looked up; in practice, the key's owner removes it prior to deallocating the value.
+ *
+ * Instances are intended to be declared with static storage duration; zero-initialization produces an empty table,
+ * and no static constructor is required.
+ */
+template <typename T, size_t Capacity> class ptr_table {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    /**
+     * Insert @a value for @a key, replacing any existing value.
+     *
+     * The key's probe sequence is searched for an existing entry up to the first EMPTY slot; only then is the first
+     * TOMBSTONE (or the EMPTY slot) claimed, ensuring that a key is never present in more than one slot.
+     *
+     * @return Returns false if the table is full.
+     */
+    bool insert (const void *key, T *value) {
+        uintptr_t k = (uintptr_t) key;
+        writer_lock lock(*this);
+        
+        slot *free = nullptr;
+        for (size_t i = 0, idx = hash(k); i < Capacity; i++, idx = next(idx)) {
+            slot &s = _slots[idx];
+            uintptr_t cur = s.key.load(std::memory_order_relaxed);
+            
+            if (cur == k) {
+                s.value.store(value, std::memory_order_release);
+                return true;
+            }
+            
+            if (cur == TOMBSTONE && free == nullptr)
+                free = &s;
+            
+            /* No entry for the key exists beyond the first EMPTY slot */
+            if (cur == EMPTY) {
+                if (free == nullptr)
+                    free = &s;
+                break;
+            }
+        }
+        
+        if (free == nullptr)
+            return false;
+        
+        /* Publish the value before the key, so that a concurrent lookup never observes a stale value */
+        free->value.store(value, std::memory_order_relaxed);
+        free->key.store(k, std::memory_order_release);
+        _count.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+    
+    /**
+     * Return the value for @a key, or nullptr if not found.
+     */
+    T *find (const void *key) const {
+        size_t probes;
+        const slot *s = lookup((uintptr_t) key, &probes);
+        if (s == nullptr)
+            return nullptr;
+        
+        return s->value.load(std::memory_order_acquire);
+    }
+    
+    /**
+     * Remove @a key, if present.
+     */
+    void remove (const void *key) {
+        uintptr_t k = (uintptr_t) key;
+        writer_lock lock(*this);
+        
+        size_t probes;
+        slot *s = const_cast<slot *>(lookup(k, &probes));
+        if (s == nullptr)
+            return;
+        
+        s->key.store(TOMBSTONE, std::memory_order_release);
+        s->value.store(nullptr, std::memory_order_relaxed);
+        _count.fetch_sub(1, std::memory_order_release);
+        
+        reclaim((size_t) (s - _slots));
+    }
+    
+    /**
+     * Return true if the table has no entries. This is a single relaxed load, and may be used to skip lookups
+     * entirely on hot paths.
+     */
+    bool empty () const {
+        return _count.load(std::memory_order_relaxed) == 0;
+    }
+    
+    /**
+     * Return the number of slots examined by a lookup of @a key; used to verify that probe sequences remain short.
+     */
+    size_t probe_length (const void *key) const {
+        size_t probes;
+        lookup((uintptr_t) key, &probes);
+        return probes;
+    }
+
+private:
+    /** Key of an unused slot; must be zero, for zero-initialization. */
+    static constexpr uintptr_t EMPTY = 0;
+    
+    /** Key of a removed slot that may still lie on another key's probe sequence */
+    static constexpr uintptr_t TOMBSTONE = 1;
+    
+    /** Return the initial probe index for @a key */
+    static size_t hash (uintptr_t key) {
+        /* Discard the (always zero) alignment bits, and apply Fibonacci hashing */
+        return ((size_t) (key >> 4) * (size_t) 2654435769U) & (Capacity - 1);
+    }
+    
+    /** Return the probe index following @a idx */
+    static size_t next (size_t idx) {
+        return (idx + 1) & (Capacity - 1);
+    }
+    
+    /** Return the probe index preceding @a idx */
+    static size_t prev (size_t idx) {
+        return (idx - 1) & (Capacity - 1);
+    }
+    
+    /** A single table slot */
+    struct slot {
+        /** The slot's key, EMPTY, or TOMBSTONE */
+        std::atomic<uintptr_t> key;
+        
+        /** The slot's value */
+        std::atomic<T *> value;
+    };
+    
+    /** Scoped acquisition of the table's writer lock */
+    class writer_lock {
+    public:
+        explicit writer_lock (ptr_table &table) : _table(table) {
+            while (_table._writer.exchange(true, std::memory_order_acquire))
+                sched_yield();
+        }
+        
+        ~writer_lock () {
+            _table._writer.store(false, std::memory_order_release);
+        }
+        
+        writer_lock (const writer_lock &) = delete;
+        writer_lock &operator= (const writer_lock &) = delete;
+        
+    private:
+        ptr_table &_table;
+    };
+    
+    /**
+     * Return the slot holding @a k, or nullptr if not found, setting @a probes to the number of slots examined.
+     *
+     * A lookup terminates at the first EMPTY slot. Tombstones are only returned to EMPTY when no live key's probe
+     * sequence passes through them, so a concurrent reclaim never hides a live entry.
+     */
+    const slot *lookup (uintptr_t k, size_t *probes) const {
+        size_t i = 0;
+        for (size_t idx = hash(k); i < Capacity; idx = next(idx)) {
+            const slot &s = _slots[idx];
+            uintptr_t cur = s.key.load(std::memory_order_acquire);
+            i++;
+            
+            if (cur == k) {
+                *probes = i;
+                return &s;
+            }
+            
+            if (cur == EMPTY)
+                break;
+        }
+        
+        *probes = i;
+        return nullptr;
+    }
+    
+    /**
+     * Return the run of tombstones containing @a idx to EMPTY, if that run ends at an EMPTY slot or spans the
+     * entire table. Must be called with the writer lock held.
+     *
+     * Every key is stored before the first EMPTY slot of its probe sequence; a run of tombstones followed by an
+     * EMPTY slot therefore lies on no live key's probe sequence, and emptying it slot by slot (from the end nearest
+     * the EMPTY slot) preserves that property at every step.
+     */
+    void reclaim (size_t idx) {
+        size_t end = idx;
+        size_t run = 0;
+        while (run < Capacity && _slots[end].key.load(std::memory_order_relaxed) == TOMBSTONE) {
+            end = next(end);
+            run++;
+        }
+        
+        if (run < Capacity && _slots[end].key.load(std::memory_order_relaxed) != EMPTY)
+            return;
+        
+        for (size_t i = 0, cur = prev(end); i < Capacity; i++, cur = prev(cur)) {
+            if (_slots[cur].key.load(std::memory_order_relaxed) != TOMBSTONE)
+                break;
+            _slots[cur].key.store(EMPTY, std::memory_order_release);
+        }
+    }
+    
+    /** Table slots */
+    slot _slots[Capacity];
+    
+    /** Number of live entries */
+    std::atomic<size_t> _count;
+    
+    /** Set while an insertion or removal holds the writer lock */
+    std::atomic<bool> _writer;
+};
+
+} /* namespace xpf */
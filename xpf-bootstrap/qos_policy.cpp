@@ -0,0 +1,356 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "qos_policy.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <sys/resource.h>
+#endif
+
+namespace xpf {
+
+/** QoS class names, as accepted by qos_policy_parse(), indexed by qos_class_index() */
+static const char *qos_class_names[XPF_QOS_CLASS_COUNT] = {
+    "user-interactive",
+    "user-initiated",
+    "default",
+    "utility",
+    "background",
+    "unspecified"
+};
+
+/**
+ * Default policies, indexed by qos_class_index(). Interactive and default work runs at the default priority;
+ * utility and background work is deprioritized, so that it does not compete with the UI thread.
+ */
+#define XPF_QOS_DEFAULT_POLICIES { \
+    /* user-interactive */  { 0,   XPF_QOS_QUEUE_HIGH,          0,  false }, \
+    /* user-initiated */    { 0,   XPF_QOS_QUEUE_HIGH,          0,  false }, \
+    /* default */           { 0,   XPF_QOS_QUEUE_DEFAULT,       0,  false }, \
+    /* utility */           { -4,  XPF_QOS_QUEUE_LOW,           5,  false }, \
+    /* background */        { -16, XPF_QOS_QUEUE_BACKGROUND,    10, true }, \
+    /* unspecified */       { 0,   XPF_QOS_QUEUE_DEFAULT,       0,  false } \
+}
+
+/** The active policy table; constant-initialized, and only modified by qos_policy_init(). */
+static qos_policy_table qos_policies = { XPF_QOS_DEFAULT_POLICIES };
+
+/**
+ * Return the policy table index of @a qos_class; unknown values are treated as XPF_QOS_UNSPECIFIED.
+ */
+static size_t qos_class_index (long qos_class) {
+    switch (qos_class) {
+        case XPF_QOS_USER_INTERACTIVE:  return 0;
+        case XPF_QOS_USER_INITIATED:    return 1;
+        case XPF_QOS_DEFAULT:           return 2;
+        case -1:                        return 2; /* NSQualityOfServiceDefault */
+        case XPF_QOS_UTILITY:           return 3;
+        case XPF_QOS_BACKGROUND:        return 4;
+        default:                        return 5;
+    }
+}
+
+/**
+ * Return true if @a qos_class is a known QoS class value, other than XPF_QOS_UNSPECIFIED.
+ */
+bool qos_class_valid (long qos_class) {
+    return qos_class_index(qos_class) != 5;
+}
+
+/**
+ * Reset @a table to the default policies.
+ */
+void qos_policy_defaults (qos_policy_table &table) {
+    table = qos_policy_table { XPF_QOS_DEFAULT_POLICIES };
+}
+
+/**
+ * Parse @a value as a signed integer, returning false if it is not a valid integer in [@a min, @a max].
+ */
+static bool qos_parse_int (const std::string &value, long min, long max, long *result) {
+    if (value.empty())
+        return false;
+    
+    char *end;
+    errno = 0;
+    long v = strtol(value.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || v < min || v > max)
+        return false;
+    
+    *result = v;
+    return true;
+}
+
+/**
+ * Parse a single `key=value` policy setting into @a policy.
+ */
+static bool qos_parse_setting (const std::string &setting, qos_policy &policy, std::string &error) {
+    size_t eq = setting.find('=');
+    if (eq == std::string::npos) {
+        error = "missing '=' in setting '" + setting + "'";
+        return false;
+    }
+    
+    std::string key = setting.substr(0, eq);
+    std::string value = setting.substr(eq + 1);
+    long v;
+    
+    if (key == "priority") {
+        if (!qos_parse_int(value, -64, 64, &v)) {
+            error = "invalid priority '" + value + "'";
+            return false;
+        }
+        policy.priority = (int) v;
+    } else if (key == "queue") {
+        if (value == "high") {
+            policy.queue_priority = XPF_QOS_QUEUE_HIGH;
+        } else if (value == "default") {
+            policy.queue_priority = XPF_QOS_QUEUE_DEFAULT;
+        } else if (value == "low") {
+            policy.queue_priority = XPF_QOS_QUEUE_LOW;
+        } else if (value == "background") {
+            policy.queue_priority = XPF_QOS_QUEUE_BACKGROUND;
+        } else {
+            error = "invalid queue priority '" + value + "'";
+            return false;
+        }
+    } else if (key == "nice") {
+        if (!qos_parse_int(value, -20, 20, &v)) {
+            error = "invalid nice value '" + value + "'";
+            return false;
+        }
+        policy.nice = (int) v;
+    } else if (key == "io") {
+        if (value == "throttle") {
+            policy.throttle_io = true;
+        } else if (value == "default") {
+            policy.throttle_io = false;
+        } else {
+            error = "invalid io policy '" + value + "'";
+            return false;
+        }
+    } else {
+        error = "unknown setting '" + key + "'";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Parse a policy specification, applying its settings to @a table. The specification is a `;`-separated list
+ * of `class:key=value,...` entries; for example:
+ *
+ *     background:priority=-20,nice=15,io=throttle;utility:queue=default
+ *
+ * Classes are named `user-interactive`, `user-initiated`, `default`, `utility`, `background`, and `unspecified`.
+ * The supported keys are `priority` (relative thread priority), `queue` (`high`, `default`, `low` or `background`),
+ * `nice` (child process nice value), and `io` (`throttle` or `default`). Settings that are not specified retain
+ * their existing values.
+ *
+ * @param spec The policy specification.
+ * @param table The table to be updated; on failure, the table is not modified.
+ * @param error On failure, a description of the error.
+ *
+ * @return Returns true on success, or false if the specification is invalid.
+ */
+bool qos_policy_parse (const char *spec, qos_policy_table &table, std::string &error) {
+    qos_policy_table result = table;
+    std::string entries(spec);
+    
+    size_t pos = 0;
+    while (pos <= entries.size()) {
+        size_t end = entries.find(';', pos);
+        if (end == std::string::npos)
+            end = entries.size();
+        
+        std::string entry = entries.substr(pos, end - pos);
+        pos = end + 1;
+        
+        /* Permit empty entries (eg, a trailing ';') */
+        if (entry.empty())
+            continue;
+        
+        size_t colon = entry.find(':');
+        if (colon == std::string::npos) {
+            error = "missing ':' in entry '" + entry + "'";
+            return false;
+        }
+        
+        std::string name = entry.substr(0, colon);
+        size_t idx;
+        for (idx = 0; idx < XPF_QOS_CLASS_COUNT; idx++) {
+            if (name == qos_class_names[idx])
+                break;
+        }
+        
+        if (idx == XPF_QOS_CLASS_COUNT) {
+            error = "unknown QoS class '" + name + "'";
+            return false;
+        }
+        
+        std::string settings = entry.substr(colon + 1);
+        size_t spos = 0;
+        while (spos < settings.size()) {
+            size_t send = settings.find(',', spos);
+            if (send == std::string::npos)
+                send = settings.size();
+            
+            if (!qos_parse_setting(settings.substr(spos, send - spos), result.policies[idx], error))
+                return false;
+            
+            spos = send + 1;
+        }
+    }
+    
+    table = result;
+    return true;
+}
+
+/**
+ * Return the policy for @a qos_class from @a table.
+ */
+const qos_policy &qos_policy_lookup (const qos_policy_table &table, long qos_class) {
+    return table.policies[qos_class_index(qos_class)];
+}
+
+/**
+ * Compute the absolute thread priority for @a policy under the given scheduling policy, clamped to the scheduling
+ * policy's valid priority range.
+ *
+ * @param sched_policy The thread's scheduling policy (eg, SCHED_OTHER).
+ * @param policy The QoS policy.
+ * @param relative_priority An additional (typically negative) offset, as supplied to the QoS APIs.
+ */
+int qos_thread_priority (int sched_policy, const qos_policy &policy, int relative_priority) {
+    int min = sched_get_priority_min(sched_policy);
+    int max = sched_get_priority_max(sched_policy);
+    if (min < 0 || max < min)
+        return 0;
+    
+    int priority = (min + max) / 2 + policy.priority + relative_priority;
+    if (priority < min)
+        return min;
+    if (priority > max)
+        return max;
+    
+    return priority;
+}
+
+/**
+ * Return the thread priority for @a policy, expressed as a value between 0.0 and 1.0 relative to the range of
+ * SCHED_OTHER (as used by -[NSOperation setThreadPriority:]).
+ */
+double qos_relative_thread_priority (const qos_policy &policy) {
+    int min = sched_get_priority_min(SCHED_OTHER);
+    int max = sched_get_priority_max(SCHED_OTHER);
+    if (min < 0 || max <= min)
+        return 0.5;
+    
+    return (double) (qos_thread_priority(SCHED_OTHER, policy, 0) - min) / (max - min);
+}
+
+/**
+ * Apply any policy overrides from XPF_QOS_POLICY; see qos_policy_parse() for the format. This must be called
+ * prior to main().
+ *
+ * @param error On failure, a description of the error.
+ *
+ * @return Returns false if XPF_QOS_POLICY is set and invalid; the default policies remain in effect.
+ */
+bool qos_policy_init (std::string &error) {
+    const char *spec = getenv("XPF_QOS_POLICY");
+    if (spec == nullptr)
+        return true;
+    
+    return qos_policy_parse(spec, qos_policies, error);
+}
+
+/**
+ * Return the active policy for @a qos_class.
+ */
+const qos_policy &qos_policy_lookup (long qos_class) {
+    return qos_policy_lookup(qos_policies, qos_class);
+}
+
+/**
+ * Apply @a policy to the calling thread.
+ *
+ * @param policy The policy to apply, or nullptr to leave the thread unmodified.
+ * @param relative_priority An additional (typically negative) priority offset.
+ */
+qos_thread_scope::qos_thread_scope (const qos_policy *policy, int relative_priority) : _restore_sched(false), _restore_io(false) {
+    if (policy == nullptr)
+        return;
+    
+    if (pthread_getschedparam(pthread_self(), &_sched_policy, &_sched_param) == 0) {
+        struct sched_param param = _sched_param;
+        param.sched_priority = qos_thread_priority(_sched_policy, *policy, relative_priority);
+        if (param.sched_priority != _sched_param.sched_priority)
+            _restore_sched = (pthread_setschedparam(pthread_self(), _sched_policy, &param) == 0);
+    }
+
+#ifdef __APPLE__
+    if (policy->throttle_io) {
+        _io_policy = getiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD);
+        if (_io_policy >= 0 && _io_policy != IOPOL_THROTTLE)
+            _restore_io = (setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE) == 0);
+    }
+#endif
+}
+
+qos_thread_scope::~qos_thread_scope () {
+    if (_restore_sched)
+        pthread_setschedparam(pthread_self(), _sched_policy, &_sched_param);
+
+#ifdef __APPLE__
+    if (_restore_io)
+        setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, _io_policy);
+#endif
+}
+
+} /* namespace xpf */
+
+/**
+ * Return the NSOperation thread priority (0.0-1.0) for @a qos_class; for use by our Objective-C facades.
+ */
+extern "C" double xpf_qos_thread_priority (long qos_class) {
+    return xpf::qos_relative_thread_priority(xpf::qos_policy_lookup(qos_class));
+}
+
+/**
+ * Return the legacy dispatch queue priority for @a qos_class; for use by our Objective-C facades.
+ */
+extern "C" long xpf_qos_queue_priority (long qos_class) {
+    return xpf::qos_policy_lookup(qos_class).queue_priority;
+}
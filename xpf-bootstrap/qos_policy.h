@@ -0,0 +1,135 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+
+#include <pthread.h>
+
+#include <string>
+
+namespace xpf {
+
+/** Yosemite QoS class values; these match the qos_class_t and NSQualityOfService constants. */
+enum qos_class_value {
+    XPF_QOS_USER_INTERACTIVE = 0x21,
+    XPF_QOS_USER_INITIATED = 0x19,
+    XPF_QOS_DEFAULT = 0x15,
+    XPF_QOS_UTILITY = 0x11,
+    XPF_QOS_BACKGROUND = 0x09,
+    XPF_QOS_UNSPECIFIED = 0x00
+};
+
+/** Number of QoS classes, including XPF_QOS_UNSPECIFIED */
+static constexpr size_t XPF_QOS_CLASS_COUNT = 6;
+
+/** Legacy global queue priorities; these match the DISPATCH_QUEUE_PRIORITY_* constants. */
+enum qos_queue_priority {
+    XPF_QOS_QUEUE_HIGH = 2,
+    XPF_QOS_QUEUE_DEFAULT = 0,
+    XPF_QOS_QUEUE_LOW = -2,
+    XPF_QOS_QUEUE_BACKGROUND = -32768
+};
+
+/**
+ * The concrete scheduling policy applied for a QoS class.
+ */
+struct qos_policy {
+    /** Thread scheduling priority, relative to the default priority of the thread's scheduling policy. */
+    int priority;
+    
+    /** The legacy global queue priority used in place of the QoS class. */
+    long queue_priority;
+    
+    /** The nice value applied to child processes. */
+    int nice;
+    
+    /** If true, disk I/O is throttled; for child processes, this places the process in the background band. */
+    bool throttle_io;
+};
+
+/**
+ * A table of QoS class policies.
+ */
+struct qos_policy_table {
+    /** Policies, indexed by qos_class_index() */
+    qos_policy policies[XPF_QOS_CLASS_COUNT];
+};
+
+void qos_policy_defaults (qos_policy_table &table);
+bool qos_policy_parse (const char *spec, qos_policy_table &table, std::string &error);
+const qos_policy &qos_policy_lookup (const qos_policy_table &table, long qos_class);
+bool qos_class_valid (long qos_class);
+int qos_thread_priority (int sched_policy, const qos_policy &policy, int relative_priority);
+double qos_relative_thread_priority (const qos_policy &policy);
+
+bool qos_policy_init (std::string &error);
+const qos_policy &qos_policy_lookup (long qos_class);
+
+/**
+ * Applies a QoS policy to the calling thread for the lifetime of the instance, restoring the thread's previous
+ * scheduling priority (and I/O policy) on destruction.
+ */
+class qos_thread_scope {
+public:
+    qos_thread_scope (const qos_policy *policy, int relative_priority);
+    ~qos_thread_scope ();
+    
+    qos_thread_scope (const qos_thread_scope &) = delete;
+    qos_thread_scope &operator= (const qos_thread_scope &) = delete;
+
+private:
+    /** If true, the thread's scheduling parameters must be restored. */
+    bool _restore_sched;
+    
+    /** The thread's previous scheduling policy and parameters. */
+    int _sched_policy;
+    struct sched_param _sched_param;
+    
+    /** If true, the thread's I/O policy must be restored. */
+    bool _restore_io;
+    
+    /** The thread's previous I/O policy. */
+    int _io_policy;
+};
+
+} /* namespace xpf */
+
+#endif /* __cplusplus */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+double xpf_qos_thread_priority (long qos_class);
+long xpf_qos_queue_priority (long qos_class);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rebind_table.h"
+#include "qos_policy.h"
+#include "ptr_table.h"
+#include "XPFLog.h"
+#include "async_log.h"
+
+#include <errno.h>
+#include <spawn.h>
+#include <sys/qos.h>
+#include <sys/resource.h>
+#include <dispatch/dispatch.h>
+
+namespace xpf {
+
+/*
+ * Yosemite's QoS classes have no Mavericks equivalent; we map them to concrete scheduling policy via the
+ * qos_policy table: global queue priorities, thread priorities, and child process nice/background state.
+ */
+
+/** Maximum number of live posix_spawnattr_t instances with an assigned QoS class. */
+static constexpr size_t XPF_SPAWN_QOS_TABLE_SIZE = 256;
+
+/**
+ * QoS policies assigned via posix_spawnattr_set_qos_class_np(), keyed by posix_spawnattr_t, and removed by
+ * posix_spawnattr_destroy(). Removed slots are reclaimed by the table, so posix_spawn() lookups of attributes with no
+ * assigned QoS class remain short however many attributes a long-running process creates and destroys.
+ */
+static ptr_table<const qos_policy, XPF_SPAWN_QOS_TABLE_SIZE> spawn_qos_table;
+
+static int xpf_posix_spawnattr_set_qos_class_np (posix_spawnattr_t *attr, qos_class_t qos_class) {
+    if (attr == NULL || *attr == NULL)
+        return EINVAL;
+    
+    if (!qos_class_valid(qos_class)) {
+        spawn_qos_table.remove(*attr);
+    } else if (!spawn_qos_table.insert(*attr, &qos_policy_lookup(qos_class))) {
+        XPFLogOnce("Warning! Too many live posix_spawnattr_t instances with an assigned QoS class; the QoS class of new instances will be ignored. This message will be logged only once.");
+    }
+    
+    return 0;
+}
+XPF_REBIND_ENTRY("_posix_spawnattr_set_qos_class_np", "libSystem.B.dylib", NULL, (uintptr_t) &xpf_posix_spawnattr_set_qos_class_np);
+
+static int (*orig_posix_spawnattr_destroy) (posix_spawnattr_t *attr);
+static int xpf_posix_spawnattr_destroy (posix_spawnattr_t *attr) {
+    if (attr != NULL && *attr != NULL && !spawn_qos_table.empty())
+        spawn_qos_table.remove(*attr);
+    
+    return orig_posix_spawnattr_destroy(attr);
+}
+XPF_REBIND_ENTRY("_posix_spawnattr_destroy", "libSystem.B.dylib", (void **) &orig_posix_spawnattr_destroy, (uintptr_t) &xpf_posix_spawnattr_destroy);
+
+/**
+ * Apply the QoS policy assigned to @a attrp (if any) to the newly spawned process @a pid.
+ *
+ * The policy is applied after the child has started, and the child briefly runs with our own scheduling state.
+ */
+static void spawn_apply_qos (pid_t pid, const posix_spawnattr_t *attrp) {
+    if (attrp == NULL || *attrp == NULL || spawn_qos_table.empty())
+        return;
+    
+    const qos_policy *policy = spawn_qos_table.find(*attrp);
+    if (policy == nullptr)
+        return;
+    
+    if (policy->nice != 0)
+        setpriority(PRIO_PROCESS, pid, policy->nice);
+    
+    if (policy->throttle_io)
+        setpriority(PRIO_DARWIN_PROCESS, pid, PRIO_DARWIN_BG);
+}
+
+static int (*orig_posix_spawn) (pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions, const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]);
+static int xpf_posix_spawn (pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions, const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]) {
+    pid_t child;
+    int ret = orig_posix_spawn(&child, path, file_actions, attrp, argv, envp);
+    if (ret != 0)
+        return ret;
+    
+    spawn_apply_qos(child, attrp);
+    if (pid != NULL)
+        *pid = child;
+    
+    return ret;
+}
+XPF_REBIND_ENTRY("_posix_spawn", "libSystem.B.dylib", (void **) &orig_posix_spawn, (uintptr_t) &xpf_posix_spawn);
+
+static int (*orig_posix_spawnp) (pid_t *pid, const char *file, const posix_spawn_file_actions_t *file_actions, const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]);
+static int xpf_posix_spawnp (pid_t *pid, const char *file, const posix_spawn_file_actions_t *file_actions, const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]) {
+    pid_t child;
+    int ret = orig_posix_spawnp(&child, file, file_actions, attrp, argv, envp);
+    if (ret != 0)
+        return ret;
+    
+    spawn_apply_qos(child, attrp);
+    if (pid != NULL)
+        *pid = child;
+    
+    return ret;
+}
+XPF_REBIND_ENTRY("_posix_spawnp", "libSystem.B.dylib", (void **) &orig_posix_spawnp, (uintptr_t) &xpf_posix_spawnp);
+
+/*
+ * Yosemite's dispatch_get_global_queue() accepts QoS classes in place of the legacy queue priorities; Mavericks'
+ * implementation returns NULL for any unknown identifier.
+ */
+static dispatch_queue_t (*orig_dispatch_get_global_queue) (long identifier, unsigned long flags);
+static dispatch_queue_t xpf_dispatch_get_global_queue (long identifier, unsigned long flags) {
+    if (identifier > 0 && qos_class_valid(identifier))
+        identifier = qos_policy_lookup(identifier).queue_priority;
+    
+    return orig_dispatch_get_global_queue(identifier, flags);
+}
+XPF_REBIND_ENTRY("_dispatch_get_global_queue", "libSystem.B.dylib", (void **) &orig_dispatch_get_global_queue, (uintptr_t) &xpf_dispatch_get_global_queue);
+
+} /* namespace xpf */
@@ -0,0 +1,62 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rebind_index.h"
+
+namespace xpf {
+
+/**
+ * Construct a new index over @a table.
+ *
+ * @param table The rebind table to be indexed. The table must remain valid for the lifetime of the index.
+ * @param count The number of entries in @a table.
+ */
+rebind_index::rebind_index (const xpf_rebind_entry *table, size_t count) : _table(table), _count(count) {
+    /* Size the table to maintain a load factor of <= 0.5 */
+    size_t size = 1;
+    while (size < count * 2)
+        size <<= 1;
+    
+    _slots.resize(size, slot { 0, nullptr });
+    _mask = size - 1;
+    
+    /* Insert in table order; linear probing ensures that entries sharing a symbol name are visited in the
+     * same order by lookup(). The entry hashes were computed at compile time by XPF_REBIND_ENTRY. */
+    for (size_t i = 0; i < count; i++) {
+        uint32_t h = table[i].symbol_hash;
+
+        size_t n = h & _mask;
+        while (_slots[n].entry != nullptr)
+            n = (n + 1) & _mask;
+        
+        _slots[n].hash = h;
+        _slots[n].entry = &table[i];
+    }
+}
+
+} /* namespace xpf */
@@ -0,0 +1,120 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include <PLPatchMaster/SymbolName.hpp>
+
+#include "rebind_table.h"
+
+namespace xpf {
+
+/**
+ * A read-only hash index over the XPF rebind table, keyed by symbol name.
+ *
+ * The index is built once from the rebind table; lookups hash the bind site's symbol name and only
+ * perform the (comparatively expensive) image suffix match against rules whose symbol name matched.
+ */
+class rebind_index {
+public:
+    rebind_index (const xpf_rebind_entry *table, size_t count);
+
+    /**
+     * Return the hash of @a symbol, as used to key the index. This is the runtime equivalent of
+     * xpf_rebind_hash().
+     */
+    static inline uint32_t hash (const char *symbol) {
+        /* 32-bit FNV-1a */
+        uint32_t h = 2166136261U;
+        for (const char *p = symbol; *p != '\0'; p++) {
+            h ^= (uint8_t) *p;
+            h *= 16777619U;
+        }
+        return h;
+    }
+    
+    /**
+     * Call @a fn with each rebind entry matching @a name, in rebind table order.
+     *
+     * @param name The two-level symbol name to look up.
+     * @param fn A function or function object accepting a `const xpf_rebind_entry &`.
+     */
+    template <typename Fn> void lookup (const patchmaster::SymbolName &name, Fn &&fn) const {
+        uint32_t h = hash(name.symbol());
+        
+        for (size_t i = h & _mask; _slots[i].entry != nullptr; i = (i + 1) & _mask) {
+            const slot &s = _slots[i];
+            if (s.hash != h)
+                continue;
+            
+            /* Hash hit; verify the symbol and image */
+            if (!name.match(patchmaster::SymbolName(s.entry->image, s.entry->symbol)))
+                continue;
+            
+            fn(*s.entry);
+        }
+    }
+    
+    /** Return the number of indexed rebind entries. */
+    size_t size () const { return _count; }
+    
+    /** Return the rebind entry at table index @a i. */
+    const xpf_rebind_entry &operator[] (size_t i) const { return _table[i]; }
+    
+    /** Return the table index of @a entry, which must be an entry returned by this index. */
+    size_t index_of (const xpf_rebind_entry &entry) const { return &entry - _table; }
+
+private:
+    /** A single open-addressed hash table slot. */
+    struct slot {
+        /** The FNV-1a hash of the entry's symbol name. */
+        uint32_t hash;
+        
+        /** The indexed entry, or nullptr if the slot is empty. */
+        const xpf_rebind_entry *entry;
+    };
+    
+    /** Open-addressed (linear probing) hash table; the table size is always a power of two. */
+    std::vector<slot> _slots;
+    
+    /** The indexed rebind table. */
+    const xpf_rebind_entry *_table;
+    
+    /** Table size mask. */
+    size_t _mask;
+    
+    /** Number of indexed entries. */
+    size_t _count;
+};
+
+} /* namespace xpf */
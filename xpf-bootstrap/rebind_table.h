@@ -26,21 +26,53 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#pragma once
+
 #include <string>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include <mach-o/loader.h>
 
 /** __DATA section containing XPF rebind data */
 #define XPF_REBIND_SECTION "__xpf_rebind"
 
+/**
+ * Compute the 32-bit FNV-1a hash of @a symbol at compile time.
+ *
+ * This must produce identical results to xpf::rebind_index::hash(); it is used to precompute the
+ * symbol hash of every rebind entry, avoiding any hashing of the rebind table at runtime.
+ */
+static inline constexpr uint32_t xpf_rebind_hash (const char *symbol, uint32_t h = 2166136261U) {
+    return *symbol == '\0' ? h : xpf_rebind_hash(symbol + 1, (h ^ (uint8_t) *symbol) * 16777619U);
+}
+
+/**
+ * Append the FNV-1a hash of @a str (including its NUL terminator) to @a h.
+ *
+ * This is used to compute hashes over entire rule tables; see xpf_rules_hash().
+ */
+static inline uint32_t xpf_hash_append (uint32_t h, const char *str) {
+    do {
+        h ^= (uint8_t) *str;
+        h *= 16777619U;
+    } while (*str++ != '\0');
+    
+    return h;
+}
+
 /**
  * Rebind table entry.
+ *
+ * Entries are immutable; the only state written at runtime is the caller-provided @a original slot.
  */
 struct xpf_rebind_entry {
     /** Name of the symbol to rebind. */
     const char *symbol;
     
+    /** Precomputed xpf_rebind_hash() of symbol. */
+    uint32_t symbol_hash;
+    
     /** Image containing the symbol to be rebound. */
     const char *image;
     
@@ -67,9 +99,10 @@ struct xpf_rebind_entry {
 #define XPF_REBIND_ENTRY(_sym, _img, _orig, _replacement) \
     __attribute__((used)) \
     __attribute__((section(SEG_DATA ", " XPF_REBIND_SECTION))) \
-    static struct xpf_rebind_entry _XPF_REBIND_ENTRY_NAME(__xpf_rebind, __COUNTER__) = { \
+    static const struct xpf_rebind_entry _XPF_REBIND_ENTRY_NAME(__xpf_rebind, __COUNTER__) = { \
         .symbol = _sym, \
+        .symbol_hash = xpf_rebind_hash(_sym), \
         .image = _img, \
         .original = _orig, \
         .replacement = _replacement \
-    }
\ No newline at end of file
+    }
@@ -0,0 +1,261 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rule_manifest.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace xpf {
+
+/**
+ * Compute the 32-bit FNV-1a checksum of @a len bytes at @a data.
+ */
+static uint32_t manifest_checksum (const void *data, size_t len) {
+    auto p = (const uint8_t *) data;
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+/**
+ * Construct a new instance backed by a previously validated @a mapping.
+ */
+rule_manifest::rule_manifest (void *mapping, size_t mapping_size) : _mapping(mapping), _mapping_size(mapping_size) {
+    auto hdr = (const xpf_rule_manifest_header *) mapping;
+    
+    _entries = (const xpf_rule_manifest_entry *) ((const uint8_t *) mapping + hdr->entries_offset);
+    _strings = (const char *) mapping + hdr->strings_offset;
+    _checksum = hdr->checksum;
+    
+    /* Entries are ordered by kind; find the start of each kind's range */
+    size_t idx = 0;
+    for (uint32_t kind = 0; kind <= XPF_RULE_FRAMEWORK + 1; kind++) {
+        while (idx < hdr->entry_count && _entries[idx].kind < kind)
+            idx++;
+        _kind_start[kind] = idx;
+    }
+}
+
+rule_manifest::~rule_manifest () {
+    munmap(_mapping, _mapping_size);
+}
+
+/**
+ * Map and validate the rule manifest at @a path.
+ *
+ * @param path The manifest path.
+ * @param error On failure, will be set to a description of the error, or to an empty string if @a path does not exist.
+ *
+ * @return Returns a new manifest instance on success, or nullptr on failure.
+ */
+rule_manifest *rule_manifest::Map (const char *path, std::string &error) {
+    error.clear();
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            error = std::string("open() failed: ") + strerror(errno);
+        return nullptr;
+    }
+    
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        error = std::string("fstat() failed: ") + strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    
+    if ((size_t) sb.st_size < sizeof(xpf_rule_manifest_header)) {
+        error = "truncated header";
+        close(fd);
+        return nullptr;
+    }
+    
+    size_t size = (size_t) sb.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = std::string("mmap() failed: ") + strerror(errno);
+        return nullptr;
+    }
+    
+    if (!Validate(mapping, size, error)) {
+        munmap(mapping, size);
+        return nullptr;
+    }
+    
+    return new rule_manifest(mapping, size);
+}
+
+/**
+ * Validate the @a size byte rule manifest at @a data.
+ *
+ * A manifest that passes validation may be read without any further bounds checking: all entries lie within
+ * the manifest, all string offsets reference NUL-terminated strings within the string pool, and entries are
+ * correctly ordered by kind.
+ *
+ * @param data The manifest data; this must be 4-byte aligned.
+ * @param size The size of @a data.
+ * @param error On failure, will be set to a description of the error.
+ */
+bool rule_manifest::Validate (const void *data, size_t size, std::string &error) {
+    if (size < sizeof(xpf_rule_manifest_header)) {
+        error = "truncated header";
+        return false;
+    }
+    
+    auto hdr = (const xpf_rule_manifest_header *) data;
+    if (hdr->magic != XPF_RULE_MANIFEST_MAGIC) {
+        error = "not a rule manifest";
+        return false;
+    }
+    
+    if (hdr->version != XPF_RULE_MANIFEST_VERSION) {
+        error = "unsupported manifest version " + std::to_string(hdr->version);
+        return false;
+    }
+    
+    uint64_t entries_end = (uint64_t) hdr->entries_offset + (uint64_t) hdr->entry_count * sizeof(xpf_rule_manifest_entry);
+    if (hdr->entries_offset < sizeof(*hdr) || hdr->entries_offset % sizeof(uint32_t) != 0 || entries_end > size) {
+        error = "invalid entry table bounds";
+        return false;
+    }
+    
+    uint64_t strings_end = (uint64_t) hdr->strings_offset + hdr->strings_size;
+    if (hdr->strings_offset < entries_end || strings_end > size || hdr->strings_size == 0) {
+        error = "invalid string pool bounds";
+        return false;
+    }
+    
+    const char *strings = (const char *) data + hdr->strings_offset;
+    if (strings[0] != '\0' || strings[hdr->strings_size - 1] != '\0') {
+        error = "string pool is not NUL-terminated";
+        return false;
+    }
+    
+    if (manifest_checksum(hdr + 1, size - sizeof(*hdr)) != hdr->checksum) {
+        error = "checksum mismatch";
+        return false;
+    }
+    
+    auto entries = (const xpf_rule_manifest_entry *) ((const uint8_t *) data + hdr->entries_offset);
+    for (uint32_t i = 0; i < hdr->entry_count; i++) {
+        const xpf_rule_manifest_entry &entry = entries[i];
+        
+        if (entry.kind < XPF_RULE_REBIND || entry.kind > XPF_RULE_FRAMEWORK) {
+            error = "entry " + std::to_string(i) + " has unknown kind " + std::to_string(entry.kind);
+            return false;
+        }
+        
+        if (i > 0 && entry.kind < entries[i - 1].kind) {
+            error = "entry " + std::to_string(i) + " is out of order";
+            return false;
+        }
+        
+        if (entry.symbol >= hdr->strings_size || entry.image >= hdr->strings_size || entry.impl >= hdr->strings_size) {
+            error = "entry " + std::to_string(i) + " references a string outside the string pool";
+            return false;
+        }
+        
+        if (strings[entry.symbol] == '\0' || (entry.kind == XPF_RULE_REBIND && strings[entry.impl] == '\0')) {
+            error = "entry " + std::to_string(i) + " is missing a required symbol name";
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Resolve all rebind entries against the @a compiled rebind table, appending the resulting rebind entries
+ * to @a entries.
+ *
+ * Each manifest rebind entry must name an implementation that is defined by an XPF_REBIND_ENTRY() in
+ * @a compiled; the new entry shares that implementation's replacement address and original slot. If any entry
+ * names an unknown implementation, the manifest does not match this build of xpf-bootstrap, and no entries
+ * are appended.
+ *
+ * An implementation's original slot is written once, with the address of the first symbol bound to it, and is
+ * called through by the implementation; an entry may only rebind a different symbol (an alias) to an
+ * implementation that has no original slot.
+ *
+ * String pointers in the appended entries are borrowed from the manifest mapping.
+ *
+ * @param compiled The compiled rebind table.
+ * @param count The number of entries in @a compiled.
+ * @param entries The vector to which the resolved entries will be appended.
+ * @param error On failure, will be set to a description of the error.
+ */
+bool rule_manifest::link_rebind_entries (const xpf_rebind_entry *compiled, size_t count, std::vector<xpf_rebind_entry> &entries, std::string &error) const {
+    size_t initial = entries.size();
+    entries.reserve(initial + this->count(XPF_RULE_REBIND));
+    
+    for (auto entry = begin(XPF_RULE_REBIND); entry != end(XPF_RULE_REBIND); entry++) {
+        const char *impl = string(entry->impl);
+        const xpf_rebind_entry *match = nullptr;
+        
+        for (size_t i = 0; i < count; i++) {
+            if (compiled[i].symbol_hash == entry->impl_id && strcmp(compiled[i].symbol, impl) == 0) {
+                match = &compiled[i];
+                break;
+            }
+        }
+        
+        if (match == nullptr) {
+            error = std::string("rule for ") + string(entry->symbol) + " references unknown implementation " + impl;
+            entries.resize(initial);
+            return false;
+        }
+        
+        if (match->original != NULL && strcmp(string(entry->symbol), impl) != 0) {
+            error = std::string("rule for ") + string(entry->symbol) + " references implementation " + impl + ", which calls through to the original " + impl;
+            entries.resize(initial);
+            return false;
+        }
+        
+        entries.push_back({
+            .symbol = string(entry->symbol),
+            .symbol_hash = entry->symbol_hash,
+            .image = string(entry->image),
+            .original = match->original,
+            .replacement = match->replacement
+        });
+    }
+    
+    return true;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,97 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "rebind_table.h"
+#include "rule_manifest_format.h"
+
+namespace xpf {
+
+/**
+ * A read-only, memory-mapped rule manifest, as produced by xpf-rulec.
+ *
+ * The manifest is validated once when mapped; all entries and strings are then borrowed directly from the
+ * backing mapping, and are valid for the lifetime of the rule_manifest instance.
+ */
+class rule_manifest {
+public:
+    ~rule_manifest ();
+    
+    rule_manifest (const rule_manifest &) = delete;
+    rule_manifest &operator= (const rule_manifest &) = delete;
+    
+    static rule_manifest *Map (const char *path, std::string &error);
+    static bool Validate (const void *data, size_t size, std::string &error);
+    
+    /** Return a pointer to the first entry of @a kind. */
+    const xpf_rule_manifest_entry *begin (xpf_rule_manifest_kind kind) const { return _entries + _kind_start[kind]; }
+    
+    /** Return a pointer just past the last entry of @a kind. */
+    const xpf_rule_manifest_entry *end (xpf_rule_manifest_kind kind) const { return _entries + _kind_start[kind + 1]; }
+    
+    /** Return the number of entries of @a kind. */
+    size_t count (xpf_rule_manifest_kind kind) const { return _kind_start[kind + 1] - _kind_start[kind]; }
+    
+    /** Return the string at the (validated) string pool @a offset. */
+    const char *string (uint32_t offset) const { return _strings + offset; }
+    
+    /** Return the manifest's checksum. */
+    uint32_t checksum () const { return _checksum; }
+    
+    bool link_rebind_entries (const xpf_rebind_entry *compiled, size_t count, std::vector<xpf_rebind_entry> &entries, std::string &error) const;
+    
+private:
+    rule_manifest (void *mapping, size_t mapping_size);
+    
+    /** The backing file mapping. */
+    void *_mapping;
+    
+    /** The size of the backing file mapping. */
+    size_t _mapping_size;
+    
+    /** Entries, borrowed from the backing mapping. */
+    const xpf_rule_manifest_entry *_entries;
+    
+    /** The index of the first entry of each kind, indexed by xpf_rule_manifest_kind; the final element is the entry count. */
+    size_t _kind_start[XPF_RULE_FRAMEWORK + 2];
+    
+    /** The string pool, borrowed from the backing mapping. */
+    const char *_strings;
+    
+    /** The manifest checksum. */
+    uint32_t _checksum;
+};
+
+} /* namespace xpf */
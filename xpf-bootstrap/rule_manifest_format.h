@@ -0,0 +1,113 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Precompiled rule manifest format.
+ *
+ * A rule manifest is produced offline by xpf-rulec from a text rule file, and is mapped read-only by
+ * xpf-bootstrap at startup. The file consists of an xpf_rule_manifest_header, followed by an array of
+ * xpf_rule_manifest_entry records, followed by a pool of NUL-terminated strings referenced by offset.
+ *
+ * All fields are in host byte order.
+ */
+
+/** Rule manifest magic ('XPFR') */
+#define XPF_RULE_MANIFEST_MAGIC 0x52465058
+
+/** Current rule manifest version; this must be incremented if the file format or the rule semantics change. */
+#define XPF_RULE_MANIFEST_VERSION 1
+
+/** Rule manifest entry kinds. */
+enum xpf_rule_manifest_kind {
+    /** Rebind @a symbol within @a image to the compiled XPF_REBIND_ENTRY() implementation named by @a impl. */
+    XPF_RULE_REBIND = 1,
+    
+    /** Mark imports of @a symbol from the library @a image as weak. */
+    XPF_RULE_WEAK = 2,
+    
+    /** Load the shared Xcode framework @a symbol before plugin initialization. */
+    XPF_RULE_FRAMEWORK = 3
+};
+
+/**
+ * Rule manifest file header.
+ */
+struct xpf_rule_manifest_header {
+    /** XPF_RULE_MANIFEST_MAGIC */
+    uint32_t magic;
+    
+    /** XPF_RULE_MANIFEST_VERSION */
+    uint32_t version;
+    
+    /** Number of xpf_rule_manifest_entry records. */
+    uint32_t entry_count;
+    
+    /** File offset of the first xpf_rule_manifest_entry record. */
+    uint32_t entries_offset;
+    
+    /** File offset of the string pool. */
+    uint32_t strings_offset;
+    
+    /** Size of the string pool, in bytes. The pool always begins with an empty string, and ends with a NUL. */
+    uint32_t strings_size;
+    
+    /** The FNV-1a checksum of all data following the header. */
+    uint32_t checksum;
+    
+    uint32_t reserved;
+};
+
+/**
+ * A single rule manifest entry.
+ *
+ * Entries are ordered by kind; rebind and weak entries are further ordered by symbol hash, while framework
+ * entries retain the order in which they were declared.
+ */
+struct xpf_rule_manifest_entry {
+    /** The xpf_rule_manifest_kind of this entry. */
+    uint32_t kind;
+    
+    /** Precomputed xpf_rebind_hash() of symbol, or 0 for framework entries. */
+    uint32_t symbol_hash;
+    
+    /** String pool offset of the symbol (or framework) name. */
+    uint32_t symbol;
+    
+    /** String pool offset of the image (rebind) or library (weak) name; the empty string if not applicable. */
+    uint32_t image;
+    
+    /** Precomputed xpf_rebind_hash() of impl, or 0 for non-rebind entries. */
+    uint32_t impl_id;
+    
+    /** String pool offset of the symbol name of the compiled XPF_REBIND_ENTRY() implementing this rule. */
+    uint32_t impl;
+};
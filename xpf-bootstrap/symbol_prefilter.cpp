@@ -0,0 +1,181 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "symbol_prefilter.h"
+#include "macho_util.h"
+
+#include <string.h>
+
+#include <deque>
+
+namespace xpf {
+
+using namespace patchmaster;
+
+/** Marker for a trie transition that has not (yet) been defined. */
+static constexpr uint32_t NO_STATE = UINT32_MAX;
+
+/**
+ * Construct a new prefilter matching any of @a symbols.
+ *
+ * @param symbols The symbol names to match. Names are matched including their NUL terminator, and need not remain
+ * valid after construction.
+ */
+symbol_prefilter::symbol_prefilter (const std::vector<const char *> &symbols) {
+    /* Class 0 is the 'unused' class; assign each distinct byte used by any pattern (including NUL) its own class. */
+    bool used[256] = { false };
+    used[0] = true;
+    for (const char *symbol : symbols) {
+        for (const char *p = symbol; *p != '\0'; p++)
+            used[(uint8_t) *p] = true;
+    }
+    
+    memset(_classes, 0, sizeof(_classes));
+    _class_count = 1;
+    for (size_t c = 0; c < 256; c++) {
+        if (used[c])
+            _classes[c] = (uint16_t) _class_count++;
+    }
+    
+    /* Build the trie; state 0 is the root. */
+    _transitions.assign(_class_count, NO_STATE);
+    _accept.assign(1, 0);
+    
+    for (const char *symbol : symbols) {
+        uint32_t state = 0;
+        const char *p = symbol;
+        do {
+            size_t edge = state * _class_count + _classes[(uint8_t) *p];
+            if (_transitions[edge] == NO_STATE) {
+                _transitions[edge] = (uint32_t) _accept.size();
+                _transitions.resize(_transitions.size() + _class_count, NO_STATE);
+                _accept.push_back(0);
+            }
+            
+            state = _transitions[edge];
+        } while (*p++ != '\0');
+        
+        _accept[state] = 1;
+    }
+    
+    /* Compute failure links in breadth-first order, converting the trie to a complete DFA as we go; each state's
+     * failure target is strictly shallower, and thus its transitions have already been completed. */
+    std::vector<uint32_t> fail(_accept.size(), 0);
+    std::deque<uint32_t> queue;
+    
+    for (size_t c = 0; c < _class_count; c++) {
+        uint32_t &next = _transitions[c];
+        if (next == NO_STATE) {
+            next = 0;
+        } else {
+            fail[next] = 0;
+            queue.push_back(next);
+        }
+    }
+    
+    while (!queue.empty()) {
+        uint32_t state = queue.front();
+        queue.pop_front();
+        
+        for (size_t c = 0; c < _class_count; c++) {
+            uint32_t &next = _transitions[state * _class_count + c];
+            uint32_t fallback = _transitions[fail[state] * _class_count + c];
+            
+            if (next == NO_STATE) {
+                next = fallback;
+            } else {
+                fail[next] = fallback;
+                _accept[next] |= _accept[fallback];
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+/**
+ * Return true if any of the prefilter's symbols occur within @a data.
+ */
+bool symbol_prefilter::matches (const uint8_t *data, size_t length) const {
+    const uint32_t *transitions = _transitions.data();
+    const uint8_t *accept = _accept.data();
+    size_t classes = _class_count;
+    
+    uint32_t state = 0;
+    for (size_t i = 0; i < length; i++) {
+        state = transitions[state * classes + _classes[data[i]]];
+        if (accept[state])
+            return true;
+    }
+    
+    return false;
+}
+
+/**
+ * Return true if any of the prefilter's symbols occur within the bind, weak bind, or lazy bind opcode streams
+ * of a loaded image.
+ *
+ * Images without an LC_DYLD_INFO command, or whose opcode streams can not be located, are always considered
+ * to match.
+ */
+bool symbol_prefilter::image_matches (const pl_mach_header_t *header) const {
+    const struct dyld_info_command *info = nullptr;
+    macho_for_each_command(header, [&](const struct load_command *cmd) {
+        if (cmd->cmd != LC_DYLD_INFO && cmd->cmd != LC_DYLD_INFO_ONLY)
+            return true;
+        
+        info = (const struct dyld_info_command *) cmd;
+        return false;
+    });
+    
+    const pl_segment_command_t *linkedit = macho_find_segment(header, SEG_LINKEDIT);
+    if (info == nullptr || linkedit == nullptr)
+        return true;
+    
+    /* Opcode streams are addressed by file offset */
+    const uint8_t *base = (const uint8_t *) (linkedit->vmaddr + macho_vmaddr_slide(header) - linkedit->fileoff);
+    const struct {
+        uint32_t offset;
+        uint32_t size;
+    } streams[] = {
+        { info->bind_off, info->bind_size },
+        { info->weak_bind_off, info->weak_bind_size },
+        { info->lazy_bind_off, info->lazy_bind_size },
+    };
+    
+    for (auto &&stream : streams) {
+        if (stream.size == 0)
+            continue;
+        
+        if (matches(base + stream.offset, stream.size))
+            return true;
+    }
+    
+    return false;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,74 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+namespace xpf {
+
+/**
+ * A multi-pattern prefilter over an image's bind opcode streams.
+ *
+ * Symbol names are stored inline (and NUL terminated) after each BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM
+ * opcode; rather than evaluating the bind VM, the prefilter scans the raw opcode bytes for any of a fixed set
+ * of symbol names using an Aho-Corasick automaton, compiled once to a dense DFA over a compressed byte alphabet.
+ *
+ * The prefilter may report false positives (eg, a watched name appearing as the suffix of an unrelated name),
+ * but never false negatives; an image that does not match can not reference any of the watched symbols.
+ */
+class symbol_prefilter {
+public:
+    symbol_prefilter (const std::vector<const char *> &symbols);
+    
+    bool matches (const uint8_t *data, size_t length) const;
+    bool image_matches (const patchmaster::pl_mach_header_t *header) const;
+    
+    /** Return the number of DFA states. */
+    size_t state_count () const { return _accept.size(); }
+
+private:
+    /** Maps each input byte to its alphabet class; class 0 is shared by all bytes that appear in no pattern. */
+    uint16_t _classes[256];
+    
+    /** Number of alphabet classes. */
+    size_t _class_count;
+    
+    /** DFA transition table, indexed by (state * _class_count) + class. */
+    std::vector<uint32_t> _transitions;
+    
+    /** Non-zero for all states that complete at least one pattern. */
+    std::vector<uint8_t> _accept;
+};
+
+} /* namespace xpf */
@@ -0,0 +1,475 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "trace.h"
+
+#include "async_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <mach/mach_time.h>
+
+#include <atomic>
+
+namespace xpf {
+
+/** Maximum number of spans recorded per thread; additional spans are dropped. */
+static constexpr size_t XPF_TRACE_EVENTS_PER_THREAD = 8192;
+
+/** Size of each thread's detail string arena; details that do not fit are dropped. */
+static constexpr size_t XPF_TRACE_DETAIL_BYTES = 256 * 1024;
+
+/** Detail offset used for spans without a detail string. */
+static constexpr uint32_t XPF_TRACE_NO_DETAIL = UINT32_MAX;
+
+bool trace_active = false;
+
+/**
+ * A single recorded span.
+ */
+struct trace_event {
+    /** The span name; always a string constant. */
+    const char *name;
+    
+    /** Start and end times, in mach_absolute_time() units. */
+    uint64_t start;
+    uint64_t end;
+    
+    /** The recording thread's ID; a buffer may be reused by any number of threads over its lifetime. */
+    uint64_t tid;
+    
+    /** Offset of the span's detail string within the owning buffer's arena, or XPF_TRACE_NO_DETAIL. */
+    uint32_t detail;
+};
+
+/**
+ * A preallocated per-thread span buffer. Buffers are written only by their owning thread, and are never
+ * deallocated; when their thread exits, they remain on the global buffer list, and are released for reuse by a new
+ * thread.
+ */
+struct trace_buffer {
+    /** The owning thread's ID. */
+    uint64_t tid;
+    
+    /** True while the buffer is owned by a thread. */
+    std::atomic<bool> owned;
+    
+    /** Number of recorded events; published with release semantics after each event is written. */
+    std::atomic<size_t> count;
+    
+    /** Number of detail arena bytes in use. */
+    size_t detail_used;
+    
+    /** Number of spans dropped due to a full buffer. */
+    std::atomic<uint64_t> dropped;
+    
+    /** Next buffer in the global list. */
+    trace_buffer *next;
+    
+    /** Recorded events. */
+    trace_event events[XPF_TRACE_EVENTS_PER_THREAD];
+    
+    /** Detail string arena. */
+    char details[XPF_TRACE_DETAIL_BYTES];
+};
+
+/** Per-thread buffer key. */
+static pthread_key_t trace_key;
+
+/** All allocated buffers. */
+static std::atomic<trace_buffer *> trace_buffers(nullptr);
+
+/** The trace output path, as provided via XPF_TRACE; the writing process' pid is inserted before writing. */
+static const char *trace_path = nullptr;
+
+/** The mach_absolute_time() timebase; fetched at initialization, as it may not be fetched from a signal handler. */
+static mach_timebase_info_data_t trace_timebase;
+
+/** Trace start time; all timestamps are reported relative to this time. */
+static uint64_t trace_start = 0;
+
+/** Set once the trace has been written; the trace is written at most once. */
+static std::atomic<bool> trace_written(false);
+
+/**
+ * Return the calling thread's buffer, reusing a buffer released by an exited thread if one has space remaining, or
+ * allocating a new buffer.
+ */
+static trace_buffer *trace_thread_buffer () {
+    trace_buffer *buffer = (trace_buffer *) pthread_getspecific(trace_key);
+    if (buffer != nullptr)
+        return buffer;
+    
+    uint64_t tid;
+    pthread_threadid_np(pthread_self(), &tid);
+    
+    for (buffer = trace_buffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next) {
+        if (buffer->owned.load(std::memory_order_relaxed) || buffer->count.load(std::memory_order_relaxed) >= XPF_TRACE_EVENTS_PER_THREAD)
+            continue;
+        
+        bool expected = false;
+        if (buffer->owned.compare_exchange_strong(expected, true, std::memory_order_acquire, std::memory_order_relaxed))
+            break;
+    }
+    
+    if (buffer == nullptr) {
+        buffer = new trace_buffer;
+        buffer->owned.store(true, std::memory_order_relaxed);
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->detail_used = 0;
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        
+        buffer->next = trace_buffers.load(std::memory_order_relaxed);
+        while (!trace_buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed));
+    }
+    
+    buffer->tid = tid;
+    pthread_setspecific(trace_key, buffer);
+    return buffer;
+}
+
+/**
+ * Thread exit handler; releases the thread's buffer for reuse. Its recorded events are retained.
+ */
+static void trace_thread_exit (void *value) {
+    ((trace_buffer *) value)->owned.store(false, std::memory_order_release);
+}
+
+/**
+ * Return the current time, in trace units.
+ */
+uint64_t trace_now () {
+    return mach_absolute_time();
+}
+
+/**
+ * Record a completed span in the calling thread's buffer. Must only be called if trace_enabled().
+ *
+ * @param name The span name; must be a string constant.
+ * @param detail An optional detail string, or nullptr; the string will be copied.
+ * @param start The span start time, as returned by trace_now().
+ * @param end The span end time, as returned by trace_now().
+ */
+void trace_record (const char *name, const char *detail, uint64_t start, uint64_t end) {
+    trace_buffer *buffer = trace_thread_buffer();
+    
+    size_t idx = buffer->count.load(std::memory_order_relaxed);
+    if (idx >= XPF_TRACE_EVENTS_PER_THREAD) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    trace_event &event = buffer->events[idx];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    event.tid = buffer->tid;
+    event.detail = XPF_TRACE_NO_DETAIL;
+    
+    if (detail != nullptr) {
+        size_t len = strlen(detail) + 1;
+        if (len <= XPF_TRACE_DETAIL_BYTES - buffer->detail_used) {
+            memcpy(buffer->details + buffer->detail_used, detail, len);
+            event.detail = (uint32_t) buffer->detail_used;
+            buffer->detail_used += len;
+        }
+    }
+    
+    buffer->count.store(idx + 1, std::memory_order_release);
+}
+
+/**
+ * Format @a value in decimal, right-aligned within @a digits, without using stdio.
+ *
+ * @return Returns the number of digits written; the formatted value begins at digits + 20 - the returned count.
+ */
+static size_t trace_format_uint (char digits[20], uint64_t value) {
+    size_t n = 0;
+    do {
+        digits[20 - ++n] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    
+    return n;
+}
+
+/**
+ * A minimal buffered writer; output is formatted into a fixed stack buffer and written with write(2). Numbers are
+ * formatted by hand, as neither heap allocation nor stdio may be used when writing the trace from a signal handler.
+ */
+class trace_writer {
+public:
+    trace_writer (int fd) : _fd(fd), _used(0) {}
+    ~trace_writer () { flush(); }
+    
+    void flush () {
+        write_all(_buffer, _used);
+        _used = 0;
+    }
+    
+    void append (const char *str, size_t len) {
+        if (len > sizeof(_buffer) - _used)
+            flush();
+        
+        if (len > sizeof(_buffer)) {
+            write_all(str, len);
+            return;
+        }
+        
+        memcpy(_buffer + _used, str, len);
+        _used += len;
+    }
+    
+    void append (const char *str) { append(str, strlen(str)); }
+    
+    /** Append the decimal representation of @a value. */
+    void append_uint (uint64_t value) {
+        char digits[20];
+        size_t n = trace_format_uint(digits, value);
+        append(digits + sizeof(digits) - n, n);
+    }
+    
+    /** Append @a ns nanoseconds as decimal microseconds, with three fractional digits. */
+    void append_us (uint64_t ns) {
+        char fraction[4] = { '.', (char) ('0' + ns / 100 % 10), (char) ('0' + ns / 10 % 10), (char) ('0' + ns % 10) };
+        append_uint(ns / 1000);
+        append(fraction, sizeof(fraction));
+    }
+    
+    /** Append @a str as the contents of a JSON string, escaping as required. */
+    void append_escaped (const char *str) {
+        for (const char *p = str; *p != '\0'; p++) {
+            unsigned char c = (unsigned char) *p;
+            if (c == '"' || c == '\\') {
+                char escaped[2] = { '\\', (char) c };
+                append(escaped, 2);
+            } else if (c < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                append(escaped, sizeof(escaped));
+            } else {
+                append((const char *) &c, 1);
+            }
+        }
+    }
+
+private:
+    void write_all (const char *p, size_t len) {
+        while (len > 0) {
+            ssize_t written = write(_fd, p, len);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                break;
+            
+            p += written;
+            len -= written;
+        }
+    }
+    
+    /** The output file descriptor. */
+    int _fd;
+    
+    /** Number of bytes buffered. */
+    size_t _used;
+    
+    /** Output buffer. */
+    char _buffer[4096];
+};
+
+/**
+ * Convert @a t from mach_absolute_time() units to nanoseconds, without overflowing the intermediate product.
+ */
+static uint64_t trace_to_ns (uint64_t t) {
+    return t / trace_timebase.denom * trace_timebase.numer + t % trace_timebase.denom * trace_timebase.numer / trace_timebase.denom;
+}
+
+/**
+ * Write the trace output path for the current process to @a path: the XPF_TRACE path, with the process' pid
+ * inserted before the file extension (if any). Concurrent (and forked) processes sharing an XPF_TRACE value thus
+ * write distinct files.
+ *
+ * @return Returns false if the path does not fit within @a size bytes.
+ */
+static bool trace_output_path (char *path, size_t size, pid_t pid) {
+    const char *slash = strrchr(trace_path, '/');
+    const char *ext = strrchr(slash != nullptr ? slash : trace_path, '.');
+    if (ext == nullptr || ext == trace_path || ext == slash + 1)
+        ext = trace_path + strlen(trace_path);
+    
+    char digits[20];
+    size_t ndigits = trace_format_uint(digits, (uint64_t) pid);
+    
+    size_t prefix = ext - trace_path;
+    size_t suffix = strlen(ext);
+    if (prefix + 1 + ndigits + suffix + 1 > size)
+        return false;
+    
+    memcpy(path, trace_path, prefix);
+    path[prefix] = '.';
+    memcpy(path + prefix + 1, digits + sizeof(digits) - ndigits, ndigits);
+    memcpy(path + prefix + 1 + ndigits, ext, suffix + 1);
+    return true;
+}
+
+/**
+ * Write all recorded spans to the trace output path, in Chrome trace-event JSON format. Only the first call has
+ * any effect.
+ *
+ * This may be called from a signal handler, and must remain async-signal-safe.
+ */
+static void trace_write () {
+    if (trace_written.exchange(true))
+        return;
+    
+    pid_t pid = getpid();
+    char path[PATH_MAX];
+    if (!trace_output_path(path, sizeof(path), pid))
+        return;
+    
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return;
+    
+    uint64_t dropped = 0;
+    uint64_t buffers = 0;
+    bool first = true;
+    
+    {
+        trace_writer out(fd);
+        out.append("{\"traceEvents\":[\n");
+        
+        for (trace_buffer *buffer = trace_buffers.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->next) {
+            size_t count = buffer->count.load(std::memory_order_acquire);
+            dropped += buffer->dropped.load(std::memory_order_relaxed);
+            buffers++;
+            
+            for (size_t i = 0; i < count; i++) {
+                const trace_event &event = buffer->events[i];
+                
+                out.append(first ? "{\"name\":\"" : ",\n{\"name\":\"");
+                out.append_escaped(event.name);
+                out.append("\",\"cat\":\"xpf\",\"ph\":\"X\",\"ts\":");
+                out.append_us(trace_to_ns(event.start - trace_start));
+                out.append(",\"dur\":");
+                out.append_us(trace_to_ns(event.end - event.start));
+                out.append(",\"pid\":");
+                out.append_uint((uint64_t) pid);
+                out.append(",\"tid\":");
+                out.append_uint(event.tid);
+                
+                if (event.detail != XPF_TRACE_NO_DETAIL) {
+                    out.append(",\"args\":{\"detail\":\"");
+                    out.append_escaped(buffer->details + event.detail);
+                    out.append("\"}");
+                }
+                
+                out.append("}");
+                first = false;
+            }
+        }
+        
+        out.append("\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":");
+        out.append_uint(dropped);
+        out.append(",\"buffers\":");
+        out.append_uint(buffers);
+        out.append("}}\n");
+    }
+    
+    close(fd);
+}
+
+/**
+ * Signal handler; writes the trace, and then re-raises the signal with its default disposition.
+ */
+static void trace_signal_handler (int sig) {
+    trace_write();
+    
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/**
+ * Enable tracing if XPF_TRACE is set to an output path. The trace will be written to that path (with the process'
+ * pid inserted before the file extension) at exit, or upon receipt of SIGINT or SIGTERM (if no other handler has
+ * been installed).
+ *
+ * This must be called once, prior to recording any spans.
+ */
+void trace_init () {
+    trace_path = getenv("XPF_TRACE");
+    if (trace_path == nullptr || *trace_path == '\0')
+        return;
+    
+    if (pthread_key_create(&trace_key, trace_thread_exit) != 0) {
+        PMLog("Failed to allocate trace buffer key; tracing disabled");
+        return;
+    }
+    
+    mach_timebase_info(&trace_timebase);
+    trace_start = trace_now();
+    atexit(trace_write);
+    
+    const int signals[] = { SIGINT, SIGTERM };
+    for (auto &&sig : signals) {
+        struct sigaction action, previous;
+        if (sigaction(sig, nullptr, &previous) != 0 || previous.sa_handler != SIG_DFL)
+            continue;
+        
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = trace_signal_handler;
+        sigemptyset(&action.sa_mask);
+        sigaction(sig, &action, nullptr);
+    }
+    
+    trace_active = true;
+}
+
+} /* namespace xpf */
+
+/**
+ * Return the current time, in trace units; intended for use by the Xcode plugin via dlsym().
+ */
+extern "C" uint64_t xpf_trace_now (void) {
+    return xpf::trace_now();
+}
+
+/**
+ * Record a completed span if tracing is enabled; intended for use by the Xcode plugin via dlsym().
+ */
+extern "C" void xpf_trace_record (const char *name, const char *detail, uint64_t start, uint64_t end) {
+    if (xpf::trace_enabled())
+        xpf::trace_record(name, detail, start, end);
+}
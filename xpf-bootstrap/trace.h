@@ -0,0 +1,87 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace xpf {
+
+/** If true, tracing is enabled; see trace_init(). Never modified after initialization. */
+extern bool trace_active;
+
+/**
+ * Return true if tracing is enabled. When disabled, this is the only cost of a trace_span.
+ */
+static inline bool trace_enabled () {
+    return __builtin_expect(trace_active, false);
+}
+
+void trace_init ();
+uint64_t trace_now ();
+void trace_record (const char *name, const char *detail, uint64_t start, uint64_t end);
+
+/**
+ * Records a single span, from construction to destruction, if tracing is enabled.
+ */
+class trace_span {
+public:
+    /**
+     * Begin a new span.
+     *
+     * @param name The span name; must be a string constant.
+     * @param detail An optional detail string (eg, an image path), or nullptr. The string is copied when the span ends.
+     */
+    trace_span (const char *name, const char *detail = nullptr) : _name(name), _detail(detail), _start(0) {
+        if (trace_enabled())
+            _start = trace_now();
+    }
+    
+    ~trace_span () {
+        if (trace_enabled())
+            trace_record(_name, _detail, _start, trace_now());
+    }
+    
+    trace_span (const trace_span &) = delete;
+    trace_span &operator= (const trace_span &) = delete;
+
+private:
+    /** The span name. */
+    const char *_name;
+    
+    /** The span detail, or nullptr. */
+    const char *_detail;
+    
+    /** The span start time, in trace_now() units. */
+    uint64_t _start;
+};
+
+} /* namespace xpf */
+
+extern "C" uint64_t xpf_trace_now (void);
+extern "C" void xpf_trace_record (const char *name, const char *detail, uint64_t start, uint64_t end);
@@ -30,40 +30,301 @@
 #import <PLPatchMaster/SymbolBinder.hpp>
 
 #import "rebind_table.h"
+#import "weak_table.h"
+#import "prepatch_marker.h"
+#import "rebind_index.h"
+#import "rule_manifest.h"
+#import "bind_plan_cache.h"
+#import "bind_rewrite.h"
+#import "macho_util.h"
+#import "parallel.h"
+#import "image_registry.h"
+#import "symbol_prefilter.h"
+#import "accounting.h"
+#import "page_snapshot.h"
 #import "cfbundle_rebind.h"
+#import "export_index.h"
+#import "qos_policy.h"
+#import "trace.h"
 
 #import "XPFLog.h"
+#import "async_log.h"
 
 #import "DVTPlugInManager.h"
 #import "dyld_priv.h"
 #import <objc/runtime.h>
 #import <mach-o/getsect.h>
+#import <mach/mach_time.h>
+
+#import <algorithm>
+#import <atomic>
+#import <memory>
+#import <string>
+#import <vector>
 
 using namespace patchmaster;
+using namespace xpf;
 
 static const char *xpf_image_state_change (enum dyld_image_states state, uint32_t infoCount, const struct dyld_image_info info[]);
 static void xpf_add_image_callback (const struct mach_header *header, intptr_t vm_slide);
+static void xpf_remove_image_callback (const struct mach_header *header, intptr_t vm_slide);
 
-static void image_rewrite_bind_opcodes (const LocalImage &image);
 static void image_rebind_required_symbols (LocalImage &image);
+static bool image_replay_rebinds (const pl_mach_header_t *header, const mapped_bind_plan &plan);
 static void image_insert_xcode_plugin_path ();
+static bool image_is_prepatched (const pl_mach_header_t *header, uint32_t flags = 0);
 
 /** Our own mach header */
 static const pl_mach_header_t *xpf_bootstrap_mh = nullptr;
 
-/* Symbols to be marked as weak. */
-static const struct weak_entry {
-    const char *library;
-    const char *symbol;
-} weak_symbols[] = {
-    { "/System/Library/Frameworks/SceneKit.framework/Versions/A/SceneKit", "_OBJC_CLASS_$_SCNParticlePropertyController" },
-    { "/usr/lib/libSystem.B.dylib", "_posix_spawnattr_set_qos_class_np" }
-};
+/** Symbol index over our XPF_REBIND_SECTION table, or nullptr if no table was found. */
+static const rebind_index *xpf_rebind_index = nullptr;
+
+/** Prefilter over all symbol names in our rebind table, or nullptr if no table was found. */
+static const symbol_prefilter *xpf_rebind_prefilter = nullptr;
+
+/** Rebind prefilter statistics; reported at exit if XPF_PREFILTER_STATS is set. */
+static bind_prefilter_stats xpf_prefilter_stats;
+
+/** Registry of all loaded images. */
+static image_registry *xpf_image_registry = nullptr;
+
+/** Export trie resolver used to determine the original address of rebound symbols. */
+static export_resolver *xpf_export_resolver = nullptr;
+
+/**
+ * Original address resolution statistics, in mach_absolute_time() units where applicable; reported at exit if
+ * XPF_EXPORT_STATS is set.
+ */
+static struct {
+    /** Number of export trie lookups. */
+    std::atomic<uint64_t> lookups;
+    
+    /** Number of lookups that failed, and fell back on the bound value. */
+    std::atomic<uint64_t> fallbacks;
+    
+    /** Total time spent in lookups, including index construction. */
+    std::atomic<uint64_t> lookup_time;
+} xpf_export_stats;
+
+/** Persistent bind plan cache, or nullptr if caching is disabled. */
+static const bind_plan_cache *xpf_bind_cache = nullptr;
+
+/** Maximum number of threads to use when analyzing batched images. */
+static size_t xpf_worker_count = 1;
+
+/** Minimum number of batched images required before analysis is distributed across worker threads. */
+static constexpr uint32_t XPF_PARALLEL_MIN_IMAGES = 16;
+
+/**
+ * Set once the initial image batch has been delivered to xpf_image_state_change(). Only that batch is analyzed in
+ * parallel; later batches are delivered from dlopen() on arbitrary application threads, where we can make no
+ * assumptions about what else may be waiting on the dyld lock.
+ */
+static std::atomic<bool> xpf_initial_batch_delivered(false);
+
+/**
+ * If true, lazy bind opcodes are never rewritten; set via XPF_PRESERVE_LINKEDIT.
+ *
+ * dyld resolves lazy binds on first call, rather than at load time, and a missing lazy import is harmless until
+ * called; code that guards its use of a weak import tests the symbol's address through a non-lazy pointer, and
+ * calls to any rebind table symbol are redirected to our replacements by rewriting the lazy pointer itself.
+ * Since the lazy bind stream makes up the bulk of most images' bind opcodes, this avoids dirtying the majority
+ * of the __LINKEDIT pages that would otherwise be touched.
+ *
+ * This is not the default, as it does not hold if lazy binding is disabled (eg, DYLD_BIND_AT_LAUNCH).
+ */
+static bool xpf_preserve_linkedit = false;
+
+/** __LINKEDIT rewrite statistics; reported at exit if XPF_LINKEDIT_STATS is set. */
+static bind_rewrite_stats xpf_linkedit_stats;
+
+/**
+ * If true, only strong imports listed in xpf_weak_rules, matching our rebind table, or not exported by their
+ * (loaded) target library are marked as weak; set via XPF_AUTO_WEAK. Otherwise, all strong imports are marked
+ * as weak.
+ *
+ * Plans computed in this mode depend on the exports of every loaded library, rather than on the image alone, and
+ * are never cached.
+ */
+static bool xpf_auto_weak = false;
+
+/** Lock guarding xpf_auto_weak_imports. */
+static pthread_mutex_t xpf_auto_weak_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** All imports marked as weak by XPF_AUTO_WEAK, as "image: symbol (library)"; reported at exit. */
+static std::vector<std::string> *xpf_auto_weak_imports = nullptr;
+
+/** Our rule manifest, or nullptr if none; see xpf_load_rule_manifest(). */
+static const rule_manifest *xpf_rule_manifest = nullptr;
+
+/** Weak import rules: xpf_weak_symbols, followed by the weak entries of our rule manifest. */
+static const struct xpf_weak_entry *xpf_weak_rules = xpf_weak_symbols;
+
+/** Number of entries in xpf_weak_rules. */
+static size_t xpf_weak_rule_count = sizeof(xpf_weak_symbols) / sizeof(xpf_weak_symbols[0]);
+
+/** The rule tables and configuration against which images are evaluated; see bind_plan_image(). */
+static bind_plan_rules xpf_plan_rules;
+
+/** The xpf_rules_hash() of our rule tables, as computed at initialization. */
+static uint32_t xpf_active_rules_hash = 0;
+
+/**
+ * Compute a hash of all rule tables that determine the contents of a bind_plan.
+ *
+ * The same hash is computed by xpf-prepatch and recorded in the XPF_LC_PREPATCHED command of prepatched images.
+ */
+static uint32_t xpf_rules_hash () {
+    uint32_t h = 2166136261U;
+    
+    if (xpf_rebind_index != nullptr) {
+        for (size_t i = 0; i < xpf_rebind_index->size(); i++) {
+            h = xpf_hash_append(h, (*xpf_rebind_index)[i].symbol);
+            h = xpf_hash_append(h, (*xpf_rebind_index)[i].image);
+        }
+    }
+    
+    for (size_t i = 0; i < xpf_weak_rule_count; i++) {
+        h = xpf_hash_append(h, xpf_weak_rules[i].library);
+        h = xpf_hash_append(h, xpf_weak_rules[i].symbol);
+    }
+    
+    /* Plans computed in XPF_PRESERVE_LINKEDIT mode omit all lazy rewrites */
+    h = xpf_hash_append(h, xpf_preserve_linkedit ? "preserve-linkedit" : "");
+    
+    /* Prepatched images were not checked against the exports of their loaded libraries, and must be re-evaluated
+     * in XPF_AUTO_WEAK mode */
+    if (xpf_auto_weak)
+        h = xpf_hash_append(h, "auto-weak");
+    
+    return h;
+}
+
+/**
+ * Report the rebind prefilter's skip rate, the rebind table lookups it saved, and the time spent scanning.
+ */
+static void xpf_prefilter_report (void) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    
+    uint64_t scanned = xpf_prefilter_stats.scanned;
+    uint64_t skipped = xpf_prefilter_stats.skipped;
+    double scan_ms = (double) xpf_prefilter_stats.scan_time * timebase.numer / timebase.denom / 1000000.0;
+    
+    PMLog("Rebind prefilter skipped %llu of %llu images (%.1f%%) and %llu rebind table lookups; %.3f ms scanning",
+        (unsigned long long) skipped, (unsigned long long) scanned, scanned > 0 ? 100.0 * skipped / scanned : 0.0,
+        (unsigned long long) xpf_prefilter_stats.lookups_skipped, scan_ms);
+}
+
+/**
+ * Report the number of __LINKEDIT bytes written, and pages made writable.
+ */
+static void xpf_linkedit_report (void) {
+    uint64_t pages = xpf_linkedit_stats.pages;
+    
+    PMLog("Rewrote %llu __LINKEDIT opcodes (%llu already applied) across %llu images; %llu pages (%llu KiB) made writable",
+        (unsigned long long) xpf_linkedit_stats.written, (unsigned long long) xpf_linkedit_stats.unchanged,
+        (unsigned long long) xpf_linkedit_stats.images, (unsigned long long) pages,
+        (unsigned long long) (pages * getpagesize() / 1024));
+}
+
+/**
+ * Record an import marked as weak by XPF_AUTO_WEAK.
+ */
+static void xpf_auto_weak_record (const std::string &import) {
+    pthread_mutex_lock(&xpf_auto_weak_lock);
+    xpf_auto_weak_imports->push_back(import);
+    pthread_mutex_unlock(&xpf_auto_weak_lock);
+}
+
+/**
+ * Report all imports marked as weak by XPF_AUTO_WEAK.
+ */
+static void xpf_auto_weak_report (void) {
+    pthread_mutex_lock(&xpf_auto_weak_lock);
+    
+    std::sort(xpf_auto_weak_imports->begin(), xpf_auto_weak_imports->end());
+    for (auto &&import : *xpf_auto_weak_imports)
+        PMLog("Weakened missing import %s", import.c_str());
+    
+    PMLog("Weakened %zu missing imports", xpf_auto_weak_imports->size());
+    pthread_mutex_unlock(&xpf_auto_weak_lock);
+}
+
+/**
+ * Report export trie lookup latency, and the memory consumed by our export indices.
+ */
+static void xpf_export_report (void) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    
+    uint64_t lookups = xpf_export_stats.lookups;
+    double lookup_us = (double) xpf_export_stats.lookup_time * timebase.numer / timebase.denom / 1000.0;
+    
+    PMLog("Resolved %llu original addresses via export tries (%llu fell back on bound values); %.3f us per lookup; %zu libraries indexed in %zu bytes",
+        (unsigned long long) lookups, (unsigned long long) xpf_export_stats.fallbacks, lookups > 0 ? lookup_us / lookups : 0.0,
+        xpf_export_resolver->index_count(), xpf_export_resolver->heap_size());
+}
+
+/**
+ * Map and validate our rule manifest.
+ *
+ * The manifest is read from XPF_RULE_MANIFEST if set, or from rules.xpfrules in the framework's Resources
+ * directory. A manifest that fails validation, or that references rebind implementations not compiled into
+ * this build, is ignored in its entirety.
+ *
+ * @param image_path The path to our own image.
+ * @param compiled The compiled rebind table.
+ * @param count The number of entries in @a compiled.
+ * @param entries On success, the manifest's resolved rebind entries will be appended.
+ */
+static const rule_manifest *xpf_load_rule_manifest (const char *image_path, const xpf_rebind_entry *compiled, size_t count, std::vector<xpf_rebind_entry> &entries) {
+    std::string path;
+    if (getenv("XPF_RULE_MANIFEST") != nullptr) {
+        path = getenv("XPF_RULE_MANIFEST");
+    } else {
+        path = image_path;
+        path = path.substr(0, path.rfind('/') + 1) + "Resources/rules.xpfrules";
+    }
+    
+    std::string error;
+    rule_manifest *manifest = rule_manifest::Map(path.c_str(), error);
+    if (manifest == nullptr) {
+        if (!error.empty())
+            PMLog("Ignoring invalid rule manifest %s: %s", path.c_str(), error.c_str());
+        return nullptr;
+    }
+    
+    if (!manifest->link_rebind_entries(compiled, count, entries, error)) {
+        PMLog("Ignoring rule manifest %s: %s", path.c_str(), error.c_str());
+        delete manifest;
+        return nullptr;
+    }
+    
+    return manifest;
+}
+
+/**
+ * Return the name of the @a index'th shared framework declared by our rule manifest, or NULL if @a index is
+ * out of range. Used by the XcodePostFacto plugin in place of its compiled framework list.
+ */
+extern "C" const char *xpf_rule_manifest_framework (size_t index) {
+    if (xpf_rule_manifest == nullptr || index >= xpf_rule_manifest->count(XPF_RULE_FRAMEWORK))
+        return nullptr;
+    
+    return xpf_rule_manifest->string(xpf_rule_manifest->begin(XPF_RULE_FRAMEWORK)[index].symbol);
+}
 
 /**
  * Pre-main initialization (non-ObjC).
  */
 __attribute__((constructor)) static void xpf_prelaunch_initializer (void) {
+    /* Enable asynchronous logging and startup tracing first, so that all subsequent phases benefit. */
+    async_log_init();
+    trace_init();
+    trace_span span("prelaunch");
+    
     /* Fetch a persistent reference to our image's mach header. */
     Dl_info dli;
     if (dladdr((const void *) &xpf_prelaunch_initializer, &dli) == 0) {
@@ -72,65 +333,406 @@ __attribute__((constructor)) static void xpf_prelaunch_initializer (void) {
     }
     xpf_bootstrap_mh = (const pl_mach_header_t *) dli.dli_fbase;
     
+    /* Fetch our compiled rebind table */
+    unsigned long rebind_table_size = 0;
+    auto rebind_table = (const struct xpf_rebind_entry *) getsectiondata(xpf_bootstrap_mh, SEG_DATA, XPF_REBIND_SECTION, &rebind_table_size);
+    size_t rebind_table_count = rebind_table_size / sizeof(xpf_rebind_entry);
+    
+    /* Map our rule manifest, if any, extending the compiled rebind and weak tables with its rules. The manifest's
+     * strings are borrowed from the (persistent) mapping. */
+    {
+        trace_span manifest_span("rule-manifest");
+        
+        std::vector<xpf_rebind_entry> manifest_rebinds;
+        xpf_rule_manifest = xpf_load_rule_manifest(dli.dli_fname, rebind_table, rebind_table_count, manifest_rebinds);
+        
+        if (!manifest_rebinds.empty()) {
+            auto combined = new std::vector<xpf_rebind_entry>(rebind_table, rebind_table + rebind_table_count);
+            combined->insert(combined->end(), manifest_rebinds.begin(), manifest_rebinds.end());
+            
+            rebind_table = combined->data();
+            rebind_table_count = combined->size();
+        }
+        
+        if (xpf_rule_manifest != nullptr && xpf_rule_manifest->count(XPF_RULE_WEAK) > 0) {
+            size_t compiled_count = xpf_weak_rule_count;
+            auto weak_rules = new xpf_weak_entry[compiled_count + xpf_rule_manifest->count(XPF_RULE_WEAK)];
+            
+            std::copy(xpf_weak_symbols, xpf_weak_symbols + compiled_count, weak_rules);
+            for (auto entry = xpf_rule_manifest->begin(XPF_RULE_WEAK); entry != xpf_rule_manifest->end(XPF_RULE_WEAK); entry++)
+                weak_rules[xpf_weak_rule_count++] = { xpf_rule_manifest->string(entry->image), xpf_rule_manifest->string(entry->symbol) };
+            
+            xpf_weak_rules = weak_rules;
+        }
+    }
+    
+    /* Index our rebind table; the table is immutable, and only needs to be indexed once. */
+    if (rebind_table != nullptr) {
+        xpf_rebind_index = new rebind_index(rebind_table, rebind_table_count);
+        
+        std::vector<const char *> symbols;
+        for (size_t i = 0; i < xpf_rebind_index->size(); i++)
+            symbols.push_back((*xpf_rebind_index)[i].symbol);
+        xpf_rebind_prefilter = new symbol_prefilter(symbols);
+    } else {
+        PMLog("No rebind table found!");
+    }
+    
+    /* Apply any QoS policy overrides; our shims map Yosemite QoS classes to concrete scheduling policy. */
+    std::string qos_error;
+    if (!qos_policy_init(qos_error))
+        PMLog("Ignoring invalid XPF_QOS_POLICY: %s", qos_error.c_str());
+    
+    xpf_preserve_linkedit = (getenv("XPF_PRESERVE_LINKEDIT") != nullptr);
+    if (getenv("XPF_LINKEDIT_STATS") != nullptr)
+        atexit(xpf_linkedit_report);
+    
+    xpf_auto_weak = (getenv("XPF_AUTO_WEAK") != nullptr);
+    if (xpf_auto_weak) {
+        xpf_auto_weak_imports = new std::vector<std::string>();
+        atexit(xpf_auto_weak_report);
+    }
+    
+    /* Set up our bind plan cache; cached plans (and prepatched images) are only valid for the rule tables they
+     * were computed against. */
+    xpf_active_rules_hash = xpf_rules_hash();
+    if (!xpf_auto_weak)
+        xpf_bind_cache = bind_plan_cache::CreateDefault(xpf_active_rules_hash);
+    
+    if (getenv("XPF_PREFILTER_STATS") != nullptr)
+        atexit(xpf_prefilter_report);
+    
+    /* Determine our worker count for batched image analysis. */
+    xpf_worker_count = parallel_worker_count();
+    
+    /* Set up our image registry; this must be in place before any callbacks are registered. */
+    xpf_image_registry = new image_registry();
+    
+    /* Set up our export resolver; library indices are built on first use. */
+    xpf_export_resolver = new export_resolver(xpf_image_registry);
+    if (getenv("XPF_EXPORT_STATS") != nullptr)
+        atexit(xpf_export_report);
+    
+    xpf_plan_rules.rebinds = xpf_rebind_index;
+    xpf_plan_rules.weak_rules = xpf_weak_rules;
+    xpf_plan_rules.weak_rule_count = xpf_weak_rule_count;
+    xpf_plan_rules.preserve_linkedit = xpf_preserve_linkedit;
+    xpf_plan_rules.auto_weak_resolver = xpf_auto_weak ? xpf_export_resolver : nullptr;
+    xpf_plan_rules.auto_weak_report = xpf_auto_weak_record;
+    xpf_plan_rules.rebind_prefilter = xpf_rebind_prefilter;
+    xpf_plan_rules.prefilter_stats = &xpf_prefilter_stats;
+    
     /* Register our state change callback */
     dyld_register_image_state_change_handler(dyld_image_state_rebased, true, xpf_image_state_change);
     
     /* Use the standard dyld callback for all other rebindings */
     _dyld_register_func_for_add_image(xpf_add_image_callback);
+    _dyld_register_func_for_remove_image(xpf_remove_image_callback);
+}
+
+/**
+ * Determine the original address of @a entry's symbol, as exported by @a library.
+ *
+ * The address is resolved from the library's export trie, and is correct regardless of whether @a target has
+ * been bound; if the symbol can not be resolved, the value currently bound at @a target is used.
+ *
+ * @param entry The rebind entry.
+ * @param target The bound location.
+ * @param library The install name of the library from which the symbol is imported, or an empty string to use
+ * the rule's own image.
+ */
+static uintptr_t rebind_original (const struct xpf_rebind_entry &entry, const uintptr_t *target, const char *library) {
+    if (*library == '\0')
+        library = entry.image;
+    
+    uint64_t start = mach_absolute_time();
+    uintptr_t address;
+    bool resolved = xpf_export_resolver->resolve(library, entry.symbol, &address);
+    
+    xpf_export_stats.lookups++;
+    xpf_export_stats.lookup_time += mach_absolute_time() - start;
+    
+    if (!resolved) {
+        xpf_export_stats.fallbacks++;
+        return *target;
+    }
+    
+    return address;
+}
+
+/**
+ * Apply a single rebind @a entry to @a target, saving the previous value (if it hasn't already been saved)
+ * and inserting the new value.
+ *
+ * @param entry The rebind entry.
+ * @param target The bound location.
+ * @param library The install name of the library from which the symbol is imported, or an empty string.
+ */
+static inline void rebind_apply (const struct xpf_rebind_entry &entry, uintptr_t *target, const char *library) {
+    if (entry.original != NULL && *entry.original == NULL)
+        *entry.original = (void *) rebind_original(entry, target, library);
+    
+    if (*target != entry.replacement)
+        *target = entry.replacement;
 }
 
 /**
  * Given a bound -- but not yet initialized -- image, apply symbol rebindings from the XPF_REBIND_SECTION.
  *
- * Note that this function will provide incorrect original addresses if the image has not already been bound.
+ * Original addresses are resolved from the exporting library's export trie; see rebind_original().
  *
  * @param image Image to rebind.
- * @param table Rebind table to apply.
  */
 static void image_rebind_required_symbols (LocalImage &image) {
-    /* Fetch our rebind table, if any */
-    unsigned long rebind_table_size;
-    auto rebind_table = (const struct xpf_rebind_entry *) getsectiondata(xpf_bootstrap_mh, SEG_DATA, XPF_REBIND_SECTION, &rebind_table_size);
-    if (rebind_table == nullptr) {
-        PMLog("No rebind table found!");
+    /* Nothing to do if we have no rebind table */
+    if (xpf_rebind_index == nullptr)
         return;
-    }
-    
-    /* Calculate the actual number of entries */
-    size_t rebind_table_len = rebind_table_size / sizeof(xpf_rebind_entry);
     
     /* Loop over all symbol references in the image */
     image.rebind_symbols([&](const bind_opstream::symbol_proc &sp) {
-        /* Iterate the bootstrap rebind table looking for a matching patch entry. */
-        for (size_t i = 0; i < rebind_table_len; i++) {
-            const struct xpf_rebind_entry &entry = rebind_table[i];
+        /* Look up any matching patch entries in the bootstrap rebind table. */
+        xpf_rebind_index->lookup(sp.name(), [&](const struct xpf_rebind_entry &entry) {
+            // XPFLog(@"Binding %s:%s in %s:%lx to %lx", sp.name().image().c_str(), sp.name().symbol().c_str(), image.path().c_str(), sp.bind_address(), entry.replacement);
+            rebind_apply(entry, (uintptr_t *) sp.bind_address(), sp.name().image());
+        });
+    });
+}
 
-            /* Check for a symbol match */
-            if (!sp.name().match(SymbolName(entry.image, entry.symbol)))
-                continue;
+/**
+ * Compute the bind plan cache key of a loaded image.
+ *
+ * @param header The image's mach header.
+ * @param key On success, the image's LC_UUID and segment layout fingerprint.
+ *
+ * @return Returns true on success, or false if the image has no LC_UUID, and can't be cached.
+ */
+static bool image_plan_key (const pl_mach_header_t *header, bind_plan_key &key) {
+    if (!macho_get_uuid(header, key.uuid))
+        return false;
     
-            // XPFLog(@"Binding %s:%s in %s:%lx to %lx", sp.name().image().c_str(), sp.name().symbol().c_str(), image.path().c_str(), sp.bind_address(), entry.replacement);
-            
-            /* On match, save the previous value (if it hasn't already been saved) and insert the new value */
-            uintptr_t *target = (uintptr_t * ) sp.bind_address();
-            
-            if (entry.original != NULL && *entry.original == NULL)
-                *entry.original = (void *) *target;
+    key.layout_hash = macho_layout_hash(header);
+    return true;
+}
+
+/**
+ * Replay the rebind sites recorded in a cached bind plan.
+ *
+ * @param header The image's mach header.
+ * @param plan The image's cached bind plan.
+ *
+ * @return Returns true on success, or false if the plan is not applicable to the image; in that case, no changes
+ * will have been made.
+ */
+static bool image_replay_rebinds (const pl_mach_header_t *header, const mapped_bind_plan &plan) {
+    if (xpf_rebind_index == nullptr)
+        return plan.rebind_site_count() == 0;
+    
+    /* Validate all sites before performing any writes */
+    intptr_t slide = macho_vmaddr_slide(header);
+    for (size_t i = 0; i < plan.rebind_site_count(); i++) {
+        const bind_plan_rebind_site &site = plan.rebind_sites()[i];
+        if (site.rule >= xpf_rebind_index->size())
+            return false;
+        
+        if (!macho_contains_range(header, slide, (uintptr_t) header + site.offset, sizeof(uintptr_t)))
+            return false;
+    }
+    
+    /* Apply; cached plans do not record the importing library, so original addresses are resolved via the
+     * rule's own image. */
+    for (size_t i = 0; i < plan.rebind_site_count(); i++) {
+        const bind_plan_rebind_site &site = plan.rebind_sites()[i];
+        rebind_apply((*xpf_rebind_index)[site.rule], (uintptr_t *) ((uintptr_t) header + site.offset), "");
+    }
+    
+    return true;
+}
+
+/**
+ * Per-image state for xpf_image_state_change()
+ */
+struct image_state_work {
+    /** The image's header */
+    const pl_mach_header_t *header;
+    
+    /** The image's path */
+    const char *path;
+    
+    /** If true, the image's bind opcodes were already rewritten on an earlier delivery. */
+    bool rewritten;
+    
+    /** If true, the image was prepatched on disk against our rule tables, and requires no rewriting. */
+    bool prepatched;
+    
+    /** If true, the image has an LC_UUID, and plans may be read from or written to the bind plan cache. */
+    bool cacheable;
+    
+    /** The image's bind plan cache key, if cacheable. */
+    bind_plan_key key;
+    
+    /** If true, a cached plan was found, and has been mapped into cached_plan. */
+    bool cached;
+    
+    /** The cached plan, if any. */
+    std::unique_ptr<mapped_bind_plan> cached_plan;
+    
+    /** The newly computed plan, if no cached plan was found. */
+    bind_plan plan;
+};
+
+/**
+ * Records the pages faulted in and dirtied within an image's writable segments over the lifetime of the instance,
+ * if accounting is enabled.
+ *
+ * The instance allocates its snapshots on construction, and should be constructed before (and so destroyed after)
+ * the phase's accounting_scope; otherwise, its own allocations are attributed to the phase.
+ */
+class image_data_accounting {
+public:
+    image_data_accounting (accounting_phase phase, const pl_mach_header_t *header) : _phase(phase), _header(header) {
+        if (!accounting_enabled())
+            return;
+        
+        _segments.reserve(header->ncmds);
+        macho_for_each_command(header, [&](const struct load_command *cmd) {
+            if (cmd->cmd == PL_LC_SEGMENT && (((const pl_segment_command_t *) cmd)->initprot & VM_PROT_WRITE))
+                _segments.push_back((const pl_segment_command_t *) cmd);
+            return true;
+        });
+        
+        _snapshots.resize(_segments.size());
+        for (size_t i = 0; i < _segments.size(); i++)
+            _snapshots[i].capture((const void *) (_segments[i]->vmaddr + macho_vmaddr_slide(header)), _segments[i]->vmsize);
+    }
+    
+    ~image_data_accounting () {
+        if (_segments.empty())
+            return;
+        
+        uint64_t faulted = 0;
+        uint64_t dirtied = 0;
+        for (size_t i = 0; i < _segments.size(); i++) {
+            page_snapshot after;
+            after.capture((const void *) (_segments[i]->vmaddr + macho_vmaddr_slide(_header)), _segments[i]->vmsize);
             
-            if (*target != entry.replacement)
-                *target = entry.replacement;
+            faulted += _snapshots[i].newly_resident(after);
+            dirtied += _snapshots[i].newly_dirtied(after);
         }
-    });
-}
+        
+        const char *path = xpf_image_registry->path((const struct mach_header *) _header);
+        accounting_record_pages(_phase, path != nullptr ? path : "<unknown>", faulted, dirtied);
+    }
+    
+    image_data_accounting (const image_data_accounting &) = delete;
+    image_data_accounting &operator= (const image_data_accounting &) = delete;
+
+private:
+    /** The accounted phase */
+    accounting_phase _phase;
+    
+    /** The image's header */
+    const pl_mach_header_t *_header;
+    
+    /** The image's writable segments. */
+    std::vector<const pl_segment_command_t *> _segments;
+    
+    /** Page state of each writable segment at construction. */
+    std::vector<page_snapshot> _snapshots;
+};
 
 /**
  * Our on-rebase state change callback; responsible for performing any modifications to the image that are necessary pre-bind.
  */
 static const char *xpf_image_state_change (enum dyld_image_states state, uint32_t infoCount, const struct dyld_image_info info[]) {
-    /* Rewrite all weak references. */
+    trace_span span("image-state-change");
+    std::unique_ptr<image_state_work[]> work(new image_state_work[infoCount]);
+    
+    /* Register all newly delivered images */
+    for (uint32_t i = 0; i < infoCount; i++)
+        xpf_image_registry->insert(info[i].imageLoadAddress, info[i].imageFilePath);
+    
+    /* Ensure that the main executable path has been resolved before fanning out; the workers must not
+     * call back into dyld. */
+    LocalImage::MainExecutablePath();
+    
+    /* Analysis is read-only, and may be distributed across workers; at launch, dyld delivers the
+     * entire initial image set as a single batch. dyld's lock is held throughout, and workers must not call
+     * back into dyld (see parallel_for()); XPF_AUTO_WEAK export lookups locate libraries via our image registry,
+     * and are safe to perform from a worker. */
+    bool initial_batch = !xpf_initial_batch_delivered.exchange(true);
+    size_t workers = (initial_batch && infoCount >= XPF_PARALLEL_MIN_IMAGES) ? xpf_worker_count : 1;
+    {
+        accounting_scope scope(ACCOUNTING_PHASE_ANALYZE);
+        parallel_for(infoCount, workers, [&](size_t i) {
+            image_state_work &w = work[i];
+            w.header = (const pl_mach_header_t *) info[i].imageLoadAddress;
+            w.path = info[i].imageFilePath;
+            trace_span image_span("analyze", w.path);
+            
+            w.rewritten = (xpf_image_registry->state((const struct mach_header *) w.header) & image_registry::STATE_BIND_OPCODES_REWRITTEN) != 0;
+            if (w.rewritten)
+                return;
+            
+            w.prepatched = image_is_prepatched(w.header);
+            if (w.prepatched)
+                return;
+            
+            w.cacheable = (xpf_bind_cache != nullptr && image_plan_key(w.header, w.key));
+            w.cached = false;
+            if (w.cacheable) {
+                w.cached_plan.reset(new mapped_bind_plan());
+                w.cached = xpf_bind_cache->load(w.key, *w.cached_plan);
+            }
+            
+            /* Otherwise, evaluate the image's bind opcodes. Any strong import may require weakening, and no image
+             * may be skipped based on our rule table symbols alone. */
+            if (!w.cached) {
+                LocalImage image = LocalImage::Analyze(w.path, w.header);
+                bind_plan_image(image, xpf_plan_rules, w.plan);
+            }
+        });
+    }
+    
+    /* Apply all rewrites serially; distinct images may share a single __LINKEDIT mapping (eg, within the
+     * dyld shared cache), and we must not race their protection changes. */
+    accounting_scope scope(ACCOUNTING_PHASE_REWRITE);
     for (uint32_t i = 0; i < infoCount; i++) {
-        LocalImage image = LocalImage::Analyze(info[i].imageFilePath, (const pl_mach_header_t *) info[i].imageLoadAddress);
-        image_rewrite_bind_opcodes(image);
+        image_state_work &w = work[i];
+        trace_span image_span("rewrite", w.path);
+        
+        if (w.rewritten)
+            continue;
+        
+        if (w.prepatched) {
+            xpf_image_registry->set_state((const struct mach_header *) w.header, image_registry::STATE_BIND_OPCODES_REWRITTEN);
+            continue;
+        }
+        
+        /* Applied plans are carried through to xpf_add_image_callback() for rebinding */
+        if (w.cached) {
+            if (bind_rewrite_apply(w.path, w.header, w.cached_plan->weak_rewrites(), w.cached_plan->weak_rewrite_count(), xpf_linkedit_stats)) {
+                xpf_image_registry->set_state((const struct mach_header *) w.header, image_registry::STATE_BIND_OPCODES_REWRITTEN);
+                xpf_image_registry->attach_plan((const struct mach_header *) w.header, std::move(w.cached_plan));
+                continue;
+            }
+            
+            /* The cached plan is not applicable; fall back on full evaluation */
+            LocalImage image = LocalImage::Analyze(w.path, w.header);
+            bind_plan_image(image, xpf_plan_rules, w.plan);
+        }
+        
+        /* Apply the new plan, and save it for subsequent launches. Empty plans are not worth a file; such images have
+         * no strong imports, and the rebind prefilter spares their re-evaluation any rebind table lookups. */
+        if (!bind_rewrite_apply(w.path, w.header, w.plan.weak_rewrites.data(), w.plan.weak_rewrites.size(), xpf_linkedit_stats))
+            continue;
+        
+        xpf_image_registry->set_state((const struct mach_header *) w.header, image_registry::STATE_BIND_OPCODES_REWRITTEN);
+        if (w.cacheable && (!w.plan.weak_rewrites.empty() || !w.plan.rebind_sites.empty()))
+            xpf_bind_cache->store(w.key, w.plan);
+        
+        std::unique_ptr<mapped_bind_plan> carried(new mapped_bind_plan());
+        carried->adopt(std::move(w.plan));
+        xpf_image_registry->attach_plan((const struct mach_header *) w.header, std::move(carried));
     }
 
     return NULL;
@@ -140,28 +742,87 @@ static const char *xpf_image_state_change (enum dyld_image_states state, uint32_
  * Image add callback; used to perform symbol rebinding and Objective-C patching after images have been fully loaded.
  */
 static void xpf_add_image_callback (const struct mach_header *header, intptr_t vm_slide) {
-    const char *name = nullptr;
-    for (uint32_t i = 0; i < _dyld_image_count(); i++) {
-        if (_dyld_get_image_header(i) != header)
-            continue;
-        
-        name = _dyld_get_image_name(i);
-        break;
+    trace_span span("rebind", trace_enabled() ? xpf_image_registry->path(header) : nullptr);
+    /* The page snapshots are allocated before, and released after, the heap accounting scope. */
+    image_data_accounting pages(ACCOUNTING_PHASE_REBIND, (const pl_mach_header_t *) header);
+    accounting_scope scope(ACCOUNTING_PHASE_REBIND);
+    
+    /* Never rebind an image twice; the bound values are no longer the original addresses. */
+    if (xpf_image_registry->state(header) & image_registry::STATE_SYMBOLS_REBOUND)
+        return;
+    
+    /* Images prepatched against a shim library bind directly to our replacements; other prepatched images must
+     * still be rebound. */
+    if (image_is_prepatched((const pl_mach_header_t *) header, XPF_PREPATCH_FLAG_REBOUND)) {
+        xpf_image_registry->set_state(header, image_registry::STATE_SYMBOLS_REBOUND);
+        image_insert_xcode_plugin_path();
+        return;
     }
-
-    /* This would be odd ... */
-    if (name == nullptr) {
+    
+    /* Replay the rebind sites of the plan carried over from xpf_image_state_change(); images that were loaded before
+     * our state change handler was registered fall back on the bind plan cache. */
+    std::unique_ptr<mapped_bind_plan> plan = xpf_image_registry->take_plan(header);
+    bind_plan_key key;
+    if (plan == nullptr && xpf_bind_cache != nullptr && image_plan_key((const pl_mach_header_t *) header, key)) {
+        plan.reset(new mapped_bind_plan());
+        if (!xpf_bind_cache->load(key, *plan))
+            plan.reset();
+    }
+    
+    if (plan != nullptr && image_replay_rebinds((const pl_mach_header_t *) header, *plan)) {
+        xpf_image_registry->set_state(header, image_registry::STATE_SYMBOLS_REBOUND);
+        image_insert_xcode_plugin_path();
         return;
     }
+    
+    /* Without a plan, skip full evaluation of any images that can not reference a rebind table symbol */
+    uint64_t scan_start = mach_absolute_time();
+    bool candidate = (xpf_rebind_prefilter == nullptr || xpf_rebind_prefilter->image_matches((const pl_mach_header_t *) header));
+    
+    xpf_prefilter_stats.scanned++;
+    xpf_prefilter_stats.scan_time += mach_absolute_time() - scan_start;
+    
+    if (!candidate) {
+        xpf_prefilter_stats.skipped++;
+        xpf_image_registry->set_state(header, image_registry::STATE_SYMBOLS_REBOUND);
+        image_insert_xcode_plugin_path();
+        return;
+    }
+    
+    /* Look up the image name; images are normally registered by xpf_image_state_change() */
+    const char *name = xpf_image_registry->path(header);
+    if (name == nullptr) {
+        for (uint32_t i = 0; i < _dyld_image_count(); i++) {
+            if (_dyld_get_image_header(i) != header)
+                continue;
+            
+            name = _dyld_get_image_name(i);
+            break;
+        }
+        
+        /* This would be odd ... */
+        if (name == nullptr) {
+            return;
+        }
+        
+        xpf_image_registry->insert(header, name);
+    }
 
     /* Perform symbol rebinding. */
     auto image = LocalImage::Analyze(name, (const pl_mach_header_t *) header);
     image_rebind_required_symbols(image);
+    xpf_image_registry->set_state(header, image_registry::STATE_SYMBOLS_REBOUND);
     
     /* Apply ObjC patch to any existing loaded images. */
     image_insert_xcode_plugin_path();
 }
 
+/**
+ * Image removal callback; used to maintain our image registry.
+ */
+static void xpf_remove_image_callback (const struct mach_header *header, intptr_t vm_slide) {
+    xpf_image_registry->remove(header);
+}
 
 /*
  * This is the only Objective-C patch that /must/ be applied early on at the bootstrap level -- we swizzle DVTPlugInManager,
@@ -199,6 +860,7 @@ static void image_insert_xcode_plugin_path () {
         return;
 
     /* Save the old implementation, insert the new. */
+    trace_span span("insert-plugin-path");
     orig_DVTPlugInManager_init = (decltype(orig_DVTPlugInManager_init)) method_getImplementation(m);
     IMP newIMP = (IMP) xpf_DVTPlugInManager_init;
     
@@ -208,83 +870,21 @@ static void image_insert_xcode_plugin_path () {
     }
 }
 
-
 /**
- * Rewrite the bind instructions of a newly loaded image, detecting and marking as weak any missing
- * symbols.
+ * Return true if @a header was prepatched on disk by xpf-prepatch against our current rule tables, with all of the
+ * given XPF_PREPATCH_FLAG_* @a flags set.
  */
-static void image_rewrite_bind_opcodes (const LocalImage &image) {
-    /* Find the LINKEDIT segment; we need this to be able to reset memory protections
-     * back to their original values. */
-    const pl_segment_command_t *linkedit = nullptr;
-    {
-        for (auto &&segment : *image.segments()) {
-            if (strcmp(segment->segname, SEG_LINKEDIT) != 0)
-                continue;
-            
-            linkedit = segment;
-        }
-
-        if (linkedit == nullptr) {
-            PMLog("Could not find the __LINKEDIT segment; cannot rebind opcodes for %s", image.path().c_str());
-            return;
-        }
-    }
-    
-    /* Mark the LINKEDIT segment as writable */
-    if (mprotect((void *) (linkedit->vmaddr + image.vmaddr_slide()), linkedit->vmsize, linkedit->initprot|PROT_WRITE) != 0) {
-        PMLog("mprotect(__LINKEDIT, PROT_WRITE) failed; cannot rebind opcodes for %s: %s", image.path().c_str(), strerror(errno));
-        return;
-    }
-
-    /* Iterate over all opcode streams in the image, looking for (and correcting)
-     * non-weak references to undefined symbols. */
-    for (auto &&opcodes : *image.bindOpcodes()) {
-        bind_opstream ops = opcodes;
+static bool image_is_prepatched (const pl_mach_header_t *header, uint32_t flags) {
+    bool prepatched = false;
+    macho_for_each_command(header, [&](const struct load_command *cmd) {
+        if (cmd->cmd != XPF_LC_PREPATCHED || cmd->cmdsize < sizeof(struct xpf_prepatch_command))
+            return true;
         
-        /* Points to the last instance of BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM (if any). */
-        const uint8_t *symbol_decl_pc = nullptr;
-        
-        /* Check for an undefined symbol */
-        auto check_def = [&](const bind_opstream::symbol_proc &sp) {
-            /* Skip any symbols not explicitly marked for weak rewriting */
-            bool found = false;
-            for (size_t i = 0; i < sizeof(weak_symbols) / sizeof(weak_symbols[0]); i++) {
-                if (strcmp(weak_symbols[i].symbol, sp.name().symbol()) != 0)
-                    continue;
-                
-                if (strcmp(weak_symbols[i].library, sp.name().image()) != 0)
-                    continue;
-                
-                found = true;
-                break;
-            }
-
-            /* Mark the sumbol as weak if it's not already */
-            if (!(sp.flags() & BIND_SYMBOL_FLAGS_WEAK_IMPORT)) {
-                /* Rewrite the symbol flags */
-                *((uint8_t *) symbol_decl_pc) = BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM | sp.flags() | BIND_SYMBOL_FLAGS_WEAK_IMPORT;
-            }
-        };
-    
-        /* Step the VM, keeping track of symbol definition state so that we can rewrite
-         * any SET_SYMBOL opcodes that reference unknown symbols. */
-        const uint8_t *last_pc = ops.position();
-        uint8_t opcode = BIND_OPCODE_DONE;
-        while (!ops.isEmpty() && (opcode = ops.step(image, check_def)) != BIND_OPCODE_DONE) {
-            /* Save the opcode address */
-            if (opcode == BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM) {
-                symbol_decl_pc = last_pc;
-            }
-            
-            /* Update our PC state */
-            last_pc = ops.position();
-        }
-    }
+        auto marker = (const struct xpf_prepatch_command *) cmd;
+        prepatched = (marker->version == XPF_PREPATCH_VERSION && marker->rules_hash == xpf_active_rules_hash && (marker->flags & flags) == flags);
+        return false;
+    });
     
-    /* Restore the LINKEDIT segment's initial protections. */
-    if (mprotect((void *) (linkedit->vmaddr + image.vmaddr_slide()), linkedit->vmsize, linkedit->initprot) != 0) {
-        PMLog("mprotect(__LINKEDIT, initprot) failed; could not restore expected protections for %s: %s", image.path().c_str(), strerror(errno));
-        return;
-    }
+    return prepatched;
 }
+
@@ -28,6 +28,9 @@
 
 #import <AppKit/AppKit.h>
 #import "yosemite_objc_stubs.h"
+#import "qos_policy.h"
+
+#import <objc/runtime.h>
 
 /*
  * This file binds (via ObjC categories) Yosemite-only methods that are required to run Xcode.
@@ -49,14 +52,87 @@ FACADE(NSColor)
 + (NSColor *) secondaryLabelColor { return [self disabledControlTextColor]; }
 @end
 
+/* Associated object key for the NSOperation/NSOperationQueue QoS facades */
+static char XPFQualityOfServiceKey;
+
+/* Return the QoS assigned to obj via our facades, or NSQualityOfServiceDefault */
+static NSQualityOfService xpf_quality_of_service (id obj) {
+    NSNumber *qos = objc_getAssociatedObject(obj, &XPFQualityOfServiceKey);
+    return (qos != nil) ? (NSQualityOfService) [qos integerValue] : NSQualityOfServiceDefault;
+}
+
+/* Apply the thread and queue priority equivalent to qualityOfService to op */
+static void xpf_operation_apply_quality_of_service (NSOperation *op, NSQualityOfService qualityOfService) {
+    [op setThreadPriority: xpf_qos_thread_priority(qualityOfService)];
+    
+    long priority = xpf_qos_queue_priority(qualityOfService);
+    if (priority > DISPATCH_QUEUE_PRIORITY_DEFAULT)
+        [op setQueuePriority: NSOperationQueuePriorityHigh];
+    else if (priority == DISPATCH_QUEUE_PRIORITY_DEFAULT)
+        [op setQueuePriority: NSOperationQueuePriorityNormal];
+    else if (priority == DISPATCH_QUEUE_PRIORITY_LOW)
+        [op setQueuePriority: NSOperationQueuePriorityLow];
+    else
+        [op setQueuePriority: NSOperationQueuePriorityVeryLow];
+}
+
+/* Apply the QoS assigned to queue (if any) to op, unless op was assigned its own QoS */
+static void xpf_operation_inherit_quality_of_service (NSOperationQueue *queue, NSOperation *op) {
+    NSNumber *qos = objc_getAssociatedObject(queue, &XPFQualityOfServiceKey);
+    if (qos == nil || objc_getAssociatedObject(op, &XPFQualityOfServiceKey) != nil)
+        return;
+    
+    xpf_operation_apply_quality_of_service(op, (NSQualityOfService) [qos integerValue]);
+}
+
+static void (*orig_NSOperationQueue_addOperation) (NSOperationQueue *self, SEL _cmd, NSOperation *op) = NULL;
+static void xpf_NSOperationQueue_addOperation (NSOperationQueue *self, SEL _cmd, NSOperation *op) {
+    xpf_operation_inherit_quality_of_service(self, op);
+    orig_NSOperationQueue_addOperation(self, _cmd, op);
+}
+
+static void (*orig_NSOperationQueue_addOperations) (NSOperationQueue *self, SEL _cmd, NSArray *ops, BOOL wait) = NULL;
+static void xpf_NSOperationQueue_addOperations (NSOperationQueue *self, SEL _cmd, NSArray *ops, BOOL wait) {
+    for (NSOperation *op in ops)
+        xpf_operation_inherit_quality_of_service(self, op);
+    orig_NSOperationQueue_addOperations(self, _cmd, ops, wait);
+}
+
+/* Replace the NSOperationQueue implementation of sel with imp, saving the original implementation to orig first */
+static void xpf_operation_queue_swizzle (SEL sel, IMP imp, IMP *orig) {
+    Method m = class_getInstanceMethod([NSOperationQueue class], sel);
+    if (m == NULL)
+        return;
+    
+    *orig = method_getImplementation(m);
+    method_setImplementation(m, imp);
+}
+
+/*
+ * NSOperationQueue has no Mavericks scheduling equivalent; instead, the queue's QoS is mapped to the thread and queue
+ * priority of each operation added (via addOperation: or addOperations:waitUntilFinished:) without a QoS of its own.
+ * The add methods are only hooked once a queue QoS is first assigned.
+ */
 FACADE(NSOperationQueue)
-- (void) setQualityOfService:(NSQualityOfService)qualityOfService {}
+- (NSQualityOfService) qualityOfService { return xpf_quality_of_service(self); }
+- (void) setQualityOfService:(NSQualityOfService)qualityOfService {
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        xpf_operation_queue_swizzle(@selector(addOperation:), (IMP) xpf_NSOperationQueue_addOperation, (IMP *) &orig_NSOperationQueue_addOperation);
+        xpf_operation_queue_swizzle(@selector(addOperations:waitUntilFinished:), (IMP) xpf_NSOperationQueue_addOperations, (IMP *) &orig_NSOperationQueue_addOperations);
+    });
+    
+    objc_setAssociatedObject(self, &XPFQualityOfServiceKey, @(qualityOfService), OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
 @end
 
-
+/* NSOperation QoS is mapped to the equivalent thread and queue priority */
 FACADE(NSOperation)
-- (NSQualityOfService) qualityOfService {return NSQualityOfServiceDefault; }
-- (void) setQualityOfService:(NSQualityOfService)qualityOfService {}
+- (NSQualityOfService) qualityOfService { return xpf_quality_of_service(self); }
+- (void) setQualityOfService:(NSQualityOfService)qualityOfService {
+    objc_setAssociatedObject(self, &XPFQualityOfServiceKey, @(qualityOfService), OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    xpf_operation_apply_quality_of_service(self, qualityOfService);
+}
 @end
 
 FACADE(NSToolbarItem)
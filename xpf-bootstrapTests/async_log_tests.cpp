@@ -0,0 +1,116 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <set>
+#include <string>
+
+#include "async_log.h"
+
+using namespace xpf;
+
+namespace {
+
+/** Number of lines logged by each process. */
+static constexpr int LINES = 256;
+
+/** Number of lines logged between each flush. */
+static constexpr int LINES_PER_FLUSH = 32;
+
+/** Log file size limit; smaller than the combined output of both processes, but larger than half of it. */
+static constexpr size_t LIMIT = 24 * 1024;
+
+/** Add every line of the file at @a path to @a lines, returning the file's size. */
+static size_t read_lines (const std::string &path, std::multiset<std::string> &lines) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+        lines.insert(line);
+    
+    struct stat sb;
+    return (stat(path.c_str(), &sb) == 0) ? (size_t) sb.st_size : 0;
+}
+
+} /* anonymous namespace */
+
+/* Concurrent processes sharing a log file rotate it once, without truncating each other's output */
+TEST(AsyncLog, SharedFileRotation) {
+    char dir[] = "/tmp/xpf-log.XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    std::string path = std::string(dir) + "/xpf.log";
+    
+    pid_t children[2];
+    for (int c = 0; c < 2; c++) {
+        children[c] = fork();
+        if (children[c] == 0) {
+            setenv("XPF_LOG_FILE", path.c_str(), 1);
+            setenv("XPF_LOG_FILE_SIZE", std::to_string(LIMIT).c_str(), 1);
+            async_log_init();
+            
+            for (int i = 0; i < LINES; i++) {
+                async_log_write("process %d line %03d: padding padding padding padding\n", c, i);
+                if (i % LINES_PER_FLUSH == LINES_PER_FLUSH - 1)
+                    async_log_flush(UINT64_MAX);
+            }
+            exit(0);
+        }
+    }
+    
+    for (auto &&child : children) {
+        int status = 0;
+        ASSERT_EQ(waitpid(child, &status, 0), child);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0) << std::hex << status;
+    }
+    
+    std::multiset<std::string> lines;
+    size_t current = read_lines(path, lines);
+    size_t rotated = read_lines(path + ".1", lines);
+    
+    EXPECT_GT(rotated, 0U);
+    EXPECT_LE(rotated, LIMIT);
+    EXPECT_LE(current, LIMIT);
+    
+    EXPECT_EQ(lines.size(), 2U * LINES);
+    for (int c = 0; c < 2; c++) {
+        for (int i = 0; i < LINES; i++) {
+            char expected[128];
+            snprintf(expected, sizeof(expected), "process %d line %03d: padding padding padding padding", c, i);
+            EXPECT_EQ(lines.count(expected), 1U) << expected;
+        }
+    }
+    
+    unlink(path.c_str());
+    unlink((path + ".1").c_str());
+    rmdir(dir);
+}
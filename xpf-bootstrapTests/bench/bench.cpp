@@ -0,0 +1,409 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bench.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace xpf {
+namespace bench {
+
+/** Return the (lazily constructed) benchmark registry. */
+static std::vector<bench_entry> &registry () {
+    static std::vector<bench_entry> entries;
+    return entries;
+}
+
+/**
+ * Register benchmark @a fn as @a name.
+ */
+bench_registration::bench_registration (const char *name, bench_fn fn) {
+    registry().push_back({ name, fn });
+}
+
+/**
+ * Return all registered benchmarks, in registration order.
+ */
+const std::vector<bench_entry> &bench_registry () {
+    return registry();
+}
+
+/**
+ * Record the median of @a samples.
+ */
+void bench_case::record (uint64_t iterations, std::vector<double> &samples) {
+    std::sort(samples.begin(), samples.end());
+    
+    size_t mid = samples.size() / 2;
+    double median = (samples.size() % 2 == 0) ? (samples[mid - 1] + samples[mid]) / 2 : samples[mid];
+    
+    _result.iterations = iterations;
+    _result.ns_per_item = median;
+    _result.items_per_second = (median > 0) ? 1e9 / median : 0;
+    _measured = true;
+}
+
+/** Append @a str to @a out as a JSON string literal. */
+static void json_string (std::string &out, const std::string &str) {
+    out += '"';
+    for (char c : str) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char) c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+/** Append @a value to @a out as a JSON number. */
+static void json_number (std::string &out, double value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.17g", isfinite(value) ? value : 0.0);
+    out += buf;
+}
+
+/**
+ * Serialize @a results as JSON:
+ *
+ *     { "benchmarks": [ { "name": ..., "iterations": ..., "ns_per_item": ..., "items_per_second": ...,
+ *                         "counters": { ... } }, ... ] }
+ */
+std::string bench_write_json (const std::vector<bench_result> &results) {
+    std::string out = "{\n  \"benchmarks\": [";
+    
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result &r = results[i];
+        out += (i == 0) ? "\n    {" : ",\n    {";
+        
+        out += "\"name\": ";
+        json_string(out, r.name);
+        out += ", \"iterations\": ";
+        json_number(out, (double) r.iterations);
+        out += ", \"ns_per_item\": ";
+        json_number(out, r.ns_per_item);
+        out += ", \"items_per_second\": ";
+        json_number(out, r.items_per_second);
+        
+        out += ", \"counters\": {";
+        bool first = true;
+        for (auto &&counter : r.counters) {
+            if (!first)
+                out += ", ";
+            first = false;
+            
+            json_string(out, counter.first);
+            out += ": ";
+            json_number(out, counter.second);
+        }
+        out += "}}";
+    }
+    
+    out += "\n  ]\n}\n";
+    return out;
+}
+
+/**
+ * A minimal JSON reader, sufficient to read back the output of bench_write_json().
+ */
+class json_reader {
+public:
+    json_reader (const std::string &json) : _p(json.c_str()), _end(json.c_str() + json.size()) {}
+    
+    bool read_results (std::vector<bench_result> &results, std::string &error) {
+        if (!expect('{'))
+            return fail(error, "expected an object");
+        
+        bool found = false;
+        if (!peek('}')) {
+            do {
+                std::string key;
+                if (!read_string(key) || !expect(':'))
+                    return fail(error, "expected a key");
+                
+                if (key == "benchmarks") {
+                    if (!read_benchmarks(results))
+                        return fail(error, "invalid benchmarks array");
+                    found = true;
+                } else if (!skip_value()) {
+                    return fail(error, "invalid value");
+                }
+            } while (expect(','));
+        }
+        
+        if (!expect('}'))
+            return fail(error, "expected '}'");
+        
+        if (!found)
+            return fail(error, "no benchmarks array");
+        
+        return true;
+    }
+
+private:
+    bool read_benchmarks (std::vector<bench_result> &results) {
+        if (!expect('['))
+            return false;
+        
+        if (expect(']'))
+            return true;
+        
+        do {
+            bench_result r = { "", 0, 0, 0, {} };
+            if (!expect('{'))
+                return false;
+            
+            if (!peek('}')) {
+                do {
+                    std::string key;
+                    if (!read_string(key) || !expect(':'))
+                        return false;
+                    
+                    double value;
+                    if (key == "name") {
+                        if (!read_string(r.name))
+                            return false;
+                    } else if (key == "iterations" || key == "ns_per_item" || key == "items_per_second") {
+                        if (!read_number(value))
+                            return false;
+                        
+                        if (key == "iterations")
+                            r.iterations = (uint64_t) value;
+                        else if (key == "ns_per_item")
+                            r.ns_per_item = value;
+                        else
+                            r.items_per_second = value;
+                    } else if (key == "counters") {
+                        if (!read_counters(r.counters))
+                            return false;
+                    } else if (!skip_value()) {
+                        return false;
+                    }
+                } while (expect(','));
+            }
+            
+            if (!expect('}'))
+                return false;
+            
+            results.push_back(r);
+        } while (expect(','));
+        
+        return expect(']');
+    }
+    
+    bool read_counters (std::map<std::string, double> &counters) {
+        if (!expect('{'))
+            return false;
+        
+        if (expect('}'))
+            return true;
+        
+        do {
+            std::string key;
+            double value;
+            if (!read_string(key) || !expect(':') || !read_number(value))
+                return false;
+            counters[key] = value;
+        } while (expect(','));
+        
+        return expect('}');
+    }
+    
+    bool skip_value () {
+        skip_ws();
+        if (_p >= _end)
+            return false;
+        
+        std::string str;
+        double number;
+        
+        switch (*_p) {
+            case '"':
+                return read_string(str);
+                
+            case '{':
+            case '[': {
+                char close = (*_p == '{') ? '}' : ']';
+                _p++;
+                if (expect(close))
+                    return true;
+                
+                do {
+                    if (close == '}' && (!read_string(str) || !expect(':')))
+                        return false;
+                    if (!skip_value())
+                        return false;
+                } while (expect(','));
+                
+                return expect(close);
+            }
+                
+            case 't':
+                return literal("true");
+            case 'f':
+                return literal("false");
+            case 'n':
+                return literal("null");
+                
+            default:
+                return read_number(number);
+        }
+    }
+    
+    bool read_string (std::string &out) {
+        if (!expect('"'))
+            return false;
+        
+        out.clear();
+        while (_p < _end && *_p != '"') {
+            if (*_p == '\\') {
+                if (++_p >= _end)
+                    return false;
+                
+                switch (*_p) {
+                    case 'n': out += '\n'; break;
+                    case 't': out += '\t'; break;
+                    case 'u':
+                        if (_end - _p < 5)
+                            return false;
+                        out += (char) strtol(std::string(_p + 1, 4).c_str(), nullptr, 16);
+                        _p += 4;
+                        break;
+                    default: out += *_p; break;
+                }
+                _p++;
+            } else {
+                out += *_p++;
+            }
+        }
+        
+        if (_p >= _end)
+            return false;
+        
+        _p++;
+        return true;
+    }
+    
+    bool read_number (double &value) {
+        skip_ws();
+        char *end;
+        value = strtod(_p, &end);
+        if (end == _p || end > _end)
+            return false;
+        
+        _p = end;
+        return true;
+    }
+    
+    bool literal (const char *word) {
+        size_t len = strlen(word);
+        if ((size_t) (_end - _p) < len || strncmp(_p, word, len) != 0)
+            return false;
+        
+        _p += len;
+        return true;
+    }
+    
+    void skip_ws () {
+        while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+            _p++;
+    }
+    
+    bool peek (char c) {
+        skip_ws();
+        return _p < _end && *_p == c;
+    }
+    
+    bool expect (char c) {
+        if (!peek(c))
+            return false;
+        
+        _p++;
+        return true;
+    }
+    
+    bool fail (std::string &error, const char *message) {
+        error = message;
+        return false;
+    }
+    
+    const char *_p;
+    const char *_end;
+};
+
+/**
+ * Parse benchmark results written by bench_write_json().
+ *
+ * @param json The JSON document.
+ * @param results On success, the parsed results will be appended to this vector.
+ * @param error On failure, a description of the error.
+ */
+bool bench_read_json (const std::string &json, std::vector<bench_result> &results, std::string &error) {
+    json_reader reader(json);
+    return reader.read_results(results, error);
+}
+
+/**
+ * Compare @a current against @a baseline; benchmarks absent from either set are ignored.
+ *
+ * @param baseline The baseline results.
+ * @param current The current results.
+ * @param threshold The maximum permitted slowdown, in percent.
+ */
+std::vector<bench_comparison> bench_compare (const std::vector<bench_result> &baseline, const std::vector<bench_result> &current, double threshold) {
+    std::map<std::string, const bench_result *> base;
+    for (auto &&r : baseline)
+        base[r.name] = &r;
+    
+    std::vector<bench_comparison> comparisons;
+    for (auto &&r : current) {
+        auto it = base.find(r.name);
+        if (it == base.end() || it->second->ns_per_item <= 0)
+            continue;
+        
+        double change = (r.ns_per_item - it->second->ns_per_item) / it->second->ns_per_item * 100.0;
+        comparisons.push_back({ r.name, it->second->ns_per_item, r.ns_per_item, change, change > threshold });
+    }
+    
+    return comparisons;
+}
+
+} /* namespace bench */
+} /* namespace xpf */
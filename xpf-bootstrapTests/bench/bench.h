@@ -0,0 +1,201 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace xpf {
+namespace bench {
+
+/**
+ * The result of a single benchmark.
+ */
+struct bench_result {
+    /** The benchmark's name. */
+    std::string name;
+    
+    /** Number of timed iterations per repetition. */
+    uint64_t iterations;
+    
+    /** Median time per item, in nanoseconds, across all repetitions. */
+    double ns_per_item;
+    
+    /** Items per second, derived from ns_per_item. */
+    double items_per_second;
+    
+    /** Additional benchmark-specific measurements (eg, memory use); these are reported, but never compared. */
+    std::map<std::string, double> counters;
+};
+
+/**
+ * Measurement configuration.
+ */
+struct bench_config {
+    /** Minimum duration of a single repetition. */
+    std::chrono::nanoseconds min_time = std::chrono::milliseconds(50);
+    
+    /** Number of repetitions; the median is reported. */
+    unsigned repetitions = 5;
+};
+
+/**
+ * The state of a single running benchmark.
+ */
+class bench_case {
+public:
+    bench_case (const std::string &name, const bench_config &config) : _config(config), _measured(false) {
+        _result.name = name;
+        _result.iterations = 0;
+        _result.ns_per_item = 0;
+        _result.items_per_second = 0;
+    }
+    
+    /**
+     * Time @a fn, which performs @a items units of work per call.
+     *
+     * The iteration count is calibrated so that each repetition runs for at least the configured minimum time; the
+     * median time per item across all repetitions is recorded. A benchmark must call measure() exactly once.
+     */
+    template <typename Fn> void measure (uint64_t items, Fn &&fn) {
+        using clock = std::chrono::steady_clock;
+        
+        /* Calibrate */
+        uint64_t iterations = 1;
+        while (true) {
+            auto start = clock::now();
+            for (uint64_t i = 0; i < iterations; i++)
+                fn();
+            auto elapsed = clock::now() - start;
+            
+            if (elapsed >= _config.min_time || iterations >= (1ULL << 40))
+                break;
+            
+            /* Scale towards the target, at most 10x per step */
+            double scale = (elapsed.count() > 0) ? (double) _config.min_time.count() / elapsed.count() * 1.2 : 10.0;
+            iterations = (uint64_t) (iterations * std::min(std::max(scale, 1.5), 10.0)) + 1;
+        }
+        
+        std::vector<double> samples;
+        for (unsigned r = 0; r < std::max(_config.repetitions, 1U); r++) {
+            auto start = clock::now();
+            for (uint64_t i = 0; i < iterations; i++)
+                fn();
+            std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+            samples.push_back(elapsed.count() / (double) (iterations * std::max<uint64_t>(items, 1)));
+        }
+        
+        record(iterations, samples);
+    }
+    
+    /** Record an additional measurement. */
+    void counter (const std::string &name, double value) { _result.counters[name] = value; }
+    
+    /** Return true if measure() has been called. */
+    bool measured () const { return _measured; }
+    
+    /** Return the benchmark's result. */
+    const bench_result &result () const { return _result; }
+
+private:
+    void record (uint64_t iterations, std::vector<double> &samples);
+    
+    const bench_config &_config;
+    bench_result _result;
+    bool _measured;
+};
+
+/** A benchmark function. */
+typedef std::function<void(bench_case &)> bench_fn;
+
+/**
+ * A named benchmark, registered at static initialization time; see XPF_BENCHMARK().
+ */
+struct bench_registration {
+    bench_registration (const char *name, bench_fn fn);
+};
+
+/**
+ * A registered benchmark.
+ */
+struct bench_entry {
+    std::string name;
+    bench_fn fn;
+};
+
+const std::vector<bench_entry> &bench_registry ();
+
+/**
+ * A single benchmark's comparison against a baseline.
+ */
+struct bench_comparison {
+    /** The benchmark's name. */
+    std::string name;
+    
+    /** Baseline and current time per item, in nanoseconds. */
+    double baseline_ns;
+    double current_ns;
+    
+    /** Relative change in time per item, in percent; positive values are slowdowns. */
+    double change;
+    
+    /** True if the slowdown exceeds the comparison threshold. */
+    bool regression;
+};
+
+std::string bench_write_json (const std::vector<bench_result> &results);
+bool bench_read_json (const std::string &json, std::vector<bench_result> &results, std::string &error);
+std::vector<bench_comparison> bench_compare (const std::vector<bench_result> &baseline, const std::vector<bench_result> &current, double threshold);
+
+/**
+ * Define and register a benchmark.
+ *
+ * @param _name The benchmark's name; by convention, "<area>/<operation>[/<parameter>]".
+ */
+#define XPF_BENCHMARK(_ident, _name) \
+    static void _ident (::xpf::bench::bench_case &); \
+    static ::xpf::bench::bench_registration _ident ## _registration(_name, _ident); \
+    static void _ident (::xpf::bench::bench_case &bench)
+
+/**
+ * Prevent the compiler from discarding the computation of @a value.
+ */
+template <typename T> inline void do_not_optimize (T const &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} /* namespace bench */
+} /* namespace xpf */
@@ -0,0 +1,86 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bench_image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace xpf {
+namespace bench {
+
+/**
+ * Synthesize and map an image with @a config, aborting on failure.
+ */
+std::unique_ptr<bench_image> bench_load_image (const test::macho_synthetic_config &config) {
+    std::unique_ptr<bench_image> result(new bench_image());
+    result->config = config;
+    result->data = test::macho_synthesize(config);
+    
+    std::string error;
+    if (!result->image.load(result->data, "/usr/lib/libsynthetic.dylib", false, error)) {
+        fprintf(stderr, "xpf-bench: could not load synthetic image: %s\n", error.c_str());
+        abort();
+    }
+    
+    return result;
+}
+
+/**
+ * Build rules against the imports of a synthetic image with @a config: every @a rebind_stride'th symbol is
+ * rebound, and every @a weak_stride'th symbol is marked as weak. A stride of 0 produces no rules.
+ */
+std::unique_ptr<bench_rules> bench_make_rules (const test::macho_synthetic_config &config, size_t rebind_stride, size_t weak_stride) {
+    std::unique_ptr<bench_rules> rules(new bench_rules());
+    size_t libraries = std::max<size_t>(config.libraries, 1);
+    
+    auto intern = [&](const std::string &str) {
+        rules->strings.emplace_back(new std::string(str));
+        return rules->strings.back()->c_str();
+    };
+    
+    for (size_t i = 0; i < config.symbols; i++) {
+        if (rebind_stride != 0 && i % rebind_stride == 0) {
+            const char *symbol = intern(test::macho_synthetic_symbol(i));
+            const char *image = intern(test::macho_synthetic_library(i % libraries));
+            rules->rebinds.push_back({ symbol, rebind_index::hash(symbol), image, nullptr, 0 });
+        }
+        
+        if (weak_stride != 0 && i % weak_stride == 0) {
+            const char *symbol = intern(test::macho_synthetic_symbol(i));
+            const char *library = intern(test::macho_synthetic_library(i % libraries));
+            rules->weak.push_back({ library, symbol });
+        }
+    }
+    
+    rules->index.reset(new rebind_index(rules->rebinds.data(), rules->rebinds.size()));
+    return rules;
+}
+
+} /* namespace bench */
+} /* namespace xpf */
@@ -0,0 +1,83 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "loaded_image.h"
+#include "macho_builder.h"
+#include "rebind_index.h"
+#include "rebind_table.h"
+#include "weak_table.h"
+
+namespace xpf {
+namespace bench {
+
+/**
+ * A synthetic image loaded for benchmarking.
+ */
+struct bench_image {
+    /** The image's configuration. */
+    test::macho_synthetic_config config;
+    
+    /** The image's file data. */
+    std::vector<uint8_t> data;
+    
+    /** The mapped image. */
+    test::loaded_image image;
+};
+
+std::unique_ptr<bench_image> bench_load_image (const test::macho_synthetic_config &config);
+
+/**
+ * Rebind and weak import rules matching a subset of a synthetic image's imports.
+ */
+struct bench_rules {
+    /** Backing storage for the rule strings. */
+    std::vector<std::unique_ptr<std::string>> strings;
+    
+    /** Rebind table entries. */
+    std::vector<xpf_rebind_entry> rebinds;
+    
+    /** Weak import rules. */
+    std::vector<xpf_weak_entry> weak;
+    
+    /** Index over rebinds. */
+    std::unique_ptr<rebind_index> index;
+};
+
+std::unique_ptr<bench_rules> bench_make_rules (const test::macho_synthetic_config &config, size_t rebind_stride, size_t weak_stride);
+
+} /* namespace bench */
+} /* namespace xpf */
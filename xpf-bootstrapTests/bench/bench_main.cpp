@@ -0,0 +1,177 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * xpf-bench
+ *
+ * Runs the xpf-bootstrap benchmarks against synthetic Mach-O images, optionally writing the results as JSON and
+ * comparing them against a previously written baseline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+using namespace xpf::bench;
+
+static void print_usage (const char *progname) {
+    fprintf(stderr, "Usage: %s [-f <filter>] [-o <json>] [-b <baseline json>] [-t <threshold>] [-m <ms>] [-r <count>] [-l]\n", progname);
+    fprintf(stderr, "  -f <filter>   Run only benchmarks whose name contains <filter>\n");
+    fprintf(stderr, "  -o <path>     Write JSON results to <path>, or to stdout if <path> is '-'\n");
+    fprintf(stderr, "  -b <path>     Compare against the JSON results at <path>\n");
+    fprintf(stderr, "  -t <percent>  Maximum permitted slowdown relative to the baseline (default: 10)\n");
+    fprintf(stderr, "  -m <ms>       Minimum duration of each repetition (default: 50)\n");
+    fprintf(stderr, "  -r <count>    Number of repetitions; the median is reported (default: 5)\n");
+    fprintf(stderr, "  -l            List all benchmarks and exit\n");
+}
+
+int main (int argc, char * const argv[]) {
+    const char *progname = argv[0];
+    const char *filter = nullptr;
+    const char *output = nullptr;
+    const char *baseline_path = nullptr;
+    double threshold = 10.0;
+    bench_config config;
+    bool list = false;
+    int ch;
+    
+    while ((ch = getopt(argc, argv, "f:o:b:t:m:r:lh")) != -1) {
+        switch (ch) {
+            case 'f':
+                filter = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            case 'm':
+                config.min_time = std::chrono::milliseconds(atoi(optarg));
+                break;
+            case 'r':
+                config.repetitions = (unsigned) atoi(optarg);
+                break;
+            case 'l':
+                list = true;
+                break;
+            case 'h':
+            default:
+                print_usage(progname);
+                return (ch == 'h') ? 0 : 1;
+        }
+    }
+    
+    if (list) {
+        for (auto &&entry : bench_registry())
+            printf("%s\n", entry.name.c_str());
+        return 0;
+    }
+    
+    /* Read the baseline first, so that a bad path is reported before running any benchmarks */
+    std::vector<bench_result> baseline;
+    if (baseline_path != nullptr) {
+        std::ifstream stream(baseline_path);
+        if (!stream) {
+            fprintf(stderr, "xpf-bench: %s: could not open baseline\n", baseline_path);
+            return 1;
+        }
+        
+        std::string json((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        std::string error;
+        if (!bench_read_json(json, baseline, error)) {
+            fprintf(stderr, "xpf-bench: %s: %s\n", baseline_path, error.c_str());
+            return 1;
+        }
+    }
+    
+    /* Run the benchmarks; progress is written to stderr, keeping stdout free for JSON output */
+    std::vector<bench_result> results;
+    for (auto &&entry : bench_registry()) {
+        if (filter != nullptr && entry.name.find(filter) == std::string::npos)
+            continue;
+        
+        bench_case bench(entry.name, config);
+        entry.fn(bench);
+        
+        if (!bench.measured()) {
+            fprintf(stderr, "xpf-bench: %s: benchmark did not call measure()\n", entry.name.c_str());
+            return 1;
+        }
+        
+        const bench_result &r = bench.result();
+        fprintf(stderr, "%-48s %14.2f ns/item %16.0f items/s", r.name.c_str(), r.ns_per_item, r.items_per_second);
+        for (auto &&counter : r.counters)
+            fprintf(stderr, "  %s=%.0f", counter.first.c_str(), counter.second);
+        fprintf(stderr, "\n");
+        
+        results.push_back(r);
+    }
+    
+    if (output != nullptr) {
+        std::string json = bench_write_json(results);
+        if (strcmp(output, "-") == 0) {
+            fputs(json.c_str(), stdout);
+        } else {
+            std::ofstream stream(output);
+            if (!stream || !(stream << json)) {
+                fprintf(stderr, "xpf-bench: %s: could not write results\n", output);
+                return 1;
+            }
+        }
+    }
+    
+    if (baseline_path == nullptr)
+        return 0;
+    
+    /* Compare against the baseline, failing on any regression beyond the threshold */
+    size_t regressions = 0;
+    for (auto &&c : bench_compare(baseline, results, threshold)) {
+        fprintf(stderr, "%-48s %12.2f -> %12.2f ns/item  %+7.1f%%%s\n", c.name.c_str(), c.baseline_ns, c.current_ns, c.change, c.regression ? "  REGRESSION" : "");
+        if (c.regression)
+            regressions++;
+    }
+    
+    if (regressions > 0) {
+        fprintf(stderr, "xpf-bench: %zu benchmark(s) regressed by more than %.1f%%\n", regressions, threshold);
+        return 2;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Benchmarks of the per-image bind processing performed by xpf-bootstrap: image analysis, bind opcode evaluation,
+ * bind planning, and __LINKEDIT rewriting.
+ */
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+#include "bench.h"
+#include "bench_image.h"
+#include "bind_rewrite.h"
+
+using namespace patchmaster;
+using namespace xpf;
+using namespace xpf::bench;
+
+/** The image shape shared by the bind benchmarks; roughly that of a mid-sized Xcode plugin framework. */
+static test::macho_synthetic_config bind_config (bool compact = false) {
+    test::macho_synthetic_config config;
+    config.libraries = 24;
+    config.symbols = 1024;
+    config.sites = 4096;
+    config.compact = compact;
+    return config;
+}
+
+/* Parse the image's load commands and locate its bind opcode streams */
+XPF_BENCHMARK(bench_bind_analyze, "bind/analyze") {
+    auto img = bench_load_image(bind_config());
+    
+    bench.measure(1, [&] {
+        LocalImage image = LocalImage::Analyze(img->image.path(), img->image.header());
+        do_not_optimize(image.bindOpcodes()->size());
+    });
+}
+
+/* Evaluate all bind opcodes, via the statically dispatched visitor */
+static void bench_evaluate (bench_case &bench, bool compact) {
+    auto img = bench_load_image(bind_config(compact));
+    LocalImage image = LocalImage::Analyze(img->image.path(), img->image.header());
+    
+    uint64_t binds = 0;
+    image.rebind_symbols([&](const bind_opstream::symbol_proc &sp) { binds++; });
+    
+    bench.measure(binds, [&] {
+        uintptr_t sum = 0;
+        image.rebind_symbols([&](const bind_opstream::symbol_proc &sp) { sum += sp.bind_address(); });
+        do_not_optimize(sum);
+    });
+    bench.counter("binds", (double) binds);
+}
+
+XPF_BENCHMARK(bench_bind_evaluate, "bind/evaluate") {
+    bench_evaluate(bench, false);
+}
+
+XPF_BENCHMARK(bench_bind_evaluate_compact, "bind/evaluate/compact") {
+    bench_evaluate(bench, true);
+}
+
+/* Evaluate all bind opcodes via the std::function interface */
+XPF_BENCHMARK(bench_bind_evaluate_function, "bind/evaluate/function") {
+    auto img = bench_load_image(bind_config());
+    LocalImage image = LocalImage::Analyze(img->image.path(), img->image.header());
+    
+    uint64_t binds = 0;
+    std::function<void(const bind_opstream::symbol_proc &)> count = [&](const bind_opstream::symbol_proc &sp) { binds++; };
+    image.rebind_symbols(count);
+    
+    uintptr_t sum = 0;
+    const std::function<void(const bind_opstream::symbol_proc &)> visit = [&](const bind_opstream::symbol_proc &sp) { sum += sp.bind_address(); };
+    
+    bench.measure(binds, [&] {
+        image.rebind_symbols(visit);
+        do_not_optimize(sum);
+    });
+}
+
+/** A large image, with a single non-lazy bind stream of roughly 450 KiB */
+static test::macho_synthetic_config opcode_config () {
+    test::macho_synthetic_config config;
+    config.libraries = 64;
+    config.symbols = 16384;
+    config.sites = 65536;
+    return config;
+}
+
+/* Step every opcode of a large opcode stream, via either the statically dispatched visitor or std::function */
+template <typename Visitor> static void bench_opcodes (bench_case &bench, Visitor &&visitor) {
+    auto img = bench_load_image(opcode_config());
+    LocalImage image = LocalImage::Analyze(img->image.path(), img->image.header());
+    
+    uint64_t opcodes = 0;
+    uint64_t bytes = 0;
+    for (auto &&stream : *image.bindOpcodes()) {
+        bind_opstream ops = stream;
+        const uint8_t *start = ops.position();
+        while (!ops.isEmpty()) {
+            ops.step(image, [](const bind_opstream::symbol_proc &) {});
+            opcodes++;
+        }
+        bytes += ops.position() - start;
+    }
+    
+    bench.measure(opcodes, [&] {
+        for (auto &&stream : *image.bindOpcodes()) {
+            bind_opstream ops = stream;
+            while (!ops.isEmpty())
+                ops.step(image, visitor);
+        }
+    });
+    bench.counter("opcodes", (double) opcodes);
+    bench.counter("bytes", (double) bytes);
+}
+
+XPF_BENCHMARK(bench_bind_opcodes, "bind/opcodes") {
+    uintptr_t sum = 0;
+    bench_opcodes(bench, [&](const bind_opstream::symbol_proc &sp) { sum += sp.bind_address(); });
+    do_not_optimize(sum);
+}
+
+XPF_BENCHMARK(bench_bind_opcodes_function, "bind/opcodes/function") {
+    uintptr_t sum = 0;
+    const std::function<void(const bind_opstream::symbol_proc &)> visitor = [&](const bind_opstream::symbol_proc &sp) { sum += sp.bind_address(); };
+    bench_opcodes(bench, visitor);
+    do_not_optimize(sum);
+}
+
+/* Compute a bind plan against weak and rebind rules matching a subset of the image's imports */
+XPF_BENCHMARK(bench_bind_plan, "bind/plan") {
+    auto config = bind_config();
+    auto img = bench_load_image(config);
+    auto rules = bench_make_rules(config, 16, 8);
+    LocalImage image = LocalImage::Analyze(img->image.path(), img->image.header());
+    
+    bind_plan_rules plan_rules = { rules->index.get(), rules->weak.data(), rules->weak.size(), false, nullptr, nullptr, nullptr, nullptr };
+    size_t rewrites = 0;
+    
+    bench.measure(config.sites, [&] {
+        bind_plan plan;
+        bind_plan_image(image, plan_rules, plan);
+        rewrites = plan.weak_rewrites.size();
+        do_not_optimize(plan.rebind_sites.size());
+    });
+    bench.counter("weak_rewrites", (double) rewrites);
+}
+
+/* Apply a bind plan's __LINKEDIT rewrites; each iteration applies the plan, and then reverts it */
+XPF_BENCHMARK(bench_bind_rewrite, "bind/rewrite") {
+    auto config = bind_config();
+    auto img = bench_load_image(config);
+    auto rules = bench_make_rules(config, 0, 4);
+    LocalImage image = LocalImage::Analyze(img->image.path(), img->image.header());
+    
+    bind_plan_rules plan_rules = { nullptr, rules->weak.data(), rules->weak.size(), false, nullptr, nullptr, nullptr, nullptr };
+    bind_plan plan;
+    bind_plan_image(image, plan_rules, plan);
+    
+    std::vector<bind_plan_weak_rewrite> revert = plan.weak_rewrites;
+    for (auto &&rewrite : revert)
+        rewrite.opcode &= ~BIND_SYMBOL_FLAGS_WEAK_IMPORT;
+    
+    bind_rewrite_stats stats;
+    stats.images = 0;
+    stats.written = 0;
+    stats.unchanged = 0;
+    stats.pages = 0;
+    
+    const char *path = img->image.path().c_str();
+    bench.measure(plan.weak_rewrites.size() * 2, [&] {
+        bind_rewrite_apply(path, img->image.header(), plan.weak_rewrites.data(), plan.weak_rewrites.size(), stats);
+        bind_rewrite_apply(path, img->image.header(), revert.data(), revert.size(), stats);
+    });
+    bench.counter("rewrites", (double) plan.weak_rewrites.size());
+}
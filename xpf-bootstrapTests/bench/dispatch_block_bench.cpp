@@ -0,0 +1,187 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * dispatch_block_wait() and dispatch_block_notify() latency, measured over the block_completion protocol shared with
+ * dispatch_block_runtime.h. libdispatch is not available on non-Darwin hosts; dispatch semaphores are replaced by
+ * POSIX semaphores, and the completing queue by a dedicated pthread.
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <memory>
+
+#include "bench.h"
+#include "block_completion.h"
+#include "posix_semaphore.h"
+
+using namespace xpf;
+using namespace xpf::bench;
+using namespace xpf::test;
+
+/** Number of completion checks performed before blocking; matches XPF_DISPATCH_BLOCK_WAIT_SPIN. */
+static constexpr unsigned int DISPATCH_BENCH_WAIT_SPIN = 1000;
+
+/** Number of notifications registered per block by the dispatch_block/notify/register benchmark. */
+static constexpr size_t DISPATCH_BENCH_NOTIFICATIONS = 16;
+
+/**
+ * A pending notification; submission signals the benchmark thread.
+ */
+struct bench_notification {
+    bench_notification *next;
+};
+
+typedef block_completion<bench_notification, posix_semaphore> bench_completion;
+
+/**
+ * A thread that completes blocks on request, standing in for the queue executing a dispatch_block_create() block.
+ */
+class completion_thread {
+public:
+    completion_thread () : _target(nullptr), _stop(false) {
+        sem_init(&_request, 0, 0);
+        sem_init(&_notified, 0, 0);
+        if (pthread_create(&_thread, nullptr, run, this) != 0) {
+            fprintf(stderr, "xpf-bench: failed to create completion thread\n");
+            abort();
+        }
+    }
+    
+    ~completion_thread () {
+        _stop.store(true, std::memory_order_release);
+        sem_post(&_request);
+        pthread_join(_thread, nullptr);
+        sem_destroy(&_request);
+        sem_destroy(&_notified);
+    }
+    
+    /** Asynchronously complete @a completion, submitting each of its notifications. */
+    void complete (bench_completion *completion) {
+        _target.store(completion, std::memory_order_release);
+        sem_post(&_request);
+    }
+    
+    /** Wait for a notification submitted by complete(). */
+    void wait_notified () {
+        posix_semaphore::wait_forever(&_notified);
+    }
+
+private:
+    static void *run (void *ctx) {
+        completion_thread *self = (completion_thread *) ctx;
+        while (true) {
+            posix_semaphore::wait_forever(&self->_request);
+            if (self->_stop.load(std::memory_order_acquire))
+                return nullptr;
+            
+            self->_target.load(std::memory_order_acquire)->complete([self](bench_notification *) {
+                sem_post(&self->_notified);
+            });
+        }
+    }
+    
+    pthread_t _thread;
+    sem_t _request;
+    sem_t _notified;
+    std::atomic<bench_completion *> _target;
+    std::atomic<bool> _stop;
+};
+
+/* dispatch_block_wait() on a block that has already completed */
+XPF_BENCHMARK(bench_dispatch_block_wait_completed, "dispatch_block/wait/completed") {
+    std::unique_ptr<bench_completion> completion(new bench_completion());
+    completion->complete([](bench_notification *) {});
+    
+    bench.measure(1, [&] {
+        do_not_optimize(completion->wait(posix_semaphore::FOREVER, DISPATCH_BENCH_WAIT_SPIN));
+    });
+}
+
+/**
+ * Measure the latency of a dispatch_block_wait() issued immediately before the block is completed by another thread,
+ * polling completion @a spin times before blocking.
+ */
+static void wait_handoff (bench_case &bench, unsigned int spin) {
+    completion_thread thread;
+    
+    bench.measure(1, [&] {
+        std::unique_ptr<bench_completion> completion(new bench_completion());
+        thread.complete(completion.get());
+        if (completion->wait(posix_semaphore::FOREVER, spin) != BLOCK_COMPLETION_COMPLETED) {
+            fprintf(stderr, "xpf-bench: dispatch_block wait did not complete\n");
+            abort();
+        }
+    });
+    bench.counter("spin", (double) spin);
+}
+
+XPF_BENCHMARK(bench_dispatch_block_wait_spin, "dispatch_block/wait/spin") { wait_handoff(bench, DISPATCH_BENCH_WAIT_SPIN); }
+XPF_BENCHMARK(bench_dispatch_block_wait_block, "dispatch_block/wait/block") { wait_handoff(bench, 0); }
+
+/* dispatch_block_wait() with DISPATCH_TIME_NOW on a block that has not completed */
+XPF_BENCHMARK(bench_dispatch_block_wait_now, "dispatch_block/wait/now") {
+    std::unique_ptr<bench_completion> completion(new bench_completion());
+    
+    bench.measure(1, [&] {
+        do_not_optimize(completion->wait(0, DISPATCH_BENCH_WAIT_SPIN));
+    });
+}
+
+/* Registration and in-order submission of multiple dispatch_block_notify() notifications on a single thread */
+XPF_BENCHMARK(bench_dispatch_block_notify_register, "dispatch_block/notify/register") {
+    bench_notification notifications[DISPATCH_BENCH_NOTIFICATIONS];
+    
+    bench.measure(DISPATCH_BENCH_NOTIFICATIONS, [&] {
+        bench_completion completion{};
+        for (size_t i = 0; i < DISPATCH_BENCH_NOTIFICATIONS; i++)
+            completion.notify(&notifications[i]);
+        
+        size_t submitted = 0;
+        completion.complete([&](bench_notification *) { submitted++; });
+        do_not_optimize(submitted);
+    });
+    bench.counter("notifications", (double) DISPATCH_BENCH_NOTIFICATIONS);
+}
+
+/* Latency from the completion of a block on another thread to the submission of its dispatch_block_notify() block */
+XPF_BENCHMARK(bench_dispatch_block_notify_handoff, "dispatch_block/notify/handoff") {
+    completion_thread thread;
+    bench_notification notification;
+    
+    bench.measure(1, [&] {
+        std::unique_ptr<bench_completion> completion(new bench_completion());
+        completion->notify(&notification);
+        thread.complete(completion.get());
+        thread.wait_notified();
+    });
+}
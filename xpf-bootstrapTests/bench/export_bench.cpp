@@ -0,0 +1,153 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Export lookup latency and per-library index memory of export_resolver, over a libSystem-shaped umbrella library
+ * re-exporting a set of synthetic sub-libraries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+#include "bench.h"
+#include "export_index.h"
+#include "image_registry.h"
+#include "loaded_image.h"
+#include "macho_builder.h"
+
+using namespace patchmaster;
+using namespace xpf;
+using namespace xpf::bench;
+
+/** Number of re-exported sub-libraries; roughly that of libSystem. */
+static constexpr size_t EXPORT_BENCH_LIBRARIES = 32;
+
+/** Number of symbols exported by each sub-library. */
+static constexpr size_t EXPORT_BENCH_SYMBOLS = 256;
+
+/** The umbrella library's install name. */
+static const char *EXPORT_BENCH_UMBRELLA = "/usr/lib/libumbrella.dylib";
+
+/**
+ * A loaded and registered umbrella library and its sub-libraries.
+ */
+struct export_bench_libraries {
+    /** The registry of all libraries. */
+    image_registry registry;
+    
+    /** All mapped libraries; the umbrella is first. */
+    std::vector<std::unique_ptr<test::loaded_image>> images;
+    
+    /** All exported symbol names, interleaved across sub-libraries. */
+    std::vector<std::string> symbols;
+};
+
+/** Return the (lazily loaded) umbrella and sub-libraries. */
+static export_bench_libraries &export_bench_load () {
+    static export_bench_libraries *libraries = [] {
+        auto result = new export_bench_libraries();
+        
+        test::macho_builder umbrella(CPU_TYPE_X86_64, MH_DYLIB);
+        umbrella.set_install_name(EXPORT_BENCH_UMBRELLA);
+        
+        std::vector<std::pair<std::string, std::vector<uint8_t>>> images;
+        for (size_t i = 0; i < EXPORT_BENCH_LIBRARIES; i++) {
+            std::string name = test::macho_synthetic_library(i);
+            umbrella.add_library(name, LC_REEXPORT_DYLIB);
+            
+            test::macho_builder library(CPU_TYPE_X86_64, MH_DYLIB);
+            library.set_install_name(name);
+            for (size_t s = 0; s < EXPORT_BENCH_SYMBOLS; s++)
+                library.add_export(test::macho_synthetic_symbol(i * EXPORT_BENCH_SYMBOLS + s), 0x1000 + s * 16);
+            
+            images.push_back(std::make_pair(name, library.build()));
+        }
+        images.insert(images.begin(), std::make_pair(std::string(EXPORT_BENCH_UMBRELLA), umbrella.build()));
+        
+        for (auto &&image : images) {
+            std::string error;
+            std::unique_ptr<test::loaded_image> loaded(new test::loaded_image());
+            if (!loaded->load(image.second, image.first, false, error)) {
+                fprintf(stderr, "xpf-bench: could not load %s: %s\n", image.first.c_str(), error.c_str());
+                abort();
+            }
+            
+            result->registry.insert((const struct mach_header *) loaded->header(), loaded->path().c_str());
+            result->images.push_back(std::move(loaded));
+        }
+        
+        for (size_t s = 0; s < EXPORT_BENCH_SYMBOLS; s++) {
+            for (size_t i = 0; i < EXPORT_BENCH_LIBRARIES; i++)
+                result->symbols.push_back(test::macho_synthetic_symbol(i * EXPORT_BENCH_SYMBOLS + s));
+        }
+        
+        return result;
+    }();
+    
+    return *libraries;
+}
+
+/* Resolve symbols through the umbrella library, with all indices already built */
+XPF_BENCHMARK(bench_export_lookup, "export/lookup") {
+    export_bench_libraries &libraries = export_bench_load();
+    export_resolver resolver(&libraries.registry);
+    
+    uintptr_t address;
+    for (auto &&symbol : libraries.symbols)
+        resolver.resolve(EXPORT_BENCH_UMBRELLA, symbol.c_str(), &address);
+    
+    bench.measure(libraries.symbols.size(), [&] {
+        uintptr_t sum = 0;
+        for (auto &&symbol : libraries.symbols) {
+            resolver.resolve(EXPORT_BENCH_UMBRELLA, symbol.c_str(), &address);
+            sum += address;
+        }
+        do_not_optimize(sum);
+    });
+    bench.counter("libraries", (double) resolver.index_count());
+    bench.counter("bytes_per_library", (double) resolver.heap_size() / resolver.index_count());
+}
+
+/* Resolve one symbol from each sub-library with a new resolver, locating each library and building its index */
+XPF_BENCHMARK(bench_export_index, "export/index") {
+    export_bench_libraries &libraries = export_bench_load();
+    size_t bytes = 0;
+    
+    bench.measure(EXPORT_BENCH_LIBRARIES, [&] {
+        export_resolver resolver(&libraries.registry);
+        uintptr_t address;
+        for (size_t i = 0; i < EXPORT_BENCH_LIBRARIES; i++)
+            resolver.resolve(EXPORT_BENCH_UMBRELLA, libraries.symbols[i].c_str(), &address);
+        
+        bytes = resolver.heap_size();
+        do_not_optimize(address);
+    });
+    bench.counter("bytes_per_library", (double) bytes / (EXPORT_BENCH_LIBRARIES + 1));
+}
@@ -0,0 +1,109 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * LEB128 decoding throughput over a LINKEDIT-sized buffer, via the SWAR and bytewise paths of
+ * read_leb128_bounded().
+ */
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+#include "bench.h"
+
+using namespace patchmaster;
+using namespace xpf::bench;
+
+/**
+ * Return 256 KiB of ULEB128 values, with lengths distributed roughly as found in bind opcode streams: mostly
+ * 1-2 byte ordinals and address advances, with occasional 3-4 byte segment offsets.
+ */
+static const std::vector<uint8_t> &leb128_buffer (size_t *count) {
+    static size_t values = 0;
+    static const std::vector<uint8_t> buffer = [] {
+        std::vector<uint8_t> out;
+        uint32_t state = 1;
+        
+        while (out.size() < 256 * 1024) {
+            state = state * 1103515245 + 12345;
+            unsigned r = (state >> 8) % 100;
+            unsigned bits = (r < 55) ? 7 : (r < 85) ? 14 : (r < 95) ? 21 : 28;
+            uint64_t value = (state >> 4) & ((1ULL << bits) - 1);
+            
+            do {
+                uint8_t byte = value & 0x7f;
+                value >>= 7;
+                out.push_back(byte | (value != 0 ? 0x80 : 0));
+            } while (value != 0);
+            values++;
+        }
+        
+        /* Keep the final values on the SWAR path */
+        out.resize(out.size() + 8, 0);
+        return out;
+    }();
+    
+    *count = values;
+    return buffer;
+}
+
+/* Decode with at least 8 readable bytes following each value */
+XPF_BENCHMARK(bench_leb128_swar, "leb128/swar") {
+    size_t count;
+    const std::vector<uint8_t> &buffer = leb128_buffer(&count);
+    const uint8_t *end = buffer.data() + buffer.size();
+    
+    bench.measure(count, [&] {
+        uint64_t sum = 0;
+        const uint8_t *p = buffer.data();
+        for (size_t i = 0; i < count; i++) {
+            size_t size;
+            sum += read_leb128_bounded(p, end, &size, false);
+            p += size;
+        }
+        do_not_optimize(sum);
+    });
+    bench.counter("bytes", (double) buffer.size());
+}
+
+/* Decode with a limit of 7 bytes past each value, forcing the bytewise path; no value exceeds 4 bytes */
+XPF_BENCHMARK(bench_leb128_scalar, "leb128/scalar") {
+    size_t count;
+    const std::vector<uint8_t> &buffer = leb128_buffer(&count);
+    
+    bench.measure(count, [&] {
+        uint64_t sum = 0;
+        const uint8_t *p = buffer.data();
+        for (size_t i = 0; i < count; i++) {
+            size_t size;
+            sum += read_leb128_bounded(p, p + 7, &size, false);
+            p += size;
+        }
+        do_not_optimize(sum);
+    });
+    bench.counter("bytes", (double) buffer.size());
+}
@@ -0,0 +1,78 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Scaling of xpf_image_state_change()'s batched analysis across parallel_for() worker counts.
+ */
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+#include "bench.h"
+#include "bench_image.h"
+#include "bind_rewrite.h"
+#include "parallel.h"
+
+using namespace patchmaster;
+using namespace xpf;
+using namespace xpf::bench;
+
+/** Number of images in the synthetic launch batch. */
+static constexpr size_t PARALLEL_BATCH_SIZE = 64;
+
+/**
+ * Analyze and plan a batch of distinct synthetic images using @a workers threads, as performed for the
+ * initial image batch at launch.
+ */
+static void parallel_analyze (bench_case &bench, size_t workers) {
+    std::vector<std::unique_ptr<bench_image>> images;
+    test::macho_synthetic_config config;
+    for (size_t i = 0; i < PARALLEL_BATCH_SIZE; i++) {
+        config.seed = (uint32_t) i + 1;
+        images.push_back(bench_load_image(config));
+    }
+    
+    auto rules = bench_make_rules(config, 16, 8);
+    bind_plan_rules plan_rules = { rules->index.get(), rules->weak.data(), rules->weak.size(), false, nullptr, nullptr, nullptr, nullptr };
+    LocalImage::MainExecutablePath();
+    
+    bench.measure(PARALLEL_BATCH_SIZE, [&] {
+        std::vector<bind_plan> plans(PARALLEL_BATCH_SIZE);
+        parallel_for(PARALLEL_BATCH_SIZE, workers, [&](size_t i) {
+            LocalImage image = LocalImage::Analyze(images[i]->image.path(), images[i]->image.header());
+            bind_plan_image(image, plan_rules, plans[i]);
+        });
+        do_not_optimize(plans.back().weak_rewrites.size());
+    });
+    bench.counter("workers", (double) workers);
+    bench.counter("host_workers", (double) parallel_worker_count());
+}
+
+XPF_BENCHMARK(bench_parallel_analyze_1, "parallel/analyze/1") { parallel_analyze(bench, 1); }
+XPF_BENCHMARK(bench_parallel_analyze_2, "parallel/analyze/2") { parallel_analyze(bench, 2); }
+XPF_BENCHMARK(bench_parallel_analyze_4, "parallel/analyze/4") { parallel_analyze(bench, 4); }
+XPF_BENCHMARK(bench_parallel_analyze_8, "parallel/analyze/8") { parallel_analyze(bench, 8); }
@@ -0,0 +1,118 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Benchmarks of rebind rule matching: the rebind_index hash lookup, compared against the linear scan of the
+ * rebind table that it replaced.
+ */
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+#include "bench.h"
+#include "bench_image.h"
+
+using namespace patchmaster;
+using namespace xpf;
+using namespace xpf::bench;
+
+/**
+ * The two-level names of every bind site in a synthetic image, along with rules matching @a rule_count of
+ * its symbols.
+ */
+struct rules_fixture {
+    std::vector<std::pair<std::string, std::string>> names;
+    std::unique_ptr<bench_rules> rules;
+};
+
+static rules_fixture rules_make_fixture (size_t rule_count) {
+    test::macho_synthetic_config config;
+    config.libraries = 24;
+    config.symbols = 1024;
+    config.sites = 4096;
+    
+    rules_fixture fixture;
+    fixture.rules = bench_make_rules(config, std::max<size_t>(config.symbols / rule_count, 1), 0);
+    
+    auto img = bench_load_image(config);
+    LocalImage image = LocalImage::Analyze(img->image.path(), img->image.header());
+    image.rebind_symbols([&](const bind_opstream::symbol_proc &sp) {
+        fixture.names.push_back(std::make_pair(sp.name().image(), sp.name().symbol()));
+    });
+    
+    return fixture;
+}
+
+/* Match every bind site against the rebind table, as image_rebind_required_symbols() originally did */
+static void rules_linear_scan (bench_case &bench, size_t rule_count) {
+    rules_fixture fixture = rules_make_fixture(rule_count);
+    const std::vector<xpf_rebind_entry> &table = fixture.rules->rebinds;
+    
+    bench.measure(fixture.names.size(), [&] {
+        size_t matches = 0;
+        for (auto &&name : fixture.names) {
+            SymbolName sym(name.first.c_str(), name.second.c_str());
+            for (auto &&entry : table) {
+                if (sym.match(SymbolName(entry.image, entry.symbol)))
+                    matches++;
+            }
+        }
+        do_not_optimize(matches);
+    });
+    bench.counter("rules", (double) table.size());
+}
+
+/* Match every bind site via the rebind index */
+static void rules_index_lookup (bench_case &bench, size_t rule_count) {
+    rules_fixture fixture = rules_make_fixture(rule_count);
+    const rebind_index &index = *fixture.rules->index;
+    
+    bench.measure(fixture.names.size(), [&] {
+        size_t matches = 0;
+        for (auto &&name : fixture.names)
+            index.lookup(SymbolName(name.first.c_str(), name.second.c_str()), [&](const xpf_rebind_entry &) { matches++; });
+        do_not_optimize(matches);
+    });
+    bench.counter("rules", (double) index.size());
+}
+
+/* The compiled table's size, and that of a table extended with a large rule manifest */
+XPF_BENCHMARK(bench_rules_linear_scan_20, "rules/linear_scan/20") {
+    rules_linear_scan(bench, 20);
+}
+
+XPF_BENCHMARK(bench_rules_rebind_index_20, "rules/rebind_index/20") {
+    rules_index_lookup(bench, 20);
+}
+
+XPF_BENCHMARK(bench_rules_linear_scan_256, "rules/linear_scan/256") {
+    rules_linear_scan(bench, 256);
+}
+
+XPF_BENCHMARK(bench_rules_rebind_index_256, "rules/rebind_index/256") {
+    rules_index_lookup(bench, 256);
+}
@@ -0,0 +1,125 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "bench.h"
+
+using namespace xpf::bench;
+
+/* Results survive a JSON round trip */
+TEST(Bench, JSONRoundTrip) {
+    std::vector<bench_result> results = {
+        { "bind/evaluate", 1000, 12.5, 80000000, { { "binds", 4096 } } },
+        { "name \"with\" escapes\\", 1, 0.25, 4e9, {} }
+    };
+    
+    std::vector<bench_result> parsed;
+    std::string error;
+    ASSERT_TRUE(bench_read_json(bench_write_json(results), parsed, error)) << error;
+    ASSERT_EQ(results.size(), parsed.size());
+    
+    for (size_t i = 0; i < results.size(); i++) {
+        EXPECT_EQ(results[i].name, parsed[i].name);
+        EXPECT_EQ(results[i].iterations, parsed[i].iterations);
+        EXPECT_DOUBLE_EQ(results[i].ns_per_item, parsed[i].ns_per_item);
+        EXPECT_DOUBLE_EQ(results[i].items_per_second, parsed[i].items_per_second);
+        EXPECT_EQ(results[i].counters, parsed[i].counters);
+    }
+}
+
+/* Unknown keys are ignored, and malformed documents are rejected */
+TEST(Bench, JSONParse) {
+    std::vector<bench_result> parsed;
+    std::string error;
+    
+    ASSERT_TRUE(bench_read_json("{\"context\": {\"host\": [1, true, null]}, \"benchmarks\": [{\"name\": \"a\", \"ns_per_item\": 2, \"extra\": \"x\"}]}", parsed, error)) << error;
+    ASSERT_EQ(1U, parsed.size());
+    EXPECT_EQ("a", parsed[0].name);
+    EXPECT_EQ(2.0, parsed[0].ns_per_item);
+    
+    parsed.clear();
+    EXPECT_FALSE(bench_read_json("", parsed, error));
+    EXPECT_FALSE(bench_read_json("{\"benchmarks\": [", parsed, error));
+    EXPECT_FALSE(bench_read_json("{\"other\": []}", parsed, error));
+}
+
+/* Slowdowns beyond the threshold are regressions; speedups and missing benchmarks are not */
+TEST(Bench, Compare) {
+    std::vector<bench_result> baseline = {
+        { "same", 1, 100, 0, {} },
+        { "slower", 1, 100, 0, {} },
+        { "much-slower", 1, 100, 0, {} },
+        { "faster", 1, 100, 0, {} },
+        { "removed", 1, 100, 0, {} }
+    };
+    std::vector<bench_result> current = {
+        { "same", 1, 100, 0, {} },
+        { "slower", 1, 105, 0, {} },
+        { "much-slower", 1, 150, 0, {} },
+        { "faster", 1, 50, 0, {} },
+        { "added", 1, 100, 0, {} }
+    };
+    
+    std::vector<bench_comparison> comparisons = bench_compare(baseline, current, 10.0);
+    ASSERT_EQ(4U, comparisons.size());
+    
+    EXPECT_EQ("same", comparisons[0].name);
+    EXPECT_DOUBLE_EQ(0.0, comparisons[0].change);
+    EXPECT_FALSE(comparisons[0].regression);
+    
+    EXPECT_EQ("slower", comparisons[1].name);
+    EXPECT_DOUBLE_EQ(5.0, comparisons[1].change);
+    EXPECT_FALSE(comparisons[1].regression);
+    
+    EXPECT_EQ("much-slower", comparisons[2].name);
+    EXPECT_DOUBLE_EQ(50.0, comparisons[2].change);
+    EXPECT_TRUE(comparisons[2].regression);
+    
+    EXPECT_EQ("faster", comparisons[3].name);
+    EXPECT_DOUBLE_EQ(-50.0, comparisons[3].change);
+    EXPECT_FALSE(comparisons[3].regression);
+}
+
+/* measure() records a positive per-item time */
+TEST(Bench, Measure) {
+    bench_config config;
+    config.min_time = std::chrono::microseconds(100);
+    config.repetitions = 3;
+    
+    bench_case bench("test", config);
+    EXPECT_FALSE(bench.measured());
+    
+    uint64_t calls = 0;
+    bench.measure(10, [&] { calls++; do_not_optimize(calls); });
+    
+    EXPECT_TRUE(bench.measured());
+    EXPECT_GT(calls, 0U);
+    EXPECT_GT(bench.result().iterations, 0U);
+    EXPECT_GT(bench.result().ns_per_item, 0.0);
+}
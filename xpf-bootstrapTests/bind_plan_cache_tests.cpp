@@ -0,0 +1,137 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bind_plan_cache.h"
+#include "macho_builder.h"
+#include "macho_util.h"
+
+using namespace xpf;
+using namespace xpf::test;
+
+namespace {
+
+static const bind_plan_key KEY = { { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10 }, 0xCAFE };
+
+/** Return a plan with @a n weak rewrites and rebind sites. */
+static bind_plan make_plan (size_t n) {
+    bind_plan plan;
+    for (size_t i = 0; i < n; i++) {
+        plan.weak_rewrites.push_back({ 0x1000 + i, (uint8_t) (0x41 + i), {} });
+        plan.rebind_sites.push_back({ 0x2000 + i * 8, (uint32_t) i, 0 });
+    }
+    return plan;
+}
+
+/** A bind plan cache within a temporary directory. */
+class BindPlanCacheTest : public ::testing::Test {
+protected:
+    void SetUp () override {
+        char tmpl[] = "/tmp/xpf-plan-cache.XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        _directory = tmpl;
+    }
+    
+    void TearDown () override {
+        std::string cmd = "rm -rf '" + _directory + "'";
+        ASSERT_EQ(system(cmd.c_str()), 0);
+    }
+    
+    std::string _directory;
+};
+
+TEST_F(BindPlanCacheTest, RoundTrip) {
+    bind_plan_cache cache(_directory + "/plans", 0x1234);
+    mapped_bind_plan loaded;
+    
+    EXPECT_FALSE(cache.load(KEY, loaded));
+    ASSERT_TRUE(cache.store(KEY, make_plan(3)));
+    ASSERT_TRUE(cache.load(KEY, loaded));
+    
+    ASSERT_EQ(loaded.weak_rewrite_count(), 3U);
+    ASSERT_EQ(loaded.rebind_site_count(), 3U);
+    EXPECT_EQ(loaded.weak_rewrites()[2].offset, 0x1002U);
+    EXPECT_EQ(loaded.weak_rewrites()[2].opcode, 0x43);
+    EXPECT_EQ(loaded.rebind_sites()[1].offset, 0x2008U);
+    EXPECT_EQ(loaded.rebind_sites()[1].rule, 1U);
+    
+    /* Plans computed against other rule tables are ignored */
+    bind_plan_cache other(_directory + "/plans", 0x5678);
+    EXPECT_FALSE(other.load(KEY, loaded));
+}
+
+/** Return the cache key of the image built as @a data. */
+static bind_plan_key image_key (const std::vector<uint8_t> &data) {
+    auto header = (const patchmaster::pl_mach_header_t *) data.data();
+    bind_plan_key key;
+    EXPECT_TRUE(macho_get_uuid(header, key.uuid));
+    key.layout_hash = macho_layout_hash(header);
+    return key;
+}
+
+/* Plans recorded against one copy of an image are rejected for a copy with the same LC_UUID, but a relocated
+ * segment layout (eg, the dyld shared cache's copy of an on-disk library) */
+TEST_F(BindPlanCacheTest, RelocatedLayout) {
+    macho_builder original(CPU_TYPE_X86_64, MH_DYLIB);
+    original.set_uuid(KEY.uuid);
+    original.add_import(original.add_library("/usr/lib/libSystem.B.dylib"), "_dispatch_block_create");
+    
+    macho_builder relocated(CPU_TYPE_X86_64, MH_DYLIB);
+    relocated.set_uuid(KEY.uuid);
+    relocated.set_page_size(0x4000);
+    relocated.add_import(relocated.add_library("/usr/lib/libSystem.B.dylib"), "_dispatch_block_create");
+    
+    bind_plan_key original_key = image_key(original.build());
+    bind_plan_key relocated_key = image_key(relocated.build());
+    ASSERT_EQ(memcmp(original_key.uuid, relocated_key.uuid, sizeof(original_key.uuid)), 0);
+    ASSERT_NE(original_key.layout_hash, relocated_key.layout_hash);
+    
+    bind_plan_cache cache(_directory + "/plans", 0x1234);
+    mapped_bind_plan loaded;
+    ASSERT_TRUE(cache.store(original_key, make_plan(1)));
+    EXPECT_FALSE(cache.load(relocated_key, loaded));
+    EXPECT_TRUE(cache.load(original_key, loaded));
+}
+
+TEST(MappedBindPlan, Adopt) {
+    mapped_bind_plan plan;
+    EXPECT_EQ(plan.weak_rewrite_count(), 0U);
+    
+    plan.adopt(make_plan(2));
+    ASSERT_EQ(plan.weak_rewrite_count(), 2U);
+    ASSERT_EQ(plan.rebind_site_count(), 2U);
+    EXPECT_EQ(plan.weak_rewrites()[1].offset, 0x1001U);
+    EXPECT_EQ(plan.rebind_sites()[1].offset, 0x2008U);
+}
+
+} /* anonymous namespace */
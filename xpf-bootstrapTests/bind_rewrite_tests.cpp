@@ -0,0 +1,269 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "bind_rewrite.h"
+#include "image_registry.h"
+#include "loaded_image.h"
+#include "macho_builder.h"
+#include "weak_table.h"
+
+using namespace patchmaster;
+using namespace xpf;
+using namespace xpf::test;
+
+namespace {
+
+static const char *FOUNDATION = "/System/Library/Frameworks/Foundation.framework/Versions/C/Foundation";
+static const char *SYSTEM = "/usr/lib/libSystem.B.dylib";
+
+/**
+ * A mapped test image importing _NSLog and _missing from Foundation, and _malloc from libSystem, with _missing
+ * bound both lazily and non-lazily.
+ */
+class BindRewriteTest : public ::testing::Test {
+protected:
+    void SetUp () override {
+        macho_builder builder(CPU_TYPE_X86_64, MH_DYLIB);
+        uint32_t foundation = builder.add_library(FOUNDATION);
+        uint32_t system = builder.add_library(SYSTEM);
+        
+        _nslog_offset = builder.add_import(foundation, "_NSLog");
+        builder.add_import(foundation, "_missing");
+        builder.add_import(foundation, "_missing");
+        builder.add_import(system, "_malloc");
+        builder.add_import(foundation, "_missing", 0, true);
+        
+        std::string error;
+        ASSERT_TRUE(_loaded.load(builder.build(), "/usr/lib/libtest.dylib", false, error)) << error;
+        _image.reset(new LocalImage(LocalImage::Analyze(_loaded.path(), _loaded.header())));
+        
+        _weak.push_back({ FOUNDATION, "_missing" });
+        _rebinds.push_back({ "_NSLog", rebind_index::hash("_NSLog"), FOUNDATION, nullptr, 0 });
+        _index.reset(new rebind_index(_rebinds.data(), _rebinds.size()));
+        
+        _rules = { _index.get(), _weak.data(), _weak.size(), false, nullptr, nullptr, nullptr, nullptr };
+        
+        _stats.images = 0;
+        _stats.written = 0;
+        _stats.unchanged = 0;
+        _stats.pages = 0;
+    }
+    
+    /** Return the flags of every bind of @a symbol, in evaluation order. */
+    std::vector<uint8_t> flags_of (const char *symbol) {
+        std::vector<uint8_t> flags;
+        _image->rebind_symbols([&](const bind_opstream::symbol_proc &sp) {
+            if (strcmp(sp.name().symbol(), symbol) == 0)
+                flags.push_back(sp.flags());
+        });
+        return flags;
+    }
+    
+    loaded_image _loaded;
+    std::unique_ptr<LocalImage> _image;
+    std::vector<xpf_weak_entry> _weak;
+    std::vector<xpf_rebind_entry> _rebinds;
+    std::unique_ptr<rebind_index> _index;
+    bind_plan_rules _rules;
+    bind_rewrite_stats _stats;
+    uint64_t _nslog_offset;
+};
+
+} /* anonymous namespace */
+
+/* Every strong import produces one rewrite per symbol declaration, and rebind rules record every bind site */
+TEST_F(BindRewriteTest, Plan) {
+    bind_plan plan;
+    bind_plan_image(*_image, _rules, plan);
+    
+    /* Three non-lazy declarations, one covering both binds of _missing, and one lazy declaration */
+    ASSERT_EQ(4U, plan.weak_rewrites.size());
+    for (auto &&rewrite : plan.weak_rewrites)
+        EXPECT_EQ(BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM | BIND_SYMBOL_FLAGS_WEAK_IMPORT, rewrite.opcode);
+    
+    ASSERT_EQ(1U, plan.rebind_sites.size());
+    EXPECT_EQ(0U, plan.rebind_sites[0].rule);
+    
+    /* Site offsets are relative to the mach header */
+    const pl_segment_command_t *data = nullptr;
+    for (auto &&segment : *_image->segments()) {
+        if (strcmp(segment->segname, SEG_DATA) == 0)
+            data = segment;
+    }
+    ASSERT_NE(nullptr, data);
+    EXPECT_EQ(data->vmaddr + _nslog_offset, plan.rebind_sites[0].offset);
+}
+
+/* Images rejected by the rebind prefilter are still weakened, but record no rebind sites */
+TEST_F(BindRewriteTest, Prefilter) {
+    bind_prefilter_stats stats;
+    stats.scanned = 0;
+    stats.skipped = 0;
+    stats.lookups_skipped = 0;
+    stats.scan_time = 0;
+    _rules.prefilter_stats = &stats;
+    
+    /* A prefilter over the rebind table's own symbols accepts the image */
+    symbol_prefilter matching({ "_NSLog" });
+    _rules.rebind_prefilter = &matching;
+    
+    bind_plan plan;
+    bind_plan_image(*_image, _rules, plan);
+    EXPECT_EQ(4U, plan.weak_rewrites.size());
+    EXPECT_EQ(1U, plan.rebind_sites.size());
+    EXPECT_EQ(1U, stats.scanned);
+    EXPECT_EQ(0U, stats.skipped);
+    EXPECT_EQ(0U, stats.lookups_skipped);
+    
+    /* A rebind table that the image can't reference is never consulted */
+    std::vector<xpf_rebind_entry> rebinds;
+    rebinds.push_back({ "_NSLogv", rebind_index::hash("_NSLogv"), FOUNDATION, nullptr, 0 });
+    rebind_index index(rebinds.data(), rebinds.size());
+    symbol_prefilter rejecting({ "_NSLogv" });
+    _rules.rebinds = &index;
+    _rules.rebind_prefilter = &rejecting;
+    
+    bind_plan rejected;
+    bind_plan_image(*_image, _rules, rejected);
+    EXPECT_EQ(plan.weak_rewrites.size(), rejected.weak_rewrites.size());
+    EXPECT_TRUE(rejected.rebind_sites.empty());
+    EXPECT_EQ(2U, stats.scanned);
+    EXPECT_EQ(1U, stats.skipped);
+    EXPECT_EQ(5U, stats.lookups_skipped);
+}
+
+/* XPF_PRESERVE_LINKEDIT leaves lazy binds untouched */
+TEST_F(BindRewriteTest, PreserveLinkedit) {
+    _rules.preserve_linkedit = true;
+    
+    bind_plan plan;
+    bind_plan_image(*_image, _rules, plan);
+    EXPECT_EQ(3U, plan.weak_rewrites.size());
+}
+
+/* Applying a plan marks the imports as weak; reapplying it writes nothing */
+TEST_F(BindRewriteTest, Apply) {
+    bind_plan plan;
+    bind_plan_image(*_image, _rules, plan);
+    
+    EXPECT_EQ(std::vector<uint8_t>({ 0, 0, 0 }), flags_of("_missing"));
+    ASSERT_TRUE(bind_rewrite_apply(_loaded.path().c_str(), _loaded.header(), plan.weak_rewrites.data(), plan.weak_rewrites.size(), _stats));
+    EXPECT_EQ(std::vector<uint8_t>(3, BIND_SYMBOL_FLAGS_WEAK_IMPORT), flags_of("_missing"));
+    EXPECT_EQ(std::vector<uint8_t>({ BIND_SYMBOL_FLAGS_WEAK_IMPORT }), flags_of("_NSLog"));
+    
+    EXPECT_EQ(1U, _stats.images);
+    EXPECT_EQ(4U, _stats.written);
+    EXPECT_EQ(0U, _stats.unchanged);
+    EXPECT_EQ(1U, _stats.pages);
+    
+    ASSERT_TRUE(bind_rewrite_apply(_loaded.path().c_str(), _loaded.header(), plan.weak_rewrites.data(), plan.weak_rewrites.size(), _stats));
+    EXPECT_EQ(1U, _stats.images);
+    EXPECT_EQ(4U, _stats.written);
+    EXPECT_EQ(4U, _stats.unchanged);
+}
+
+/* Rewrites that do not target a SET_SYMBOL opcode within __LINKEDIT are rejected without any writes */
+TEST_F(BindRewriteTest, RejectInvalid) {
+    bind_plan plan;
+    bind_plan_image(*_image, _rules, plan);
+    ASSERT_FALSE(plan.weak_rewrites.empty());
+    
+    /* Outside __LINKEDIT */
+    std::vector<bind_plan_weak_rewrite> rewrites = plan.weak_rewrites;
+    rewrites.push_back({ 0, BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM, {} });
+    EXPECT_FALSE(bind_rewrite_apply(_loaded.path().c_str(), _loaded.header(), rewrites.data(), rewrites.size(), _stats));
+    
+    /* Not a SET_SYMBOL opcode */
+    rewrites = plan.weak_rewrites;
+    rewrites.push_back({ rewrites.back().offset + 1, BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM, {} });
+    EXPECT_FALSE(bind_rewrite_apply(_loaded.path().c_str(), _loaded.header(), rewrites.data(), rewrites.size(), _stats));
+    
+    /* Replacement is not a SET_SYMBOL opcode */
+    rewrites = plan.weak_rewrites;
+    rewrites[0].opcode = BIND_OPCODE_DO_BIND;
+    EXPECT_FALSE(bind_rewrite_apply(_loaded.path().c_str(), _loaded.header(), rewrites.data(), rewrites.size(), _stats));
+    
+    EXPECT_EQ(0U, _stats.written);
+    EXPECT_EQ(std::vector<uint8_t>({ 0, 0, 0 }), flags_of("_missing"));
+}
+
+/* All imports weakened by XPF_AUTO_WEAK because they are missing from their target library */
+static std::vector<std::string> auto_weak_reported;
+
+static void auto_weak_record (const std::string &import) {
+    auto_weak_reported.push_back(import);
+}
+
+/* XPF_AUTO_WEAK only weakens listed imports, rebind table imports, and imports missing from their target library */
+TEST_F(BindRewriteTest, AutoWeak) {
+    macho_builder foundation(CPU_TYPE_X86_64, MH_DYLIB);
+    foundation.set_install_name(FOUNDATION);
+    foundation.add_export("_NSLog", 0x1000);
+    
+    macho_builder system(CPU_TYPE_X86_64, MH_DYLIB);
+    system.set_install_name(SYSTEM);
+    system.add_export("_malloc", 0x1000);
+    
+    std::string error;
+    loaded_image foundation_image;
+    loaded_image system_image;
+    ASSERT_TRUE(foundation_image.load(foundation.build(), FOUNDATION, false, error)) << error;
+    ASSERT_TRUE(system_image.load(system.build(), SYSTEM, false, error)) << error;
+    
+    image_registry registry;
+    registry.insert((const struct mach_header *) foundation_image.header(), foundation_image.path().c_str());
+    registry.insert((const struct mach_header *) system_image.header(), system_image.path().c_str());
+    
+    export_resolver resolver(&registry);
+    _rules.auto_weak_resolver = &resolver;
+    _rules.auto_weak_report = auto_weak_record;
+    auto_weak_reported.clear();
+    
+    /* _NSLog via the rebind table, and both declarations of the listed _missing */
+    bind_plan plan;
+    bind_plan_image(*_image, _rules, plan);
+    EXPECT_EQ(3U, plan.weak_rewrites.size());
+    EXPECT_TRUE(auto_weak_reported.empty());
+    
+    /* Without a weak rule, _missing is found to be missing from Foundation, and reported */
+    bind_plan_rules unlisted_rules = _rules;
+    unlisted_rules.weak_rule_count = 0;
+    unlisted_rules.rebinds = nullptr;
+    
+    bind_plan unlisted;
+    bind_plan_image(*_image, unlisted_rules, unlisted);
+    EXPECT_EQ(2U, unlisted.weak_rewrites.size());
+    ASSERT_EQ(2U, auto_weak_reported.size());
+    EXPECT_EQ("/usr/lib/libtest.dylib: _missing (" + std::string(FOUNDATION) + ")", auto_weak_reported[0]);
+    
+    ASSERT_TRUE(bind_rewrite_apply(_loaded.path().c_str(), _loaded.header(), plan.weak_rewrites.data(), plan.weak_rewrites.size(), _stats));
+    EXPECT_EQ(std::vector<uint8_t>({ 0 }), flags_of("_malloc"));
+    EXPECT_EQ(std::vector<uint8_t>({ BIND_SYMBOL_FLAGS_WEAK_IMPORT }), flags_of("_NSLog"));
+}
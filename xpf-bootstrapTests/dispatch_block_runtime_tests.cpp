@@ -0,0 +1,338 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "dispatch_block_runtime.h"
+#include "posix_semaphore.h"
+
+using namespace xpf;
+using namespace xpf::test;
+
+namespace {
+
+/** Number of live test_block instances. */
+static std::atomic<int> live_blocks(0);
+
+/**
+ * A reference-counted heap block, standing in for a blocks runtime heap block.
+ */
+struct test_block {
+    explicit test_block (const std::function<void()> &fn) : refs(1), fn(fn) { live_blocks++; }
+    ~test_block () { live_blocks--; }
+    
+    /** Reference count; the block is freed (destroying fn) along with the last reference. */
+    std::atomic<int> refs;
+    
+    /** The block's body. */
+    std::function<void()> fn;
+};
+
+/**
+ * A serial queue backed by a single pthread, recording the number of submissions via each entry point.
+ */
+class test_queue {
+public:
+    test_queue () : refs(1), async_count(0), barrier_async_count(0), sync_count(0), barrier_sync_count(0), _running(false), _stop(false) {
+        pthread_mutex_init(&_lock, nullptr);
+        pthread_cond_init(&_cond, nullptr);
+        pthread_create(&_thread, nullptr, run, this);
+    }
+    
+    ~test_queue () {
+        pthread_mutex_lock(&_lock);
+        _stop = true;
+        pthread_cond_signal(&_cond);
+        pthread_mutex_unlock(&_lock);
+        
+        pthread_join(_thread, nullptr);
+        pthread_cond_destroy(&_cond);
+        pthread_mutex_destroy(&_lock);
+    }
+    
+    /** Enqueue @a block (retained) for execution on the queue's thread. */
+    void submit (test_block *block) {
+        block->refs++;
+        pthread_mutex_lock(&_lock);
+        _pending.push_back(block);
+        pthread_cond_signal(&_cond);
+        pthread_mutex_unlock(&_lock);
+    }
+    
+    /** Block until all previously submitted blocks have executed. */
+    void drain () {
+        pthread_mutex_lock(&_lock);
+        while (!_pending.empty() || _running)
+            pthread_cond_wait(&_cond, &_lock);
+        pthread_mutex_unlock(&_lock);
+    }
+    
+    /** Reference count, maintained by the executor's retain_queue() and release_queue(). */
+    std::atomic<int> refs;
+    
+    /** Submission counts, by entry point. */
+    std::atomic<int> async_count;
+    std::atomic<int> barrier_async_count;
+    std::atomic<int> sync_count;
+    std::atomic<int> barrier_sync_count;
+
+private:
+    static void *run (void *arg);
+    
+    pthread_t _thread;
+    pthread_mutex_t _lock;
+    pthread_cond_t _cond;
+    std::deque<test_block *> _pending;
+    bool _running;
+    bool _stop;
+};
+
+/**
+ * dispatch_block_runtime executor backed by test_block and test_queue.
+ */
+struct pthread_executor {
+    typedef test_block *block;
+    typedef test_queue *queue;
+    typedef unsigned long flags;
+    typedef posix_semaphore semaphore;
+    
+    static constexpr flags BARRIER = 0x4;
+    
+    template <typename Fn> static block wrap (const Fn &fn) { return new test_block(fn); }
+    
+    static block copy_block (block b) {
+        b->refs++;
+        return b;
+    }
+    
+    static void release_block (block b) {
+        if (--b->refs == 0)
+            delete b;
+    }
+    
+    static void invoke (block b) { b->fn(); }
+    
+    static void retain_queue (queue q) { q->refs++; }
+    static void release_queue (queue q) { q->refs--; }
+    
+    static void async (queue q, block b) {
+        q->async_count++;
+        q->submit(b);
+    }
+    
+    static void barrier_async (queue q, block b) {
+        q->barrier_async_count++;
+        q->submit(b);
+    }
+    
+    static void sync (queue q, block b) {
+        q->sync_count++;
+        invoke(b);
+    }
+    
+    static void barrier_sync (queue q, block b) {
+        q->barrier_sync_count++;
+        invoke(b);
+    }
+};
+
+constexpr pthread_executor::flags pthread_executor::BARRIER;
+
+/** Execute blocks until the queue is stopped, releasing each block after execution. */
+void *test_queue::run (void *arg) {
+    test_queue *self = (test_queue *) arg;
+    
+    pthread_mutex_lock(&self->_lock);
+    while (true) {
+        while (self->_pending.empty() && !self->_stop)
+            pthread_cond_wait(&self->_cond, &self->_lock);
+        
+        if (self->_pending.empty())
+            break;
+        
+        test_block *block = self->_pending.front();
+        self->_pending.pop_front();
+        self->_running = true;
+        pthread_mutex_unlock(&self->_lock);
+        
+        pthread_executor::invoke(block);
+        pthread_executor::release_block(block);
+        
+        pthread_mutex_lock(&self->_lock);
+        self->_running = false;
+        pthread_cond_broadcast(&self->_cond);
+    }
+    pthread_mutex_unlock(&self->_lock);
+    
+    return nullptr;
+}
+
+typedef dispatch_block_runtime<pthread_executor, 64> test_runtime;
+
+/** Return a new block incrementing @a counter. */
+static test_block *counting_block (std::atomic<int> &counter) {
+    return new test_block([&counter]() { counter++; });
+}
+
+/** Create a runtime block wrapping @a block, releasing the caller's reference to @a block. */
+static test_block *create (test_runtime &runtime, unsigned long flags, test_block *block) {
+    bool registered = false;
+    test_block *wrapper = runtime.create(flags, nullptr, 0, block, registered);
+    EXPECT_TRUE(registered);
+    pthread_executor::release_block(block);
+    return wrapper;
+}
+
+/* A wrapper executes the user's block, and completes, waking any waiter */
+TEST(DispatchBlockRuntime, Execute) {
+    static test_runtime runtime;
+    test_queue queue;
+    std::atomic<int> executed(0);
+    
+    test_block *wrapper = create(runtime, 0, counting_block(executed));
+    block_completion_wait_result result;
+    ASSERT_TRUE(runtime.wait(wrapper, 0, 1, result));
+    EXPECT_EQ(BLOCK_COMPLETION_TIMED_OUT, result);
+    
+    runtime.async(&queue, wrapper);
+    ASSERT_TRUE(runtime.wait(wrapper, posix_semaphore::FOREVER, 1, result));
+    EXPECT_EQ(BLOCK_COMPLETION_COMPLETED, result);
+    EXPECT_EQ(1, executed);
+    
+    queue.drain();
+    pthread_executor::release_block(wrapper);
+    EXPECT_TRUE(runtime.empty());
+}
+
+/* A cancelled wrapper skips the user's block, but still completes */
+TEST(DispatchBlockRuntime, CancelSkipsBlock) {
+    static test_runtime runtime;
+    test_queue queue;
+    std::atomic<int> executed(0);
+    std::atomic<int> notified(0);
+    
+    test_block *wrapper = create(runtime, 0, counting_block(executed));
+    test_block *notification = counting_block(notified);
+    ASSERT_TRUE(runtime.notify(wrapper, &queue, notification));
+    
+    ASSERT_TRUE(runtime.cancel(wrapper));
+    runtime.async(&queue, wrapper);
+    
+    block_completion_wait_result result;
+    ASSERT_TRUE(runtime.wait(wrapper, posix_semaphore::FOREVER, 1, result));
+    EXPECT_EQ(BLOCK_COMPLETION_COMPLETED, result);
+    
+    queue.drain();
+    EXPECT_EQ(0, executed);
+    EXPECT_EQ(1, notified);
+    
+    pthread_executor::release_block(notification);
+    pthread_executor::release_block(wrapper);
+}
+
+/* testcancel() reflects cancel(), and blocks not created by the runtime are never cancelled */
+TEST(DispatchBlockRuntime, TestCancel) {
+    static test_runtime runtime;
+    std::atomic<int> executed(0);
+    
+    test_block *wrapper = create(runtime, 0, counting_block(executed));
+    EXPECT_EQ(0, runtime.testcancel(wrapper));
+    EXPECT_TRUE(runtime.cancel(wrapper));
+    EXPECT_EQ(1, runtime.testcancel(wrapper));
+    
+    test_block *plain = counting_block(executed);
+    EXPECT_FALSE(runtime.cancel(plain));
+    EXPECT_EQ(0, runtime.testcancel(plain));
+    
+    pthread_executor::release_block(plain);
+    pthread_executor::release_block(wrapper);
+}
+
+/* Barrier-flagged blocks are routed to the executor's barrier variants; all other blocks are not */
+TEST(DispatchBlockRuntime, BarrierRouting) {
+    static test_runtime runtime;
+    test_queue queue;
+    std::atomic<int> executed(0);
+    
+    test_block *barrier = create(runtime, pthread_executor::BARRIER, counting_block(executed));
+    test_block *wrapper = create(runtime, 0, counting_block(executed));
+    test_block *plain = counting_block(executed);
+    
+    runtime.async(&queue, barrier);
+    runtime.async(&queue, wrapper);
+    runtime.async(&queue, plain);
+    queue.drain();
+    EXPECT_EQ(1, queue.barrier_async_count);
+    EXPECT_EQ(2, queue.async_count);
+    
+    runtime.sync(&queue, barrier);
+    runtime.sync(&queue, wrapper);
+    runtime.sync(&queue, plain);
+    EXPECT_EQ(1, queue.barrier_sync_count);
+    EXPECT_EQ(2, queue.sync_count);
+    EXPECT_EQ(6, executed);
+    
+    pthread_executor::release_block(plain);
+    pthread_executor::release_block(wrapper);
+    pthread_executor::release_block(barrier);
+}
+
+/* Attributes are unregistered and freed -- releasing any pending notifications -- with the last wrapper copy */
+TEST(DispatchBlockRuntime, ReleaseUnregisters) {
+    static test_runtime runtime;
+    test_queue queue;
+    std::atomic<int> executed(0);
+    int baseline = live_blocks;
+    
+    test_block *wrapper = create(runtime, 0, counting_block(executed));
+    test_block *notification = counting_block(executed);
+    ASSERT_TRUE(runtime.notify(wrapper, &queue, notification));
+    pthread_executor::release_block(notification);
+    EXPECT_EQ(2, queue.refs);
+    
+    test_block *copy = pthread_executor::copy_block(wrapper);
+    pthread_executor::release_block(wrapper);
+    EXPECT_TRUE(runtime.registered(copy));
+    
+    pthread_executor::release_block(copy);
+    EXPECT_TRUE(runtime.empty());
+    
+    /* The wrapper, the user's block, and the never-submitted notification are all released */
+    EXPECT_EQ(baseline, live_blocks);
+    EXPECT_EQ(1, queue.refs);
+    EXPECT_EQ(0, executed);
+}
+
+} /* anonymous namespace */
@@ -0,0 +1,166 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+
+#include "export_index.h"
+#include "image_registry.h"
+#include "loaded_image.h"
+#include "macho_builder.h"
+
+using namespace patchmaster;
+using namespace xpf;
+using namespace xpf::test;
+
+namespace {
+
+static const char *SYSTEM = "/usr/lib/libSystem.B.dylib";
+static const char *SYSTEM_C = "/usr/lib/system/libsystem_c.dylib";
+static const char *SYSTEM_M = "/usr/lib/system/libsystem_m.dylib";
+
+/**
+ * A libSystem umbrella re-exporting libsystem_c and libsystem_m, with libsystem_c exporting _malloc and
+ * re-exporting _sqrt from libsystem_m as _c_sqrt. All three libraries are loaded and registered, excepting
+ * libsystem_m, which tests load as required.
+ */
+class ExportResolverTest : public ::testing::Test {
+protected:
+    void SetUp () override {
+        macho_builder system(CPU_TYPE_X86_64, MH_DYLIB);
+        system.set_install_name(SYSTEM);
+        system.add_library(SYSTEM_C, LC_REEXPORT_DYLIB);
+        system.add_library(SYSTEM_M, LC_REEXPORT_DYLIB);
+        system.add_export("_system_version", 0x1000);
+        
+        macho_builder system_c(CPU_TYPE_X86_64, MH_DYLIB);
+        system_c.set_install_name(SYSTEM_C);
+        uint32_t m = system_c.add_library(SYSTEM_M);
+        system_c.add_export("_malloc", 0x1010);
+        system_c.add_reexport("_c_sqrt", m, "_sqrt");
+        
+        macho_builder system_m(CPU_TYPE_X86_64, MH_DYLIB);
+        system_m.set_install_name(SYSTEM_M);
+        system_m.add_export("_sqrt", 0x1020);
+        
+        load(_system, system, SYSTEM);
+        load(_system_c, system_c, SYSTEM_C);
+        _system_m_data = system_m.build();
+    }
+    
+    /** Map @a builder's image at @a path, and register it. */
+    void load (loaded_image &image, const macho_builder &builder, const char *path) {
+        std::string error;
+        ASSERT_TRUE(image.load(builder.build(), path, false, error)) << error;
+        _registry.insert((const struct mach_header *) image.header(), image.path().c_str());
+    }
+    
+    /** Map and register libsystem_m. */
+    void load_system_m () {
+        std::string error;
+        ASSERT_TRUE(_system_m.load(_system_m_data, SYSTEM_M, false, error)) << error;
+        _registry.insert((const struct mach_header *) _system_m.header(), _system_m.path().c_str());
+    }
+    
+    image_registry _registry;
+    loaded_image _system;
+    loaded_image _system_c;
+    loaded_image _system_m;
+    std::vector<uint8_t> _system_m_data;
+};
+
+} /* anonymous namespace */
+
+/* Symbols are resolved directly, and through re-exported libraries */
+TEST_F(ExportResolverTest, Resolve) {
+    export_resolver resolver(&_registry);
+    uintptr_t address = 0;
+    
+    ASSERT_TRUE(resolver.resolve(SYSTEM, "_system_version", &address));
+    EXPECT_EQ(address, (uintptr_t) _system.header() + 0x1000);
+    
+    ASSERT_TRUE(resolver.resolve(SYSTEM, "_malloc", &address));
+    EXPECT_EQ(address, (uintptr_t) _system_c.header() + 0x1010);
+    
+    /* Relative names are matched by suffix */
+    ASSERT_TRUE(resolver.resolve("libsystem_c.dylib", "_malloc", &address));
+    EXPECT_EQ(address, (uintptr_t) _system_c.header() + 0x1010);
+    
+    /* Both names share a single index */
+    EXPECT_EQ(resolver.index_count(), 2U);
+    EXPECT_GT(resolver.heap_size(), 0U);
+}
+
+/* A symbol is only missing if every re-exported library is loaded */
+TEST_F(ExportResolverTest, Lookup) {
+    export_resolver resolver(&_registry);
+    
+    EXPECT_EQ(resolver.lookup(SYSTEM, "_malloc"), EXPORT_FOUND);
+    EXPECT_EQ(resolver.lookup(SYSTEM, "_missing"), EXPORT_UNKNOWN);
+    EXPECT_EQ(resolver.lookup(SYSTEM_C, "_missing"), EXPORT_MISSING);
+    EXPECT_EQ(resolver.lookup(SYSTEM_C, "_c_sqrt"), EXPORT_UNKNOWN);
+    EXPECT_EQ(resolver.lookup("/usr/lib/libmissing.dylib", "_malloc"), EXPORT_UNKNOWN);
+    
+    load_system_m();
+    EXPECT_EQ(resolver.lookup(SYSTEM, "_missing"), EXPORT_MISSING);
+    
+    uintptr_t address = 0;
+    ASSERT_TRUE(resolver.resolve(SYSTEM_C, "_c_sqrt", &address));
+    EXPECT_EQ(address, (uintptr_t) _system_m.header() + 0x1020);
+}
+
+/* Indices of unloaded libraries are discarded */
+TEST_F(ExportResolverTest, Unload) {
+    export_resolver resolver(&_registry);
+    load_system_m();
+    EXPECT_EQ(resolver.lookup(SYSTEM, "_sqrt"), EXPORT_FOUND);
+    EXPECT_EQ(resolver.index_count(), 3U);
+    
+    _registry.remove((const struct mach_header *) _system_m.header());
+    EXPECT_EQ(resolver.lookup(SYSTEM, "_sqrt"), EXPORT_UNKNOWN);
+    EXPECT_EQ(resolver.index_count(), 2U);
+}
+
+/* A cached index is not reused for a different library registered at the same address */
+TEST_F(ExportResolverTest, AddressReuse) {
+    macho_builder unnamed(CPU_TYPE_X86_64, MH_DYLIB);
+    unnamed.add_export("_unnamed", 0x1000);
+    
+    loaded_image image;
+    load(image, unnamed, "/usr/lib/libfirst.dylib");
+    auto header = (const struct mach_header *) image.header();
+    
+    export_resolver resolver(&_registry);
+    EXPECT_EQ(resolver.lookup("/usr/lib/libfirst.dylib", "_unnamed"), EXPORT_FOUND);
+    
+    /* The image has no install name; once replaced, it is no longer known as libfirst */
+    _registry.remove(header);
+    _registry.insert(header, "/usr/lib/libsecond.dylib");
+    
+    EXPECT_EQ(resolver.lookup("/usr/lib/libfirst.dylib", "_unnamed"), EXPORT_UNKNOWN);
+    EXPECT_EQ(resolver.lookup("/usr/lib/libsecond.dylib", "_unnamed"), EXPORT_FOUND);
+    EXPECT_EQ(resolver.index_count(), 1U);
+}
@@ -0,0 +1,197 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sys/mman.h>
+
+#include <thread>
+
+#include "image_registry.h"
+
+using namespace xpf;
+
+namespace {
+
+/** Return a plan with a single rebind site. */
+static bind_plan make_plan () {
+    bind_plan plan;
+    plan.rebind_sites.push_back({ 0x2000, 0, 0 });
+    return plan;
+}
+
+/**
+ * Return a distinct, page-aligned fake header. The registry reads each image's load commands on insertion; fake
+ * headers are backed by zero-filled pages, and have no load commands.
+ */
+static const struct mach_header *fake_header (uintptr_t i) {
+    static constexpr size_t PAGES = 16384;
+    static const uint8_t *pages = (const uint8_t *) mmap(nullptr, PAGES * 4096, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    
+    if (pages == MAP_FAILED || i >= PAGES)
+        abort();
+    
+    return (const struct mach_header *) (pages + i * 4096);
+}
+
+TEST(ImageRegistry, InsertRemove) {
+    image_registry registry;
+    
+    EXPECT_EQ(registry.path(fake_header(1)), nullptr);
+    registry.insert(fake_header(1), "/usr/lib/liba.dylib");
+    EXPECT_STREQ(registry.path(fake_header(1)), "/usr/lib/liba.dylib");
+    
+    /* Re-registration updates the path, and preserves state */
+    registry.set_state(fake_header(1), image_registry::STATE_SYMBOLS_REBOUND);
+    registry.insert(fake_header(1), "/usr/lib/libb.dylib");
+    EXPECT_STREQ(registry.path(fake_header(1)), "/usr/lib/libb.dylib");
+    EXPECT_EQ(registry.state(fake_header(1)), (uint32_t) image_registry::STATE_SYMBOLS_REBOUND);
+    
+    /* A new image loaded at the same address starts with no state */
+    registry.remove(fake_header(1));
+    EXPECT_EQ(registry.path(fake_header(1)), nullptr);
+    registry.insert(fake_header(1), "/usr/lib/libc.dylib");
+    EXPECT_EQ(registry.state(fake_header(1)), 0U);
+}
+
+/* State updates made concurrently with resizing inserts are never lost */
+TEST(ImageRegistry, ConcurrentSetState) {
+    static constexpr uintptr_t IMAGES = 256;
+    image_registry registry;
+    
+    for (uintptr_t i = 1; i <= IMAGES; i++)
+        registry.insert(fake_header(i), "/usr/lib/libtest.dylib");
+    
+    std::thread inserter([&] {
+        for (uintptr_t i = IMAGES + 1; i < IMAGES + 8192; i++)
+            registry.insert(fake_header(i), "/usr/lib/libother.dylib");
+    });
+    
+    std::thread setter([&] {
+        for (uintptr_t i = 1; i <= IMAGES; i++) {
+            registry.set_state(fake_header(i), image_registry::STATE_BIND_OPCODES_REWRITTEN);
+            registry.set_state(fake_header(i), image_registry::STATE_SYMBOLS_REBOUND);
+            std::this_thread::yield();
+        }
+    });
+    
+    inserter.join();
+    setter.join();
+    
+    for (uintptr_t i = 1; i <= IMAGES; i++)
+        EXPECT_EQ(registry.state(fake_header(i)), (uint32_t) (image_registry::STATE_BIND_OPCODES_REWRITTEN | image_registry::STATE_SYMBOLS_REBOUND)) << i;
+}
+
+/* Plans are carried by the registry until taken, and released with their image */
+TEST(ImageRegistry, CarryPlan) {
+    image_registry registry;
+    auto header = fake_header(1);
+    
+    std::unique_ptr<mapped_bind_plan> plan(new mapped_bind_plan());
+    plan->adopt(make_plan());
+    
+    /* Unregistered images can not carry a plan */
+    registry.attach_plan(header, std::move(plan));
+    EXPECT_EQ(registry.take_plan(header), nullptr);
+    
+    registry.insert(header, "/usr/lib/libtest.dylib");
+    plan.reset(new mapped_bind_plan());
+    plan->adopt(make_plan());
+    registry.attach_plan(header, std::move(plan));
+    
+    plan = registry.take_plan(header);
+    ASSERT_NE(plan, nullptr);
+    EXPECT_EQ(plan->rebind_site_count(), 1U);
+    EXPECT_EQ(registry.take_plan(header), nullptr);
+    
+    /* Plans survive a resize */
+    registry.attach_plan(header, std::move(plan));
+    for (uintptr_t i = 2; i < 2048; i++)
+        registry.insert(fake_header(i), "/usr/lib/libother.dylib");
+    
+    plan = registry.take_plan(header);
+    ASSERT_NE(plan, nullptr);
+    
+    registry.attach_plan(header, std::move(plan));
+    registry.remove(header);
+    EXPECT_EQ(registry.take_plan(header), nullptr);
+}
+
+/* Each registration is assigned a new generation, including a re-registration at the same address */
+TEST(ImageRegistry, Generation) {
+    image_registry registry;
+    
+    EXPECT_EQ(registry.generation(fake_header(1)), 0U);
+    registry.insert(fake_header(1), "/usr/lib/liba.dylib");
+    registry.insert(fake_header(2), "/usr/lib/libb.dylib");
+    
+    uint64_t first = registry.generation(fake_header(1));
+    EXPECT_NE(first, 0U);
+    EXPECT_NE(registry.generation(fake_header(2)), first);
+    
+    /* Updating the path of a registered image preserves its generation */
+    registry.insert(fake_header(1), "/usr/lib/liba.dylib");
+    EXPECT_EQ(registry.generation(fake_header(1)), first);
+    
+    registry.remove(fake_header(1));
+    EXPECT_EQ(registry.generation(fake_header(1)), 0U);
+    
+    registry.insert(fake_header(1), "/usr/lib/libc.dylib");
+    EXPECT_NE(registry.generation(fake_header(1)), 0U);
+    EXPECT_NE(registry.generation(fake_header(1)), first);
+}
+
+/* Libraries are found by exact absolute path, and by suffix where either name is relative */
+TEST(ImageRegistry, FindLibrary) {
+    image_registry registry;
+    registry.insert(fake_header(1), "/usr/lib/libSystem.B.dylib");
+    registry.insert(fake_header(2), "/Library/Frameworks/Test.framework/Versions/A/Test");
+    registry.insert(fake_header(3), "libembedded.dylib");
+    
+    uint64_t generation = 0;
+    EXPECT_EQ(registry.find_library("/usr/lib/libSystem.B.dylib", &generation), fake_header(1));
+    EXPECT_EQ(generation, registry.generation(fake_header(1)));
+    
+    EXPECT_EQ(registry.find_library("libSystem.B.dylib", nullptr), fake_header(1));
+    EXPECT_EQ(registry.find_library("Test.framework/Versions/A/Test", nullptr), fake_header(2));
+    EXPECT_EQ(registry.find_library("/opt/lib/libembedded.dylib", nullptr), fake_header(3));
+    
+    /* Absolute names never suffix match other absolute names */
+    EXPECT_EQ(registry.find_library("/opt/lib/libSystem.B.dylib", nullptr), nullptr);
+    EXPECT_EQ(registry.find_library("libmissing.dylib", nullptr), nullptr);
+    
+    /* Removed libraries are no longer found, and a path update replaces the old name */
+    registry.remove(fake_header(1));
+    EXPECT_EQ(registry.find_library("/usr/lib/libSystem.B.dylib", nullptr), nullptr);
+    
+    registry.insert(fake_header(2), "/Library/Frameworks/Renamed.framework/Renamed");
+    EXPECT_EQ(registry.find_library("/Library/Frameworks/Test.framework/Versions/A/Test", nullptr), nullptr);
+    EXPECT_EQ(registry.find_library("/Library/Frameworks/Renamed.framework/Renamed", nullptr), fake_header(2));
+}
+
+} /* anonymous namespace */
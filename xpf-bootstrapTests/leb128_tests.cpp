@@ -0,0 +1,183 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+using namespace patchmaster;
+
+namespace {
+
+/** Bytewise reference decoder, independent of SymbolBinder.hpp. */
+static uint64_t reference_decode (const std::vector<uint8_t> &bytes, bool is_signed, size_t *size) {
+    uint64_t result = 0;
+    unsigned int shift = 0;
+    size_t i = 0;
+    uint8_t byte;
+    
+    do {
+        byte = bytes[i++];
+        if (shift < 64)
+            result |= (uint64_t) (byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    
+    if (is_signed && shift < 64 && (byte & 0x40))
+        result |= ~0ULL << shift;
+    
+    *size = i;
+    return result;
+}
+
+static std::vector<uint8_t> encode_uleb128 (uint64_t value, size_t pad_to = 0) {
+    std::vector<uint8_t> out;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value != 0 || out.size() + 1 < pad_to)
+            byte |= 0x80;
+        out.push_back(byte);
+    } while (value != 0 || out.size() < pad_to);
+    return out;
+}
+
+static std::vector<uint8_t> encode_sleb128 (int64_t value) {
+    std::vector<uint8_t> out;
+    bool more = true;
+    while (more) {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40)))
+            more = false;
+        else
+            byte |= 0x80;
+        out.push_back(byte);
+    }
+    return out;
+}
+
+/**
+ * Decode @a encoded via both the SWAR path (followed by @a trailer, with at least 8 readable bytes) and the
+ * scalar path (with the buffer ending at the terminator), and check both against the reference decoder.
+ */
+static void check_equivalence (const std::vector<uint8_t> &encoded, bool is_signed, uint8_t trailer = 0xFF) {
+    size_t ref_size;
+    uint64_t expected = reference_decode(encoded, is_signed, &ref_size);
+    ASSERT_EQ(encoded.size(), ref_size);
+    
+    /* Scalar: limit at the end of the encoding */
+    size_t scalar_size = 0;
+    uint64_t scalar = read_leb128_bounded(encoded.data(), encoded.data() + encoded.size(), &scalar_size, is_signed);
+    
+    /* SWAR: followed by trailing bytes, which must be ignored */
+    std::vector<uint8_t> padded = encoded;
+    padded.resize(encoded.size() + 8, trailer);
+    size_t swar_size = 0;
+    uint64_t swar = read_leb128_bounded(padded.data(), padded.data() + padded.size(), &swar_size, is_signed);
+    
+    EXPECT_EQ(expected, scalar);
+    EXPECT_EQ(expected, swar);
+    EXPECT_EQ(encoded.size(), scalar_size);
+    EXPECT_EQ(encoded.size(), swar_size);
+}
+
+} /* anonymous namespace */
+
+/* Every unsigned bit width, at the boundaries of each encoded length */
+TEST(LEB128, UnsignedBoundaries) {
+    for (unsigned bits = 0; bits <= 64; bits++) {
+        uint64_t max = (bits == 64) ? ~0ULL : ((1ULL << bits) - 1);
+        for (uint64_t value : { max, max + 1, max - 1, max >> 1 }) {
+            SCOPED_TRACE(value);
+            check_equivalence(encode_uleb128(value), false);
+            check_equivalence(encode_uleb128(value), false, 0x00);
+        }
+    }
+}
+
+/* Every signed bit width, positive and negative */
+TEST(LEB128, SignedBoundaries) {
+    for (unsigned bits = 0; bits < 64; bits++) {
+        int64_t max = (int64_t) ((1ULL << bits) - 1);
+        for (int64_t value : { max, -max, -max - 1, max + 1, -(max >> 1) }) {
+            SCOPED_TRACE(value);
+            check_equivalence(encode_sleb128(value), true);
+            check_equivalence(encode_sleb128(value), true, 0x00);
+        }
+    }
+    
+    check_equivalence(encode_sleb128(INT64_MIN), true);
+    check_equivalence(encode_sleb128(INT64_MAX), true);
+}
+
+/* Non-canonical (zero-padded) encodings, as emitted by ld64 for fixed-size fields */
+TEST(LEB128, PaddedEncodings) {
+    for (size_t len = 1; len <= 10; len++) {
+        for (uint64_t value : { 0ULL, 1ULL, 0x7fULL, 0x3fffULL }) {
+            std::vector<uint8_t> encoded = encode_uleb128(value, len);
+            if (encoded.size() != std::max(len, encode_uleb128(value).size()))
+                continue;
+            
+            SCOPED_TRACE(len);
+            check_equivalence(encoded, false);
+            check_equivalence(encoded, true);
+        }
+    }
+}
+
+/* Randomized values of every encoded length, including trailing garbage */
+TEST(LEB128, Randomized) {
+    std::mt19937_64 rng(42);
+    for (int i = 0; i < 100000; i++) {
+        unsigned bits = rng() % 65;
+        uint64_t value = (bits == 64) ? rng() : (rng() & ((1ULL << bits) - 1));
+        uint8_t trailer = (uint8_t) rng();
+        
+        check_equivalence(encode_uleb128(value), false, trailer);
+        check_equivalence(encode_sleb128((int64_t) value >> (rng() % 64)), true, trailer);
+        
+        if (HasFailure())
+            FAIL() << "value " << value;
+    }
+}
+
+/* Values followed by fewer than 8 readable bytes are decoded without reading past the limit */
+TEST(LEB128, NearLimit) {
+    std::vector<uint8_t> encoded = encode_uleb128(0x123456789ULL);
+    for (size_t extra = 0; extra < 8; extra++) {
+        std::vector<uint8_t> buf = encoded;
+        buf.resize(encoded.size() + extra, 0xFF);
+        
+        size_t size = 0;
+        EXPECT_EQ(0x123456789ULL, read_leb128_bounded(buf.data(), buf.data() + buf.size(), &size, false));
+        EXPECT_EQ(encoded.size(), size);
+    }
+}
@@ -0,0 +1,312 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <tuple>
+
+#include "analyze_rules.h"
+#include "export_trie.h"
+#include "loaded_image.h"
+#include "macho_binds.h"
+#include "macho_builder.h"
+#include "macho_file.h"
+
+using namespace patchmaster;
+using namespace xpf;
+using namespace xpf::test;
+
+namespace {
+
+/** A bind, as read back from a built image. */
+typedef std::tuple<int, int64_t, std::string, std::string, uint8_t, int64_t, uint64_t> bind_tuple;
+
+/** Parse @a data, and return all binds as (stream, ordinal, library, symbol, flags, addend, address). */
+static std::vector<bind_tuple> read_binds (const std::vector<uint8_t> &data, macho_file_image &image) {
+    std::string error;
+    EXPECT_TRUE(image.parse(data.data(), data.size(), error)) << error;
+    
+    std::vector<bind_tuple> binds;
+    EXPECT_TRUE(macho_evaluate_binds(image, [&](const macho_bind &b) {
+        binds.push_back(std::make_tuple((int) b.stream, b.ordinal, std::string(b.library), std::string(b.symbol), b.flags, b.addend, b.address));
+    }, error)) << error;
+    
+    return binds;
+}
+
+/** Return the __DATA vmaddr of @a image. */
+static uint64_t data_vmaddr (const macho_file_image &image) {
+    for (auto &&segment : image.segments()) {
+        if (segment.name == SEG_DATA)
+            return segment.vmaddr;
+    }
+    
+    ADD_FAILURE() << "no __DATA segment";
+    return 0;
+}
+
+/** Populate @a builder with imports exercising every non-lazy bind opcode form. */
+static void add_mixed_imports (macho_builder &builder) {
+    uint32_t foundation = builder.add_library("/System/Library/Frameworks/Foundation.framework/Versions/C/Foundation");
+    uint32_t system = builder.add_library("/usr/lib/libSystem.B.dylib");
+    
+    /* Pad out to an ordinal requiring BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB */
+    uint32_t last = 0;
+    for (int i = 0; i < 16; i++)
+        last = builder.add_library("/usr/lib/libpad" + std::to_string(i) + ".dylib");
+    
+    size_t ptr = builder.pointer_size();
+    
+    /* Runs of evenly spaced binds, and binds separated by varying gaps */
+    for (int i = 0; i < 5; i++)
+        builder.add_import_at(i * ptr * 2, foundation, "_NSLog");
+    builder.add_import_at(ptr * 11, foundation, "_NSLog");
+    builder.add_import_at(ptr * 13, system, "_malloc");
+    builder.add_import_at(ptr * 14, system, "_free");
+    builder.add_import_at(ptr * 40, system, "_free");
+    builder.add_import_at(ptr * 300, system, "_free");
+    builder.add_import_at(ptr * 301, system, "_optional", BIND_SYMBOL_FLAGS_WEAK_IMPORT);
+    builder.add_import_at(ptr * 302, system, "_optional", BIND_SYMBOL_FLAGS_WEAK_IMPORT, false, 16);
+    builder.add_import_at(ptr * 303, last, "_padded");
+    builder.add_import_at(ptr * 304, BIND_SPECIAL_DYLIB_FLAT_LOOKUP, "_flat");
+    
+    /* Binds out of address order */
+    builder.add_import_at(ptr * 20, system, "_backwards");
+    
+    /* Lazy binds */
+    builder.add_import_at(ptr * 400, system, "_lazy_one", 0, true);
+    builder.add_import_at(ptr * 401, foundation, "_lazy_two", 0, true);
+}
+
+} /* anonymous namespace */
+
+/* Binds emitted via LC_DYLD_INFO_ONLY must read back exactly, for both 32-bit and 64-bit images */
+TEST(MachOBuilder, BindRoundTrip) {
+    for (cpu_type_t cputype : { CPU_TYPE_X86_64, CPU_TYPE_X86 }) {
+        macho_builder builder(cputype, MH_DYLIB);
+        builder.set_install_name("/usr/lib/libtest.dylib");
+        add_mixed_imports(builder);
+        
+        std::vector<uint8_t> data = builder.build();
+        macho_file_image image;
+        std::vector<bind_tuple> binds = read_binds(data, image);
+        
+        EXPECT_EQ((cputype & CPU_ARCH_ABI64) != 0, image.is64());
+        EXPECT_EQ("/usr/lib/libtest.dylib", image.install_name());
+        ASSERT_EQ(builder.imports().size(), binds.size());
+        
+        /* Binds are read back in stream order: all non-lazy binds, then all lazy binds */
+        std::vector<macho_builder_import> expected = builder.imports();
+        std::stable_partition(expected.begin(), expected.end(), [](const macho_builder_import &i) { return !i.lazy; });
+        
+        uint64_t base = data_vmaddr(image);
+        for (size_t i = 0; i < expected.size(); i++) {
+            const macho_builder_import &imp = expected[i];
+            std::string library = imp.ordinal > 0 ? image.libraries()[imp.ordinal - 1] : "";
+            
+            EXPECT_EQ(imp.lazy ? MACHO_BIND_STREAM_LAZY : MACHO_BIND_STREAM_REGULAR, std::get<0>(binds[i])) << imp.symbol;
+            EXPECT_EQ(imp.ordinal, std::get<1>(binds[i])) << imp.symbol;
+            EXPECT_EQ(library, std::get<2>(binds[i])) << imp.symbol;
+            EXPECT_EQ(imp.symbol, std::get<3>(binds[i]));
+            EXPECT_EQ(imp.flags, std::get<4>(binds[i])) << imp.symbol;
+            EXPECT_EQ(imp.addend, std::get<5>(binds[i])) << imp.symbol;
+            EXPECT_EQ(base + imp.offset, std::get<6>(binds[i])) << imp.symbol;
+        }
+    }
+}
+
+/* Compact bind encoding must bind exactly the same locations, in fewer bytes */
+TEST(MachOBuilder, CompactBinds) {
+    macho_builder plain(CPU_TYPE_X86_64, MH_DYLIB);
+    macho_builder compact(CPU_TYPE_X86_64, MH_DYLIB);
+    add_mixed_imports(plain);
+    add_mixed_imports(compact);
+    compact.set_compact_binds(true);
+    
+    std::vector<uint8_t> plain_data = plain.build();
+    std::vector<uint8_t> compact_data = compact.build();
+    
+    macho_file_image plain_image, compact_image;
+    EXPECT_EQ(read_binds(plain_data, plain_image), read_binds(compact_data, compact_image));
+    EXPECT_LT(compact_image.dyld_info()->bind_size, plain_image.dyld_info()->bind_size);
+}
+
+/* Synthetic images bind every site, and import each symbol from its assigned library */
+TEST(MachOBuilder, SyntheticImage) {
+    for (bool lazy : { false, true }) {
+        for (bool compact : { false, true }) {
+            macho_synthetic_config config;
+            config.libraries = 20;
+            config.symbols = 100;
+            config.sites = 500;
+            config.lazy = lazy;
+            config.compact = compact;
+            
+            std::vector<uint8_t> data = macho_synthesize(config);
+            macho_file_image image;
+            std::vector<bind_tuple> binds = read_binds(data, image);
+            
+            ASSERT_EQ(config.sites, binds.size());
+            EXPECT_EQ(config.libraries, image.libraries().size());
+            
+            std::vector<bool> seen(config.symbols, false);
+            for (auto &&bind : binds) {
+                EXPECT_EQ(lazy ? MACHO_BIND_STREAM_LAZY : MACHO_BIND_STREAM_REGULAR, std::get<0>(bind));
+                
+                size_t symbol = strtoul(std::get<3>(bind).c_str() + strlen("_synthetic_symbol_"), nullptr, 10);
+                ASSERT_LT(symbol, config.symbols);
+                EXPECT_EQ(macho_synthetic_symbol(symbol), std::get<3>(bind));
+                EXPECT_EQ(macho_synthetic_library(symbol % config.libraries), std::get<2>(bind));
+                seen[symbol] = true;
+            }
+            
+            EXPECT_EQ(config.symbols, (size_t) std::count(seen.begin(), seen.end(), true));
+        }
+    }
+    
+    /* The same seed produces the same image */
+    macho_synthetic_config config;
+    EXPECT_EQ(macho_synthesize(config), macho_synthesize(config));
+}
+
+/* Exports are emitted as a well-formed trie */
+TEST(MachOBuilder, ExportTrie) {
+    macho_builder builder(CPU_TYPE_X86_64, MH_DYLIB);
+    uint32_t system = builder.add_library("/usr/lib/libSystem.B.dylib", LC_REEXPORT_DYLIB);
+    
+    std::vector<std::string> expected = { "_a", "_ab", "_abc", "_abd", "_b", "_xpf_rebind", "_xpf_weak" };
+    for (auto &&symbol : expected)
+        builder.add_export(symbol, 0x1000);
+    builder.add_reexport("_reexported", system, "_original");
+    expected.push_back("_reexported");
+    
+    std::vector<uint8_t> data = builder.build();
+    macho_file_image image;
+    std::string error;
+    ASSERT_TRUE(image.parse(data.data(), data.size(), error)) << error;
+    ASSERT_NE(nullptr, image.dyld_info());
+    ASSERT_EQ(1U, image.reexports().size());
+    
+    macho_file_range trie = image.file_range(image.dyld_info()->export_off, image.dyld_info()->export_size);
+    ASSERT_NE(nullptr, trie.data);
+    
+    std::vector<std::string> found;
+    uint64_t reexport_flags = 0;
+    EXPECT_TRUE(export_trie_walk(trie.data, trie.size, [&](const std::string &name, uint64_t flags) {
+        found.push_back(name);
+        if (name == "_reexported")
+            reexport_flags = flags;
+    }));
+    
+    std::sort(found.begin(), found.end());
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(expected, found);
+    EXPECT_EQ((uint64_t) EXPORT_SYMBOL_FLAGS_REEXPORT, reexport_flags);
+}
+
+/* Rebind rules are readable by xpf-analyze */
+TEST(MachOBuilder, RebindRules) {
+    for (cpu_type_t cputype : { CPU_TYPE_X86_64, CPU_TYPE_X86 }) {
+        macho_builder builder(cputype, MH_DYLIB);
+        builder.add_import(BIND_SPECIAL_DYLIB_FLAT_LOOKUP, "_unrelated");
+        builder.add_rebind_rule("_dispatch_block_create", "/usr/lib/libSystem.B.dylib");
+        builder.add_rebind_rule("_CFBundleGetInfoDictionary", "", true);
+        
+        std::vector<uint8_t> data = builder.build();
+        macho_file_image image;
+        std::string error;
+        ASSERT_TRUE(image.parse(data.data(), data.size(), error)) << error;
+        
+        std::vector<analyze_rebind_rule> rules;
+        ASSERT_TRUE(analyze_read_rebind_rules(image, rules, error)) << error;
+        ASSERT_EQ(2U, rules.size());
+        EXPECT_EQ("_dispatch_block_create", rules[0].symbol);
+        EXPECT_EQ("/usr/lib/libSystem.B.dylib", rules[0].image);
+        EXPECT_FALSE(rules[0].has_original);
+        EXPECT_EQ("_CFBundleGetInfoDictionary", rules[1].symbol);
+        EXPECT_EQ("", rules[1].image);
+        EXPECT_TRUE(rules[1].has_original);
+    }
+}
+
+/* Universal binaries list each slice at an aligned offset */
+TEST(MachOBuilder, FatBinary) {
+    for (bool fat64 : { false, true }) {
+        std::vector<uint8_t> x86_64 = macho_builder(CPU_TYPE_X86_64, MH_DYLIB).build();
+        std::vector<uint8_t> i386 = macho_builder(CPU_TYPE_X86, MH_DYLIB).build();
+        std::vector<uint8_t> fat = macho_build_fat({ { CPU_TYPE_X86_64, x86_64 }, { CPU_TYPE_X86, i386 } }, fat64);
+        
+        std::vector<macho_slice> slices;
+        std::string error;
+        ASSERT_TRUE(macho_slices(fat.data(), fat.size(), slices, error)) << error;
+        ASSERT_EQ(2U, slices.size());
+        
+        EXPECT_EQ(CPU_TYPE_X86_64, slices[0].cputype);
+        EXPECT_EQ(CPU_TYPE_X86, slices[1].cputype);
+        EXPECT_EQ(x86_64.size(), slices[0].size);
+        EXPECT_EQ(i386.size(), slices[1].size);
+        EXPECT_EQ(0U, slices[0].offset % 4096);
+        EXPECT_EQ(0U, slices[1].offset % 4096);
+        EXPECT_EQ(0, memcmp(fat.data() + slices[1].offset, i386.data(), i386.size()));
+    }
+}
+
+/* LocalImage::Analyze of a mapped image evaluates the same binds as the offline reader */
+TEST(MachOBuilder, LocalImageAnalyze) {
+    macho_builder builder(CPU_TYPE_X86_64, MH_DYLIB);
+    add_mixed_imports(builder);
+    std::vector<uint8_t> data = builder.build();
+    
+    macho_file_image file;
+    std::vector<bind_tuple> expected = read_binds(data, file);
+    
+    loaded_image loaded;
+    std::string error;
+    ASSERT_TRUE(loaded.load(data, "/usr/lib/libtest.dylib", false, error)) << error;
+    
+    LocalImage image = LocalImage::Analyze(loaded.path(), loaded.header());
+    EXPECT_EQ(loaded.vmaddr_slide(), image.vmaddr_slide());
+    
+    std::vector<bind_tuple> binds;
+    for (auto &&opcodes : *image.bindOpcodes()) {
+        bind_opstream ops = opcodes;
+        ops.evaluate(image, [&](const bind_opstream::symbol_proc &sp) {
+            int stream = ops.isLazy() ? MACHO_BIND_STREAM_LAZY : MACHO_BIND_STREAM_REGULAR;
+            binds.push_back(std::make_tuple(stream, 0, std::string(sp.name().image()), std::string(sp.name().symbol()), sp.flags(), sp.addend(), sp.bind_address() - loaded.vmaddr_slide()));
+        });
+    }
+    
+    /* The runtime reader does not report ordinals; compare everything else */
+    for (auto &&bind : expected) {
+        std::get<1>(bind) = 0;
+        if (std::get<2>(bind).empty() && std::get<3>(bind) != "_flat")
+            std::get<2>(bind) = loaded.path();
+    }
+    EXPECT_EQ(expected, binds);
+}
@@ -0,0 +1,208 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "macho_builder.h"
+#include "macho_chained.h"
+
+using namespace xpf;
+using namespace xpf::test;
+
+namespace {
+
+static const char *SYSTEM = "/usr/lib/libSystem.B.dylib";
+static const char *FOUNDATION = "/System/Library/Frameworks/Foundation.framework/Versions/C/Foundation";
+
+/** A chained fixup pointer format, and the architecture it is emitted for. */
+struct chained_format {
+    const char *name;
+    macho_chained_ptr_format pointer_format;
+    cpu_type_t cputype;
+};
+
+static const chained_format CHAINED_FORMATS[] = {
+    { "arm64e", MACHO_CHAINED_PTR_ARM64E, CPU_TYPE_ARM64 },
+    { "64", MACHO_CHAINED_PTR_64, CPU_TYPE_X86_64 },
+    { "32", MACHO_CHAINED_PTR_32, CPU_TYPE_I386 },
+    { "64_offset", MACHO_CHAINED_PTR_64_OFFSET, CPU_TYPE_X86_64 },
+    { "arm64e_userland", MACHO_CHAINED_PTR_ARM64E_USERLAND, CPU_TYPE_ARM64 },
+    { "arm64e_userland24", MACHO_CHAINED_PTR_ARM64E_USERLAND24, CPU_TYPE_ARM64 },
+};
+
+static const macho_chained_import_format IMPORT_FORMATS[] = {
+    MACHO_CHAINED_IMPORT_FORMAT,
+    MACHO_CHAINED_IMPORT_ADDEND_FORMAT,
+    MACHO_CHAINED_IMPORT_ADDEND64_FORMAT
+};
+
+/**
+ * A fixture image for every combination of pointer and imports table format. Binds span two pages, with
+ * interleaved rebases; in the 32-bit format, the gap between the first page's binds exceeds the maximum chain
+ * delta, requiring multiple chain starts within the page.
+ */
+class ChainedFixupsTest : public ::testing::TestWithParam<std::tuple<chained_format, macho_chained_import_format>> {
+protected:
+    void SetUp () override {
+        const chained_format &format = std::get<0>(GetParam());
+        size_t ptr = (format.pointer_format == MACHO_CHAINED_PTR_32) ? 4 : 8;
+        
+        macho_builder builder(format.cputype, MH_EXECUTE);
+        builder.set_chained_fixups(format.pointer_format, std::get<1>(GetParam()));
+        
+        uint32_t system = builder.add_library(SYSTEM);
+        uint32_t foundation = builder.add_library(FOUNDATION);
+        
+        builder.add_import_at(0, system, "_malloc");
+        builder.add_import_at(ptr, foundation, "_NSLog", 0, false, 16);
+        builder.add_rebase(ptr * 2, 0x100);
+        builder.add_import_at(0x200, system, "_free", BIND_SYMBOL_FLAGS_WEAK_IMPORT);
+        builder.add_import_at(0x1000, system, "_malloc");
+        builder.add_rebase(0x1000 + ptr, 0x200);
+        builder.add_import_at(0x1800, BIND_SPECIAL_DYLIB_FLAT_LOOKUP, "_flat");
+        
+        _imports = builder.imports();
+        _data = builder.build();
+        
+        std::string error;
+        ASSERT_TRUE(_image.parse(_data.data(), _data.size(), error)) << error;
+        
+        for (auto &&segment : _image.segments()) {
+            if (segment.name == SEG_DATA)
+                _data_vmaddr = segment.vmaddr;
+        }
+    }
+    
+    std::vector<macho_builder_import> _imports;
+    std::vector<uint8_t> _data;
+    macho_file_image _image;
+    uint64_t _data_vmaddr = 0;
+};
+
+/* Every bind is visited once, in address order, with its import and full addend */
+TEST_P(ChainedFixupsTest, WalkBinds) {
+    std::string error;
+    macho_chained_imports imports;
+    ASSERT_TRUE(macho_chained_read_imports(_image, imports, error)) << error;
+    EXPECT_EQ(imports.format, (uint32_t) std::get<1>(GetParam()));
+    
+    size_t idx = 0;
+    ASSERT_TRUE(macho_chained_walk_binds(_image, [&](uint32_t index, int64_t addend, uint64_t address) {
+        ASSERT_LT(idx, _imports.size());
+        ASSERT_LT(index, imports.imports.size());
+        
+        const macho_builder_import &expected = _imports[idx++];
+        const macho_chained_import &import = imports.imports[index];
+        
+        EXPECT_EQ(address, _data_vmaddr + expected.offset);
+        EXPECT_EQ(import.symbol, expected.symbol);
+        EXPECT_EQ(import.ordinal, expected.ordinal);
+        EXPECT_EQ(import.weak, (expected.flags & BIND_SYMBOL_FLAGS_WEAK_IMPORT) != 0);
+        EXPECT_EQ(import.addend + addend, expected.addend) << expected.symbol;
+    }, error)) << error;
+    
+    EXPECT_EQ(idx, _imports.size());
+}
+
+/* Imports table entries may be retargeted in place, without disturbing their name, addend, or neighbours */
+TEST_P(ChainedFixupsTest, SetImport) {
+    std::string error;
+    macho_chained_imports before;
+    ASSERT_TRUE(macho_chained_read_imports(_image, before, error)) << error;
+    
+    const macho_chained_import &target = before.imports[0];
+    ASSERT_TRUE(macho_chained_set_import(_data.data(), before.format, target.entry_offset, 2, true, error)) << error;
+    
+    macho_chained_imports after;
+    ASSERT_TRUE(macho_chained_read_imports(_image, after, error)) << error;
+    ASSERT_EQ(after.imports.size(), before.imports.size());
+    
+    EXPECT_EQ(after.imports[0].ordinal, 2);
+    EXPECT_STREQ(after.imports[0].library, FOUNDATION);
+    EXPECT_TRUE(after.imports[0].weak);
+    EXPECT_STREQ(after.imports[0].symbol, "_malloc");
+    EXPECT_EQ(after.imports[0].addend, before.imports[0].addend);
+    
+    for (size_t i = 1; i < after.imports.size(); i++) {
+        EXPECT_EQ(after.imports[i].ordinal, before.imports[i].ordinal);
+        EXPECT_EQ(after.imports[i].weak, before.imports[i].weak);
+        EXPECT_STREQ(after.imports[i].symbol, before.imports[i].symbol);
+        EXPECT_EQ(after.imports[i].addend, before.imports[i].addend);
+    }
+    
+    /* Special ordinals are sign-extended */
+    ASSERT_TRUE(macho_chained_set_import(_data.data(), before.format, target.entry_offset, BIND_SPECIAL_DYLIB_FLAT_LOOKUP, false, error)) << error;
+    ASSERT_TRUE(macho_chained_read_imports(_image, after, error)) << error;
+    EXPECT_EQ(after.imports[0].ordinal, BIND_SPECIAL_DYLIB_FLAT_LOOKUP);
+    EXPECT_FALSE(after.imports[0].weak);
+    
+    /* Ordinals beyond the entry format's range are rejected, and leave the entry unmodified */
+    int64_t too_large = (before.format == MACHO_CHAINED_IMPORT_ADDEND64) ? 0xFFF1 : 0xF1;
+    EXPECT_FALSE(macho_chained_set_import(_data.data(), before.format, target.entry_offset, too_large, false, error));
+    EXPECT_FALSE(macho_chained_set_import(_data.data(), before.format, target.entry_offset, -16, false, error));
+    ASSERT_TRUE(macho_chained_read_imports(_image, after, error)) << error;
+    EXPECT_EQ(after.imports[0].ordinal, BIND_SPECIAL_DYLIB_FLAT_LOOKUP);
+    
+    /* The fixup chains are untouched */
+    size_t binds = 0;
+    ASSERT_TRUE(macho_chained_walk_binds(_image, [&](uint32_t index, int64_t addend, uint64_t address) { binds++; }, error)) << error;
+    EXPECT_EQ(binds, _imports.size());
+}
+
+/** Return the test name suffix for @a info. */
+static std::string chained_test_name (const ::testing::TestParamInfo<ChainedFixupsTest::ParamType> &info) {
+    static const char *import_names[] = { "", "import", "addend", "addend64" };
+    return std::string(std::get<0>(info.param).name) + "_" + import_names[std::get<1>(info.param)];
+}
+
+INSTANTIATE_TEST_SUITE_P(Formats, ChainedFixupsTest, ::testing::Combine(::testing::ValuesIn(CHAINED_FORMATS), ::testing::ValuesIn(IMPORT_FORMATS)), chained_test_name);
+
+/* Malformed chains are rejected */
+TEST(ChainedFixups, RejectInvalidImport) {
+    macho_builder builder(CPU_TYPE_X86_64, MH_EXECUTE);
+    builder.set_chained_fixups(MACHO_CHAINED_PTR_64, MACHO_CHAINED_IMPORT_FORMAT);
+    builder.add_import_at(0, builder.add_library(SYSTEM), "_malloc");
+    
+    std::vector<uint8_t> data = builder.build();
+    macho_file_image image;
+    std::string error;
+    ASSERT_TRUE(image.parse(data.data(), data.size(), error)) << error;
+    
+    uint64_t data_offset = 0;
+    for (auto &&segment : image.segments()) {
+        if (segment.name == SEG_DATA)
+            data_offset = segment.fileoff;
+    }
+    
+    /* Point the bind at a nonexistent import */
+    data[data_offset] = 0x01;
+    EXPECT_FALSE(macho_chained_walk_binds(image, [](uint32_t, int64_t, uint64_t) {}, error));
+    EXPECT_EQ(error, "chained bind references an invalid import");
+}
+
+} /* anonymous namespace */
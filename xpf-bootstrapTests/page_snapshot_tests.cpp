@@ -0,0 +1,109 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "page_snapshot.h"
+
+using namespace xpf;
+
+namespace {
+
+static constexpr size_t PAGES = 16;
+
+/* Untouched anonymous pages are not resident; touched pages are reported as newly resident */
+TEST(PageSnapshot, AnonymousMapping) {
+    size_t page_size = getpagesize();
+    auto base = (volatile uint8_t *) mmap(nullptr, PAGES * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE((void *) base, MAP_FAILED);
+    
+    page_snapshot before;
+    ASSERT_TRUE(before.capture((const void *) base, PAGES * page_size));
+    EXPECT_EQ(before.page_count(), PAGES);
+    EXPECT_EQ(before.resident_count(), 0U);
+    
+    for (size_t i = 0; i < PAGES; i += 4)
+        base[i * page_size] = 1;
+    
+    page_snapshot after;
+    ASSERT_TRUE(after.capture((const void *) base, PAGES * page_size));
+    EXPECT_EQ(after.resident_count(), PAGES / 4);
+    EXPECT_EQ(before.newly_resident(after), PAGES / 4);
+    EXPECT_EQ(after.newly_resident(before), 0U);
+    
+    if (!page_snapshot::dirty_state_supported()) {
+        EXPECT_EQ(before.newly_dirtied(after), 0U);
+    }
+    
+    /* Unaligned ranges are extended to cover every overlapping page */
+    page_snapshot partial;
+    ASSERT_TRUE(partial.capture((const void *) (base + page_size - 1), 2));
+    EXPECT_EQ(partial.page_count(), 2U);
+    
+    /* Snapshots of differing ranges can not be compared */
+    EXPECT_EQ(partial.newly_resident(after), 0U);
+    
+    munmap((void *) base, PAGES * page_size);
+    EXPECT_FALSE(after.capture((const void *) base, PAGES * page_size));
+}
+
+/* Read faults on a file-backed mapping are reported as resident */
+TEST(PageSnapshot, FileMapping) {
+    size_t page_size = getpagesize();
+    char path[] = "/tmp/xpf-page-snapshot.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    unlink(path);
+    ASSERT_EQ(ftruncate(fd, PAGES * page_size), 0);
+    
+    auto base = (const volatile uint8_t *) mmap(nullptr, PAGES * page_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    ASSERT_NE((const void *) base, MAP_FAILED);
+    
+    page_snapshot before;
+    ASSERT_TRUE(before.capture((const void *) base, PAGES * page_size));
+    
+    uint8_t sum = 0;
+    for (size_t i = 0; i < PAGES; i++)
+        sum += base[i * page_size];
+    EXPECT_EQ(sum, 0);
+    
+    page_snapshot after;
+    ASSERT_TRUE(after.capture((const void *) base, PAGES * page_size));
+    EXPECT_EQ(after.resident_count(), PAGES);
+    EXPECT_EQ(before.resident_count() + before.newly_resident(after), PAGES);
+    
+    munmap((void *) base, PAGES * page_size);
+}
+
+} /* anonymous namespace */
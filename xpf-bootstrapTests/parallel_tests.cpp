@@ -0,0 +1,57 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+#include "parallel.h"
+
+using namespace xpf;
+
+/* Every index is processed exactly once, and only worker threads report parallel_in_worker() */
+TEST(ParallelFor, ProcessesAllIndices) {
+    std::vector<std::atomic<int>> seen(1000);
+    std::atomic<size_t> outside_worker(0);
+    
+    for (auto &&s : seen)
+        s = 0;
+    
+    EXPECT_FALSE(parallel_in_worker());
+    parallel_for(seen.size(), 4, [&](size_t i) {
+        seen[i]++;
+        if (!parallel_in_worker())
+            outside_worker++;
+    });
+    EXPECT_FALSE(parallel_in_worker());
+    
+    for (auto &&s : seen)
+        EXPECT_EQ(s.load(), 1);
+    EXPECT_EQ(outside_worker.load(), 0U);
+}
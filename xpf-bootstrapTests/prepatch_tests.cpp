@@ -0,0 +1,268 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "macho_builder.h"
+#include "prepatch.h"
+#include "prepatch_marker.h"
+
+using namespace xpf;
+using namespace xpf::test;
+
+namespace {
+
+static const char *SYSTEM = "/usr/lib/libSystem.B.dylib";
+static const char *FOUNDATION = "/System/Library/Frameworks/Foundation.framework/Versions/C/Foundation";
+static const char *SHIM = "@rpath/libxpf-shim.dylib";
+
+/** A single evaluated bind. */
+struct evaluated_bind {
+    macho_bind_stream stream;
+    int64_t ordinal;
+    std::string library;
+    std::string symbol;
+    uint8_t flags;
+};
+
+/**
+ * Prepatches fixture images built with macho_builder. Each fixture imports _dispatch_block_create (a rebind rule)
+ * from libSystem both lazily and non-lazily, _posix_spawnattr_set_qos_class_np (a weak table entry) from
+ * libSystem, and _NSLog from Foundation.
+ */
+class PrepatchTest : public ::testing::Test {
+protected:
+    void SetUp () override {
+        _options.rules.push_back({ "_dispatch_block_create", SYSTEM, false });
+        _options.rules_hash = prepatch_rules_hash(_options.rules);
+    }
+    
+    void TearDown () override {
+        for (auto &&path : _paths)
+            unlink(path.c_str());
+    }
+    
+    /** Return the fixture image for @a cputype. */
+    std::vector<uint8_t> fixture (cpu_type_t cputype = CPU_TYPE_X86_64, bool chained = false) {
+        macho_builder builder(cputype, MH_EXECUTE);
+        builder.set_header_padding(512);
+        if (chained)
+            builder.set_chained_fixups(MACHO_CHAINED_PTR_64, MACHO_CHAINED_IMPORT_FORMAT);
+        
+        uint32_t system = builder.add_library(SYSTEM);
+        uint32_t foundation = builder.add_library(FOUNDATION);
+        
+        builder.add_import(system, "_dispatch_block_create");
+        builder.add_import(system, "_posix_spawnattr_set_qos_class_np");
+        builder.add_import(foundation, "_NSLog");
+        if (!chained)
+            builder.add_import(system, "_dispatch_block_create", 0, true);
+        
+        return builder.build();
+    }
+    
+    /** Write a shim library exporting @a symbols to a temporary file, returning its path. */
+    std::string write_shim (const std::vector<std::string> &symbols, bool install_name = true) {
+        macho_builder builder(CPU_TYPE_X86_64, MH_DYLIB);
+        if (install_name)
+            builder.set_install_name(SHIM);
+        
+        for (auto &&symbol : symbols)
+            builder.add_export(symbol, 0x1000);
+        
+        std::vector<uint8_t> data = builder.build();
+        char path[] = "/tmp/xpf-shim.XXXXXX";
+        int fd = mkstemp(path);
+        EXPECT_GE(fd, 0);
+        EXPECT_EQ(write(fd, data.data(), data.size()), (ssize_t) data.size());
+        close(fd);
+        
+        _paths.push_back(path);
+        return path;
+    }
+    
+    /** Evaluate all binds of the thin image @a data. */
+    static std::vector<evaluated_bind> evaluate (const uint8_t *data, size_t size) {
+        std::vector<evaluated_bind> binds;
+        std::string error;
+        macho_file_image image;
+        
+        EXPECT_TRUE(image.parse(data, size, error)) << error;
+        EXPECT_TRUE(macho_evaluate_binds(image, [&](const macho_bind &bind) {
+            binds.push_back({ bind.stream, bind.ordinal, bind.library, bind.symbol, bind.flags });
+        }, error)) << error;
+        
+        return binds;
+    }
+    
+    /** Return the XPF_LC_PREPATCHED command of the thin 64-bit image @a data, or nullptr. */
+    static const struct xpf_prepatch_command *marker (const uint8_t *data) {
+        auto header = (const struct mach_header_64 *) data;
+        const uint8_t *p = data + sizeof(*header);
+        for (uint32_t i = 0; i < header->ncmds; i++) {
+            auto cmd = (const struct load_command *) p;
+            if (cmd->cmd == XPF_LC_PREPATCHED)
+                return (const struct xpf_prepatch_command *) cmd;
+            p += cmd->cmdsize;
+        }
+        return nullptr;
+    }
+    
+    prepatch_options _options;
+    std::vector<std::string> _paths;
+};
+
+/* Without a shim, all strong imports are weakened, and rebind table imports are left for runtime rebinding */
+TEST_F(PrepatchTest, WithoutShim) {
+    std::vector<uint8_t> input = fixture();
+    std::vector<uint8_t> output;
+    std::vector<prepatch_change> changes;
+    std::string error;
+    
+    ASSERT_TRUE(prepatch_file(_options, input.data(), input.size(), output, changes, error)) << error;
+    
+    /* Three non-lazy imports, and one lazy import */
+    ASSERT_EQ(changes.size(), 4U);
+    for (auto &&change : changes)
+        EXPECT_EQ(change.kind, PREPATCH_CHANGE_WEAK) << change.symbol;
+    
+    for (auto &&bind : evaluate(output.data(), output.size())) {
+        EXPECT_NE(bind.library, SHIM);
+        EXPECT_NE(bind.flags & BIND_SYMBOL_FLAGS_WEAK_IMPORT, 0) << bind.symbol;
+    }
+    
+    auto cmd = marker(output.data());
+    ASSERT_NE(cmd, nullptr);
+    EXPECT_EQ(cmd->cmdsize % 8, 0U);
+    EXPECT_EQ(cmd->version, (uint32_t) XPF_PREPATCH_VERSION);
+    EXPECT_EQ(cmd->rules_hash, _options.rules_hash);
+    EXPECT_EQ(cmd->flags & XPF_PREPATCH_FLAG_REBOUND, 0U);
+    
+    /* Images may only be prepatched once */
+    std::vector<uint8_t> again;
+    EXPECT_FALSE(prepatch_file(_options, output.data(), output.size(), again, changes, error));
+}
+
+/* With a shim exporting all rebound symbols, lazy and non-lazy rebind table imports are redirected */
+TEST_F(PrepatchTest, WithShim) {
+    std::string error;
+    ASSERT_TRUE(prepatch_load_shim(write_shim({ "_dispatch_block_create" }), _options, error)) << error;
+    EXPECT_EQ(_options.shim, SHIM);
+    
+    std::vector<uint8_t> input = fixture();
+    std::vector<uint8_t> output;
+    std::vector<prepatch_change> changes;
+    ASSERT_TRUE(prepatch_file(_options, input.data(), input.size(), output, changes, error)) << error;
+    
+    /* Redirected imports are left strong; all other imports are weakened */
+    size_t redirected = 0;
+    for (auto &&bind : evaluate(output.data(), output.size())) {
+        bool weak = (bind.flags & BIND_SYMBOL_FLAGS_WEAK_IMPORT) != 0;
+        if (bind.symbol == "_dispatch_block_create") {
+            EXPECT_EQ(bind.library, SHIM);
+            EXPECT_EQ(bind.ordinal, 3);
+            EXPECT_FALSE(weak);
+            redirected++;
+        } else {
+            EXPECT_NE(bind.library, SHIM) << bind.symbol;
+            EXPECT_TRUE(weak) << bind.symbol;
+        }
+    }
+    EXPECT_EQ(redirected, 2U);
+    
+    auto cmd = marker(output.data());
+    ASSERT_NE(cmd, nullptr);
+    EXPECT_EQ(cmd->flags & XPF_PREPATCH_FLAG_REBOUND, (uint32_t) XPF_PREPATCH_FLAG_REBOUND);
+}
+
+/* Redirection is refused if the shim does not export a redirected symbol */
+TEST_F(PrepatchTest, ShimMissingExport) {
+    std::string error;
+    ASSERT_TRUE(prepatch_load_shim(write_shim({ "_dispatch_block_perform" }), _options, error)) << error;
+    
+    std::vector<uint8_t> input = fixture();
+    std::vector<uint8_t> output;
+    std::vector<prepatch_change> changes;
+    EXPECT_FALSE(prepatch_file(_options, input.data(), input.size(), output, changes, error));
+    EXPECT_NE(error.find("does not export _dispatch_block_create"), std::string::npos) << error;
+    
+    /* A shim install name without a shim binary can not be verified */
+    _options.shim_path.clear();
+    EXPECT_FALSE(prepatch_file(_options, input.data(), input.size(), output, changes, error));
+}
+
+TEST_F(PrepatchTest, ShimWithoutInstallName) {
+    std::string error;
+    EXPECT_FALSE(prepatch_load_shim(write_shim({ "_dispatch_block_create" }, false), _options, error));
+    EXPECT_TRUE(_options.shim.empty());
+}
+
+/* Chained fixup images are redirected via their imports table */
+TEST_F(PrepatchTest, ChainedFixups) {
+    std::string error;
+    ASSERT_TRUE(prepatch_load_shim(write_shim({ "_dispatch_block_create" }), _options, error)) << error;
+    
+    std::vector<uint8_t> input = fixture(CPU_TYPE_X86_64, true);
+    std::vector<uint8_t> output;
+    std::vector<prepatch_change> changes;
+    ASSERT_TRUE(prepatch_file(_options, input.data(), input.size(), output, changes, error)) << error;
+    
+    auto binds = evaluate(output.data(), output.size());
+    ASSERT_EQ(binds.size(), 3U);
+    for (auto &&bind : binds) {
+        bool weak = (bind.flags & BIND_SYMBOL_FLAGS_WEAK_IMPORT) != 0;
+        EXPECT_EQ(bind.stream, MACHO_BIND_STREAM_CHAINED);
+        EXPECT_EQ(bind.library == SHIM, bind.symbol == "_dispatch_block_create") << bind.symbol;
+        EXPECT_EQ(weak, bind.symbol != "_dispatch_block_create") << bind.symbol;
+    }
+}
+
+/* Every slice of a fat file is patched */
+TEST_F(PrepatchTest, FatFile) {
+    std::vector<uint8_t> input = macho_build_fat({
+        { CPU_TYPE_X86_64, fixture(CPU_TYPE_X86_64) },
+        { CPU_TYPE_ARM64, fixture(CPU_TYPE_ARM64) }
+    });
+    std::vector<uint8_t> output;
+    std::vector<prepatch_change> changes;
+    std::string error;
+    ASSERT_TRUE(prepatch_file(_options, input.data(), input.size(), output, changes, error)) << error;
+    EXPECT_EQ(changes.size(), 8U);
+    
+    std::vector<macho_slice> slices;
+    ASSERT_TRUE(macho_slices(output.data(), output.size(), slices, error)) << error;
+    ASSERT_EQ(slices.size(), 2U);
+    for (auto &&slice : slices)
+        EXPECT_NE(marker(output.data() + slice.offset), nullptr) << macho_arch_name(slice.cputype);
+}
+
+} /* anonymous namespace */
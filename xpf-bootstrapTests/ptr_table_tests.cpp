@@ -0,0 +1,315 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "ptr_table.h"
+
+using namespace xpf;
+
+namespace {
+
+/** Table capacity used by the single-threaded tests; keys k << 8 all share a single probe sequence. */
+static constexpr size_t SMALL = 16;
+
+/** Return a fake, 16-byte aligned key. */
+static const void *key (uintptr_t k) {
+    return (const void *) (k << 8);
+}
+
+/* Re-inserting a key after an earlier key in its probe sequence was removed replaces the existing entry */
+TEST(PtrTable, ReinsertPastTombstone) {
+    static ptr_table<int, SMALL> table;
+    int a = 1, b = 2, c = 3;
+    
+    ASSERT_TRUE(table.insert(key(1), &a));
+    ASSERT_TRUE(table.insert(key(2), &b));
+    table.remove(key(1));
+    
+    /* Must replace key(2)'s existing entry, rather than claiming key(1)'s tombstone */
+    ASSERT_TRUE(table.insert(key(2), &c));
+    EXPECT_EQ(table.find(key(2)), &c);
+    
+    table.remove(key(2));
+    EXPECT_EQ(table.find(key(2)), nullptr);
+    EXPECT_TRUE(table.empty());
+}
+
+/* Tombstones are reused, and insertion only fails once every slot holds a live entry */
+TEST(PtrTable, Capacity) {
+    static ptr_table<int, SMALL> table;
+    std::vector<int> values(SMALL + 1);
+    
+    for (uintptr_t i = 0; i < SMALL; i++)
+        ASSERT_TRUE(table.insert(key(i + 1), &values[i])) << i;
+    EXPECT_FALSE(table.insert(key(SMALL + 1), &values[SMALL]));
+    
+    /* Replacement succeeds in a full table */
+    EXPECT_TRUE(table.insert(key(SMALL), &values[0]));
+    EXPECT_EQ(table.find(key(SMALL)), &values[0]);
+    
+    table.remove(key(3));
+    EXPECT_TRUE(table.insert(key(SMALL + 1), &values[SMALL]));
+    EXPECT_EQ(table.find(key(SMALL + 1)), &values[SMALL]);
+    EXPECT_EQ(table.find(key(3)), nullptr);
+    
+    for (uintptr_t i = 0; i <= SMALL; i++)
+        table.remove(key(i + 1));
+    EXPECT_TRUE(table.empty());
+}
+
+/** Table capacity used by the churn test. */
+static constexpr size_t CHURN_CAPACITY = 1024;
+
+/** Number of keys live at any time during the churn test. */
+static constexpr size_t CHURN_LIVE = 64;
+
+/** Return a fake, 16-byte aligned churn test key; unlike key(), consecutive keys spread across the whole table. */
+static const void *churn_key (uintptr_t k) {
+    return (const void *) (k << 4);
+}
+
+/** Return the maximum lookup probe length over a range of keys that were never inserted. */
+template <typename Table> static size_t max_miss_probes (const Table &table) {
+    size_t max = 0;
+    for (uintptr_t k = 0; k < CHURN_CAPACITY; k++)
+        max = std::max(max, table.probe_length(churn_key(0x1000000 + k)));
+    return max;
+}
+
+/* Tombstones left by removal are reclaimed, keeping lookup misses short after many insert/remove cycles */
+TEST(PtrTable, ChurnKeepsMissesShort) {
+    static ptr_table<int, CHURN_CAPACITY> table;
+    int value = 0;
+    
+    /* Slide a window of live keys across many times the table's capacity in distinct keys */
+    for (uintptr_t i = 0; i < CHURN_CAPACITY * 16; i++) {
+        ASSERT_TRUE(table.insert(churn_key(i + 1), &value)) << i;
+        if (i >= CHURN_LIVE)
+            table.remove(churn_key(i + 1 - CHURN_LIVE));
+    }
+    
+    EXPECT_LT(max_miss_probes(table), CHURN_LIVE / 2);
+    
+    /* Removing the remaining keys returns every slot to EMPTY */
+    for (uintptr_t i = CHURN_CAPACITY * 16 - CHURN_LIVE; i < CHURN_CAPACITY * 16; i++)
+        table.remove(churn_key(i + 1));
+    EXPECT_TRUE(table.empty());
+    EXPECT_EQ(max_miss_probes(table), 1U);
+}
+
+/* A table whose every slot was once occupied is fully reclaimed once its entries are removed */
+TEST(PtrTable, ReclaimFullTable) {
+    static ptr_table<int, SMALL> table;
+    int value = 0;
+    
+    for (uintptr_t i = 0; i < SMALL; i++)
+        ASSERT_TRUE(table.insert(key(i + 1), &value)) << i;
+    EXPECT_EQ(table.probe_length(key(SMALL + 1)), SMALL);
+    
+    for (uintptr_t i = 0; i < SMALL; i++)
+        table.remove(key(i + 1));
+    EXPECT_EQ(table.probe_length(key(SMALL + 1)), 1U);
+}
+
+/*
+ * Heap-allocated keys (as used by the posix_spawnattr_t QoS table) that are repeatedly created, registered, and
+ * destroyed, while lookups of unregistered keys remain short.
+ */
+TEST(PtrTable, HeapKeyChurn) {
+    static ptr_table<int, 256> table;
+    int value = 0;
+    
+    std::vector<void *> probes;
+    for (size_t i = 0; i < 64; i++)
+        probes.push_back(malloc(64));
+    
+    /* Keep a window of live keys, with varying allocation sizes so that freed addresses aren't simply reused */
+    std::vector<void *> live;
+    for (size_t i = 0; i < 256 * 16; i++) {
+        void *attr = malloc(64 + (i % 13) * 48);
+        ASSERT_TRUE(table.insert(attr, &value)) << i;
+        live.push_back(attr);
+        
+        if (live.size() > 16) {
+            void *oldest = live.front();
+            live.erase(live.begin());
+            EXPECT_EQ(table.find(oldest), &value);
+            table.remove(oldest);
+            free(oldest);
+        }
+    }
+    
+    for (void *attr : live) {
+        table.remove(attr);
+        free(attr);
+    }
+    
+    EXPECT_TRUE(table.empty());
+    for (void *probe : probes) {
+        EXPECT_EQ(table.probe_length(probe), 1U);
+        free(probe);
+    }
+}
+
+/** Number of threads used by the concurrent tests. */
+static constexpr size_t THREADS = 8;
+
+/** Number of keys owned by each thread. */
+static constexpr size_t KEYS_PER_THREAD = 64;
+
+/** Number of insert/find/remove rounds performed by each thread. */
+static constexpr size_t ROUNDS = 2000;
+
+/** Table shared by the concurrent tests; sized such that all threads' keys may be live at once. */
+static ptr_table<uintptr_t, 1024> shared_table;
+
+/** Per-thread state for the concurrent tests. */
+struct worker {
+    /** The worker's index. */
+    uintptr_t index;
+    
+    /** Values for each of the worker's keys. */
+    uintptr_t values[KEYS_PER_THREAD];
+    
+    /** Number of lookups that returned another key's value, or that failed to find a live key. */
+    size_t errors;
+};
+
+/** Return the @a n'th key owned by @a w; keys of all workers are interleaved to share probe sequences. */
+static const void *worker_key (const worker &w, size_t n) {
+    return key(1 + n * THREADS + w.index);
+}
+
+/**
+ * Repeatedly insert, re-insert, look up, and remove the worker's keys, verifying every lookup against the
+ * worker's own values.
+ */
+static void *worker_main (void *arg) {
+    worker &w = *(worker *) arg;
+    
+    for (size_t round = 0; round < ROUNDS; round++) {
+        size_t live = 1 + round % KEYS_PER_THREAD;
+        for (size_t n = 0; n < live; n++) {
+            w.values[n] = (w.index << 32) | (round << 8) | n;
+            if (!shared_table.insert(worker_key(w, n), &w.values[n]))
+                w.errors++;
+        }
+        
+        /* Replacement must never produce a duplicate entry */
+        for (size_t n = 0; n < live; n += 2) {
+            if (!shared_table.insert(worker_key(w, n), &w.values[n]))
+                w.errors++;
+        }
+        
+        for (size_t n = 0; n < live; n++) {
+            if (shared_table.find(worker_key(w, n)) != &w.values[n])
+                w.errors++;
+        }
+        
+        for (size_t n = 0; n < live; n++) {
+            shared_table.remove(worker_key(w, n));
+            if (shared_table.find(worker_key(w, n)) != nullptr)
+                w.errors++;
+        }
+    }
+    
+    return nullptr;
+}
+
+/* Concurrent insertion, replacement, lookup, and removal of distinct keys sharing probe sequences */
+TEST(PtrTable, ConcurrentDistinctKeys) {
+    std::vector<worker> workers(THREADS);
+    std::vector<pthread_t> threads(THREADS);
+    
+    for (size_t i = 0; i < THREADS; i++) {
+        workers[i].index = i;
+        workers[i].errors = 0;
+        ASSERT_EQ(pthread_create(&threads[i], nullptr, worker_main, &workers[i]), 0);
+    }
+    
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], nullptr);
+        EXPECT_EQ(workers[i].errors, 0U) << i;
+    }
+    
+    EXPECT_TRUE(shared_table.empty());
+}
+
+/** A key that is never removed while the concurrent lookup test runs, and its value. */
+static uintptr_t stable_value = 42;
+
+/** Set once the concurrent lookup test's writers have finished. */
+static std::atomic<bool> writers_done(false);
+
+/** Repeatedly look up the stable key, counting failed lookups, until all writers have finished. */
+static void *reader_main (void *arg) {
+    size_t &errors = *(size_t *) arg;
+    while (!writers_done.load(std::memory_order_acquire)) {
+        if (shared_table.find(key(0x100000)) != &stable_value)
+            errors++;
+    }
+    
+    return nullptr;
+}
+
+/* Lookups of a live key always succeed while other keys are concurrently inserted and removed */
+TEST(PtrTable, ConcurrentLookup) {
+    ASSERT_TRUE(shared_table.insert(key(0x100000), &stable_value));
+    
+    size_t reader_errors = 0;
+    pthread_t reader;
+    ASSERT_EQ(pthread_create(&reader, nullptr, reader_main, &reader_errors), 0);
+    
+    std::vector<worker> workers(THREADS);
+    std::vector<pthread_t> threads(THREADS);
+    for (size_t i = 0; i < THREADS; i++) {
+        workers[i].index = i;
+        workers[i].errors = 0;
+        ASSERT_EQ(pthread_create(&threads[i], nullptr, worker_main, &workers[i]), 0);
+    }
+    
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], nullptr);
+        EXPECT_EQ(workers[i].errors, 0U) << i;
+    }
+    
+    writers_done.store(true, std::memory_order_release);
+    pthread_join(reader, nullptr);
+    EXPECT_EQ(reader_errors, 0U);
+    
+    shared_table.remove(key(0x100000));
+    EXPECT_TRUE(shared_table.empty());
+}
+
+} /* anonymous namespace */
@@ -0,0 +1,236 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <string>
+
+#include "qos_policy.h"
+
+using namespace xpf;
+
+namespace {
+
+/* Unset classes map to the default policy, and unknown values to the unspecified policy */
+TEST(QoSPolicy, Lookup) {
+    qos_policy_table table;
+    qos_policy_defaults(table);
+    
+    EXPECT_EQ(qos_policy_lookup(table, XPF_QOS_BACKGROUND).priority, -16);
+    EXPECT_EQ(qos_policy_lookup(table, XPF_QOS_BACKGROUND).queue_priority, XPF_QOS_QUEUE_BACKGROUND);
+    EXPECT_TRUE(qos_policy_lookup(table, XPF_QOS_BACKGROUND).throttle_io);
+    EXPECT_EQ(qos_policy_lookup(table, XPF_QOS_USER_INITIATED).queue_priority, XPF_QOS_QUEUE_HIGH);
+    
+    /* NSQualityOfServiceDefault */
+    EXPECT_EQ(&qos_policy_lookup(table, -1), &qos_policy_lookup(table, XPF_QOS_DEFAULT));
+    EXPECT_EQ(&qos_policy_lookup(table, 0x42), &qos_policy_lookup(table, XPF_QOS_UNSPECIFIED));
+    
+    EXPECT_TRUE(qos_class_valid(XPF_QOS_UTILITY));
+    EXPECT_TRUE(qos_class_valid(-1));
+    EXPECT_FALSE(qos_class_valid(XPF_QOS_UNSPECIFIED));
+    EXPECT_FALSE(qos_class_valid(0x42));
+}
+
+/* Settings are applied to their class; unspecified settings and classes retain their existing values */
+TEST(QoSPolicy, Parse) {
+    qos_policy_table table;
+    qos_policy_defaults(table);
+    std::string error;
+    
+    ASSERT_TRUE(qos_policy_parse("background:priority=-20,nice=15,io=default;utility:queue=default;", table, error)) << error;
+    
+    const qos_policy &background = qos_policy_lookup(table, XPF_QOS_BACKGROUND);
+    EXPECT_EQ(background.priority, -20);
+    EXPECT_EQ(background.nice, 15);
+    EXPECT_FALSE(background.throttle_io);
+    EXPECT_EQ(background.queue_priority, XPF_QOS_QUEUE_BACKGROUND);
+    
+    const qos_policy &utility = qos_policy_lookup(table, XPF_QOS_UTILITY);
+    EXPECT_EQ(utility.queue_priority, XPF_QOS_QUEUE_DEFAULT);
+    EXPECT_EQ(utility.priority, -4);
+    EXPECT_EQ(utility.nice, 5);
+    
+    EXPECT_EQ(qos_policy_lookup(table, XPF_QOS_USER_INTERACTIVE).queue_priority, XPF_QOS_QUEUE_HIGH);
+    
+    /* An empty specification is valid */
+    EXPECT_TRUE(qos_policy_parse("", table, error)) << error;
+    EXPECT_EQ(qos_policy_lookup(table, XPF_QOS_BACKGROUND).priority, -20);
+}
+
+/* Invalid specifications are rejected with a description of the error, leaving the table unmodified */
+TEST(QoSPolicy, ParseErrors) {
+    const char *specs[][2] = {
+        { "background", "missing ':' in entry 'background'" },
+        { "idle:priority=1", "unknown QoS class 'idle'" },
+        { "utility:priority", "missing '=' in setting 'priority'" },
+        { "utility:priority=65", "invalid priority '65'" },
+        { "utility:priority=", "invalid priority ''" },
+        { "utility:priority=1x", "invalid priority '1x'" },
+        { "utility:nice=-21", "invalid nice value '-21'" },
+        { "utility:queue=highest", "invalid queue priority 'highest'" },
+        { "utility:io=fast", "invalid io policy 'fast'" },
+        { "utility:weight=1", "unknown setting 'weight'" },
+    };
+    
+    for (auto &&spec : specs) {
+        qos_policy_table table;
+        qos_policy_defaults(table);
+        std::string error;
+        
+        /* Valid settings preceding the error must not be applied */
+        std::string input = std::string("utility:priority=-8;") + spec[0];
+        EXPECT_FALSE(qos_policy_parse(input.c_str(), table, error)) << input;
+        EXPECT_EQ(error, spec[1]) << input;
+        EXPECT_EQ(qos_policy_lookup(table, XPF_QOS_UTILITY).priority, -4) << input;
+    }
+}
+
+/* Thread priorities are offset from the middle of the scheduling policy's range, and clamped to that range */
+TEST(QoSPolicy, ThreadPriorityClamping) {
+    int min = sched_get_priority_min(SCHED_FIFO);
+    int max = sched_get_priority_max(SCHED_FIFO);
+    ASSERT_LT(min, max);
+    int mid = (min + max) / 2;
+    
+    qos_policy policy = { 0, XPF_QOS_QUEUE_DEFAULT, 0, false };
+    EXPECT_EQ(qos_thread_priority(SCHED_FIFO, policy, 0), mid);
+    EXPECT_EQ(qos_thread_priority(SCHED_FIFO, policy, -1), mid - 1);
+    
+    policy.priority = -4;
+    EXPECT_EQ(qos_thread_priority(SCHED_FIFO, policy, 0), mid - 4);
+    EXPECT_EQ(qos_thread_priority(SCHED_FIFO, policy, -15), std::max(mid - 19, min));
+    
+    policy.priority = -64;
+    EXPECT_EQ(qos_thread_priority(SCHED_FIFO, policy, -64), min);
+    
+    policy.priority = 64;
+    EXPECT_EQ(qos_thread_priority(SCHED_FIFO, policy, 64), max);
+    
+    /* Invalid scheduling policies produce the default priority */
+    EXPECT_EQ(qos_thread_priority(-1, policy, 0), 0);
+    
+    /* Relative priorities are always within [0, 1] */
+    for (int p = -64; p <= 64; p += 16) {
+        policy.priority = p;
+        double relative = qos_relative_thread_priority(policy);
+        EXPECT_GE(relative, 0.0) << p;
+        EXPECT_LE(relative, 1.0) << p;
+    }
+}
+
+/** Result of a qos_thread_scope test thread. */
+struct scope_result {
+    /** If false, the thread's scheduling policy could not be changed, and no other results are valid. */
+    bool supported;
+    
+    /** The thread's scheduling priority before, within, and after the scope. */
+    int before;
+    int within;
+    int after;
+    
+    /** The thread's scheduling policy after the scope. */
+    int policy_after;
+};
+
+/** The policy applied by scope_thread_main. */
+static const qos_policy scope_policy = { -4, XPF_QOS_QUEUE_LOW, 5, false };
+
+/** Return the calling thread's scheduling priority. */
+static int current_priority (int *policy) {
+    struct sched_param param;
+    pthread_getschedparam(pthread_self(), policy, &param);
+    return param.sched_priority;
+}
+
+/**
+ * Move the calling thread to SCHED_FIFO, then apply scope_policy within a qos_thread_scope, recording the thread's
+ * priority before, within, and after the scope. Real-time scheduling is confined to this thread.
+ */
+static void *scope_thread_main (void *arg) {
+    scope_result &result = *(scope_result *) arg;
+    struct sched_param param;
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    
+    result.supported = (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0);
+    if (!result.supported)
+        return nullptr;
+    
+    int policy;
+    result.before = current_priority(&policy);
+    {
+        qos_thread_scope scope(&scope_policy, -2);
+        result.within = current_priority(&policy);
+    }
+    result.after = current_priority(&result.policy_after);
+    
+    return nullptr;
+}
+
+/* The thread's previous scheduling priority is restored when the scope ends */
+TEST(QoSPolicy, ThreadScopeRestore) {
+    scope_result result = {};
+    pthread_t thread;
+    ASSERT_EQ(pthread_create(&thread, nullptr, scope_thread_main, &result), 0);
+    pthread_join(thread, nullptr);
+    
+    if (!result.supported)
+        GTEST_SKIP() << "SCHED_FIFO is not permitted";
+    
+    EXPECT_EQ(result.within, qos_thread_priority(SCHED_FIFO, scope_policy, -2));
+    EXPECT_NE(result.within, result.before);
+    EXPECT_EQ(result.after, result.before);
+    EXPECT_EQ(result.policy_after, SCHED_FIFO);
+}
+
+/* A nullptr policy, or one matching the thread's current priority, leaves the thread unmodified */
+TEST(QoSPolicy, ThreadScopeUnmodified) {
+    int policy;
+    int before = current_priority(&policy);
+    
+    {
+        qos_thread_scope scope(nullptr, -10);
+        int current_policy;
+        EXPECT_EQ(current_priority(&current_policy), before);
+        EXPECT_EQ(current_policy, policy);
+    }
+    
+    {
+        qos_thread_scope scope(&scope_policy, 0);
+        int current_policy;
+        EXPECT_EQ(current_priority(&current_policy), qos_thread_priority(policy, scope_policy, 0));
+    }
+    
+    int after_policy;
+    EXPECT_EQ(current_priority(&after_policy), before);
+    EXPECT_EQ(after_policy, policy);
+}
+
+} /* anonymous namespace */
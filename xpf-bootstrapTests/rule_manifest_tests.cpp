@@ -0,0 +1,346 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <PLPatchMaster/SymbolName.hpp>
+
+#include "rule_compiler.h"
+#include "rule_manifest.h"
+
+using namespace patchmaster;
+using namespace xpf;
+
+namespace {
+
+/** Parse and compile @a text, failing the current test on error. */
+static std::vector<uint8_t> compile_rules (const std::string &text) {
+    std::vector<rulec_rule> rules;
+    std::vector<uint8_t> manifest;
+    std::string error;
+    
+    EXPECT_TRUE(rulec_parse(text, rules, error)) << error;
+    EXPECT_TRUE(rulec_compile(rules, manifest, error)) << error;
+    return manifest;
+}
+
+/** Map a copy of @a data via rule_manifest::Map(). */
+static std::unique_ptr<rule_manifest> map_manifest (const std::vector<uint8_t> &data, std::string &error) {
+    char path[] = "/tmp/xpf-rules.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        error = "mkstemp() failed";
+        return nullptr;
+    }
+    
+    bool written = (write(fd, data.data(), data.size()) == (ssize_t) data.size());
+    close(fd);
+    
+    std::unique_ptr<rule_manifest> manifest(written ? rule_manifest::Map(path, error) : nullptr);
+    unlink(path);
+    return manifest;
+}
+
+/** A rule file exercising every directive. */
+static const char *RULES =
+    "# Comment\n"
+    "\n"
+    "rebind _dispatch_block_create /usr/lib/libSystem.B.dylib   # trailing comment\n"
+    "rebind _CFBundleGetInfoDictionary -\n"
+    "rebind _CFBundleGetLocalInfoDictionary CoreFoundation _CFBundleGetInfoDictionary\n"
+    "weak /usr/lib/libSystem.B.dylib _missing\n"
+    "framework SpriteKit.framework\n"
+    "framework SceneKit.framework\n";
+
+/* Every directive is parsed, in declaration order */
+TEST(RuleCompiler, Parse) {
+    std::vector<rulec_rule> rules;
+    std::string error;
+    ASSERT_TRUE(rulec_parse(RULES, rules, error)) << error;
+    ASSERT_EQ(6U, rules.size());
+    
+    EXPECT_EQ(XPF_RULE_REBIND, rules[0].kind);
+    EXPECT_EQ("_dispatch_block_create", rules[0].symbol);
+    EXPECT_EQ("/usr/lib/libSystem.B.dylib", rules[0].image);
+    EXPECT_EQ("_dispatch_block_create", rules[0].impl);
+    EXPECT_EQ(3U, rules[0].line);
+    
+    /* '-' matches any image */
+    EXPECT_EQ("", rules[1].image);
+    
+    EXPECT_EQ("_CFBundleGetLocalInfoDictionary", rules[2].symbol);
+    EXPECT_EQ("CoreFoundation", rules[2].image);
+    EXPECT_EQ("_CFBundleGetInfoDictionary", rules[2].impl);
+    
+    EXPECT_EQ(XPF_RULE_WEAK, rules[3].kind);
+    EXPECT_EQ("/usr/lib/libSystem.B.dylib", rules[3].image);
+    EXPECT_EQ("_missing", rules[3].symbol);
+    
+    EXPECT_EQ(XPF_RULE_FRAMEWORK, rules[4].kind);
+    EXPECT_EQ("SpriteKit.framework", rules[4].symbol);
+    EXPECT_EQ(8U, rules[5].line);
+}
+
+/* Malformed rules are rejected with their line number */
+TEST(RuleCompiler, ParseErrors) {
+    const char *cases[][2] = {
+        { "rebind _foo", "line 1: expected 'rebind <symbol> <image> [<implementation>]'" },
+        { "rebind _foo - _bar _baz", "line 1: expected 'rebind <symbol> <image> [<implementation>]'" },
+        { "\nweak _foo", "line 2: expected 'weak <library> <symbol>'" },
+        { "framework", "line 1: expected 'framework <name>'" },
+        { "# comment\nreplace _foo -", "line 2: unknown directive 'replace'" },
+        { "rebind _foo -\nrebind _foo - _bar", "line 2: duplicate rebind rule for _foo" },
+        { "framework A\nframework A", "line 2: duplicate framework rule for A" },
+    };
+    
+    for (auto &&c : cases) {
+        std::vector<rulec_rule> rules;
+        std::string error;
+        EXPECT_FALSE(rulec_parse(c[0], rules, error)) << c[0];
+        EXPECT_EQ(c[1], error) << c[0];
+    }
+    
+    /* The same symbol may be rebound in different images */
+    std::vector<rulec_rule> rules;
+    std::string error;
+    EXPECT_TRUE(rulec_parse("rebind _foo -\nrebind _foo libfoo.dylib", rules, error)) << error;
+}
+
+/* Rebind implementations must exist, and aliases may only name implementations without an original slot */
+TEST(RuleCompiler, CheckImplementations) {
+    std::vector<analyze_rebind_rule> compiled = {
+        { "_CFBundleGetInfoDictionary", "CoreFoundation", true },
+        { "_dispatch_block_create", "libSystem.B.dylib", false },
+    };
+    
+    auto check = [&](const std::string &text, const std::vector<analyze_rebind_rule> *impls, std::string &error) {
+        std::vector<rulec_rule> rules;
+        EXPECT_TRUE(rulec_parse(text, rules, error)) << error;
+        return rulec_check_implementations(rules, impls, error);
+    };
+    
+    std::string error;
+    EXPECT_TRUE(check("rebind _CFBundleGetInfoDictionary -\nweak libfoo.dylib _foo", &compiled, error)) << error;
+    EXPECT_TRUE(check("rebind _dispatch_block_create_alias - _dispatch_block_create", &compiled, error)) << error;
+    
+    EXPECT_FALSE(check("rebind _missing -", &compiled, error));
+    EXPECT_EQ("line 1: no rebind implementation for _missing", error);
+    
+    EXPECT_FALSE(check("\nrebind _CFBundleGetLocalInfoDictionary - _CFBundleGetInfoDictionary", &compiled, error));
+    EXPECT_EQ("line 2: implementation _CFBundleGetInfoDictionary calls through to the original _CFBundleGetInfoDictionary, and cannot rebind _CFBundleGetLocalInfoDictionary", error);
+    
+    /* Without the compiled rules, only aliases are rejected */
+    EXPECT_TRUE(check("rebind _missing -", nullptr, error)) << error;
+    EXPECT_FALSE(check("rebind _dispatch_block_create_alias - _dispatch_block_create", nullptr, error));
+    EXPECT_EQ("line 1: rebinding _dispatch_block_create_alias to implementation _dispatch_block_create requires an xpf-bootstrap binary (-b)", error);
+}
+
+/* Compiled manifests are mapped with entries grouped by kind; framework entries retain their declaration order */
+TEST(RuleManifest, Map) {
+    std::vector<uint8_t> data = compile_rules(RULES);
+    
+    std::string error;
+    std::unique_ptr<rule_manifest> manifest = map_manifest(data, error);
+    ASSERT_NE(nullptr, manifest) << error;
+    
+    EXPECT_EQ(3U, manifest->count(XPF_RULE_REBIND));
+    EXPECT_EQ(1U, manifest->count(XPF_RULE_WEAK));
+    ASSERT_EQ(2U, manifest->count(XPF_RULE_FRAMEWORK));
+    
+    for (auto entry = manifest->begin(XPF_RULE_REBIND); entry != manifest->end(XPF_RULE_REBIND); entry++) {
+        EXPECT_EQ(xpf_rebind_hash(manifest->string(entry->symbol)), entry->symbol_hash);
+        EXPECT_EQ(xpf_rebind_hash(manifest->string(entry->impl)), entry->impl_id);
+        if (entry != manifest->begin(XPF_RULE_REBIND)) {
+            EXPECT_LE(entry[-1].symbol_hash, entry->symbol_hash);
+        }
+    }
+    
+    const xpf_rule_manifest_entry *weak = manifest->begin(XPF_RULE_WEAK);
+    EXPECT_STREQ("_missing", manifest->string(weak->symbol));
+    EXPECT_STREQ("/usr/lib/libSystem.B.dylib", manifest->string(weak->image));
+    
+    EXPECT_STREQ("SpriteKit.framework", manifest->string(manifest->begin(XPF_RULE_FRAMEWORK)[0].symbol));
+    EXPECT_STREQ("SceneKit.framework", manifest->string(manifest->begin(XPF_RULE_FRAMEWORK)[1].symbol));
+    
+    /* A missing manifest is not an error */
+    EXPECT_EQ(nullptr, rule_manifest::Map("/nonexistent/rules.xpfrules", error));
+    EXPECT_EQ("", error);
+}
+
+/** Recompute the checksum of the manifest @a data. */
+static void update_checksum (std::vector<uint8_t> &data) {
+    uint32_t checksum = 2166136261U;
+    for (size_t i = sizeof(xpf_rule_manifest_header); i < data.size(); i++) {
+        checksum ^= data[i];
+        checksum *= 16777619U;
+    }
+    memcpy(data.data() + offsetof(xpf_rule_manifest_header, checksum), &checksum, sizeof(checksum));
+}
+
+/* Every structural defect is detected before the manifest is used */
+TEST(RuleManifest, Validate) {
+    const std::vector<uint8_t> valid = compile_rules(RULES);
+    std::string error;
+    ASSERT_TRUE(rule_manifest::Validate(valid.data(), valid.size(), error)) << error;
+    
+    auto header = [](std::vector<uint8_t> &data) { return (xpf_rule_manifest_header *) data.data(); };
+    auto entries = [&](std::vector<uint8_t> &data) {
+        return (xpf_rule_manifest_entry *) (data.data() + header(data)->entries_offset);
+    };
+    
+    /* Each mutation is followed by a checksum update, unless it targets the checksum itself */
+    struct mutation {
+        const char *error;
+        std::function<void(std::vector<uint8_t> &)> apply;
+        bool checksum;
+    };
+    
+    std::vector<mutation> mutations = {
+        { "truncated header", [](std::vector<uint8_t> &d) { d.resize(sizeof(xpf_rule_manifest_header) - 1); }, false },
+        { "not a rule manifest", [&](std::vector<uint8_t> &d) { header(d)->magic ^= 1; }, false },
+        { "unsupported manifest version 2", [&](std::vector<uint8_t> &d) { header(d)->version = 2; }, false },
+        { "invalid entry table bounds", [&](std::vector<uint8_t> &d) { header(d)->entry_count = 0x10000000; }, false },
+        { "invalid entry table bounds", [&](std::vector<uint8_t> &d) { header(d)->entries_offset = 2; }, false },
+        { "invalid string pool bounds", [&](std::vector<uint8_t> &d) { header(d)->strings_size += 1; }, false },
+        { "invalid string pool bounds", [&](std::vector<uint8_t> &d) { header(d)->strings_offset -= 4; }, false },
+        { "string pool is not NUL-terminated", [](std::vector<uint8_t> &d) { d.back() = 'x'; }, true },
+        { "checksum mismatch", [](std::vector<uint8_t> &d) { d[d.size() - 2] ^= 0x20; }, false },
+        { "entry 0 has unknown kind 0", [&](std::vector<uint8_t> &d) { entries(d)[0].kind = 0; }, true },
+        { "entry 1 is out of order", [&](std::vector<uint8_t> &d) { entries(d)[0].kind = XPF_RULE_WEAK; }, true },
+        { "entry 2 references a string outside the string pool", [&](std::vector<uint8_t> &d) { entries(d)[2].impl = header(d)->strings_size; }, true },
+        { "entry 0 is missing a required symbol name", [&](std::vector<uint8_t> &d) { entries(d)[0].symbol = 0; }, true },
+        { "entry 0 is missing a required symbol name", [&](std::vector<uint8_t> &d) { entries(d)[0].impl = 0; }, true },
+    };
+    
+    for (size_t i = 0; i < mutations.size(); i++) {
+        std::vector<uint8_t> data = valid;
+        mutations[i].apply(data);
+        if (mutations[i].checksum)
+            update_checksum(data);
+        
+        EXPECT_FALSE(rule_manifest::Validate(data.data(), data.size(), error)) << i;
+        EXPECT_EQ(mutations[i].error, error) << i;
+        
+        /* Map() applies the same validation */
+        EXPECT_EQ(nullptr, map_manifest(data, error)) << i;
+        EXPECT_EQ(mutations[i].error, error) << i;
+    }
+    
+    /* Framework and weak entries don't require an implementation */
+    std::vector<uint8_t> data = compile_rules("weak libfoo.dylib _foo\nframework Foo.framework\n");
+    EXPECT_TRUE(rule_manifest::Validate(data.data(), data.size(), error)) << error;
+}
+
+/** Original slots of the compiled implementations used by the link tests. */
+static void *orig_get_info;
+
+/** A compiled rebind table. */
+static const xpf_rebind_entry compiled_entries[] = {
+    { "_CFBundleGetInfoDictionary", xpf_rebind_hash("_CFBundleGetInfoDictionary"), "CoreFoundation", &orig_get_info, 0x1000 },
+    { "_dispatch_block_create", xpf_rebind_hash("_dispatch_block_create"), "libSystem.B.dylib", NULL, 0x2000 },
+};
+
+/**
+ * Link the rebind entries of the manifest compiled from @a text against compiled_entries. The linked entries borrow
+ * their strings from @a manifest.
+ */
+static bool link_rules (const std::string &text, std::unique_ptr<rule_manifest> &manifest, std::vector<xpf_rebind_entry> &entries, std::string &error) {
+    manifest = map_manifest(compile_rules(text), error);
+    if (manifest == nullptr)
+        return false;
+    
+    return manifest->link_rebind_entries(compiled_entries, sizeof(compiled_entries) / sizeof(compiled_entries[0]), entries, error);
+}
+
+/* Manifest rebind entries share their implementation's replacement and original slot */
+TEST(RuleManifest, LinkRebindEntries) {
+    std::unique_ptr<rule_manifest> manifest;
+    std::vector<xpf_rebind_entry> entries;
+    std::string error;
+    ASSERT_TRUE(link_rules("rebind _CFBundleGetInfoDictionary /System/Library/Frameworks/CoreFoundation.framework/CoreFoundation\n"
+                           "rebind _dispatch_block_create_alias - _dispatch_block_create\n", manifest, entries, error)) << error;
+    ASSERT_EQ(2U, entries.size());
+    
+    for (auto &&entry : entries) {
+        EXPECT_EQ(xpf_rebind_hash(entry.symbol), entry.symbol_hash);
+        if (strcmp(entry.symbol, "_CFBundleGetInfoDictionary") == 0) {
+            EXPECT_STREQ("/System/Library/Frameworks/CoreFoundation.framework/CoreFoundation", entry.image);
+            EXPECT_EQ(&orig_get_info, entry.original);
+            EXPECT_EQ(0x1000U, entry.replacement);
+        } else {
+            EXPECT_STREQ("_dispatch_block_create_alias", entry.symbol);
+            EXPECT_STREQ("", entry.image);
+            EXPECT_EQ(nullptr, entry.original);
+            EXPECT_EQ(0x2000U, entry.replacement);
+        }
+    }
+}
+
+/* A manifest referencing an unknown implementation, or aliasing an implementation with an original slot, is rejected */
+TEST(RuleManifest, LinkRebindEntriesErrors) {
+    const char *cases[][2] = {
+        { "rebind _missing -", "rule for _missing references unknown implementation _missing" },
+        { "rebind _CFBundleGetLocalInfoDictionary - _CFBundleGetInfoDictionary",
+          "rule for _CFBundleGetLocalInfoDictionary references implementation _CFBundleGetInfoDictionary, which calls through to the original _CFBundleGetInfoDictionary" },
+    };
+    
+    for (auto &&c : cases) {
+        /* No entries are appended on failure */
+        std::unique_ptr<rule_manifest> manifest;
+        std::vector<xpf_rebind_entry> entries(1, compiled_entries[1]);
+        std::string error;
+        std::string text = std::string("rebind _dispatch_block_create -\n") + c[0];
+        EXPECT_FALSE(link_rules(text, manifest, entries, error)) << c[0];
+        EXPECT_EQ(c[1], error);
+        EXPECT_EQ(1U, entries.size());
+    }
+}
+
+/* Rule images are matched against the umbrella library recorded by the importing image, as in the README example */
+TEST(RuleManifest, ReadmeExample) {
+    std::unique_ptr<rule_manifest> manifest;
+    std::vector<xpf_rebind_entry> entries;
+    std::string error;
+    ASSERT_TRUE(link_rules("rebind _dispatch_block_create /usr/lib/libSystem.B.dylib\n", manifest, entries, error)) << error;
+    ASSERT_EQ(1U, entries.size());
+    
+    SymbolName rule(entries[0].image, entries[0].symbol);
+    EXPECT_TRUE(rule.match(SymbolName("/usr/lib/libSystem.B.dylib", "_dispatch_block_create")));
+    EXPECT_FALSE(rule.match(SymbolName("/usr/lib/system/libdispatch.dylib", "_dispatch_block_create")));
+}
+
+} /* anonymous namespace */
@@ -0,0 +1,152 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "loaded_image.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include <darwin_compat.h>
+
+using namespace patchmaster;
+
+namespace xpf {
+namespace test {
+
+loaded_image::~loaded_image () {
+    unload();
+}
+
+/**
+ * Map the 64-bit Mach-O image @a data. The image's segments must be ordered by vmaddr, with the first segment
+ * at vmaddr 0 and file offset 0.
+ *
+ * @param data The image data.
+ * @param path The path reported for the image.
+ * @param register_image If true, register the image with the darwin-compat _dyld_* functions.
+ * @param error On failure, a description of the error.
+ */
+bool loaded_image::load (const std::vector<uint8_t> &data, const std::string &path, bool register_image, std::string &error) {
+    unload();
+    
+    if (data.size() < sizeof(pl_mach_header_t) || ((const pl_mach_header_t *) data.data())->magic != (sizeof(void *) == 8 ? MH_MAGIC_64 : MH_MAGIC)) {
+        error = "not a native Mach-O image";
+        return false;
+    }
+    
+    /* Size the mapping */
+    auto header = (const pl_mach_header_t *) data.data();
+    std::vector<const pl_segment_command_t *> segments;
+    
+    const uint8_t *cmd_ptr = (const uint8_t *) (header + 1);
+    uint64_t vm_end = 0;
+    for (uint32_t i = 0; i < header->ncmds; i++) {
+        auto cmd = (const struct load_command *) cmd_ptr;
+        if (cmd->cmd == PL_LC_SEGMENT) {
+            auto segment = (const pl_segment_command_t *) cmd;
+            if (segment->fileoff + segment->filesize > data.size()) {
+                error = "segment extends past the end of the image";
+                return false;
+            }
+            
+            segments.push_back(segment);
+            vm_end = std::max<uint64_t>(vm_end, segment->vmaddr + segment->vmsize);
+        }
+        cmd_ptr += cmd->cmdsize;
+    }
+    
+    if (segments.empty() || segments[0]->vmaddr != 0 || segments[0]->fileoff != 0) {
+        error = "the first segment must map the mach header at vmaddr 0";
+        return false;
+    }
+    
+    size_t page_size = getpagesize();
+    size_t size = (vm_end + page_size - 1) & ~(page_size - 1);
+    
+    void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (base == MAP_FAILED) {
+        error = std::string("mmap() failed: ") + strerror(errno);
+        return false;
+    }
+    
+    _base = (uint8_t *) base;
+    _size = size;
+    _path = path;
+    
+    /* Copy in the segments; offsets must be computed before the header is re-protected */
+    for (auto segment : segments)
+        memcpy(_base + segment->vmaddr, data.data() + segment->fileoff, segment->filesize);
+    
+    for (auto segment : segments) {
+        uintptr_t start = segment->vmaddr & ~(page_size - 1);
+        uintptr_t end = (segment->vmaddr + segment->vmsize + page_size - 1) & ~(page_size - 1);
+        int prot = 0;
+        
+        if (segment->initprot & VM_PROT_READ)
+            prot |= PROT_READ;
+        if (segment->initprot & VM_PROT_WRITE)
+            prot |= PROT_WRITE;
+        
+        /* Never map test images executable */
+        if (end > start && mprotect(_base + start, end - start, prot) != 0) {
+            error = std::string("mprotect() failed: ") + strerror(errno);
+            unload();
+            return false;
+        }
+    }
+    
+    if (register_image) {
+        darwin_compat_add_image((const struct mach_header *) _base, _path.c_str(), vmaddr_slide());
+        _registered = true;
+    }
+    
+    return true;
+}
+
+/**
+ * Unmap the image, and remove its darwin-compat registration, if any.
+ */
+void loaded_image::unload () {
+    if (_base == nullptr)
+        return;
+    
+    if (_registered)
+        darwin_compat_remove_image((const struct mach_header *) _base);
+    
+    munmap(_base, _size);
+    _base = nullptr;
+    _size = 0;
+    _registered = false;
+}
+
+} /* namespace test */
+} /* namespace xpf */
@@ -0,0 +1,87 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+namespace xpf {
+namespace test {
+
+/**
+ * A Mach-O image mapped into the current process as dyld would map it, for use by tests and benchmarks running on
+ * non-Darwin hosts.
+ *
+ * Each segment is mapped at its vmaddr relative to a single anonymous mapping, and protected according to its
+ * initprot. If registered, the image is reported by the darwin-compat _dyld_* functions until it is unloaded.
+ */
+class loaded_image {
+public:
+    loaded_image () : _base(nullptr), _size(0), _registered(false) {}
+    ~loaded_image ();
+    
+    loaded_image (const loaded_image &) = delete;
+    loaded_image &operator= (const loaded_image &) = delete;
+    
+    bool load (const std::vector<uint8_t> &data, const std::string &path, bool register_image, std::string &error);
+    void unload ();
+    
+    /** Return the image's mach header, or nullptr if not loaded. */
+    const patchmaster::pl_mach_header_t *header () const { return (const patchmaster::pl_mach_header_t *) _base; }
+    
+    /** Return the image's vmaddr slide. */
+    intptr_t vmaddr_slide () const { return (intptr_t) _base; }
+    
+    /** Return the image's path. */
+    const std::string &path () const { return _path; }
+    
+    /** Return the size of the image's mapping. */
+    size_t size () const { return _size; }
+
+private:
+    /** The base address of the mapping, or nullptr if not loaded. */
+    uint8_t *_base;
+    
+    /** The size of the mapping. */
+    size_t _size;
+    
+    /** The image's path. */
+    std::string _path;
+    
+    /** True if the image was registered with darwin-compat. */
+    bool _registered;
+};
+
+} /* namespace test */
+} /* namespace xpf */
@@ -0,0 +1,145 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Portable implementations of the LocalImage members provided by the PLPatchMaster binary on Darwin, allowing the
+ * bind opcode evaluation templates of SymbolBinder.hpp to be exercised against loaded_image mappings.
+ */
+
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <PLPatchMaster/SymbolBinder.hpp>
+
+namespace patchmaster {
+
+/**
+ * Return the path of the current process' executable.
+ */
+const std::string &LocalImage::MainExecutablePath () {
+    static const std::string path = [] {
+        char buf[PATH_MAX];
+        ssize_t len = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+        return std::string(buf, len > 0 ? len : 0);
+    }();
+    
+    return path;
+}
+
+/**
+ * Parse the segments, linked libraries, and LC_DYLD_INFO bind opcode streams of a loaded image.
+ *
+ * @param path The image's path.
+ * @param header The image's mach header.
+ */
+LocalImage LocalImage::Analyze (const std::string &path, const pl_mach_header_t *header) {
+    auto libraries = std::make_shared<pl_image_vector<const std::string>>();
+    auto segments = std::make_shared<pl_image_vector<const pl_segment_command_t *>>();
+    auto bindings = std::make_shared<pl_image_vector<const bind_opstream>>();
+    
+    const struct dyld_info_command *dyld_info = nullptr;
+    const pl_segment_command_t *text = nullptr;
+    const pl_segment_command_t *linkedit = nullptr;
+    
+    auto cmd = (const struct load_command *) (header + 1);
+    for (uint32_t i = 0; i < header->ncmds; i++) {
+        switch (cmd->cmd) {
+            case PL_LC_SEGMENT: {
+                auto segment = (const pl_segment_command_t *) cmd;
+                segments->push_back(segment);
+                
+                if (strcmp(segment->segname, SEG_TEXT) == 0)
+                    text = segment;
+                else if (strcmp(segment->segname, SEG_LINKEDIT) == 0)
+                    linkedit = segment;
+                break;
+            }
+                
+            case LC_LOAD_DYLIB:
+            case LC_LOAD_WEAK_DYLIB:
+            case LC_REEXPORT_DYLIB:
+            case LC_LAZY_LOAD_DYLIB:
+            case LC_LOAD_UPWARD_DYLIB: {
+                auto dylib = (const struct dylib_command *) cmd;
+                libraries->push_back(std::string((const char *) cmd + dylib->dylib.name.offset));
+                break;
+            }
+                
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY:
+                dyld_info = (const struct dyld_info_command *) cmd;
+                break;
+        }
+        
+        cmd = (const struct load_command *) ((const uint8_t *) cmd + cmd->cmdsize);
+    }
+    
+    if (text == nullptr)
+        PMFatal("Could not find the __TEXT segment of %s", path.c_str());
+    
+    intptr_t slide = (intptr_t) header - (intptr_t) text->vmaddr;
+    
+    if (dyld_info != nullptr && linkedit != nullptr) {
+        const uint8_t *linkedit_base = (const uint8_t *) (linkedit->vmaddr + slide - linkedit->fileoff);
+        
+        if (dyld_info->bind_size > 0)
+            bindings->push_back(bind_opstream(linkedit_base + dyld_info->bind_off, dyld_info->bind_size, false));
+        
+        if (dyld_info->weak_bind_size > 0)
+            bindings->push_back(bind_opstream(linkedit_base + dyld_info->weak_bind_off, dyld_info->weak_bind_size, false));
+        
+        if (dyld_info->lazy_bind_size > 0)
+            bindings->push_back(bind_opstream(linkedit_base + dyld_info->lazy_bind_off, dyld_info->lazy_bind_size, true));
+    }
+    
+    return LocalImage(path, header, slide, libraries, segments, bindings);
+}
+
+/**
+ * Evaluate all of the image's bind opcode streams, calling @a bind for every bound symbol.
+ */
+void LocalImage::rebind_symbols (const std::function<void(const bind_opstream::symbol_proc &)> &bind) {
+    rebind_symbols<const std::function<void(const bind_opstream::symbol_proc &)> &>(bind);
+}
+
+/**
+ * Evaluate all opcodes in the stream, calling @a bind for every bound symbol.
+ */
+void bind_opstream::evaluate (const LocalImage &image, const std::function<void(const symbol_proc &)> &bind) {
+    evaluate<const std::function<void(const symbol_proc &)> &>(image, bind);
+}
+
+/**
+ * Evaluate a single opcode, calling @a bind if the opcode binds one or more symbols.
+ */
+uint8_t bind_opstream::step (const LocalImage &image, const std::function<void(const symbol_proc &)> &bind) {
+    return step<const std::function<void(const symbol_proc &)> &>(image, bind);
+}
+
+} /* namespace patchmaster */
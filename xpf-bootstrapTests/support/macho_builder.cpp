@@ -0,0 +1,1108 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "macho_builder.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+
+#include <mach-o/fat.h>
+
+#include "rebind_table.h"
+
+#ifndef LC_DYLD_EXPORTS_TRIE
+#define LC_DYLD_EXPORTS_TRIE (0x33 | LC_REQ_DYLD)
+#endif
+
+#ifndef LC_DYLD_CHAINED_FIXUPS
+#define LC_DYLD_CHAINED_FIXUPS (0x34 | LC_REQ_DYLD)
+#endif
+
+#ifndef FAT_MAGIC_64
+#define FAT_MAGIC_64 0xcafebabf
+#endif
+
+namespace xpf {
+namespace test {
+
+/* Byte encoding helpers */
+
+static void put_uleb128 (std::vector<uint8_t> &out, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0)
+            byte |= 0x80;
+        out.push_back(byte);
+    } while (value != 0);
+}
+
+static void put_sleb128 (std::vector<uint8_t> &out, int64_t value) {
+    bool more = true;
+    while (more) {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if ((value == 0 && (byte & 0x40) == 0) || (value == -1 && (byte & 0x40) != 0))
+            more = false;
+        else
+            byte |= 0x80;
+        out.push_back(byte);
+    }
+}
+
+static void put_cstring (std::vector<uint8_t> &out, const std::string &str) {
+    out.insert(out.end(), str.begin(), str.end());
+    out.push_back('\0');
+}
+
+template <typename T> static void put_le (std::vector<uint8_t> &out, T value) {
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(value));
+    out.insert(out.end(), bytes, bytes + sizeof(bytes));
+}
+
+template <typename T> static void set_le (std::vector<uint8_t> &out, size_t offset, T value) {
+    memcpy(&out[offset], &value, sizeof(value));
+}
+
+static void put_be32 (std::vector<uint8_t> &out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((value >> shift) & 0xFF);
+}
+
+static void put_be64 (std::vector<uint8_t> &out, uint64_t value) {
+    put_be32(out, value >> 32);
+    put_be32(out, value & 0xFFFFFFFF);
+}
+
+static void pad_to (std::vector<uint8_t> &out, size_t alignment) {
+    while (out.size() % alignment != 0)
+        out.push_back(0);
+}
+
+static uint64_t round_up (uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * Construct a new builder.
+ *
+ * @param cputype The image's CPU type; CPU_ARCH_ABI64 determines whether a 64-bit image is emitted.
+ * @param filetype The image's file type (MH_EXECUTE, MH_DYLIB, MH_BUNDLE).
+ */
+macho_builder::macho_builder (cpu_type_t cputype, uint32_t filetype) :
+    _cputype(cputype),
+    _filetype(filetype),
+    _is64((cputype & CPU_ARCH_ABI64) != 0),
+    _page_size(4096),
+    _header_padding(0),
+    _compact(false),
+    _chained(false),
+    _pointer_format(MACHO_CHAINED_PTR_64),
+    _import_format(MACHO_CHAINED_IMPORT_FORMAT),
+    _has_uuid(false),
+    _next_offset(0)
+{
+    memset(_uuid, 0, sizeof(_uuid));
+}
+
+/** Set the LC_ID_DYLIB install name. */
+void macho_builder::set_install_name (const std::string &install_name) {
+    _install_name = install_name;
+}
+
+/** Emit an LC_UUID command with @a uuid. */
+void macho_builder::set_uuid (const uint8_t uuid[16]) {
+    memcpy(_uuid, uuid, sizeof(_uuid));
+    _has_uuid = true;
+}
+
+/** Set the segment alignment, and the page size used for chained fixups. */
+void macho_builder::set_page_size (uint32_t page_size) {
+    _page_size = page_size;
+}
+
+/** Reserve at least @a padding bytes of free space following the load commands. */
+void macho_builder::set_header_padding (uint32_t padding) {
+    _header_padding = padding;
+}
+
+/** If true, fold runs of binds into the compact DO_BIND_* opcodes emitted by ld64. */
+void macho_builder::set_compact_binds (bool compact) {
+    _compact = compact;
+}
+
+/** Bind imports via LC_DYLD_CHAINED_FIXUPS rather than LC_DYLD_INFO_ONLY. */
+void macho_builder::set_chained_fixups (macho_chained_ptr_format pointer_format, macho_chained_import_format import_format) {
+    _chained = true;
+    _pointer_format = pointer_format;
+    _import_format = import_format;
+}
+
+/**
+ * Add a dependent library, returning its ordinal.
+ */
+uint32_t macho_builder::add_library (const std::string &install_name, uint32_t cmd) {
+    _libraries.push_back(std::make_pair(install_name, cmd));
+    return (uint32_t) _libraries.size();
+}
+
+/**
+ * Add an import bound at the next free pointer-sized slot of __DATA, returning the slot's __DATA offset.
+ */
+uint64_t macho_builder::add_import (int ordinal, const std::string &symbol, uint8_t flags, bool lazy, int64_t addend) {
+    uint64_t offset = _next_offset;
+    add_import_at(offset, ordinal, symbol, flags, lazy, addend);
+    return offset;
+}
+
+/**
+ * Add an import bound at @a offset within __DATA.
+ */
+void macho_builder::add_import_at (uint64_t offset, int ordinal, const std::string &symbol, uint8_t flags, bool lazy, int64_t addend) {
+    _imports.push_back({ ordinal, symbol, flags, addend, offset, lazy });
+    _next_offset = std::max(_next_offset, offset + pointer_size());
+}
+
+/**
+ * Add a chained rebase of the pointer at @a offset within __DATA to the unslid VM address @a target. Rebases are only
+ * emitted in chained fixup images, where they form part of the fixup chains.
+ */
+void macho_builder::add_rebase (uint64_t offset, uint64_t target) {
+    _rebases.push_back({ offset, target });
+    _next_offset = std::max(_next_offset, offset + pointer_size());
+}
+
+/** Export @a symbol at @a address, relative to the mach header. */
+void macho_builder::add_export (const std::string &symbol, uint64_t address, uint64_t flags) {
+    _exports.push_back({ symbol, flags, address, 0, "" });
+}
+
+/** Re-export @a symbol from the library at @a ordinal, optionally under a different name. */
+void macho_builder::add_reexport (const std::string &symbol, uint64_t ordinal, const std::string &reexport_name) {
+    _exports.push_back({ symbol, EXPORT_SYMBOL_FLAGS_REEXPORT, 0, ordinal, reexport_name });
+}
+
+/**
+ * Add an xpf_rebind_entry for @a symbol and @a image to a __DATA,__xpf_rebind section. If @a original is true, the
+ * entry's original slot points at the start of __DATA.
+ */
+void macho_builder::add_rebind_rule (const std::string &symbol, const std::string &image, bool original) {
+    _rebind_rules.push_back({ symbol, image, original });
+}
+
+/** Append a raw load command; @a command must be a complete, correctly sized load command. */
+void macho_builder::add_load_command (const std::vector<uint8_t> &command) {
+    _commands.push_back(command);
+}
+
+/**
+ * Emit the bind opcode stream for either the lazy or non-lazy imports, in the order they were added.
+ *
+ * Non-lazy binds are encoded as ld64 does: the symbol, ordinal, type and addend are only set when they change, and
+ * addresses are advanced relative to the previous bind. In compact mode, runs of evenly spaced binds of the same
+ * symbol are folded into DO_BIND_ULEB_TIMES_SKIPPING_ULEB, and address advances are folded into the preceding
+ * DO_BIND. Lazy binds are emitted as independent, DONE-terminated sequences.
+ */
+std::vector<uint8_t> macho_builder::encode_binds (bool lazy) const {
+    std::vector<uint8_t> out;
+    std::vector<const macho_builder_import *> binds;
+    for (const auto &import : _imports) {
+        if (import.lazy == lazy)
+            binds.push_back(&import);
+    }
+    
+    uint64_t ptr_size = pointer_size();
+    
+    auto put_ordinal = [&](int ordinal) {
+        if (ordinal <= 0)
+            out.push_back(BIND_OPCODE_SET_DYLIB_SPECIAL_IMM | (ordinal & BIND_IMMEDIATE_MASK));
+        else if (ordinal <= BIND_IMMEDIATE_MASK)
+            out.push_back(BIND_OPCODE_SET_DYLIB_ORDINAL_IMM | ordinal);
+        else {
+            out.push_back(BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB);
+            put_uleb128(out, ordinal);
+        }
+    };
+    
+    auto put_symbol = [&](const macho_builder_import &import) {
+        out.push_back(BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM | (import.flags & BIND_IMMEDIATE_MASK));
+        put_cstring(out, import.symbol);
+    };
+    
+    if (lazy) {
+        for (const auto *import : binds) {
+            out.push_back(BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB | 1);
+            put_uleb128(out, import->offset);
+            put_ordinal(import->ordinal);
+            put_symbol(*import);
+            out.push_back(BIND_OPCODE_DO_BIND);
+            out.push_back(BIND_OPCODE_DONE);
+        }
+        return out;
+    }
+    
+    auto same_decl = [](const macho_builder_import *a, const macho_builder_import *b) {
+        return a->ordinal == b->ordinal && a->symbol == b->symbol && a->flags == b->flags && a->addend == b->addend;
+    };
+    
+    const macho_builder_import *current = nullptr;
+    bool address_valid = false;
+    uint64_t address = 0;
+    
+    if (!binds.empty())
+        out.push_back(BIND_OPCODE_SET_TYPE_IMM | BIND_TYPE_POINTER);
+    
+    for (size_t i = 0; i < binds.size();) {
+        const macho_builder_import *import = binds[i];
+        
+        if (current == nullptr || current->ordinal != import->ordinal)
+            put_ordinal(import->ordinal);
+        
+        if (current == nullptr || current->symbol != import->symbol || current->flags != import->flags)
+            put_symbol(*import);
+        
+        if ((current == nullptr && import->addend != 0) || (current != nullptr && current->addend != import->addend)) {
+            out.push_back(BIND_OPCODE_SET_ADDEND_SLEB);
+            put_sleb128(out, import->addend);
+        }
+        
+        current = import;
+        
+        if (!address_valid || import->offset < address) {
+            out.push_back(BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB | 1);
+            put_uleb128(out, import->offset);
+        } else if (import->offset > address) {
+            out.push_back(BIND_OPCODE_ADD_ADDR_ULEB);
+            put_uleb128(out, import->offset - address);
+        }
+        address = import->offset;
+        address_valid = true;
+        
+        if (_compact) {
+            /* Find the run of evenly spaced binds of this declaration */
+            size_t count = 1;
+            uint64_t stride = 0;
+            while (i + count < binds.size() && same_decl(binds[i + count], import)) {
+                uint64_t prev = binds[i + count - 1]->offset;
+                uint64_t next = binds[i + count]->offset;
+                if (next < prev + ptr_size)
+                    break;
+                if (count == 1)
+                    stride = next - prev;
+                else if (next - prev != stride)
+                    break;
+                count++;
+            }
+            
+            if (count >= 3) {
+                out.push_back(BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB);
+                put_uleb128(out, count);
+                put_uleb128(out, stride - ptr_size);
+                address += count * stride;
+                i += count;
+                continue;
+            }
+            
+            /* Fold the advance to the next bind into this DO_BIND */
+            if (i + 1 < binds.size() && binds[i + 1]->offset > address + ptr_size) {
+                uint64_t delta = binds[i + 1]->offset - address - ptr_size;
+                if (delta % ptr_size == 0 && delta / ptr_size <= BIND_IMMEDIATE_MASK) {
+                    out.push_back(BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED | (uint8_t) (delta / ptr_size));
+                } else {
+                    out.push_back(BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB);
+                    put_uleb128(out, delta);
+                }
+                address += ptr_size + delta;
+                i++;
+                continue;
+            }
+        }
+        
+        out.push_back(BIND_OPCODE_DO_BIND);
+        address += ptr_size;
+        i++;
+    }
+    
+    out.push_back(BIND_OPCODE_DONE);
+    return out;
+}
+
+/**
+ * A node in an export trie under construction.
+ */
+struct trie_node {
+    /** Terminal export info, if this node names a symbol. */
+    bool terminal = false;
+    std::vector<uint8_t> info;
+    
+    /** Child edges, in insertion order. */
+    std::vector<std::pair<std::string, std::unique_ptr<trie_node>>> children;
+    
+    /** The node's offset within the serialized trie. */
+    uint64_t offset = 0;
+};
+
+/**
+ * Insert @a suffix into the trie rooted at @a node, splitting edges as required.
+ */
+static void trie_insert (trie_node *node, const std::string &suffix, const std::vector<uint8_t> &info) {
+    if (suffix.empty()) {
+        node->terminal = true;
+        node->info = info;
+        return;
+    }
+    
+    for (auto &child : node->children) {
+        const std::string &edge = child.first;
+        size_t common = 0;
+        while (common < edge.size() && common < suffix.size() && edge[common] == suffix[common])
+            common++;
+        
+        if (common == 0)
+            continue;
+        
+        if (common < edge.size()) {
+            /* Split the edge at the common prefix */
+            std::unique_ptr<trie_node> mid(new trie_node());
+            mid->children.push_back(std::make_pair(edge.substr(common), std::move(child.second)));
+            child.first = edge.substr(0, common);
+            child.second = std::move(mid);
+        }
+        
+        trie_insert(child.second.get(), suffix.substr(common), info);
+        return;
+    }
+    
+    std::unique_ptr<trie_node> leaf(new trie_node());
+    leaf->terminal = true;
+    leaf->info = info;
+    node->children.push_back(std::make_pair(suffix, std::move(leaf)));
+}
+
+/** Append @a node and its descendants to @a nodes, in preorder. */
+static void trie_flatten (trie_node *node, std::vector<trie_node *> &nodes) {
+    nodes.push_back(node);
+    for (auto &child : node->children)
+        trie_flatten(child.second.get(), nodes);
+}
+
+/** Serialize a single trie node, using the children's current offsets. */
+static void trie_encode_node (const trie_node *node, std::vector<uint8_t> &out) {
+    if (node->terminal) {
+        put_uleb128(out, node->info.size());
+        out.insert(out.end(), node->info.begin(), node->info.end());
+    } else {
+        out.push_back(0);
+    }
+    
+    out.push_back((uint8_t) node->children.size());
+    for (const auto &child : node->children) {
+        put_cstring(out, child.first);
+        put_uleb128(out, child.second->offset);
+    }
+}
+
+/**
+ * Emit the export trie.
+ */
+std::vector<uint8_t> macho_builder::encode_exports () const {
+    trie_node root;
+    for (const auto &exp : _exports) {
+        std::vector<uint8_t> info;
+        put_uleb128(info, exp.flags);
+        if (exp.flags & EXPORT_SYMBOL_FLAGS_REEXPORT) {
+            put_uleb128(info, exp.reexport_ordinal);
+            put_cstring(info, exp.reexport_name);
+        } else {
+            put_uleb128(info, exp.address);
+        }
+        
+        trie_insert(&root, exp.symbol, info);
+    }
+    
+    std::vector<trie_node *> nodes;
+    trie_flatten(&root, nodes);
+    
+    /* Node offsets depend on the ULEB128-encoded size of the child offsets; iterate until stable */
+    std::vector<uint8_t> out;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        out.clear();
+        for (auto *node : nodes) {
+            if (node->offset != out.size()) {
+                node->offset = out.size();
+                changed = true;
+            }
+            trie_encode_node(node, out);
+        }
+    }
+    
+    return out;
+}
+
+/** Chained fixup pointer layout for a single format. */
+struct chained_layout {
+    size_t ptr_size;
+    size_t stride;
+    uint32_t max_next;
+};
+
+static chained_layout chained_layout_for (macho_chained_ptr_format format) {
+    switch (format) {
+        case MACHO_CHAINED_PTR_ARM64E:
+        case MACHO_CHAINED_PTR_ARM64E_USERLAND:
+        case MACHO_CHAINED_PTR_ARM64E_USERLAND24:
+            return { 8, 8, 0x7FF };
+        case MACHO_CHAINED_PTR_64:
+        case MACHO_CHAINED_PTR_64_OFFSET:
+            return { 8, 4, 0xFFF };
+        case MACHO_CHAINED_PTR_32:
+            return { 4, 4, 0x1F };
+    }
+    
+    return { 8, 4, 0xFFF };
+}
+
+/**
+ * Emit the LC_DYLD_CHAINED_FIXUPS payload, and write the encoded chain pointers into @a data.
+ */
+std::vector<uint8_t> macho_builder::encode_chained_fixups (uint64_t data_vmaddr, uint64_t data_size, std::string &error) const {
+    chained_layout layout = chained_layout_for(_pointer_format);
+    
+    /* Build the imports table and symbol pool; the pool begins with an empty string, as emitted by ld64 */
+    std::vector<uint8_t> imports;
+    std::vector<uint8_t> symbols(1, '\0');
+    std::map<std::string, uint32_t> symbol_offsets;
+    std::map<std::tuple<int, std::string, bool, int64_t>, uint32_t> import_indices;
+    
+    struct fixup {
+        uint64_t offset;
+        bool bind;
+        uint32_t index;
+        int64_t addend;
+        uint64_t target;
+    };
+    std::vector<fixup> fixups;
+    
+    for (const auto &import : _imports) {
+        bool weak = (import.flags & BIND_SYMBOL_FLAGS_WEAK_IMPORT) != 0;
+        
+        /* The plain format has no table addend; the addend is stored inline in the fixup */
+        int64_t table_addend = (_import_format == MACHO_CHAINED_IMPORT_FORMAT) ? 0 : import.addend;
+        int64_t inline_addend = import.addend - table_addend;
+        
+        auto key = std::make_tuple(import.ordinal, import.symbol, weak, table_addend);
+        auto existing = import_indices.find(key);
+        uint32_t index;
+        
+        if (existing != import_indices.end()) {
+            index = existing->second;
+        } else {
+            index = (uint32_t) import_indices.size();
+            import_indices[key] = index;
+            
+            auto name = symbol_offsets.find(import.symbol);
+            uint32_t name_offset;
+            if (name == symbol_offsets.end()) {
+                name_offset = (uint32_t) symbols.size();
+                symbol_offsets[import.symbol] = name_offset;
+                put_cstring(symbols, import.symbol);
+            } else {
+                name_offset = name->second;
+            }
+            
+            switch (_import_format) {
+                case MACHO_CHAINED_IMPORT_FORMAT:
+                case MACHO_CHAINED_IMPORT_ADDEND_FORMAT:
+                    if (name_offset >= (1U << 23)) {
+                        error = "chained import name offset can not be represented";
+                        return {};
+                    }
+                    put_le<uint32_t>(imports, ((uint8_t) import.ordinal) | ((uint32_t) weak << 8) | (name_offset << 9));
+                    if (_import_format == MACHO_CHAINED_IMPORT_ADDEND_FORMAT)
+                        put_le<int32_t>(imports, (int32_t) table_addend);
+                    break;
+                    
+                case MACHO_CHAINED_IMPORT_ADDEND64_FORMAT:
+                    put_le<uint64_t>(imports, ((uint16_t) import.ordinal) | ((uint64_t) weak << 16) | ((uint64_t) name_offset << 32));
+                    put_le<int64_t>(imports, table_addend);
+                    break;
+            }
+        }
+        
+        fixups.push_back({ import.offset, true, index, inline_addend, 0 });
+    }
+    
+    for (const auto &rebase : _rebases)
+        fixups.push_back({ rebase.offset, false, 0, 0, rebase.target });
+    
+    std::sort(fixups.begin(), fixups.end(), [](const fixup &a, const fixup &b) { return a.offset < b.offset; });
+    
+    /* Lay out the chains: one chain per page, except where a 32-bit chain can not span the gap to the next fixup */
+    uint64_t page_count = round_up(data_size, _page_size) / _page_size;
+    std::vector<std::vector<uint16_t>> page_chains(page_count);
+    std::vector<uint32_t> next_delta(fixups.size(), 0);
+    
+    for (size_t i = 0; i < fixups.size(); i++) {
+        const fixup &f = fixups[i];
+        if (f.offset % layout.stride != 0 || f.offset + layout.ptr_size > data_size) {
+            error = "chained fixup is misaligned or outside __DATA";
+            return {};
+        }
+        
+        uint64_t page = f.offset / _page_size;
+        if ((f.offset % _page_size) + layout.ptr_size > _page_size) {
+            error = "chained fixup spans a page boundary";
+            return {};
+        }
+        
+        bool chained_from_prev = i > 0 && next_delta[i - 1] != 0;
+        if (!chained_from_prev)
+            page_chains[page].push_back((uint16_t) (f.offset % _page_size));
+        
+        if (i + 1 < fixups.size() && fixups[i + 1].offset / _page_size == page) {
+            uint64_t delta = (fixups[i + 1].offset - f.offset) / layout.stride;
+            if (delta <= layout.max_next)
+                next_delta[i] = (uint32_t) delta;
+            else if (layout.ptr_size == 8) {
+                error = "chained fixups are too far apart to be chained";
+                return {};
+            }
+        }
+    }
+    
+    /* Encode the chain pointers */
+    for (size_t i = 0; i < fixups.size(); i++) {
+        const fixup &f = fixups[i];
+        uint64_t next = next_delta[i];
+        uint64_t value;
+        
+        switch (_pointer_format) {
+            case MACHO_CHAINED_PTR_64:
+            case MACHO_CHAINED_PTR_64_OFFSET:
+                if (f.bind) {
+                    if (f.index > 0xFFFFFF || f.addend < 0 || f.addend > 0xFF) {
+                        error = "chained bind can not be represented";
+                        return {};
+                    }
+                    value = (1ULL << 63) | (next << 51) | ((uint64_t) f.addend << 24) | f.index;
+                } else {
+                    value = (next << 51) | (f.target & 0xFFFFFFFFFULL);
+                }
+                break;
+                
+            case MACHO_CHAINED_PTR_ARM64E:
+            case MACHO_CHAINED_PTR_ARM64E_USERLAND:
+            case MACHO_CHAINED_PTR_ARM64E_USERLAND24: {
+                uint32_t max_index = (_pointer_format == MACHO_CHAINED_PTR_ARM64E_USERLAND24) ? 0xFFFFFF : 0xFFFF;
+                if (f.bind) {
+                    if (f.index > max_index || f.addend < -(1 << 18) || f.addend >= (1 << 18)) {
+                        error = "chained bind can not be represented";
+                        return {};
+                    }
+                    value = (1ULL << 62) | (next << 51) | (((uint64_t) f.addend & 0x7FFFF) << 32) | f.index;
+                } else {
+                    value = (next << 51) | (f.target & 0x7FFFFFFFFFFULL);
+                }
+                break;
+            }
+                
+            case MACHO_CHAINED_PTR_32:
+                if (f.bind) {
+                    if (f.index > 0xFFFFF || f.addend < 0 || f.addend > 0x3F) {
+                        error = "chained bind can not be represented";
+                        return {};
+                    }
+                    value = (1U << 31) | (next << 26) | ((uint64_t) f.addend << 20) | f.index;
+                } else {
+                    value = (next << 26) | (f.target & 0x3FFFFFF);
+                }
+                break;
+                
+            default:
+                error = "unsupported chained pointer format";
+                return {};
+        }
+        
+        /* The chain values are written by build(); record them in the fixup's target */
+        fixups[i].target = value;
+    }
+    
+    /* Page starts, with the 32-bit multi-start overflow entries appended after the per-page array */
+    std::vector<uint16_t> page_starts(page_count, 0xFFFF);
+    std::vector<uint16_t> overflow;
+    for (uint64_t page = 0; page < page_count; page++) {
+        const auto &chains = page_chains[page];
+        if (chains.empty())
+            continue;
+        
+        if (chains.size() == 1) {
+            page_starts[page] = chains[0];
+            continue;
+        }
+        
+        page_starts[page] = 0x8000 | (uint16_t) (page_count + overflow.size());
+        for (size_t i = 0; i < chains.size(); i++)
+            overflow.push_back(chains[i] | ((i + 1 == chains.size()) ? 0x8000 : 0));
+    }
+    
+    /* dyld_chained_fixups_header */
+    std::vector<uint8_t> out;
+    put_le<uint32_t>(out, 0);   /* fixups_version */
+    put_le<uint32_t>(out, 0);   /* starts_offset */
+    put_le<uint32_t>(out, 0);   /* imports_offset */
+    put_le<uint32_t>(out, 0);   /* symbols_offset */
+    put_le<uint32_t>(out, (uint32_t) import_indices.size());
+    put_le<uint32_t>(out, _import_format);
+    put_le<uint32_t>(out, 0);   /* symbols_format */
+    pad_to(out, 8);
+    
+    /* dyld_chained_starts_in_image; only __DATA has fixups */
+    size_t starts_offset = out.size();
+    set_le<uint32_t>(out, 4, (uint32_t) starts_offset);
+    put_le<uint32_t>(out, 3);
+    put_le<uint32_t>(out, 0);
+    put_le<uint32_t>(out, 16);
+    put_le<uint32_t>(out, 0);
+    
+    /* dyld_chained_starts_in_segment */
+    put_le<uint32_t>(out, (uint32_t) (22 + 2 * (page_starts.size() + overflow.size())));
+    put_le<uint16_t>(out, (uint16_t) _page_size);
+    put_le<uint16_t>(out, (uint16_t) _pointer_format);
+    put_le<uint64_t>(out, data_vmaddr);
+    put_le<uint32_t>(out, 0);   /* max_valid_pointer */
+    put_le<uint16_t>(out, (uint16_t) page_count);
+    for (uint16_t start : page_starts)
+        put_le<uint16_t>(out, start);
+    for (uint16_t start : overflow)
+        put_le<uint16_t>(out, start);
+    
+    pad_to(out, (_import_format == MACHO_CHAINED_IMPORT_ADDEND64_FORMAT) ? 8 : 4);
+    set_le<uint32_t>(out, 8, (uint32_t) out.size());
+    out.insert(out.end(), imports.begin(), imports.end());
+    
+    set_le<uint32_t>(out, 12, (uint32_t) out.size());
+    out.insert(out.end(), symbols.begin(), symbols.end());
+    pad_to(out, 8);
+    
+    /* Append the encoded chain values; build() strips them and writes them into __DATA */
+    for (const auto &f : fixups) {
+        put_le<uint64_t>(out, f.offset);
+        put_le<uint64_t>(out, f.target);
+    }
+    put_le<uint64_t>(out, fixups.size());
+    
+    return out;
+}
+
+/**
+ * Emit the image.
+ *
+ * @throws std::runtime_error if the builder's configuration can not be encoded.
+ */
+std::vector<uint8_t> macho_builder::build () const {
+    size_t ptr_size = pointer_size();
+    size_t header_size = _is64 ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+    size_t seg_size = _is64 ? sizeof(struct segment_command_64) : sizeof(struct segment_command);
+    size_t sect_size = _is64 ? sizeof(struct section_64) : sizeof(struct section);
+    
+    /* __TEXT contents: __text, followed by the rebind rule strings in __cstring */
+    std::vector<uint8_t> cstrings;
+    std::vector<std::pair<uint64_t, uint64_t>> rule_strings;
+    for (const auto &rule : _rebind_rules) {
+        uint64_t symbol = cstrings.size();
+        put_cstring(cstrings, rule.symbol);
+        uint64_t image = cstrings.size();
+        put_cstring(cstrings, rule.image);
+        rule_strings.push_back(std::make_pair(symbol, image));
+    }
+    
+    bool has_rules = !_rebind_rules.empty();
+    uint32_t text_nsects = has_rules ? 2 : 1;
+    uint32_t data_nsects = has_rules ? 2 : 1;
+    
+    /* Size the load commands */
+    auto dylib_cmd_size = [&](const std::string &name) {
+        return (uint32_t) round_up(sizeof(struct dylib_command) + name.size() + 1, ptr_size);
+    };
+    
+    size_t cmds_size = 0;
+    uint32_t ncmds = 0;
+    
+    cmds_size += (seg_size + sect_size * text_nsects) + (seg_size + sect_size * data_nsects) + seg_size;
+    ncmds += 3;
+    
+    if (!_install_name.empty()) {
+        cmds_size += dylib_cmd_size(_install_name);
+        ncmds++;
+    }
+    
+    for (const auto &lib : _libraries) {
+        cmds_size += dylib_cmd_size(lib.first);
+        ncmds++;
+    }
+    
+    if (_has_uuid) {
+        cmds_size += sizeof(struct uuid_command);
+        ncmds++;
+    }
+    
+    if (_chained) {
+        cmds_size += 2 * sizeof(struct linkedit_data_command);
+        ncmds += 2;
+    } else {
+        cmds_size += sizeof(struct dyld_info_command);
+        ncmds++;
+    }
+    
+    for (const auto &cmd : _commands) {
+        cmds_size += cmd.size();
+        ncmds++;
+    }
+    
+    /* __TEXT layout */
+    uint64_t text_offset = round_up(header_size + cmds_size + _header_padding, 16);
+    uint64_t text_size = 16;
+    uint64_t cstring_offset = text_offset + text_size;
+    uint64_t text_segment_size = round_up(std::max<uint64_t>(cstring_offset + cstrings.size(), 1), _page_size);
+    
+    /* __DATA layout: import slots, followed by the rebind table */
+    size_t entry_size = ptr_size * 5;
+    uint64_t data_vmaddr = text_segment_size;
+    uint64_t rebind_offset = round_up(_next_offset, ptr_size);
+    uint64_t data_used = rebind_offset + (entry_size * _rebind_rules.size());
+    uint64_t data_segment_size = round_up(std::max<uint64_t>(data_used, 1), _page_size);
+    
+    /* __LINKEDIT contents */
+    std::string error;
+    std::vector<uint8_t> bind, lazy_bind, chained, chain_values;
+    std::vector<uint8_t> exports = encode_exports();
+    
+    if (_chained) {
+        chained = encode_chained_fixups(data_vmaddr, data_segment_size, error);
+        if (!error.empty())
+            throw std::runtime_error(error);
+        
+        /* Split off the trailing chain values */
+        uint64_t count;
+        memcpy(&count, &chained[chained.size() - 8], sizeof(count));
+        size_t values_size = (count * 16) + 8;
+        chain_values.assign(chained.end() - values_size, chained.end() - 8);
+        chained.resize(chained.size() - values_size);
+    } else {
+        bind = encode_binds(false);
+        lazy_bind = encode_binds(true);
+    }
+    
+    uint64_t linkedit_offset = data_vmaddr + data_segment_size;
+    std::vector<uint8_t> linkedit;
+    
+    auto append_linkedit = [&](const std::vector<uint8_t> &blob) {
+        uint64_t offset = linkedit_offset + linkedit.size();
+        linkedit.insert(linkedit.end(), blob.begin(), blob.end());
+        pad_to(linkedit, ptr_size);
+        return offset;
+    };
+    
+    uint64_t bind_off = 0, lazy_bind_off = 0, exports_off = 0, chained_off = 0;
+    if (_chained) {
+        chained_off = append_linkedit(chained);
+    } else {
+        bind_off = append_linkedit(bind);
+        lazy_bind_off = append_linkedit(lazy_bind);
+    }
+    exports_off = append_linkedit(exports);
+    
+    uint64_t linkedit_filesize = std::max<uint64_t>(linkedit.size(), ptr_size);
+    linkedit.resize(linkedit_filesize, 0);
+    
+    /* Emit the image */
+    std::vector<uint8_t> out;
+    out.reserve(linkedit_offset + linkedit_filesize);
+    
+    uint32_t flags = MH_DYLDLINK | MH_TWOLEVEL;
+    if (_is64) {
+        put_le<uint32_t>(out, MH_MAGIC_64);
+    } else {
+        put_le<uint32_t>(out, MH_MAGIC);
+    }
+    
+    cpu_subtype_t subtype = (_cputype == CPU_TYPE_X86 || _cputype == CPU_TYPE_X86_64) ? CPU_SUBTYPE_X86_ALL : 0;
+    put_le<int32_t>(out, _cputype);
+    put_le<int32_t>(out, subtype);
+    put_le<uint32_t>(out, _filetype);
+    put_le<uint32_t>(out, ncmds);
+    put_le<uint32_t>(out, (uint32_t) cmds_size);
+    put_le<uint32_t>(out, flags);
+    if (_is64)
+        put_le<uint32_t>(out, 0);
+    
+    auto put_name16 = [&](const char *name) {
+        char buf[16] = { 0 };
+        memcpy(buf, name, std::min(strlen(name), sizeof(buf)));
+        out.insert(out.end(), buf, buf + sizeof(buf));
+    };
+    
+    auto put_addr = [&](uint64_t value) {
+        if (_is64)
+            put_le<uint64_t>(out, value);
+        else
+            put_le<uint32_t>(out, (uint32_t) value);
+    };
+    
+    auto put_segment = [&](const char *name, uint64_t vmaddr, uint64_t vmsize, uint64_t fileoff, uint64_t filesize, vm_prot_t prot, uint32_t nsects) {
+        put_le<uint32_t>(out, _is64 ? LC_SEGMENT_64 : LC_SEGMENT);
+        put_le<uint32_t>(out, (uint32_t) (seg_size + sect_size * nsects));
+        put_name16(name);
+        put_addr(vmaddr);
+        put_addr(vmsize);
+        put_addr(fileoff);
+        put_addr(filesize);
+        put_le<int32_t>(out, prot);
+        put_le<int32_t>(out, prot);
+        put_le<uint32_t>(out, nsects);
+        put_le<uint32_t>(out, 0);
+    };
+    
+    auto put_section = [&](const char *sectname, const char *segname, uint64_t addr, uint64_t size, uint32_t align, uint32_t sflags) {
+        put_name16(sectname);
+        put_name16(segname);
+        put_addr(addr);
+        put_addr(size);
+        put_le<uint32_t>(out, (uint32_t) addr);     /* offset; vmaddr == fileoff */
+        put_le<uint32_t>(out, align);
+        put_le<uint32_t>(out, 0);
+        put_le<uint32_t>(out, 0);
+        put_le<uint32_t>(out, sflags);
+        put_le<uint32_t>(out, 0);
+        put_le<uint32_t>(out, 0);
+        if (_is64)
+            put_le<uint32_t>(out, 0);
+    };
+    
+    put_segment(SEG_TEXT, 0, text_segment_size, 0, text_segment_size, VM_PROT_READ | VM_PROT_EXECUTE, text_nsects);
+    put_section(SECT_TEXT, SEG_TEXT, text_offset, text_size, 4, S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS);
+    if (has_rules)
+        put_section("__cstring", SEG_TEXT, cstring_offset, cstrings.size(), 0, S_CSTRING_LITERALS);
+    
+    put_segment(SEG_DATA, data_vmaddr, data_segment_size, data_vmaddr, data_segment_size, VM_PROT_READ | VM_PROT_WRITE, data_nsects);
+    put_section(SECT_DATA, SEG_DATA, data_vmaddr, std::max<uint64_t>(rebind_offset, ptr_size), _is64 ? 3 : 2, 0);
+    if (has_rules)
+        put_section(XPF_REBIND_SECTION, SEG_DATA, data_vmaddr + rebind_offset, entry_size * _rebind_rules.size(), _is64 ? 3 : 2, 0);
+    
+    put_segment(SEG_LINKEDIT, linkedit_offset, round_up(linkedit_filesize, _page_size), linkedit_offset, linkedit_filesize, VM_PROT_READ, 0);
+    
+    auto put_dylib = [&](uint32_t cmd, const std::string &name) {
+        uint32_t size = dylib_cmd_size(name);
+        size_t start = out.size();
+        put_le<uint32_t>(out, cmd);
+        put_le<uint32_t>(out, size);
+        put_le<uint32_t>(out, sizeof(struct dylib_command));
+        put_le<uint32_t>(out, 2);               /* timestamp */
+        put_le<uint32_t>(out, 0x10000);         /* current_version */
+        put_le<uint32_t>(out, 0x10000);         /* compatibility_version */
+        put_cstring(out, name);
+        out.resize(start + size, 0);
+    };
+    
+    if (!_install_name.empty())
+        put_dylib(LC_ID_DYLIB, _install_name);
+    
+    for (const auto &lib : _libraries)
+        put_dylib(lib.second, lib.first);
+    
+    if (_has_uuid) {
+        put_le<uint32_t>(out, LC_UUID);
+        put_le<uint32_t>(out, sizeof(struct uuid_command));
+        out.insert(out.end(), _uuid, _uuid + sizeof(_uuid));
+    }
+    
+    if (_chained) {
+        put_le<uint32_t>(out, LC_DYLD_CHAINED_FIXUPS);
+        put_le<uint32_t>(out, sizeof(struct linkedit_data_command));
+        put_le<uint32_t>(out, (uint32_t) chained_off);
+        put_le<uint32_t>(out, (uint32_t) chained.size());
+        
+        put_le<uint32_t>(out, LC_DYLD_EXPORTS_TRIE);
+        put_le<uint32_t>(out, sizeof(struct linkedit_data_command));
+        put_le<uint32_t>(out, (uint32_t) exports_off);
+        put_le<uint32_t>(out, (uint32_t) exports.size());
+    } else {
+        put_le<uint32_t>(out, LC_DYLD_INFO_ONLY);
+        put_le<uint32_t>(out, sizeof(struct dyld_info_command));
+        put_le<uint32_t>(out, 0);
+        put_le<uint32_t>(out, 0);
+        put_le<uint32_t>(out, (uint32_t) bind_off);
+        put_le<uint32_t>(out, (uint32_t) bind.size());
+        put_le<uint32_t>(out, 0);
+        put_le<uint32_t>(out, 0);
+        put_le<uint32_t>(out, (uint32_t) lazy_bind_off);
+        put_le<uint32_t>(out, (uint32_t) lazy_bind.size());
+        put_le<uint32_t>(out, (uint32_t) exports_off);
+        put_le<uint32_t>(out, (uint32_t) exports.size());
+    }
+    
+    for (const auto &cmd : _commands)
+        out.insert(out.end(), cmd.begin(), cmd.end());
+    
+    /* __text: a single return instruction, padded with zeros */
+    out.resize(text_offset, 0);
+    out.push_back(0xC3);
+    out.resize(cstring_offset, 0);
+    out.insert(out.end(), cstrings.begin(), cstrings.end());
+    out.resize(data_vmaddr, 0);
+    
+    /* __DATA */
+    out.resize(linkedit_offset, 0);
+    for (size_t i = 0; i < chain_values.size(); i += 16) {
+        uint64_t offset, value;
+        memcpy(&offset, &chain_values[i], sizeof(offset));
+        memcpy(&value, &chain_values[i + 8], sizeof(value));
+        memcpy(&out[data_vmaddr + offset], &value, ptr_size);
+    }
+    
+    for (size_t i = 0; i < _rebind_rules.size(); i++) {
+        uint64_t entry = data_vmaddr + rebind_offset + (i * entry_size);
+        uint64_t symbol = cstring_offset + rule_strings[i].first;
+        uint64_t image = cstring_offset + rule_strings[i].second;
+        
+        /* symbol, symbol_hash (padded to pointer alignment), image, original, replacement */
+        memcpy(&out[entry], &symbol, ptr_size);
+        memcpy(&out[entry + (ptr_size * 2)], &image, ptr_size);
+        if (_rebind_rules[i].original)
+            memcpy(&out[entry + (ptr_size * 3)], &data_vmaddr, ptr_size);
+        memcpy(&out[entry + (ptr_size * 4)], &text_offset, ptr_size);
+    }
+    
+    out.insert(out.end(), linkedit.begin(), linkedit.end());
+    return out;
+}
+
+/**
+ * Emit a universal binary containing @a slices, in order. Slices are aligned to 4KiB.
+ *
+ * @param slices The CPU type and image data of each slice.
+ * @param fat64 If true, emit a FAT_MAGIC_64 header.
+ */
+std::vector<uint8_t> macho_build_fat (const std::vector<std::pair<cpu_type_t, std::vector<uint8_t>>> &slices, bool fat64) {
+    const uint32_t align = 12;
+    std::vector<uint8_t> out;
+    
+    put_be32(out, fat64 ? FAT_MAGIC_64 : FAT_MAGIC);
+    put_be32(out, (uint32_t) slices.size());
+    
+    uint64_t offset = round_up(8 + slices.size() * (fat64 ? sizeof(struct fat_arch_64) : sizeof(struct fat_arch)), 1 << align);
+    std::vector<uint64_t> offsets;
+    
+    for (const auto &slice : slices) {
+        int32_t subtype;
+        memcpy(&subtype, &slice.second[8], sizeof(subtype));
+        
+        put_be32(out, (uint32_t) slice.first);
+        put_be32(out, (uint32_t) subtype);
+        if (fat64) {
+            put_be64(out, offset);
+            put_be64(out, slice.second.size());
+            put_be32(out, align);
+            put_be32(out, 0);
+        } else {
+            put_be32(out, (uint32_t) offset);
+            put_be32(out, (uint32_t) slice.second.size());
+            put_be32(out, align);
+        }
+        
+        offsets.push_back(offset);
+        offset = round_up(offset + slice.second.size(), 1 << align);
+    }
+    
+    for (size_t i = 0; i < slices.size(); i++) {
+        out.resize(offsets[i], 0);
+        out.insert(out.end(), slices[i].second.begin(), slices[i].second.end());
+    }
+    
+    return out;
+}
+
+/** Return the install name of synthetic library @a index. */
+std::string macho_synthetic_library (size_t index) {
+    return "/usr/lib/libsynthetic" + std::to_string(index) + ".dylib";
+}
+
+/** Return the name of synthetic symbol @a index. */
+std::string macho_synthetic_symbol (size_t index) {
+    return "_synthetic_symbol_" + std::to_string(index);
+}
+
+/**
+ * Generate a synthetic image with the import shape described by @a config.
+ *
+ * Symbol i is imported from library (i % libraries); the first min(sites, symbols) bind sites bind each symbol in turn,
+ * and the remaining sites bind pseudo-randomly chosen symbols, sorted by symbol as ld64 emits them.
+ */
+std::vector<uint8_t> macho_synthesize (const macho_synthetic_config &config) {
+    macho_builder builder(config.cputype, MH_DYLIB);
+    builder.set_install_name("/usr/lib/libsynthetic.dylib");
+    builder.set_compact_binds(config.compact);
+    
+    size_t libraries = std::max<size_t>(config.libraries, 1);
+    size_t symbols = std::max<size_t>(config.symbols, 1);
+    
+    for (size_t i = 0; i < libraries; i++)
+        builder.add_library(macho_synthetic_library(i));
+    
+    std::vector<size_t> sites;
+    sites.reserve(config.sites);
+    
+    uint32_t state = config.seed;
+    for (size_t i = 0; i < config.sites; i++) {
+        if (i < symbols) {
+            sites.push_back(i);
+        } else {
+            state = state * 1103515245 + 12345;
+            sites.push_back((state >> 8) % symbols);
+        }
+    }
+    std::stable_sort(sites.begin(), sites.end(), [libraries](size_t a, size_t b) {
+        return std::make_pair(a % libraries, a) < std::make_pair(b % libraries, b);
+    });
+    
+    for (size_t symbol : sites)
+        builder.add_import((int) (symbol % libraries) + 1, macho_synthetic_symbol(symbol), 0, config.lazy);
+    
+    return builder.build();
+}
+
+} /* namespace test */
+} /* namespace xpf */
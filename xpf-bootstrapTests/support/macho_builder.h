@@ -0,0 +1,243 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <mach-o/loader.h>
+
+#include <string>
+#include <vector>
+
+namespace xpf {
+namespace test {
+
+/** Chained fixup pointer formats; these match the DYLD_CHAINED_PTR_* constants. */
+enum macho_chained_ptr_format {
+    MACHO_CHAINED_PTR_ARM64E = 1,
+    MACHO_CHAINED_PTR_64 = 2,
+    MACHO_CHAINED_PTR_32 = 3,
+    MACHO_CHAINED_PTR_64_OFFSET = 6,
+    MACHO_CHAINED_PTR_ARM64E_USERLAND = 9,
+    MACHO_CHAINED_PTR_ARM64E_USERLAND24 = 12
+};
+
+/** Chained fixup imports table formats; these match the DYLD_CHAINED_IMPORT* constants. */
+enum macho_chained_import_format {
+    MACHO_CHAINED_IMPORT_FORMAT = 1,
+    MACHO_CHAINED_IMPORT_ADDEND_FORMAT = 2,
+    MACHO_CHAINED_IMPORT_ADDEND64_FORMAT = 3
+};
+
+/**
+ * A single bound import.
+ */
+struct macho_builder_import {
+    /** The library ordinal, or one of the BIND_SPECIAL_DYLIB_* constants. */
+    int ordinal;
+    
+    /** The symbol name. */
+    std::string symbol;
+    
+    /** BIND_SYMBOL_FLAGS_* */
+    uint8_t flags;
+    
+    /** The addend applied to the bound address. */
+    int64_t addend;
+    
+    /** The offset of the bound pointer within __DATA. */
+    uint64_t offset;
+    
+    /** If true, the import is bound lazily; ignored when emitting chained fixups. */
+    bool lazy;
+};
+
+/**
+ * A single exported symbol.
+ */
+struct macho_builder_export {
+    /** The symbol name. */
+    std::string symbol;
+    
+    /** EXPORT_SYMBOL_FLAGS_*; if EXPORT_SYMBOL_FLAGS_REEXPORT is set, the address is ignored. */
+    uint64_t flags;
+    
+    /** The symbol's address, relative to the mach header. */
+    uint64_t address;
+    
+    /** For re-exports, the ordinal of the library from which the symbol is re-exported. */
+    uint64_t reexport_ordinal;
+    
+    /** For re-exports, the symbol's name within the re-exporting library, or an empty string if unchanged. */
+    std::string reexport_name;
+};
+
+/**
+ * Generates Mach-O images for use as test fixtures and benchmark inputs.
+ *
+ * Images have a __TEXT, __DATA, and __LINKEDIT segment, in that order; each segment's vmaddr is equal to its file
+ * offset, allowing a built image to be mapped as-is, with the mapping address as its vmaddr slide. Imports are
+ * bound via either LC_DYLD_INFO_ONLY opcode streams, or LC_DYLD_CHAINED_FIXUPS.
+ */
+class macho_builder {
+public:
+    macho_builder (cpu_type_t cputype, uint32_t filetype);
+    
+    void set_install_name (const std::string &install_name);
+    void set_uuid (const uint8_t uuid[16]);
+    void set_page_size (uint32_t page_size);
+    void set_header_padding (uint32_t padding);
+    void set_compact_binds (bool compact);
+    void set_chained_fixups (macho_chained_ptr_format pointer_format, macho_chained_import_format import_format);
+    
+    uint32_t add_library (const std::string &install_name, uint32_t cmd = LC_LOAD_DYLIB);
+    uint64_t add_import (int ordinal, const std::string &symbol, uint8_t flags = 0, bool lazy = false, int64_t addend = 0);
+    void add_import_at (uint64_t offset, int ordinal, const std::string &symbol, uint8_t flags = 0, bool lazy = false, int64_t addend = 0);
+    void add_rebase (uint64_t offset, uint64_t target);
+    void add_export (const std::string &symbol, uint64_t address, uint64_t flags = EXPORT_SYMBOL_FLAGS_KIND_REGULAR);
+    void add_reexport (const std::string &symbol, uint64_t ordinal, const std::string &reexport_name = "");
+    void add_rebind_rule (const std::string &symbol, const std::string &image, bool original = false);
+    void add_load_command (const std::vector<uint8_t> &command);
+    
+    /** Return true if this builder emits a 64-bit image. */
+    bool is64 () const { return _is64; }
+    
+    /** Return the size of a pointer in the emitted image. */
+    size_t pointer_size () const { return _is64 ? 8 : 4; }
+    
+    /** Return all imports, in the order they were added. */
+    const std::vector<macho_builder_import> &imports () const { return _imports; }
+    
+    std::vector<uint8_t> build () const;
+
+private:
+    /** A single chained rebase fixup. */
+    struct rebase {
+        uint64_t offset;
+        uint64_t target;
+    };
+    
+    /** A single XPF_REBIND_ENTRY() */
+    struct rebind_rule {
+        std::string symbol;
+        std::string image;
+        bool original;
+    };
+    
+    std::vector<uint8_t> encode_binds (bool lazy) const;
+    std::vector<uint8_t> encode_exports () const;
+    std::vector<uint8_t> encode_chained_fixups (uint64_t data_vmaddr, uint64_t data_size, std::string &error) const;
+    
+    /** The image's CPU type. */
+    cpu_type_t _cputype;
+    
+    /** The image's file type. */
+    uint32_t _filetype;
+    
+    /** True if the image is 64-bit. */
+    bool _is64;
+    
+    /** Segment alignment. */
+    uint32_t _page_size;
+    
+    /** Minimum free space following the load commands, as reserved by ld64's -headerpad. */
+    uint32_t _header_padding;
+    
+    /** If true, repeated binds are folded into the compact DO_BIND_* opcodes. */
+    bool _compact;
+    
+    /** If true, imports are bound via LC_DYLD_CHAINED_FIXUPS. */
+    bool _chained;
+    macho_chained_ptr_format _pointer_format;
+    macho_chained_import_format _import_format;
+    
+    /** LC_ID_DYLIB install name, or an empty string. */
+    std::string _install_name;
+    
+    /** LC_UUID, if any. */
+    bool _has_uuid;
+    uint8_t _uuid[16];
+    
+    /** Dependent libraries and their load commands, in ordinal order. */
+    std::vector<std::pair<std::string, uint32_t>> _libraries;
+    
+    /** Bound imports. */
+    std::vector<macho_builder_import> _imports;
+    
+    /** Chained rebases. */
+    std::vector<rebase> _rebases;
+    
+    /** Exported symbols. */
+    std::vector<macho_builder_export> _exports;
+    
+    /** __DATA,__xpf_rebind entries. */
+    std::vector<rebind_rule> _rebind_rules;
+    
+    /** Additional raw load commands. */
+    std::vector<std::vector<uint8_t>> _commands;
+    
+    /** The next unassigned __DATA offset for add_import(). */
+    uint64_t _next_offset;
+};
+
+std::vector<uint8_t> macho_build_fat (const std::vector<std::pair<cpu_type_t, std::vector<uint8_t>>> &slices, bool fat64 = false);
+
+/**
+ * Parameters of a synthetic image; see macho_synthesize().
+ */
+struct macho_synthetic_config {
+    /** The image's CPU type. */
+    cpu_type_t cputype = CPU_TYPE_X86_64;
+    
+    /** Number of dependent libraries; imports are distributed round-robin across libraries. */
+    size_t libraries = 16;
+    
+    /** Number of distinct imported symbols. */
+    size_t symbols = 512;
+    
+    /** Number of bind sites; every symbol is bound at least once if sites >= symbols. */
+    size_t sites = 2048;
+    
+    /** If true, all binds are emitted in the lazy bind stream; otherwise, all binds are non-lazy. */
+    bool lazy = false;
+    
+    /** If true, repeated binds are folded into the compact DO_BIND_* opcodes. */
+    bool compact = false;
+    
+    /** Seed for the pseudo-random assignment of symbols to bind sites. */
+    uint32_t seed = 1;
+};
+
+std::string macho_synthetic_library (size_t index);
+std::string macho_synthetic_symbol (size_t index);
+std::vector<uint8_t> macho_synthesize (const macho_synthetic_config &config);
+
+} /* namespace test */
+} /* namespace xpf */
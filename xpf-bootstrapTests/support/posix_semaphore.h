@@ -0,0 +1,92 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <time.h>
+
+namespace xpf {
+namespace test {
+
+/**
+ * block_completion semaphore operations backed by POSIX semaphores, standing in for dispatch semaphores on non-Darwin
+ * hosts; timeouts are relative, in nanoseconds.
+ */
+struct posix_semaphore {
+    typedef sem_t *type;
+    typedef uint64_t timeout;
+    
+    /** Timeout value that never expires */
+    static constexpr timeout FOREVER = UINT64_MAX;
+    
+    static type create () {
+        sem_t *sema = new sem_t;
+        sem_init(sema, 0, 0);
+        return sema;
+    }
+    
+    static void release (type sema) {
+        sem_destroy(sema);
+        delete sema;
+    }
+    
+    static void signal (type sema) { sem_post(sema); }
+    
+    static bool wait (type sema, timeout t) {
+        if (t == FOREVER) {
+            wait_forever(sema);
+            return true;
+        }
+        
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = (uint64_t) deadline.tv_nsec + t;
+        deadline.tv_sec += (time_t) (ns / 1000000000ULL);
+        deadline.tv_nsec = (long) (ns % 1000000000ULL);
+        
+        while (sem_timedwait(sema, &deadline) != 0) {
+            if (errno != EINTR)
+                return false;
+        }
+        
+        return true;
+    }
+    
+    static void wait_forever (type sema) {
+        while (sem_wait(sema) != 0 && errno == EINTR)
+            continue;
+    }
+    
+    static bool is_now (timeout t) { return t == 0; }
+};
+
+} /* namespace test */
+} /* namespace xpf */
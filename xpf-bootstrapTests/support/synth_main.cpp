@@ -0,0 +1,125 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * xpf-synth
+ *
+ * Writes a synthetic Mach-O dylib with a configurable import shape, for use as a benchmark input or as a test
+ * fixture for the offline tools.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <stdexcept>
+
+#include "macho_builder.h"
+
+using namespace xpf::test;
+
+static void print_usage (const char *progname) {
+    fprintf(stderr, "Usage: %s [-a <arch>] [-l <libraries>] [-s <symbols>] [-n <sites>] [-r <seed>] [-z] [-c] <output>\n", progname);
+    fprintf(stderr, "  -a <arch>       x86_64 (default), i386, or arm64\n");
+    fprintf(stderr, "  -l <count>      Number of dependent libraries (default: 16)\n");
+    fprintf(stderr, "  -s <count>      Number of distinct imported symbols (default: 512)\n");
+    fprintf(stderr, "  -n <count>      Number of bind sites (default: 2048)\n");
+    fprintf(stderr, "  -r <seed>       Seed for the assignment of symbols to bind sites (default: 1)\n");
+    fprintf(stderr, "  -z              Emit all binds as lazy binds\n");
+    fprintf(stderr, "  -c              Fold repeated binds into compact bind opcodes\n");
+}
+
+int main (int argc, char * const argv[]) {
+    const char *progname = argv[0];
+    macho_synthetic_config config;
+    int ch;
+    
+    while ((ch = getopt(argc, argv, "a:l:s:n:r:zch")) != -1) {
+        switch (ch) {
+            case 'a':
+                if (strcmp(optarg, "x86_64") == 0) {
+                    config.cputype = CPU_TYPE_X86_64;
+                } else if (strcmp(optarg, "i386") == 0) {
+                    config.cputype = CPU_TYPE_X86;
+                } else if (strcmp(optarg, "arm64") == 0) {
+                    config.cputype = CPU_TYPE_ARM64;
+                } else {
+                    fprintf(stderr, "xpf-synth: unsupported architecture %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'l':
+                config.libraries = strtoul(optarg, nullptr, 10);
+                break;
+            case 's':
+                config.symbols = strtoul(optarg, nullptr, 10);
+                break;
+            case 'n':
+                config.sites = strtoul(optarg, nullptr, 10);
+                break;
+            case 'r':
+                config.seed = (uint32_t) strtoul(optarg, nullptr, 10);
+                break;
+            case 'z':
+                config.lazy = true;
+                break;
+            case 'c':
+                config.compact = true;
+                break;
+            case 'h':
+            default:
+                print_usage(progname);
+                return (ch == 'h') ? 0 : 1;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    
+    if (argc != 1) {
+        print_usage(progname);
+        return 1;
+    }
+    
+    std::vector<uint8_t> image;
+    try {
+        image = macho_synthesize(config);
+    } catch (const std::runtime_error &e) {
+        fprintf(stderr, "xpf-synth: %s\n", e.what());
+        return 1;
+    }
+    
+    std::ofstream stream(argv[0], std::ios::binary);
+    if (!stream || !stream.write((const char *) image.data(), image.size())) {
+        fprintf(stderr, "xpf-synth: %s: could not write image\n", argv[0]);
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "trace.h"
+
+using namespace xpf;
+
+namespace {
+
+/**
+ * Runs @a fn in a forked child with XPF_TRACE set to a path within a temporary directory, and reads back the
+ * trace written by the child; tracing state is process-global, and may only be initialized once per process.
+ */
+class TraceTest : public ::testing::Test {
+protected:
+    void SetUp () override {
+        char dir[] = "/tmp/xpf-trace.XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        _dir = dir;
+    }
+    
+    void TearDown () override {
+        unlink(_output.c_str());
+        rmdir(_dir.c_str());
+    }
+    
+    /** Run @a fn in a traced child process, returning its wait status. */
+    template <typename Fn> int run (Fn &&fn) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            setenv("XPF_TRACE", (_dir + "/trace.json").c_str(), 1);
+            trace_init();
+            fn();
+            exit(0);
+        }
+        
+        int status = 0;
+        EXPECT_EQ(waitpid(pid, &status, 0), pid);
+        _pid = pid;
+        _output = _dir + "/trace." + std::to_string(pid) + ".json";
+        return status;
+    }
+    
+    /** Return the contents of the child's trace, or an empty string if not written. */
+    std::string trace () {
+        std::ifstream in(_output);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        return contents.str();
+    }
+    
+    std::string _dir;
+    std::string _output;
+    pid_t _pid;
+};
+
+} /* anonymous namespace */
+
+/* Spans are written to a per-process path, with hand-formatted timestamps */
+TEST_F(TraceTest, Write) {
+    int status = run([] {
+        trace_span span("test-span", "detail \"quoted\"\n");
+    });
+    ASSERT_TRUE(WIFEXITED(status));
+    
+    std::string contents = trace();
+    ASSERT_FALSE(contents.empty()) << _output;
+    
+    EXPECT_NE(contents.find("\"name\":\"test-span\""), std::string::npos) << contents;
+    EXPECT_NE(contents.find("\"detail\":\"detail \\\"quoted\\\"\\u000a\""), std::string::npos) << contents;
+    EXPECT_NE(contents.find("\"pid\":" + std::to_string(_pid)), std::string::npos) << contents;
+    EXPECT_TRUE(std::regex_search(contents, std::regex("\"ts\":[0-9]+\\.[0-9]{3},\"dur\":[0-9]+\\.[0-9]{3},"))) << contents;
+    EXPECT_NE(contents.find("\"dropped\":0,\"buffers\":1}"), std::string::npos) << contents;
+}
+
+/* Buffers of exited threads are reused by later threads, and each span records its own thread */
+TEST_F(TraceTest, ReuseBuffers) {
+    static constexpr size_t THREADS = 8;
+    int status = run([] {
+        for (size_t i = 0; i < THREADS; i++)
+            std::thread([] { trace_span span("thread-span"); }).join();
+    });
+    ASSERT_TRUE(WIFEXITED(status));
+    
+    std::string contents = trace();
+    EXPECT_NE(contents.find("\"buffers\":1}"), std::string::npos) << contents;
+    
+    std::set<std::string> tids;
+    std::regex tid("\"tid\":([0-9]+)");
+    for (auto it = std::sregex_iterator(contents.begin(), contents.end(), tid); it != std::sregex_iterator(); ++it)
+        tids.insert((*it)[1]);
+    EXPECT_EQ(tids.size(), THREADS);
+}
+
+/* The trace is written from the SIGTERM handler */
+TEST_F(TraceTest, Signal) {
+    int status = run([] {
+        { trace_span span("before-signal"); }
+        raise(SIGTERM);
+    });
+    ASSERT_TRUE(WIFSIGNALED(status));
+    EXPECT_EQ(WTERMSIG(status), SIGTERM);
+    EXPECT_NE(trace().find("\"name\":\"before-signal\""), std::string::npos);
+}
@@ -0,0 +1,208 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * xpf-prepatch
+ *
+ * Applies xpf-bootstrap's bind opcode rewrites to a Mach-O binary ahead of time, writing the patched binary
+ * and a manifest of all changes. Prepatched images are marked with an XPF_LC_PREPATCHED command; xpf-bootstrap
+ * skips their bind opcode rewriting at runtime, and also skips rebinding if all rebind table imports were
+ * redirected to a shim library.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "prepatch.h"
+
+using namespace xpf;
+
+/**
+ * Write @a size bytes of @a data to @a path, via a temporary file that is renamed into place.
+ */
+static bool write_file (const std::string &path, const void *data, size_t size, mode_t mode, std::string &error) {
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd < 0) {
+        error = std::string("open() failed: ") + strerror(errno);
+        return false;
+    }
+    
+    const uint8_t *p = (const uint8_t *) data;
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            
+            error = std::string("write() failed: ") + strerror(errno);
+            close(fd);
+            unlink(tmp.c_str());
+            return false;
+        }
+        
+        p += written;
+        size -= written;
+    }
+    
+    if (close(fd) != 0 || rename(tmp.c_str(), path.c_str()) != 0) {
+        error = std::string("failed to write file: ") + strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Format the manifest for @a changes.
+ */
+static std::string format_manifest (const prepatch_options &options, const char *input, const char *output, const std::vector<prepatch_change> &changes) {
+    static const char *stream_names[] = { "bind", "weak-bind", "lazy-bind", "chained" };
+    static const char *kind_names[] = { "weak", "redirect" };
+    char hash[16];
+    
+    snprintf(hash, sizeof(hash), "0x%08x", options.rules_hash);
+    
+    std::string manifest = "# xpf-prepatch manifest\n";
+    manifest += std::string("input ") + input + "\n";
+    manifest += std::string("output ") + output + "\n";
+    manifest += std::string("rules-hash ") + hash + "\n";
+    if (!options.shim.empty())
+        manifest += "shim " + options.shim + "\n";
+    
+    for (auto &&change : changes) {
+        manifest += std::string(macho_arch_name(change.cputype)) + " " + kind_names[change.kind] + " " + stream_names[change.stream] + " " +
+            change.symbol + " (" + change.library + ")\n";
+    }
+    
+    return manifest;
+}
+
+static void print_usage (const char *progname) {
+    fprintf(stderr, "Usage: %s -b <xpf-bootstrap binary> [-S <shim library>] [-m <manifest>] <input> <output>\n", progname);
+    fprintf(stderr, "  -b <path>   xpf-bootstrap binary from which rebind rules will be read\n");
+    fprintf(stderr, "  -S <path>   Built shim library to which rebind table symbols will be redirected, via its install name;\n");
+    fprintf(stderr, "              without a shim, rebind table symbols are left for xpf-bootstrap to rebind at runtime\n");
+    fprintf(stderr, "  -m <path>   Manifest path (default: <output>.xpf-manifest)\n");
+}
+
+int main (int argc, char * const argv[]) {
+    const char *progname = argv[0];
+    const char *bootstrap = nullptr;
+    const char *shim = nullptr;
+    std::string manifest_path;
+    prepatch_options options;
+    int ch;
+    
+    while ((ch = getopt(argc, argv, "b:S:m:h")) != -1) {
+        switch (ch) {
+            case 'b':
+                bootstrap = optarg;
+                break;
+                
+            case 'S':
+                shim = optarg;
+                break;
+                
+            case 'm':
+                manifest_path = optarg;
+                break;
+                
+            case 'h':
+            default:
+                print_usage(progname);
+                return 2;
+        }
+    }
+    
+    argc -= optind;
+    argv += optind;
+    
+    if (bootstrap == nullptr || argc != 2) {
+        print_usage(progname);
+        return 2;
+    }
+    
+    const char *input = argv[0];
+    const char *output = argv[1];
+    if (manifest_path.empty())
+        manifest_path = std::string(output) + ".xpf-manifest";
+    
+    /* Load the rebind rules */
+    std::string error;
+    if (!analyze_load_rebind_rules(bootstrap, options.rules, error)) {
+        fprintf(stderr, "xpf-prepatch: %s: %s\n", bootstrap, error.c_str());
+        return 1;
+    }
+    options.rules_hash = prepatch_rules_hash(options.rules);
+    
+    /* Load the shim library, if any */
+    if (shim != nullptr && !prepatch_load_shim(shim, options, error)) {
+        fprintf(stderr, "xpf-prepatch: %s: %s\n", shim, error.c_str());
+        return 1;
+    }
+    
+    /* Patch the input */
+    mapped_file file;
+    struct stat sb;
+    if (!file.map(input, error) || stat(input, &sb) != 0) {
+        fprintf(stderr, "xpf-prepatch: %s: %s\n", input, error.empty() ? strerror(errno) : error.c_str());
+        return 1;
+    }
+    
+    std::vector<uint8_t> patched;
+    std::vector<prepatch_change> changes;
+    if (!prepatch_file(options, file.data(), file.size(), patched, changes, error)) {
+        fprintf(stderr, "xpf-prepatch: %s: %s\n", input, error.c_str());
+        return 1;
+    }
+    
+    /* Write the results */
+    if (!write_file(output, patched.data(), patched.size(), sb.st_mode & 0777, error)) {
+        fprintf(stderr, "xpf-prepatch: %s: %s\n", output, error.c_str());
+        return 1;
+    }
+    
+    std::string manifest = format_manifest(options, input, output, changes);
+    if (!write_file(manifest_path, manifest.data(), manifest.size(), 0644, error)) {
+        fprintf(stderr, "xpf-prepatch: %s: %s\n", manifest_path.c_str(), error.c_str());
+        return 1;
+    }
+    
+    return 0;
+}
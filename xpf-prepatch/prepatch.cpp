@@ -0,0 +1,835 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "prepatch.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <tuple>
+
+#include <PLPatchMaster/SymbolName.hpp>
+
+#include "rebind_table.h"
+#include "weak_table.h"
+#include "prepatch_marker.h"
+#include "macho_chained.h"
+#include "sdk_index.h"
+
+namespace xpf {
+
+/** Alignment of segment VM sizes; the larger of the x86 and arm64 page sizes. */
+static constexpr uint64_t PREPATCH_VM_PAGE_SIZE = 0x4000;
+
+/** Default fat slice alignment (as a power of 2), used for slices without a declared alignment. */
+static constexpr uint32_t PREPATCH_FAT_DEFAULT_ALIGN = 12;
+
+/**
+ * A bind evaluated from the input image. Unlike macho_bind, all strings are owned, as the image's data
+ * will be modified while the records are live.
+ */
+struct prepatch_bind {
+    prepatch_bind (const macho_bind &b) : stream(b.stream), ordinal(b.ordinal), library(b.library), symbol(b.symbol),
+        flags(b.flags), type(b.type), addend(b.addend), address(b.address), segment(b.segment),
+        symbol_opcode_offset(b.symbol_opcode_offset), ordinal_opcode_offset(b.ordinal_opcode_offset),
+        ordinal_opcode_size(b.ordinal_opcode_size), redirect(false) {}
+    
+    macho_bind_stream stream;
+    int64_t ordinal;
+    std::string library;
+    std::string symbol;
+    uint8_t flags;
+    uint8_t type;
+    int64_t addend;
+    uint64_t address;
+    uint8_t segment;
+    uint64_t symbol_opcode_offset;
+    uint64_t ordinal_opcode_offset;
+    uint32_t ordinal_opcode_size;
+    
+    /** If true, this bind is to be redirected to the shim library. */
+    bool redirect;
+};
+
+/**
+ * Compute the xpf_rules_hash() of @a rules and our weak symbol table.
+ *
+ * This must produce identical results to xpf-bootstrap's xpf_rules_hash() in its default
+ * (non-XPF_PRESERVE_LINKEDIT) configuration.
+ */
+uint32_t prepatch_rules_hash (const std::vector<analyze_rebind_rule> &rules) {
+    uint32_t h = 2166136261U;
+    
+    for (auto &&rule : rules) {
+        h = xpf_hash_append(h, rule.symbol.c_str());
+        h = xpf_hash_append(h, rule.image.c_str());
+    }
+    
+    for (size_t i = 0; i < sizeof(xpf_weak_symbols) / sizeof(xpf_weak_symbols[0]); i++) {
+        h = xpf_hash_append(h, xpf_weak_symbols[i].library);
+        h = xpf_hash_append(h, xpf_weak_symbols[i].symbol);
+    }
+    
+    h = xpf_hash_append(h, "");
+    
+    return h;
+}
+
+/**
+ * Load the shim library at @a path, configuring @a options to redirect rebind table imports to the shim's
+ * install name.
+ *
+ * @param path The path of the built shim library.
+ * @param options The prepatch configuration to be updated.
+ * @param error On failure, a description of the error.
+ */
+bool prepatch_load_shim (const std::string &path, prepatch_options &options, std::string &error) {
+    mapped_file file;
+    if (!file.map(path, error))
+        return false;
+    
+    std::vector<macho_slice> slices;
+    if (!macho_slices(file.data(), file.size(), slices, error))
+        return false;
+    
+    macho_file_image image;
+    if (!image.parse(file.data() + slices[0].offset, slices[0].size, error))
+        return false;
+    
+    if (image.install_name().empty()) {
+        error = "shim library has no LC_ID_DYLIB command";
+        return false;
+    }
+    
+    options.shim = image.install_name();
+    options.shim_path = path;
+    return true;
+}
+
+/**
+ * Verify that every bind in @a binds that is to be redirected is exported by the @a cputype slice of the shim
+ * library.
+ */
+static bool verify_shim_exports (const prepatch_options &options, cpu_type_t cputype, const std::vector<prepatch_bind> &binds, std::string &error) {
+    library_exports exports;
+    bool loaded = false;
+    
+    for (auto &&bind : binds) {
+        if (!bind.redirect)
+            continue;
+        
+        if (!loaded) {
+            if (options.shim_path.empty()) {
+                error = "no shim library was provided to verify redirected imports against";
+                return false;
+            }
+            
+            if (!library_exports_load_macho(options.shim_path, cputype, exports, error)) {
+                error = options.shim_path + ": " + error;
+                return false;
+            }
+            
+            loaded = true;
+        }
+        
+        if (exports.symbols.count(bind.symbol) == 0) {
+            error = "shim library " + options.shim_path + " does not export " + bind.symbol;
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Append the ULEB128 encoding of @a value to @a out, padded to at least @a min_size bytes.
+ */
+static void encode_uleb128 (std::vector<uint8_t> &out, uint64_t value, size_t min_size = 0) {
+    size_t written = 0;
+    do {
+        uint8_t b = value & 0x7f;
+        value >>= 7;
+        written++;
+        
+        if (value != 0 || written < min_size)
+            b |= 0x80;
+        
+        out.push_back(b);
+    } while (value != 0 || written < min_size);
+}
+
+/**
+ * Append the SLEB128 encoding of @a value to @a out.
+ */
+static void encode_sleb128 (std::vector<uint8_t> &out, int64_t value) {
+    bool more = true;
+    while (more) {
+        uint8_t b = value & 0x7f;
+        value >>= 7;
+        
+        more = !((value == 0 && (b & 0x40) == 0) || (value == -1 && (b & 0x40) != 0));
+        out.push_back(more ? (b | 0x80) : b);
+    }
+}
+
+/**
+ * Append a BIND_OPCODE_SET_DYLIB_* opcode declaring @a ordinal to @a out.
+ */
+static void encode_ordinal (std::vector<uint8_t> &out, int64_t ordinal) {
+    if (ordinal <= 0) {
+        out.push_back(BIND_OPCODE_SET_DYLIB_SPECIAL_IMM | (ordinal & BIND_IMMEDIATE_MASK));
+    } else if (ordinal <= BIND_IMMEDIATE_MASK) {
+        out.push_back(BIND_OPCODE_SET_DYLIB_ORDINAL_IMM | (uint8_t) ordinal);
+    } else {
+        out.push_back(BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB);
+        encode_uleb128(out, (uint64_t) ordinal);
+    }
+}
+
+/**
+ * Encode @a binds as a non-lazy bind opcode stream, substituting @a shim_ordinal for all redirected binds.
+ *
+ * Binds are emitted in their original order; this does not attempt to match the compactness of the linker's
+ * encoding.
+ */
+static std::vector<uint8_t> encode_bind_stream (const macho_file_image &image, const std::vector<const prepatch_bind *> &binds, int64_t shim_ordinal) {
+    const uint64_t ptr_size = image.is64() ? 8 : 4;
+    std::vector<uint8_t> out;
+    
+    bool have_state = false;
+    int64_t ordinal = 0;
+    const std::string *symbol = nullptr;
+    uint8_t flags = 0;
+    uint8_t type = 0;
+    int64_t addend = 0;
+    uint8_t segment = 0;
+    uint64_t address = 0;
+    
+    for (auto &&bind : binds) {
+        int64_t bind_ordinal = bind->redirect ? shim_ordinal : bind->ordinal;
+        
+        if (!have_state || bind_ordinal != ordinal) {
+            encode_ordinal(out, bind_ordinal);
+            ordinal = bind_ordinal;
+        }
+        
+        if (!have_state || *symbol != bind->symbol || flags != bind->flags) {
+            out.push_back(BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM | bind->flags);
+            out.insert(out.end(), bind->symbol.begin(), bind->symbol.end());
+            out.push_back('\0');
+            symbol = &bind->symbol;
+            flags = bind->flags;
+        }
+        
+        if (!have_state || type != bind->type) {
+            out.push_back(BIND_OPCODE_SET_TYPE_IMM | bind->type);
+            type = bind->type;
+        }
+        
+        if (addend != bind->addend) {
+            out.push_back(BIND_OPCODE_SET_ADDEND_SLEB);
+            encode_sleb128(out, bind->addend);
+            addend = bind->addend;
+        }
+        
+        if (have_state && segment == bind->segment && bind->address > address) {
+            out.push_back(BIND_OPCODE_ADD_ADDR_ULEB);
+            encode_uleb128(out, bind->address - address);
+        } else if (!have_state || segment != bind->segment || bind->address != address) {
+            out.push_back(BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB | bind->segment);
+            encode_uleb128(out, bind->address - image.segments()[bind->segment].vmaddr);
+            segment = bind->segment;
+        }
+        
+        out.push_back(BIND_OPCODE_DO_BIND);
+        address = bind->address + ptr_size;
+        have_state = true;
+    }
+    
+    out.push_back(BIND_OPCODE_DONE);
+    return out;
+}
+
+/**
+ * Call @a fn with the file offset and address of each load command in the Mach-O image at @a data. The image must
+ * already have been validated by macho_file_image::parse().
+ */
+template <typename Fn> static void for_each_command (uint8_t *data, bool is64, Fn &&fn) {
+    auto header = (struct mach_header *) data;
+    size_t offset = is64 ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+    
+    for (uint32_t i = 0; i < header->ncmds; i++) {
+        auto cmd = (struct load_command *) (data + offset);
+        fn(offset, cmd);
+        offset += cmd->cmdsize;
+    }
+}
+
+/**
+ * Return true if @a bind matches any of our rebind rules.
+ */
+static bool match_rebind (const prepatch_options &options, const prepatch_bind &bind) {
+    patchmaster::SymbolName name(bind.library.c_str(), bind.symbol.c_str());
+    for (auto &&rule : options.rules) {
+        if (patchmaster::SymbolName(rule.image.c_str(), rule.symbol.c_str()).match(name))
+            return true;
+    }
+    
+    return false;
+}
+
+/**
+ * Return true if @a bind should be marked as weak. As in xpf-bootstrap's default configuration, every strong
+ * import is marked as weak.
+ */
+static bool match_weak (const prepatch_bind &bind) {
+    return !(bind.flags & BIND_SYMBOL_FLAGS_WEAK_IMPORT);
+}
+
+/**
+ * Verify that the bind opcodes of the patched @a image evaluate to @a expected, with all redirected binds
+ * bound to @a shim_ordinal and all weakened binds marked as weak imports.
+ */
+static bool verify_image (const std::vector<uint8_t> &image, const std::vector<prepatch_bind> &expected, const std::set<uint64_t> &weakened, int64_t shim_ordinal, std::string &error) {
+    macho_file_image patched;
+    if (!patched.parse(image.data(), image.size(), error))
+        return false;
+    
+    size_t idx = 0;
+    bool mismatch = false;
+    bool ok = macho_evaluate_binds(patched, [&](const macho_bind &bind) {
+        if (mismatch || idx >= expected.size()) {
+            mismatch = true;
+            return;
+        }
+        
+        const prepatch_bind &e = expected[idx++];
+        int64_t ordinal = e.redirect ? shim_ordinal : e.ordinal;
+        uint8_t flags = weakened.count(e.symbol_opcode_offset) ? (e.flags | BIND_SYMBOL_FLAGS_WEAK_IMPORT) : e.flags;
+        
+        if (bind.stream != e.stream || bind.ordinal != ordinal || e.symbol != bind.symbol || bind.flags != flags ||
+            bind.type != e.type || bind.addend != e.addend || bind.address != e.address)
+        {
+            mismatch = true;
+        }
+    }, error);
+    
+    if (!ok)
+        return false;
+    
+    if (mismatch || idx != expected.size()) {
+        error = "patched bind opcodes do not match the expected binds";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Determine the library ordinal of the shim library within @a image, and whether a new LC_LOAD_DYLIB command
+ * is required.
+ */
+static bool resolve_shim_ordinal (const prepatch_options &options, const macho_file_image &image, int64_t &shim_ordinal, bool &add_shim, std::string &error) {
+    auto &libraries = image.libraries();
+    for (size_t i = 0; i < libraries.size(); i++) {
+        if (libraries[i] == options.shim)
+            shim_ordinal = i + 1;
+    }
+    
+    if (shim_ordinal == 0) {
+        shim_ordinal = libraries.size() + 1;
+        add_shim = true;
+    }
+    
+    return true;
+}
+
+/**
+ * Prepatch the LC_DYLD_INFO bind opcodes of @a image.
+ *
+ * @param options The prepatch configuration.
+ * @param cputype The image's architecture.
+ * @param parsed The parsed image.
+ * @param image The image data; this will be modified in place, and may be extended.
+ * @param binds All binds evaluated from the unmodified image; redirected binds will be marked.
+ * @param weakened On return, the offsets of all symbol opcodes marked as weak imports.
+ * @param changes All changes applied to the image will be appended to this vector.
+ * @param shim_ordinal On return, the shim library ordinal, or 0 if no binds were redirected.
+ * @param add_shim On return, true if a new LC_LOAD_DYLIB command is required for the shim library.
+ * @param error On failure, a description of the error.
+ */
+static bool prepatch_bind_opcodes (const prepatch_options &options, cpu_type_t cputype, const macho_file_image &parsed, std::vector<uint8_t> &image, std::vector<prepatch_bind> &binds, std::set<uint64_t> &weakened, std::vector<prepatch_change> &changes, int64_t &shim_ordinal, bool &add_shim, std::string &error) {
+    /* Determine the required changes. Weak definition binds are coalesced at runtime, and are never modified. */
+    std::set<std::tuple<prepatch_change_kind, macho_bind_stream, std::string, std::string>> reported;
+    bool redirect_regular = false;
+    bool redirect_lazy = false;
+    
+    for (auto &&bind : binds) {
+        if (bind.stream == MACHO_BIND_STREAM_WEAK)
+            continue;
+        
+        /* Rebind table imports are only redirected to a shim library; otherwise, they are left for runtime rebinding */
+        prepatch_change_kind kind;
+        if (!options.shim.empty() && bind.ordinal > 0 && match_rebind(options, bind)) {
+            bind.redirect = true;
+            kind = PREPATCH_CHANGE_REDIRECT;
+            
+            if (bind.stream == MACHO_BIND_STREAM_LAZY)
+                redirect_lazy = true;
+            else
+                redirect_regular = true;
+        } else if (weakened.count(bind.symbol_opcode_offset) != 0 || match_weak(bind)) {
+            weakened.insert(bind.symbol_opcode_offset);
+            kind = PREPATCH_CHANGE_WEAK;
+        } else {
+            continue;
+        }
+        
+        if (reported.insert(std::make_tuple(kind, bind.stream, bind.library, bind.symbol)).second)
+            changes.push_back(prepatch_change { cputype, kind, bind.stream, bind.library, bind.symbol });
+    }
+    
+    /* Mark weak imports; the symbol opcode's flags are shared by every bind that follows it. */
+    for (auto &&offset : weakened)
+        image[offset] |= BIND_SYMBOL_FLAGS_WEAK_IMPORT;
+    
+    if ((redirect_regular || redirect_lazy) && !resolve_shim_ordinal(options, parsed, shim_ordinal, add_shim, error))
+        return false;
+    
+    /* Each lazy bind is evaluated independently by dyld, from offsets embedded in the image's stub helpers; the
+     * lazy stream must be patched in place. */
+    if (redirect_lazy) {
+        std::map<uint64_t, bool> ordinal_opcodes;
+        for (auto &&bind : binds) {
+            if (bind.stream != MACHO_BIND_STREAM_LAZY)
+                continue;
+            
+            auto entry = ordinal_opcodes.insert(std::make_pair(bind.ordinal_opcode_offset, bind.redirect));
+            if (entry.first->second != bind.redirect) {
+                error = "lazy bind ordinal is shared by redirected and non-redirected symbols";
+                return false;
+            }
+        }
+        
+        for (auto &&entry : ordinal_opcodes) {
+            if (!entry.second)
+                continue;
+            
+            const prepatch_bind *bind = nullptr;
+            for (auto &&b : binds) {
+                if (b.stream == MACHO_BIND_STREAM_LAZY && b.ordinal_opcode_offset == entry.first)
+                    bind = &b;
+            }
+            
+            std::vector<uint8_t> opcode;
+            if (bind->ordinal_opcode_size == 1 && shim_ordinal <= BIND_IMMEDIATE_MASK) {
+                opcode.push_back(BIND_OPCODE_SET_DYLIB_ORDINAL_IMM | (uint8_t) shim_ordinal);
+            } else if (bind->ordinal_opcode_size > 1) {
+                opcode.push_back(BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB);
+                encode_uleb128(opcode, (uint64_t) shim_ordinal, bind->ordinal_opcode_size - 1);
+            }
+            
+            if (opcode.size() != bind->ordinal_opcode_size) {
+                error = "shim library ordinal does not fit within the lazy bind opcodes";
+                return false;
+            }
+            
+            memcpy(&image[entry.first], opcode.data(), opcode.size());
+        }
+    }
+    
+    /* Non-lazy binds share ordinal opcodes across symbols; the stream must be re-encoded. */
+    size_t dyld_info_offset = (const uint8_t *) parsed.dyld_info() - image.data();
+    if (redirect_regular) {
+        std::vector<const prepatch_bind *> regular;
+        for (auto &&bind : binds) {
+            if (bind.stream == MACHO_BIND_STREAM_REGULAR)
+                regular.push_back(&bind);
+        }
+        
+        /* Apply the weak flags to our copies, too */
+        std::vector<prepatch_bind> updated;
+        updated.reserve(regular.size());
+        for (auto &&bind : regular) {
+            updated.push_back(*bind);
+            if (weakened.count(bind->symbol_opcode_offset) != 0)
+                updated.back().flags |= BIND_SYMBOL_FLAGS_WEAK_IMPORT;
+        }
+        for (size_t i = 0; i < updated.size(); i++)
+            regular[i] = &updated[i];
+        
+        std::vector<uint8_t> stream = encode_bind_stream(parsed, regular, shim_ordinal);
+        auto info = (struct dyld_info_command *) &image[dyld_info_offset];
+        
+        if (stream.size() <= info->bind_size) {
+            /* Write in place; any remaining bytes are zero-filled (BIND_OPCODE_DONE) */
+            memset(&image[info->bind_off], 0, info->bind_size);
+            memcpy(&image[info->bind_off], stream.data(), stream.size());
+        } else {
+            /* Append to the end of __LINKEDIT, which must be the last segment in the file */
+            size_t linkedit_offset = 0;
+            for_each_command(image.data(), parsed.is64(), [&](size_t offset, struct load_command *cmd) {
+                if (cmd->cmd != LC_SEGMENT && cmd->cmd != LC_SEGMENT_64)
+                    return;
+                
+                if (strncmp(((struct segment_command *) cmd)->segname, SEG_LINKEDIT, 16) == 0)
+                    linkedit_offset = offset;
+            });
+            
+            uint64_t fileoff, filesize, vmaddr, vmsize;
+            if (linkedit_offset == 0) {
+                error = "no " SEG_LINKEDIT " segment";
+                return false;
+            } else if (parsed.is64()) {
+                auto seg = (struct segment_command_64 *) &image[linkedit_offset];
+                fileoff = seg->fileoff; filesize = seg->filesize; vmaddr = seg->vmaddr; vmsize = seg->vmsize;
+            } else {
+                auto seg = (struct segment_command *) &image[linkedit_offset];
+                fileoff = seg->fileoff; filesize = seg->filesize; vmaddr = seg->vmaddr; vmsize = seg->vmsize;
+            }
+            
+            if (fileoff + filesize != image.size()) {
+                error = SEG_LINKEDIT " is not the last segment in the file";
+                return false;
+            }
+            
+            uint64_t bind_off = (image.size() + 7) & ~(uint64_t) 7;
+            uint64_t new_filesize = bind_off + stream.size() - fileoff;
+            uint64_t new_vmsize = (new_filesize <= vmsize) ? vmsize : (new_filesize + PREPATCH_VM_PAGE_SIZE - 1) & ~(PREPATCH_VM_PAGE_SIZE - 1);
+            
+            for (auto &&segment : parsed.segments()) {
+                if (segment.vmaddr > vmaddr && segment.vmaddr < vmaddr + new_vmsize) {
+                    error = "no VM space to extend " SEG_LINKEDIT;
+                    return false;
+                }
+            }
+            
+            if (!parsed.is64() && (bind_off + stream.size() > UINT32_MAX || vmaddr + new_vmsize > UINT32_MAX)) {
+                error = SEG_LINKEDIT " would exceed the 32-bit address space";
+                return false;
+            }
+            
+            image.resize(bind_off, 0);
+            image.insert(image.end(), stream.begin(), stream.end());
+            
+            if (parsed.is64()) {
+                auto seg = (struct segment_command_64 *) &image[linkedit_offset];
+                seg->filesize = new_filesize;
+                seg->vmsize = new_vmsize;
+            } else {
+                auto seg = (struct segment_command *) &image[linkedit_offset];
+                seg->filesize = (uint32_t) new_filesize;
+                seg->vmsize = (uint32_t) new_vmsize;
+            }
+            
+            info = (struct dyld_info_command *) &image[dyld_info_offset];
+            info->bind_off = (uint32_t) bind_off;
+        }
+        
+        info->bind_size = (uint32_t) stream.size();
+    }
+    
+    return true;
+}
+
+/**
+ * Prepatch the LC_DYLD_CHAINED_FIXUPS imports table of @a image.
+ *
+ * Every bind fixup references a single imports table entry, and dyld resolves each import exactly once; rules are
+ * matched against the imports table, and each matching entry is patched in place, leaving the fixup chains
+ * themselves untouched.
+ *
+ * @sa prepatch_bind_opcodes
+ */
+static bool prepatch_chained_fixups (const prepatch_options &options, cpu_type_t cputype, const macho_file_image &parsed, std::vector<uint8_t> &image, std::vector<prepatch_bind> &binds, std::set<uint64_t> &weakened, std::vector<prepatch_change> &changes, int64_t &shim_ordinal, bool &add_shim, std::string &error) {
+    macho_chained_imports imports;
+    if (!macho_chained_read_imports(parsed, imports, error))
+        return false;
+    
+    std::set<uint64_t> redirected;
+    for (auto &&import : imports.imports) {
+        macho_bind b = {};
+        b.stream = MACHO_BIND_STREAM_CHAINED;
+        b.ordinal = import.ordinal;
+        b.library = import.library;
+        b.symbol = import.symbol;
+        b.flags = import.weak ? BIND_SYMBOL_FLAGS_WEAK_IMPORT : 0;
+        
+        prepatch_bind bind(b);
+        prepatch_change_kind kind;
+        if (!options.shim.empty() && bind.ordinal > 0 && match_rebind(options, bind)) {
+            redirected.insert(import.entry_offset);
+            kind = PREPATCH_CHANGE_REDIRECT;
+        } else if (match_weak(bind)) {
+            weakened.insert(import.entry_offset);
+            kind = PREPATCH_CHANGE_WEAK;
+        } else {
+            continue;
+        }
+        
+        changes.push_back(prepatch_change { cputype, kind, MACHO_BIND_STREAM_CHAINED, bind.library, bind.symbol });
+    }
+    
+    if (!redirected.empty() && !resolve_shim_ordinal(options, parsed, shim_ordinal, add_shim, error))
+        return false;
+    
+    for (auto &&bind : binds) {
+        if (redirected.count(bind.symbol_opcode_offset) != 0)
+            bind.redirect = true;
+    }
+    
+    for (auto &&import : imports.imports) {
+        bool redirect = redirected.count(import.entry_offset) != 0;
+        bool weak = weakened.count(import.entry_offset) != 0;
+        if (!redirect && !weak)
+            continue;
+        
+        if (!macho_chained_set_import(image.data(), imports.format, import.entry_offset, redirect ? shim_ordinal : import.ordinal, import.weak || weak, error))
+            return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Prepatch a single thin Mach-O image, in place.
+ *
+ * All strong imports are marked as weak imports,
+ * all two-level imports matching the rebind table are redirected to the shim library (if configured), and an
+ * XPF_LC_PREPATCHED command is appended to the image's load commands.
+ *
+ * @param options The prepatch configuration.
+ * @param cputype The image's architecture.
+ * @param image The image data; this will be modified in place, and may be extended.
+ * @param changes All changes applied to the image will be appended to this vector.
+ * @param error On failure, a description of the error.
+ */
+bool prepatch_image (const prepatch_options &options, cpu_type_t cputype, std::vector<uint8_t> &image, std::vector<prepatch_change> &changes, std::string &error) {
+    macho_file_image parsed;
+    if (!parsed.parse(image.data(), image.size(), error))
+        return false;
+    
+    /* The image data may be reallocated below; anything referenced via parsed.header() must be fetched here */
+    const bool is64 = parsed.is64();
+    const size_t header_size = is64 ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+    const uint64_t commands_end = header_size + parsed.header()->sizeofcmds;
+    
+    if (parsed.dyld_info() == nullptr && parsed.chained_fixups() == nullptr) {
+        error = "no LC_DYLD_INFO or LC_DYLD_CHAINED_FIXUPS command";
+        return false;
+    }
+    
+    bool prepatched = false;
+    for_each_command(image.data(), is64, [&](size_t offset, struct load_command *cmd) {
+        if (cmd->cmd == XPF_LC_PREPATCHED)
+            prepatched = true;
+    });
+    
+    if (prepatched) {
+        error = "image has already been prepatched";
+        return false;
+    }
+    
+    /* Evaluate all binds */
+    std::vector<prepatch_bind> binds;
+    if (!macho_evaluate_binds(parsed, [&](const macho_bind &bind) { binds.push_back(prepatch_bind(bind)); }, error))
+        return false;
+    
+    /* Determine and apply the required bind changes */
+    std::set<uint64_t> weakened;
+    int64_t shim_ordinal = 0;
+    bool add_shim = false;
+    
+    if (parsed.chained_fixups() != nullptr) {
+        if (!prepatch_chained_fixups(options, cputype, parsed, image, binds, weakened, changes, shim_ordinal, add_shim, error))
+            return false;
+    } else if (!prepatch_bind_opcodes(options, cputype, parsed, image, binds, weakened, changes, shim_ordinal, add_shim, error)) {
+        return false;
+    }
+    
+    if (!verify_shim_exports(options, cputype, binds, error))
+        return false;
+    
+    /* xpf-bootstrap may skip rebinding only if no rebind table import was left in place */
+    bool rebound = true;
+    for (auto &&bind : binds) {
+        if (bind.stream != MACHO_BIND_STREAM_WEAK && !bind.redirect && match_rebind(options, bind))
+            rebound = false;
+    }
+    
+    /* Append our load commands */
+    std::vector<uint8_t> commands;
+    if (add_shim) {
+        size_t name_size = (options.shim.size() + 1 + 7) & ~(size_t) 7;
+        struct dylib_command dylib;
+        dylib.cmd = LC_LOAD_DYLIB;
+        dylib.cmdsize = (uint32_t) (sizeof(dylib) + name_size);
+        dylib.dylib.name.offset = sizeof(dylib);
+        dylib.dylib.timestamp = 2;
+        dylib.dylib.current_version = 0x10000;
+        dylib.dylib.compatibility_version = 0x10000;
+        
+        commands.insert(commands.end(), (const uint8_t *) &dylib, (const uint8_t *) (&dylib + 1));
+        commands.insert(commands.end(), options.shim.begin(), options.shim.end());
+        commands.resize(sizeof(dylib) + name_size, 0);
+    }
+    
+    struct xpf_prepatch_command marker;
+    marker.cmd = XPF_LC_PREPATCHED;
+    marker.cmdsize = sizeof(marker);
+    marker.version = XPF_PREPATCH_VERSION;
+    marker.rules_hash = options.rules_hash;
+    marker.flags = rebound ? XPF_PREPATCH_FLAG_REBOUND : 0;
+    marker.reserved = 0;
+    commands.insert(commands.end(), (const uint8_t *) &marker, (const uint8_t *) (&marker + 1));
+    
+    /* The new commands must fit between the existing load commands and the first section's data */
+    uint64_t data_start = image.size();
+    for (auto &&section : parsed.sections()) {
+        if (section.offset != 0)
+            data_start = std::min(data_start, (uint64_t) section.offset);
+    }
+    for (auto &&segment : parsed.segments()) {
+        if (segment.fileoff != 0 && segment.filesize != 0)
+            data_start = std::min(data_start, segment.fileoff);
+    }
+    
+    if (commands_end + commands.size() > data_start) {
+        error = "insufficient space for additional load commands";
+        return false;
+    }
+    
+    memcpy(&image[commands_end], commands.data(), commands.size());
+    auto header = (struct mach_header *) image.data();
+    header->ncmds += add_shim ? 2 : 1;
+    header->sizeofcmds += (uint32_t) commands.size();
+    
+    /* Sanity check the result */
+    return verify_image(image, binds, weakened, shim_ordinal, error);
+}
+
+/**
+ * Append the big-endian encoding of @a value to @a out.
+ */
+template <typename T> static void write_be (std::vector<uint8_t> &out, T value) {
+    for (size_t i = sizeof(T); i > 0; i--)
+        out.push_back((uint8_t) (value >> ((i - 1) * 8)));
+}
+
+/**
+ * Prepatch a thin or fat Mach-O file.
+ *
+ * @param options The prepatch configuration.
+ * @param data The input file data.
+ * @param size The input file size.
+ * @param output On success, the patched file.
+ * @param changes All changes applied to the file will be appended to this vector.
+ * @param error On failure, a description of the error.
+ */
+bool prepatch_file (const prepatch_options &options, const uint8_t *data, size_t size, std::vector<uint8_t> &output, std::vector<prepatch_change> &changes, std::string &error) {
+    std::vector<macho_slice> slices;
+    if (!macho_slices(data, size, slices, error))
+        return false;
+    
+    std::vector<std::vector<uint8_t>> images;
+    for (auto &&slice : slices) {
+        images.emplace_back(data + slice.offset, data + slice.offset + slice.size);
+        if (!prepatch_image(options, slice.cputype, images.back(), changes, error)) {
+            error = std::string(macho_arch_name(slice.cputype)) + ": " + error;
+            return false;
+        }
+    }
+    
+    /* Thin file */
+    uint32_t magic;
+    memcpy(&magic, data, sizeof(magic));
+    if (magic == MH_MAGIC || magic == MH_MAGIC_64) {
+        output = std::move(images[0]);
+        return true;
+    }
+    
+    /* Fat file; lay out the slices, and use the 64-bit fat header only if required. */
+    std::vector<uint64_t> offsets;
+    bool fat64 = false;
+    uint64_t offset = 8 + slices.size() * 20;
+    for (size_t i = 0; i < slices.size(); i++) {
+        uint32_t align = slices[i].align != 0 ? slices[i].align : PREPATCH_FAT_DEFAULT_ALIGN;
+        if (align >= 64) {
+            error = "invalid fat slice alignment";
+            return false;
+        }
+        
+        offset = (offset + (1ULL << align) - 1) & ~((1ULL << align) - 1);
+        offsets.push_back(offset);
+        offset += images[i].size();
+        
+        if (offset > UINT32_MAX)
+            fat64 = true;
+    }
+    
+    /* The 64-bit header is larger, and may require relayout; conservatively recompute. */
+    if (fat64) {
+        offset = 8 + slices.size() * 32;
+        for (size_t i = 0; i < slices.size(); i++) {
+            uint32_t align = slices[i].align != 0 ? slices[i].align : PREPATCH_FAT_DEFAULT_ALIGN;
+            offset = (offset + (1ULL << align) - 1) & ~((1ULL << align) - 1);
+            offsets[i] = offset;
+            offset += images[i].size();
+        }
+    }
+    
+    output.clear();
+    write_be<uint32_t>(output, fat64 ? FAT_MAGIC_64 : FAT_MAGIC);
+    write_be<uint32_t>(output, (uint32_t) slices.size());
+    
+    for (size_t i = 0; i < slices.size(); i++) {
+        write_be<uint32_t>(output, (uint32_t) slices[i].cputype);
+        write_be<uint32_t>(output, (uint32_t) slices[i].cpusubtype);
+        if (fat64) {
+            write_be<uint64_t>(output, offsets[i]);
+            write_be<uint64_t>(output, images[i].size());
+            write_be<uint32_t>(output, slices[i].align != 0 ? slices[i].align : PREPATCH_FAT_DEFAULT_ALIGN);
+            write_be<uint32_t>(output, 0);
+        } else {
+            write_be<uint32_t>(output, (uint32_t) offsets[i]);
+            write_be<uint32_t>(output, (uint32_t) images[i].size());
+            write_be<uint32_t>(output, slices[i].align != 0 ? slices[i].align : PREPATCH_FAT_DEFAULT_ALIGN);
+        }
+    }
+    
+    for (size_t i = 0; i < slices.size(); i++) {
+        output.resize(offsets[i], 0);
+        output.insert(output.end(), images[i].begin(), images[i].end());
+    }
+    
+    return true;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,98 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "macho_file.h"
+#include "macho_binds.h"
+#include "analyze_rules.h"
+
+namespace xpf {
+
+/**
+ * Prepatch configuration.
+ */
+struct prepatch_options {
+    /** Rebind rules loaded from xpf-bootstrap. */
+    std::vector<analyze_rebind_rule> rules;
+    
+    /** The xpf_rules_hash() of the rule tables; recorded in the XPF_LC_PREPATCHED command. */
+    uint32_t rules_hash;
+    
+    /**
+     * Install name of the shim library exporting our symbol replacements, or an empty string if rebind table
+     * imports are to be left for xpf-bootstrap to rebind at runtime.
+     */
+    std::string shim;
+    
+    /** Path of the built shim library; every redirected import must be exported by the shim's matching slice. */
+    std::string shim_path;
+};
+
+/**
+ * Prepatch change types.
+ */
+enum prepatch_change_kind {
+    /** A symbol import was marked as weak. */
+    PREPATCH_CHANGE_WEAK = 0,
+    
+    /** A symbol import was redirected to the shim library. */
+    PREPATCH_CHANGE_REDIRECT
+};
+
+/**
+ * A single change applied by the prepatcher.
+ */
+struct prepatch_change {
+    /** The architecture of the modified slice. */
+    cpu_type_t cputype;
+    
+    /** The change type. */
+    prepatch_change_kind kind;
+    
+    /** The bind stream that was modified. */
+    macho_bind_stream stream;
+    
+    /** The install name of the library from which the symbol was originally imported. */
+    std::string library;
+    
+    /** The symbol name. */
+    std::string symbol;
+};
+
+uint32_t prepatch_rules_hash (const std::vector<analyze_rebind_rule> &rules);
+bool prepatch_load_shim (const std::string &path, prepatch_options &options, std::string &error);
+bool prepatch_image (const prepatch_options &options, cpu_type_t cputype, std::vector<uint8_t> &image, std::vector<prepatch_change> &changes, std::string &error);
+bool prepatch_file (const prepatch_options &options, const uint8_t *data, size_t size, std::vector<uint8_t> &output, std::vector<prepatch_change> &changes, std::string &error);
+
+} /* namespace xpf */
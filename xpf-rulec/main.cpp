@@ -0,0 +1,179 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * xpf-rulec
+ *
+ * Compiles a text rule file to the binary rule manifest mapped by xpf-bootstrap at startup, allowing rebind,
+ * weak import, and shared framework rules to be added for a new Xcode release without rebuilding xpf-bootstrap.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "analyze_rules.h"
+#include "rule_compiler.h"
+
+using namespace xpf;
+
+/**
+ * Read the entire contents of @a path into @a text.
+ */
+static bool read_file (const char *path, std::string &text, std::string &error) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        error = std::string("open() failed: ") + strerror(errno);
+        return false;
+    }
+    
+    text.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    if (stream.bad()) {
+        error = "read failed";
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Write @a size bytes of @a data to @a path, via a temporary file that is renamed into place.
+ */
+static bool write_file (const std::string &path, const void *data, size_t size, std::string &error) {
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        error = std::string("open() failed: ") + strerror(errno);
+        return false;
+    }
+    
+    const uint8_t *p = (const uint8_t *) data;
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            
+            error = std::string("write() failed: ") + strerror(errno);
+            close(fd);
+            unlink(tmp.c_str());
+            return false;
+        }
+        
+        p += written;
+        size -= written;
+    }
+    
+    if (close(fd) != 0 || rename(tmp.c_str(), path.c_str()) != 0) {
+        error = std::string("failed to write file: ") + strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+static void print_usage (const char *progname) {
+    fprintf(stderr, "Usage: %s [-b <xpf-bootstrap binary>] <rules> <output>\n", progname);
+    fprintf(stderr, "  -b <path>   xpf-bootstrap binary against which rebind implementations will be checked; required if\n");
+    fprintf(stderr, "              any rebind rule names an implementation for a different symbol\n");
+}
+
+int main (int argc, char * const argv[]) {
+    const char *progname = argv[0];
+    const char *bootstrap = nullptr;
+    int ch;
+    
+    while ((ch = getopt(argc, argv, "b:h")) != -1) {
+        switch (ch) {
+            case 'b':
+                bootstrap = optarg;
+                break;
+                
+            case 'h':
+            default:
+                print_usage(progname);
+                return 2;
+        }
+    }
+    
+    argc -= optind;
+    argv += optind;
+    
+    if (argc != 2) {
+        print_usage(progname);
+        return 2;
+    }
+    
+    const char *input = argv[0];
+    const char *output = argv[1];
+    
+    /* Parse the rules */
+    std::string text;
+    std::string error;
+    std::vector<rulec_rule> rules;
+    if (!read_file(input, text, error) || !rulec_parse(text, rules, error)) {
+        fprintf(stderr, "xpf-rulec: %s: %s\n", input, error.c_str());
+        return 1;
+    }
+    
+    /* Verify rebind implementations against the bootstrap binary, if available */
+    std::vector<analyze_rebind_rule> compiled;
+    if (bootstrap != nullptr && !analyze_load_rebind_rules(bootstrap, compiled, error)) {
+        fprintf(stderr, "xpf-rulec: %s: %s\n", bootstrap, error.c_str());
+        return 1;
+    }
+    
+    if (!rulec_check_implementations(rules, (bootstrap != nullptr) ? &compiled : nullptr, error)) {
+        fprintf(stderr, "xpf-rulec: %s: %s\n", input, error.c_str());
+        return 1;
+    }
+    
+    /* Compile and write the manifest */
+    std::vector<uint8_t> manifest;
+    if (!rulec_compile(rules, manifest, error)) {
+        fprintf(stderr, "xpf-rulec: %s: %s\n", input, error.c_str());
+        return 1;
+    }
+    
+    if (!write_file(output, manifest.data(), manifest.size(), error)) {
+        fprintf(stderr, "xpf-rulec: %s: %s\n", output, error.c_str());
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rule_compiler.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+#include "rebind_table.h"
+#include "rule_manifest.h"
+
+namespace xpf {
+
+/**
+ * Split @a line into whitespace-separated fields, stopping at any '#' comment.
+ */
+static std::vector<std::string> rulec_fields (const std::string &line) {
+    std::vector<std::string> fields;
+    std::istringstream stream(line.substr(0, line.find('#')));
+    std::string field;
+    
+    while (stream >> field)
+        fields.push_back(field);
+    
+    return fields;
+}
+
+/**
+ * Parse a text rule file.
+ *
+ * Each non-empty line declares a single rule; '#' begins a comment that extends to the end of the line.
+ *
+ *     rebind <symbol> <image> [<implementation>]
+ *     weak <library> <symbol>
+ *     framework <name>
+ *
+ * A rebind image of '-' matches the symbol in any image. If no implementation is given, the rule is implemented
+ * by the compiled XPF_REBIND_ENTRY() for the same symbol; otherwise, the rule is an alias of that implementation.
+ * Aliases must be verified by rulec_check_implementations().
+ *
+ * @param text The rule file contents.
+ * @param rules On success, will be populated with the parsed rules, in declaration order.
+ * @param error On failure, will be set to a description of the error.
+ */
+bool rulec_parse (const std::string &text, std::vector<rulec_rule> &rules, std::string &error) {
+    std::set<std::tuple<int, std::string, std::string>> seen;
+    std::istringstream stream(text);
+    std::string line;
+    unsigned int lineno = 0;
+    
+    while (std::getline(stream, line)) {
+        lineno++;
+        
+        std::vector<std::string> fields = rulec_fields(line);
+        if (fields.empty())
+            continue;
+        
+        auto invalid = [&](const std::string &reason) {
+            error = "line " + std::to_string(lineno) + ": " + reason;
+            return false;
+        };
+        
+        rulec_rule rule;
+        rule.line = lineno;
+        
+        const std::string &directive = fields[0];
+        if (directive == "rebind") {
+            if (fields.size() != 3 && fields.size() != 4)
+                return invalid("expected 'rebind <symbol> <image> [<implementation>]'");
+            
+            rule.kind = XPF_RULE_REBIND;
+            rule.symbol = fields[1];
+            rule.image = (fields[2] == "-") ? "" : fields[2];
+            rule.impl = (fields.size() == 4) ? fields[3] : fields[1];
+        } else if (directive == "weak") {
+            if (fields.size() != 3)
+                return invalid("expected 'weak <library> <symbol>'");
+            
+            rule.kind = XPF_RULE_WEAK;
+            rule.image = fields[1];
+            rule.symbol = fields[2];
+        } else if (directive == "framework") {
+            if (fields.size() != 2)
+                return invalid("expected 'framework <name>'");
+            
+            rule.kind = XPF_RULE_FRAMEWORK;
+            rule.symbol = fields[1];
+        } else {
+            return invalid("unknown directive '" + directive + "'");
+        }
+        
+        if (!seen.insert(std::make_tuple((int) rule.kind, rule.symbol, rule.image)).second)
+            return invalid("duplicate " + directive + " rule for " + rule.symbol);
+        
+        rules.push_back(rule);
+    }
+    
+    return true;
+}
+
+/**
+ * Verify that every rebind rule in @a rules names a compiled rebind implementation, and that every alias names an
+ * implementation without an original slot.
+ *
+ * An implementation's original slot is written once, with the address of the first symbol bound to it, and the
+ * implementation calls through it; an alias of such an implementation would call the wrong function. xpf-bootstrap
+ * rejects these aliases at load time; they are rejected here so that the manifest is not discarded at runtime.
+ *
+ * @param rules The rules to check.
+ * @param compiled The rebind rules compiled into xpf-bootstrap, or nullptr if not available; aliases can not be
+ * verified without the compiled rules, and are rejected.
+ * @param error On failure, will be set to a description of the error.
+ */
+bool rulec_check_implementations (const std::vector<rulec_rule> &rules, const std::vector<analyze_rebind_rule> *compiled, std::string &error) {
+    /* As with rule_manifest::link_rebind_entries(), the first compiled entry for an implementation is used */
+    std::map<std::string, bool> impls;
+    if (compiled != nullptr) {
+        for (auto &&rule : *compiled)
+            impls.insert(std::make_pair(rule.symbol, rule.has_original));
+    }
+    
+    for (auto &&rule : rules) {
+        if (rule.kind != XPF_RULE_REBIND)
+            continue;
+        
+        auto invalid = [&](const std::string &reason) {
+            error = "line " + std::to_string(rule.line) + ": " + reason;
+            return false;
+        };
+        
+        bool alias = (rule.impl != rule.symbol);
+        if (compiled == nullptr) {
+            if (alias)
+                return invalid("rebinding " + rule.symbol + " to implementation " + rule.impl + " requires an xpf-bootstrap binary (-b)");
+            continue;
+        }
+        
+        auto impl = impls.find(rule.impl);
+        if (impl == impls.end())
+            return invalid("no rebind implementation for " + rule.impl);
+        
+        if (alias && impl->second)
+            return invalid("implementation " + rule.impl + " calls through to the original " + rule.impl + ", and cannot rebind " + rule.symbol);
+    }
+    
+    return true;
+}
+
+/**
+ * Compile @a rules to a binary rule manifest.
+ *
+ * @param rules The rules to compile.
+ * @param output On success, will be populated with the manifest data.
+ * @param error On failure, will be set to a description of the error.
+ */
+bool rulec_compile (const std::vector<rulec_rule> &rules, std::vector<uint8_t> &output, std::string &error) {
+    /* Intern all strings; offset 0 is always the empty string */
+    std::string strings(1, '\0');
+    std::map<std::string, uint32_t> interned;
+    interned[""] = 0;
+    
+    auto intern = [&](const std::string &str) {
+        auto iter = interned.find(str);
+        if (iter != interned.end())
+            return iter->second;
+        
+        uint32_t offset = (uint32_t) strings.size();
+        strings.append(str.c_str(), str.size() + 1);
+        interned[str] = offset;
+        return offset;
+    };
+    
+    std::vector<xpf_rule_manifest_entry> entries;
+    for (auto &&rule : rules) {
+        xpf_rule_manifest_entry entry;
+        entry.kind = rule.kind;
+        entry.symbol_hash = (rule.kind == XPF_RULE_FRAMEWORK) ? 0 : xpf_rebind_hash(rule.symbol.c_str());
+        entry.symbol = intern(rule.symbol);
+        entry.image = intern(rule.image);
+        entry.impl_id = (rule.kind == XPF_RULE_REBIND) ? xpf_rebind_hash(rule.impl.c_str()) : 0;
+        entry.impl = intern(rule.impl);
+        entries.push_back(entry);
+    }
+    
+    /* Order by kind and symbol hash; framework entries have no hash, and retain their declaration order */
+    std::stable_sort(entries.begin(), entries.end(), [](const xpf_rule_manifest_entry &lhs, const xpf_rule_manifest_entry &rhs) {
+        return std::tie(lhs.kind, lhs.symbol_hash) < std::tie(rhs.kind, rhs.symbol_hash);
+    });
+    
+    /* Lay out the file */
+    xpf_rule_manifest_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = XPF_RULE_MANIFEST_MAGIC;
+    hdr.version = XPF_RULE_MANIFEST_VERSION;
+    hdr.entry_count = (uint32_t) entries.size();
+    hdr.entries_offset = sizeof(hdr);
+    hdr.strings_offset = hdr.entries_offset + hdr.entry_count * sizeof(xpf_rule_manifest_entry);
+    hdr.strings_size = (uint32_t) strings.size();
+    
+    output.clear();
+    output.insert(output.end(), (const uint8_t *) &hdr, (const uint8_t *) (&hdr + 1));
+    output.insert(output.end(), (const uint8_t *) entries.data(), (const uint8_t *) (entries.data() + entries.size()));
+    output.insert(output.end(), strings.begin(), strings.end());
+    
+    uint32_t checksum = 2166136261U;
+    for (size_t i = sizeof(hdr); i < output.size(); i++) {
+        checksum ^= output[i];
+        checksum *= 16777619U;
+    }
+    memcpy(output.data() + offsetof(xpf_rule_manifest_header, checksum), &checksum, sizeof(checksum));
+    
+    /* Verify the result with the same validation applied by xpf-bootstrap */
+    if (!rule_manifest::Validate(output.data(), output.size(), error)) {
+        error = "generated an invalid manifest: " + error;
+        return false;
+    }
+    
+    return true;
+}
+
+} /* namespace xpf */
@@ -0,0 +1,65 @@
+/*
+ * Author: Landon Fuller <landon@landonf.org>
+ *
+ * Copyright (c) 2015 Landon Fuller <landon@landonf.org>
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "analyze_rules.h"
+#include "rule_manifest_format.h"
+
+namespace xpf {
+
+/**
+ * A single rule parsed from a text rule file.
+ */
+struct rulec_rule {
+    /** The rule kind. */
+    xpf_rule_manifest_kind kind;
+    
+    /** The symbol (or framework) name. */
+    std::string symbol;
+    
+    /** The image (rebind) or library (weak) name; empty if not applicable. */
+    std::string image;
+    
+    /** The symbol name of the compiled XPF_REBIND_ENTRY() implementing a rebind rule; empty otherwise. */
+    std::string impl;
+    
+    /** The source line on which the rule was declared. */
+    unsigned int line;
+};
+
+bool rulec_parse (const std::string &text, std::vector<rulec_rule> &rules, std::string &error);
+bool rulec_check_implementations (const std::vector<rulec_rule> &rules, const std::vector<analyze_rebind_rule> *compiled, std::string &error);
+bool rulec_compile (const std::vector<rulec_rule> &rules, std::vector<uint8_t> &output, std::string &error);
+
+} /* namespace xpf */